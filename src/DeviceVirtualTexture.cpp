@@ -0,0 +1,170 @@
+#include "DeviceVirtualTexture.h"
+#include "util/Error.h"
+
+#include <cmath>
+#include <format>
+
+constexpr vk::DeviceSize TileByteSize = VirtualTexturePaddedTileSize * VirtualTexturePaddedTileSize * 4;
+
+DeviceVirtualTexture::DeviceVirtualTexture(
+	const zvk::Context* ctx, zvk::QueueIdx queueIdx, const VirtualTextureSettings& settings,
+	const std::vector<zvk::HostImage*>& images
+) : BaseVkObject(ctx)
+{
+	for (uint32_t i = 0; i < images.size(); i++) {
+		auto image = images[i];
+
+		bool isCandidate = settings.enable &&
+			image->dataType == zvk::HostImageType::Int8 && image->channels == 4 &&
+			static_cast<uint32_t>(std::max(image->width, image->height)) >= settings.minSize;
+
+		if (!isCandidate) {
+			mPageTable.addResidentTexture();
+			continue;
+		}
+		uint32_t idx = mPageTable.addVirtualTexture(image->width, image->height);
+		mSources[idx] = VirtualTextureSource(
+			image->data<uint8_t>(), image->width, image->height, mPageTable.infos()[idx].numMips
+		);
+	}
+
+	const uint32_t maxAtlasTiles = 16384 / VirtualTexturePaddedTileSize;
+	uint32_t budget = std::max(settings.budget, static_cast<uint32_t>(mSources.size()));
+
+	mAtlasTiles = std::min(static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(budget)))), maxAtlasTiles);
+	budget = std::min(budget, mAtlasTiles * mAtlasTiles);
+
+	if (empty()) {
+		mAtlasTiles = 1;
+		budget = 0;
+	}
+	mStreamer = TileStreamer(&mPageTable, budget, settings.maxUploadsPerFrame);
+
+	const auto hostVisible = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	uint32_t atlasSize = mAtlasTiles * VirtualTexturePaddedTileSize;
+
+	atlas = zvk::Memory::createImage2DAndInitLayout(
+		mCtx, queueIdx, vk::Extent2D(atlasSize, atlasSize), vk::Format::eR8G8B8A8Srgb,
+		vk::ImageTiling::eOptimal, vk::ImageLayout::eGeneral,
+		vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		vk::MemoryPropertyFlagBits::eDeviceLocal
+	);
+	atlas->createImageView();
+	atlas->createSampler(vk::Filter::eLinear);
+	zvk::DebugUtils::nameVkObject(mCtx->device, atlas->image, "virtualTextureAtlas");
+
+	infos = zvk::Memory::createBufferFromHost(
+		mCtx, queueIdx, mPageTable.infos().data(), std::max<size_t>(zvk::sizeOf(mPageTable.infos()), sizeof(VirtualTextureInfo)),
+		vk::BufferUsageFlagBits::eStorageBuffer
+	);
+	zvk::DebugUtils::nameVkObject(mCtx->device, infos->buffer, "virtualTextureInfos");
+
+	pageTable = zvk::Memory::createBuffer(
+		mCtx, std::max<size_t>(zvk::sizeOf(mPageTable.entries()), sizeof(uint32_t)),
+		vk::BufferUsageFlagBits::eStorageBuffer, hostVisible
+	);
+	pageTable->mapMemory();
+	zvk::DebugUtils::nameVkObject(mCtx->device, pageTable->buffer, "virtualPageTable");
+
+	feedback = zvk::Memory::createBuffer(
+		mCtx, VirtualTextureFeedbackSize * sizeof(uint32_t),
+		vk::BufferUsageFlagBits::eStorageBuffer, hostVisible
+	);
+	feedback->mapMemory();
+	memset(feedback->data, 0xff, feedback->size);
+	zvk::DebugUtils::nameVkObject(mCtx->device, feedback->buffer, "virtualTextureFeedback");
+
+	auto pinned = mStreamer.pinCoarsestMips();
+
+	mStagingBuffer = zvk::Memory::createBuffer(
+		mCtx, TileByteSize * std::max<size_t>({ pinned.size(), settings.maxUploadsPerFrame, 1 }),
+		vk::BufferUsageFlagBits::eTransferSrc, hostVisible
+	);
+	mStagingBuffer->mapMemory();
+
+	auto cmd = zvk::Command::createOneTimeSubmit(mCtx, queueIdx);
+	recordUploads(cmd->cmd, pinned);
+	cmd->submitAndWait();
+	syncPageTable();
+
+	if (!empty()) {
+		size_t hostBytes = 0;
+
+		for (const auto& [idx, source] : mSources) {
+			hostBytes += source.byteSize();
+		}
+		Log::line<1>("Virtual Texture");
+		Log::line<2>(std::format("Textures = {}, budget = {} tiles", mSources.size(), mStreamer.budget()));
+		Log::line<2>(std::format("Host source = {} MB, atlas = {} MB",
+			hostBytes >> 20, (vk::DeviceSize(atlasSize) * atlasSize * 4) >> 20));
+	}
+}
+
+void DeviceVirtualTexture::update(vk::CommandBuffer cmd) {
+	if (empty()) {
+		return;
+	}
+	auto uploads = mStreamer.processFeedback(static_cast<const uint32_t*>(feedback->data), VirtualTextureFeedbackSize);
+	memset(feedback->data, 0xff, feedback->size);
+
+	recordUploads(cmd, uploads);
+	syncPageTable();
+}
+
+void DeviceVirtualTexture::finishFrame(vk::CommandBuffer cmd) {
+	if (empty()) {
+		return;
+	}
+	auto barrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead);
+
+	cmd.pipelineBarrier(
+		vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+		vk::PipelineStageFlagBits::eHost,
+		vk::DependencyFlags{ 0 }, barrier, {}, {}
+	);
+}
+
+void DeviceVirtualTexture::recordUploads(vk::CommandBuffer cmd, const std::vector<VirtualTileUpload>& uploads) {
+	if (uploads.empty()) {
+		return;
+	}
+	std::vector<vk::BufferImageCopy> copies;
+
+	for (uint32_t i = 0; i < uploads.size(); i++) {
+		const auto& [tile, slot] = uploads[i];
+		auto dst = static_cast<uint8_t*>(mStagingBuffer->data) + TileByteSize * i;
+
+		mSources.at(tile.texture).copyTile(tile.mip, tile.x, tile.y, dst);
+
+		int32_t atlasX = static_cast<int32_t>((slot % mAtlasTiles) * VirtualTexturePaddedTileSize);
+		int32_t atlasY = static_cast<int32_t>((slot / mAtlasTiles) * VirtualTexturePaddedTileSize);
+
+		copies.push_back(vk::BufferImageCopy()
+			.setBufferOffset(TileByteSize * i)
+			.setBufferRowLength(0)
+			.setBufferImageHeight(0)
+			.setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1))
+			.setImageOffset({ atlasX, atlasY, 0 })
+			.setImageExtent({ VirtualTexturePaddedTileSize, VirtualTexturePaddedTileSize, 1 }));
+	}
+
+	auto beforeCopy = vk::MemoryBarrier(vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eTransferWrite);
+	auto afterCopy = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+	auto shaderStages = vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader |
+		vk::PipelineStageFlagBits::eRayTracingShaderKHR;
+
+	cmd.pipelineBarrier(shaderStages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{ 0 }, beforeCopy, {}, {});
+	cmd.copyBufferToImage(mStagingBuffer->buffer, atlas->image, atlas->layout, copies);
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, shaderStages, vk::DependencyFlags{ 0 }, afterCopy, {}, {});
+}
+
+void DeviceVirtualTexture::syncPageTable() {
+	if (auto range = mPageTable.dirtyRange()) {
+		auto [begin, end] = *range;
+		memcpy(
+			static_cast<uint32_t*>(pageTable->data) + begin,
+			mPageTable.entries().data() + begin, (end - begin) * sizeof(uint32_t)
+		);
+	}
+	mPageTable.clearDirty();
+}
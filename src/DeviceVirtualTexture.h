@@ -0,0 +1,51 @@
+#pragma once
+
+#include <map>
+
+#include <zvk.hpp>
+
+#include "VirtualTexture.h"
+
+struct VirtualTextureSettings {
+	bool enable = false;
+	uint32_t minSize = 4096;
+	uint32_t budget = 1024;
+	uint32_t maxUploadsPerFrame = 64;
+};
+
+/**
+* GPU half of sparse virtual texturing: the physical tile atlas, the page table and the
+*   feedback buffer that shading passes write tile requests into
+*/
+class DeviceVirtualTexture : public zvk::BaseVkObject {
+public:
+	DeviceVirtualTexture(
+		const zvk::Context* ctx, zvk::QueueIdx queueIdx, const VirtualTextureSettings& settings,
+		const std::vector<zvk::HostImage*>& images);
+
+	bool isVirtual(uint32_t textureIdx) const { return mPageTable.isVirtual(textureIdx); }
+	bool empty() const { return mSources.empty(); }
+	const TileStreamer::Statistics& statistics() const { return mStreamer.statistics(); }
+
+	// Consumes last frame's feedback and records tile uploads, must run before any shading pass
+	void update(vk::CommandBuffer cmd);
+	// Makes this frame's feedback writes visible to the host
+	void finishFrame(vk::CommandBuffer cmd);
+
+private:
+	void recordUploads(vk::CommandBuffer cmd, const std::vector<VirtualTileUpload>& uploads);
+	void syncPageTable();
+
+public:
+	std::unique_ptr<zvk::Image> atlas;
+	std::unique_ptr<zvk::Buffer> infos;
+	std::unique_ptr<zvk::Buffer> pageTable;
+	std::unique_ptr<zvk::Buffer> feedback;
+
+private:
+	VirtualPageTable mPageTable;
+	TileStreamer mStreamer;
+	std::map<uint32_t, VirtualTextureSource> mSources;
+	std::unique_ptr<zvk::Buffer> mStagingBuffer;
+	uint32_t mAtlasTiles = 1;
+};
@@ -220,13 +220,17 @@ void GBufferPass::createPipeline(
 	vk::Extent2D extent, zvk::ShaderManager* shaderManager,
 	const std::vector<vk::DescriptorSetLayout>& descLayouts
 ) {
+	// Rebuilt when shaders are reloaded, keeping the render pass and frames
+	mCtx->device.destroyPipeline(mPipeline);
+	mCtx->device.destroyPipelineLayout(mPipelineLayout);
+
 	auto vertStageInfo = zvk::ShaderManager::shaderStageCreateInfo(
-		shaderManager->createShaderModule("shaders/gbuffer.vert.spv"),
+		shaderManager->createShaderModule("shaders/GBuffer.vert.spv"),
 		vk::ShaderStageFlagBits::eVertex
 	);
 
 	auto fragStageInfo = zvk::ShaderManager::shaderStageCreateInfo(
-		shaderManager->createShaderModule("shaders/gBuffer.frag.spv"),
+		shaderManager->createShaderModule("shaders/GBuffer.frag.spv"),
 		vk::ShaderStageFlagBits::eFragment
 	);
 
@@ -316,7 +320,7 @@ void GBufferPass::createPipeline(
 		.setBasePipelineHandle(nullptr)
 		.setBasePipelineIndex(-1);
 
-	auto result = mCtx->device.createGraphicsPipeline({}, pipelineCreateInfo);
+	auto result = mCtx->device.createGraphicsPipeline(mCtx->pipelineCache->cache, pipelineCreateInfo);
 
 	if (result.result != vk::Result::eSuccess) {
 		throw std::runtime_error("Failed to create GBufferPass pipeline");
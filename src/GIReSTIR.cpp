@@ -81,7 +81,7 @@ void GIReSTIR::createPipeline(zvk::ShaderManager* shaderManager, const std::vect
 		.setGroups(groups)
 		.setMaxPipelineRayRecursionDepth(maxDepth);
 
-	auto result = zvk::ExtFunctions::createRayTracingPipelineKHR(mCtx->device, {}, {}, pipelineCreateInfo);
+	auto result = zvk::ExtFunctions::createRayTracingPipelineKHR(mCtx->device, {}, mCtx->pipelineCache->cache, pipelineCreateInfo);
 
 	if (result.result != vk::Result::eSuccess) {
 		throw std::runtime_error("Failed to create RayTracingPass pipeline");
@@ -53,12 +53,6 @@ void GRISReSTIR::render(vk::CommandBuffer cmd, vk::Extent2D extent, const zvk::D
 }
 
 void GRISReSTIR::createPipeline(zvk::ShaderManager* shaderManager, const std::vector<vk::DescriptorSetLayout>& descLayouts) {
-    mPathTracePass = std::make_unique<RayTracing>(mCtx);
-    //mRetracePass = std::make_unique<RayTracing>(mCtx);
-    mSpatialReusePass = std::make_unique<RayTracing>(mCtx);
-    mTemporalReusePass = std::make_unique<RayTracing>(mCtx);
-    //mMISWeightPass = std::make_unique<RayTracing>(mCtx);
-
     mPathTracePass->createPipeline(shaderManager, "shaders/gris_path_trace.comp.spv", "shaders/gris_path_trace.rgen.spv", descLayouts, sizeof(Settings));
     //mRetracePass->createPipeline(shaderManager, "shaders/gris_retrace.comp.spv", "", descLayouts, sizeof(Settings));
     mTemporalReusePass->createPipeline(shaderManager, "shaders/gris_resample_temporal.comp.spv", "", descLayouts, sizeof(Settings));
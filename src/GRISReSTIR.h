@@ -17,7 +17,12 @@ public:
 	};
 
 public:
-	GRISReSTIR(const zvk::Context* ctx) : BaseVkObject(ctx) {}
+	// Passes live as long as this so that their ray tracing mode survives pipeline rebuilds on shader reload
+	GRISReSTIR(const zvk::Context* ctx) :
+		BaseVkObject(ctx),
+		mPathTracePass(std::make_unique<RayTracing>(ctx)),
+		mTemporalReusePass(std::make_unique<RayTracing>(ctx)),
+		mSpatialReusePass(std::make_unique<RayTracing>(ctx)) {}
 	~GRISReSTIR() { destroy(); }
 	void destroy();
 
@@ -35,7 +35,7 @@ GUIManager::GUIManager(const zvk::Context* ctx, GLFWwindow* window, uint32_t num
 		.Device = ctx->device,
 		.QueueFamily = ctx->queues[queueIdx].familyIdx,
 		.Queue = ctx->queues[queueIdx].queue,
-		.PipelineCache = VK_NULL_HANDLE,
+		.PipelineCache = ctx->pipelineCache->cache,
 		.DescriptorPool = mDescriptorPool->pool,
 		.Subpass = 0,
 		.MinImageCount = 2,
@@ -0,0 +1,501 @@
+#include "LightBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+constexpr float Pi = 3.14159265358979323846f;
+constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+
+static float safeSqrt(float x) {
+	return std::sqrt(std::max(x, 0.f));
+}
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+static float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+	return (cosA > cosB) ? 1.f : cosA * cosB + sinA * sinB;
+}
+
+static float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+	return (cosA > cosB) ? 0.f : sinA * cosB - cosA * sinB;
+}
+
+static float angleBetween(const glm::vec3& a, const glm::vec3& b) {
+	if (glm::dot(a, b) < 0.f) {
+		return Pi - 2.f * std::asin(std::min(glm::length(a + b) * .5f, 1.f));
+	}
+	return 2.f * std::asin(std::min(glm::length(b - a) * .5f, 1.f));
+}
+
+static glm::vec3 rotate(const glm::vec3& v, const glm::vec3& axis, float theta) {
+	float cosTheta = std::cos(theta);
+	float sinTheta = std::sin(theta);
+	return v * cosTheta + glm::cross(axis, v) * sinTheta + axis * glm::dot(axis, v) * (1.f - cosTheta);
+}
+
+DirectionCone DirectionCone::unite(const DirectionCone& a, const DirectionCone& b) {
+	if (a.empty) {
+		return b;
+	}
+	if (b.empty) {
+		return a;
+	}
+	float thetaA = std::acos(std::clamp(a.cosTheta, -1.f, 1.f));
+	float thetaB = std::acos(std::clamp(b.cosTheta, -1.f, 1.f));
+	float thetaD = angleBetween(a.axis, b.axis);
+
+	if (std::min(thetaD + thetaB, Pi) <= thetaA) {
+		return a;
+	}
+	if (std::min(thetaD + thetaA, Pi) <= thetaB) {
+		return b;
+	}
+	float thetaO = (thetaA + thetaD + thetaB) * .5f;
+	glm::vec3 rotAxis = glm::cross(a.axis, b.axis);
+
+	if (thetaO >= Pi || glm::dot(rotAxis, rotAxis) == 0.f) {
+		return { a.axis, -1.f, false };
+	}
+	glm::vec3 axis = rotate(a.axis, glm::normalize(rotAxis), thetaO - thetaA);
+	return { glm::normalize(axis), std::cos(thetaO), false };
+}
+
+LightBounds LightBounds::unite(const LightBounds& a, const LightBounds& b) {
+	return LightBounds {
+		.boundMin = glm::min(a.boundMin, b.boundMin),
+		.boundMax = glm::max(a.boundMax, b.boundMax),
+		.power = a.power + b.power,
+		.cone = DirectionCone::unite(a.cone, b.cone),
+		.cosThetaE = std::min(a.cosThetaE, b.cosThetaE)
+	};
+}
+
+/**
+* Upper bound of the contribution of these emitters to a point, following pbrt-v4's
+*   LightBounds::Importance. Must match lightBVHImportance in light_sampling.glsl
+*/
+float LightBounds::importance(const glm::vec3& pos, const glm::vec3& norm) const {
+	glm::vec3 center = centroid();
+	glm::vec3 diag = boundMax - boundMin;
+	glm::vec3 toPos = pos - center;
+
+	float dist2 = glm::dot(toPos, toPos);
+	float clampedDist2 = std::max(dist2, glm::length(diag) * .5f);
+	float dist = std::sqrt(dist2);
+	glm::vec3 wi = (dist > 0.f) ? toPos / dist : cone.axis;
+
+	float cosThetaW = glm::dot(cone.axis, wi);
+	float sinThetaW = safeSqrt(1.f - cosThetaW * cosThetaW);
+
+	// Angle subtended by the bounding sphere of the box
+	float radius2 = glm::dot(diag, diag) * .25f;
+	float cosThetaB = (dist2 < radius2) ? -1.f : safeSqrt(1.f - radius2 / dist2);
+	float sinThetaB = safeSqrt(1.f - cosThetaB * cosThetaB);
+
+	float cosThetaO = cone.cosTheta;
+	float sinThetaO = safeSqrt(1.f - cosThetaO * cosThetaO);
+
+	float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+	float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+	float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+
+	if (cosThetaP <= cosThetaE) {
+		return 0.f;
+	}
+	float importance = power * cosThetaP / clampedDist2;
+
+	if (norm != glm::vec3(0.f)) {
+		float cosThetaI = std::abs(glm::dot(wi, norm));
+		float sinThetaI = safeSqrt(1.f - cosThetaI * cosThetaI);
+		importance *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+	}
+	return std::max(importance, 0.f);
+}
+
+static float surfaceArea(const LightBounds& bounds) {
+	glm::vec3 d = bounds.boundMax - bounds.boundMin;
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// Power times the solid angle measure of the orientation cone times surface area, see pbrt-v4
+static float splitCost(const LightBounds& bounds, const glm::vec3& nodeDiag, int dim) {
+	if (bounds.power <= 0.f) {
+		return 0.f;
+	}
+	float cosThetaO = std::clamp(bounds.cone.cosTheta, -1.f, 1.f);
+	float thetaO = std::acos(cosThetaO);
+	float thetaE = std::acos(std::clamp(bounds.cosThetaE, -1.f, 1.f));
+	float thetaW = std::min(thetaO + thetaE, Pi);
+	float sinThetaO = safeSqrt(1.f - cosThetaO * cosThetaO);
+
+	float measureOmega = 2.f * Pi * (1.f - cosThetaO) +
+		Pi * .5f * (2.f * thetaW * sinThetaO - std::cos(thetaO - 2.f * thetaW) - 2.f * thetaO * sinThetaO + cosThetaO);
+
+	float regularization = std::max({ nodeDiag.x, nodeDiag.y, nodeDiag.z }) / nodeDiag[dim];
+	return bounds.power * measureOmega * regularization * surfaceArea(bounds);
+}
+
+void LightBVH::build(const std::vector<LightBounds>& lights) {
+	clear();
+	mLights = lights;
+
+	if (lights.empty()) {
+		return;
+	}
+	lightIndices.resize(lights.size());
+	std::iota(lightIndices.begin(), lightIndices.end(), 0);
+	bitTrails.resize(lights.size());
+	nodes.reserve(lights.size() * 2);
+
+	buildRecursive(0, static_cast<uint32_t>(lights.size()), 0, 0);
+
+	mParents.assign(nodes.size(), 0);
+	mLightLeaves.resize(lights.size());
+
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		const auto& node = nodes[i];
+
+		if (node.numLights == 0) {
+			mParents[i + 1] = i;
+			mParents[node.secondChild] = i;
+		}
+		for (uint32_t j = node.lightOffset; j < node.lightOffset + node.numLights; j++) {
+			mLightLeaves[lightIndices[j]] = i;
+		}
+	}
+}
+
+std::vector<uint32_t> LightBVH::updatePower(const std::vector<std::pair<uint32_t, float>>& lightPowers) {
+	std::vector<uint32_t> dirtyNodes;
+
+	for (auto [lightId, power] : lightPowers) {
+		mLights[lightId].power = power;
+
+		// Children are always stored after their parents, so ancestors have smaller indices
+		for (uint32_t node = mLightLeaves[lightId]; ; node = mParents[node]) {
+			dirtyNodes.push_back(node);
+
+			if (node == 0) {
+				break;
+			}
+		}
+	}
+	std::sort(dirtyNodes.begin(), dirtyNodes.end());
+	dirtyNodes.erase(std::unique(dirtyNodes.begin(), dirtyNodes.end()), dirtyNodes.end());
+
+	for (auto iter = dirtyNodes.rbegin(); iter != dirtyNodes.rend(); iter++) {
+		auto& node = nodes[*iter];
+
+		if (node.numLights == 0) {
+			node.power = nodes[*iter + 1].power + nodes[node.secondChild].power;
+			continue;
+		}
+		double power = 0.0;
+
+		for (uint32_t i = node.lightOffset; i < node.lightOffset + node.numLights; i++) {
+			power += mLights[lightIndices[i]].power;
+		}
+		node.power = static_cast<float>(power);
+	}
+	return dirtyNodes;
+}
+
+void LightBVH::clear() {
+	nodes.clear();
+	lightIndices.clear();
+	bitTrails.clear();
+	mLights.clear();
+	mParents.clear();
+	mLightLeaves.clear();
+	mDepth = 0;
+}
+
+uint32_t LightBVH::buildRecursive(uint32_t begin, uint32_t end, uint32_t bitTrail, uint32_t depth) {
+	mDepth = std::max(mDepth, depth + 1);
+
+	LightBounds bounds;
+	glm::vec3 centroidMin(FLT_MAX);
+	glm::vec3 centroidMax(-FLT_MAX);
+
+	for (uint32_t i = begin; i < end; i++) {
+		const auto& light = mLights[lightIndices[i]];
+		bounds = LightBounds::unite(bounds, light);
+		centroidMin = glm::min(centroidMin, light.centroid());
+		centroidMax = glm::max(centroidMax, light.centroid());
+	}
+	uint32_t nodeIdx = static_cast<uint32_t>(nodes.size());
+
+	// Branch bits are stored in 32 bits, deeper subtrees are merged into one leaf
+	if (end - begin == 1 || depth + 1 >= MaxDepth) {
+		makeLeaf(bounds, begin, end, bitTrail);
+		return nodeIdx;
+	}
+	glm::vec3 nodeDiag = bounds.boundMax - bounds.boundMin;
+
+	auto bucketOf = [&](const LightBounds& light, int dim) {
+		float offset = (light.centroid()[dim] - centroidMin[dim]) / (centroidMax[dim] - centroidMin[dim]);
+		return std::min(static_cast<uint32_t>(offset * NumBuckets), NumBuckets - 1);
+	};
+
+	float minCost = FLT_MAX;
+	int minDim = -1;
+	uint32_t minBucket = 0;
+
+	for (int dim = 0; dim < 3; dim++) {
+		if (centroidMax[dim] == centroidMin[dim]) {
+			continue;
+		}
+		LightBounds buckets[NumBuckets];
+
+		for (uint32_t i = begin; i < end; i++) {
+			const auto& light = mLights[lightIndices[i]];
+			uint32_t b = bucketOf(light, dim);
+			buckets[b] = LightBounds::unite(buckets[b], light);
+		}
+
+		LightBounds above[NumBuckets];
+		above[NumBuckets - 1] = buckets[NumBuckets - 1];
+
+		for (int i = NumBuckets - 2; i >= 0; i--) {
+			above[i] = LightBounds::unite(above[i + 1], buckets[i]);
+		}
+		LightBounds below;
+
+		for (uint32_t i = 0; i < NumBuckets - 1; i++) {
+			below = LightBounds::unite(below, buckets[i]);
+
+			float cost = splitCost(below, nodeDiag, dim) + splitCost(above[i + 1], nodeDiag, dim);
+
+			if (cost > 0.f && cost < minCost) {
+				minCost = cost;
+				minDim = dim;
+				minBucket = i;
+			}
+		}
+	}
+	uint32_t mid = (begin + end) / 2;
+
+	if (minDim != -1) {
+		auto iter = std::partition(lightIndices.begin() + begin, lightIndices.begin() + end, [&](uint32_t idx) {
+			return bucketOf(mLights[idx], minDim) <= minBucket;
+		});
+		uint32_t split = static_cast<uint32_t>(iter - lightIndices.begin());
+
+		if (split != begin && split != end) {
+			mid = split;
+		}
+	}
+	nodes.push_back(LightBVHNode{});
+
+	buildRecursive(begin, mid, bitTrail, depth + 1);
+	uint32_t secondChild = buildRecursive(mid, end, bitTrail | (1u << depth), depth + 1);
+
+	nodes[nodeIdx] = LightBVHNode {
+		.boundMin = bounds.boundMin,
+		.power = bounds.power,
+		.boundMax = bounds.boundMax,
+		.cosThetaO = bounds.cone.cosTheta,
+		.axis = bounds.cone.axis,
+		.cosThetaE = bounds.cosThetaE,
+		.secondChild = secondChild,
+		.lightOffset = 0,
+		.numLights = 0
+	};
+	return nodeIdx;
+}
+
+void LightBVH::makeLeaf(const LightBounds& bounds, uint32_t begin, uint32_t end, uint32_t bitTrail) {
+	double power = 0.0;
+
+	for (uint32_t i = begin; i < end; i++) {
+		power += mLights[lightIndices[i]].power;
+		bitTrails[lightIndices[i]] = bitTrail;
+	}
+	nodes.push_back(LightBVHNode {
+		.boundMin = bounds.boundMin,
+		.power = static_cast<float>(power),
+		.boundMax = bounds.boundMax,
+		.cosThetaO = bounds.cone.cosTheta,
+		.axis = bounds.cone.axis,
+		.cosThetaE = bounds.cosThetaE,
+		.secondChild = 0,
+		.lightOffset = begin,
+		.numLights = end - begin
+	});
+}
+
+float LightBVH::nodeImportance(uint32_t nodeIdx, const glm::vec3& pos, const glm::vec3& norm) const {
+	const auto& node = nodes[nodeIdx];
+
+	auto bounds = LightBounds {
+		.boundMin = node.boundMin,
+		.boundMax = node.boundMax,
+		.power = node.power,
+		.cone = { node.axis, node.cosThetaO, false },
+		.cosThetaE = node.cosThetaE
+	};
+	return bounds.importance(pos, norm);
+}
+
+std::optional<LightBVH::Sample> LightBVH::sample(const glm::vec3& pos, const glm::vec3& norm, float r) const {
+	if (empty()) {
+		return std::nullopt;
+	}
+	uint32_t nodeIdx = 0;
+	float pmf = 1.f;
+
+	while (true) {
+		const auto& node = nodes[nodeIdx];
+
+		if (node.numLights == 1) {
+			return Sample{ lightIndices[node.lightOffset], pmf };
+		}
+		else if (node.numLights > 1) {
+			if (node.power <= 0.f) {
+				return std::nullopt;
+			}
+			float target = r * node.power;
+
+			for (uint32_t i = 0; i < node.numLights; i++) {
+				uint32_t lightId = lightIndices[node.lightOffset + i];
+				float power = mLights[lightId].power;
+
+				if (target < power || i == node.numLights - 1) {
+					return Sample{ lightId, pmf * power / node.power };
+				}
+				target -= power;
+			}
+		}
+		float importance0 = nodeImportance(nodeIdx + 1, pos, norm);
+		float importance1 = nodeImportance(node.secondChild, pos, norm);
+
+		if (importance0 == 0.f && importance1 == 0.f) {
+			return std::nullopt;
+		}
+		float prob0 = importance0 / (importance0 + importance1);
+
+		if (r < prob0) {
+			nodeIdx = nodeIdx + 1;
+			r = std::min(r / prob0, OneMinusEpsilon);
+			pmf *= prob0;
+		}
+		else {
+			nodeIdx = node.secondChild;
+			r = std::min((r - prob0) / (1.f - prob0), OneMinusEpsilon);
+			pmf *= 1.f - prob0;
+		}
+	}
+}
+
+float LightBVH::pmf(const glm::vec3& pos, const glm::vec3& norm, uint32_t lightId) const {
+	if (empty() || lightId >= bitTrails.size()) {
+		return 0.f;
+	}
+	uint32_t bitTrail = bitTrails[lightId];
+	uint32_t nodeIdx = 0;
+	float pmf = 1.f;
+
+	while (true) {
+		const auto& node = nodes[nodeIdx];
+
+		if (node.numLights == 1) {
+			return pmf;
+		}
+		else if (node.numLights > 1) {
+			return (node.power > 0.f) ? pmf * mLights[lightId].power / node.power : 0.f;
+		}
+		float importance0 = nodeImportance(nodeIdx + 1, pos, norm);
+		float importance1 = nodeImportance(node.secondChild, pos, norm);
+
+		if (importance0 == 0.f && importance1 == 0.f) {
+			return 0.f;
+		}
+		float prob0 = importance0 / (importance0 + importance1);
+
+		if (bitTrail & 1) {
+			nodeIdx = node.secondChild;
+			pmf *= 1.f - prob0;
+		}
+		else {
+			nodeIdx = nodeIdx + 1;
+			pmf *= prob0;
+		}
+		bitTrail >>= 1;
+	}
+}
+
+LightBVH::Validation LightBVH::validate(uint32_t numPoints, uint32_t samplesPerPoint, uint32_t seed) const {
+	Validation result;
+
+	if (empty()) {
+		return result;
+	}
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(0.f, OneMinusEpsilon);
+
+	glm::vec3 sceneMin = nodes[0].boundMin;
+	glm::vec3 sceneExtent = nodes[0].boundMax - nodes[0].boundMin;
+
+	// Probability of traversal ending where both children have zero importance
+	auto deadEndMass = [&](const glm::vec3& pos, const glm::vec3& norm) {
+		double mass = 0.0;
+		std::vector<std::pair<uint32_t, double>> stack = { { 0, 1.0 } };
+
+		while (!stack.empty()) {
+			auto [nodeIdx, prob] = stack.back();
+			stack.pop_back();
+			const auto& node = nodes[nodeIdx];
+
+			if (node.numLights > 1 && node.power <= 0.f) {
+				mass += prob;
+			}
+			if (node.numLights > 0) {
+				continue;
+			}
+			float importance0 = nodeImportance(nodeIdx + 1, pos, norm);
+			float importance1 = nodeImportance(node.secondChild, pos, norm);
+
+			if (importance0 == 0.f && importance1 == 0.f) {
+				mass += prob;
+				continue;
+			}
+			double prob0 = importance0 / (importance0 + importance1);
+			stack.push_back({ nodeIdx + 1, prob * prob0 });
+			stack.push_back({ node.secondChild, prob * (1.0 - prob0) });
+		}
+		return mass;
+	};
+
+	for (uint32_t i = 0; i < numPoints; i++) {
+		glm::vec3 pos = sceneMin + sceneExtent * glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 1.2f - sceneExtent * .1f;
+		glm::vec3 norm(0.f);
+
+		// Half of the points also weight by a surface normal
+		if (i & 1) {
+			float cosTheta = 1.f - 2.f * uniform(rng);
+			float phi = 2.f * Pi * uniform(rng);
+			float sinTheta = safeSqrt(1.f - cosTheta * cosTheta);
+			norm = glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+		}
+		double sum = deadEndMass(pos, norm);
+
+		for (uint32_t lightId = 0; lightId < mLights.size(); lightId++) {
+			sum += pmf(pos, norm, lightId);
+		}
+		result.maxSumError = std::max(result.maxSumError, static_cast<float>(std::abs(sum - 1.0)));
+
+		for (uint32_t j = 0; j < samplesPerPoint; j++) {
+			auto sample = this->sample(pos, norm, uniform(rng));
+
+			if (!sample || sample->pmf <= 0.f) {
+				continue;
+			}
+			float error = std::abs(pmf(pos, norm, sample->lightId) - sample->pmf) / sample->pmf;
+			result.maxPmfError = std::max(result.maxPmfError, error);
+			result.numSamples++;
+		}
+		result.numPoints++;
+	}
+	return result;
+}
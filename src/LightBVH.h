@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cfloat>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+* Bounding cone of emission directions, cosTheta = -1 covers the whole sphere
+*/
+struct DirectionCone {
+	glm::vec3 axis = glm::vec3(0.f, 0.f, 1.f);
+	float cosTheta = 1.f;
+	bool empty = true;
+
+	static DirectionCone unite(const DirectionCone& a, const DirectionCone& b);
+};
+
+/**
+* Spatial, power and orientation bounds of a set of emitters. cosThetaO bounds the spread of
+*   emitter normals around the cone axis, cosThetaE the spread of emission around each normal
+*/
+struct LightBounds {
+	glm::vec3 boundMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundMax = glm::vec3(-FLT_MAX);
+	float power = 0.f;
+	DirectionCone cone;
+	float cosThetaE = 1.f;
+
+	static LightBounds unite(const LightBounds& a, const LightBounds& b);
+
+	glm::vec3 centroid() const { return (boundMin + boundMax) * .5f; }
+	float importance(const glm::vec3& pos, const glm::vec3& norm) const;
+};
+
+// Mirrored by LightBVHNode in layouts.glsl. Interior nodes keep their first child right after
+//   themselves, leaves have numLights > 0 and index a range of lightIndices
+struct LightBVHNode {
+	glm::vec3 boundMin;
+	float power;
+	glm::vec3 boundMax;
+	float cosThetaO;
+	glm::vec3 axis;
+	float cosThetaE;
+	uint32_t secondChild;
+	uint32_t lightOffset;
+	uint32_t numLights;
+	uint32_t pad;
+};
+
+/**
+* Light BVH for many-light sampling (Conty & Kulla 2018, in the form used by pbrt-v4).
+*   Traversal picks children in proportion to their importance at the shading point, and
+*   every light stores the branch bits leading to its leaf so that the pmf of any light
+*   can be queried exactly for MIS. sample() and pmf() are the CPU reference of the GLSL
+*   versions in light_sampling.glsl
+*/
+class LightBVH {
+public:
+	static constexpr uint32_t MaxDepth = 32;
+	static constexpr uint32_t NumBuckets = 12;
+
+	struct Sample {
+		uint32_t lightId;
+		float pmf;
+	};
+
+	struct Validation {
+		float maxSumError = 0.f;
+		float maxPmfError = 0.f;
+		uint32_t numPoints = 0;
+		uint32_t numSamples = 0;
+	};
+
+	void build(const std::vector<LightBounds>& lights);
+	void clear();
+
+	// Refits node powers after light powers changed, returns the indices of changed nodes in ascending order
+	std::vector<uint32_t> updatePower(const std::vector<std::pair<uint32_t, float>>& lightPowers);
+
+	std::optional<Sample> sample(const glm::vec3& pos, const glm::vec3& norm, float r) const;
+	float pmf(const glm::vec3& pos, const glm::vec3& norm, uint32_t lightId) const;
+
+	// Checks that pmf() sums to one over all lights and agrees with sample() at random points
+	Validation validate(uint32_t numPoints, uint32_t samplesPerPoint, uint32_t seed = 0) const;
+
+	bool empty() const { return nodes.empty(); }
+	uint32_t depth() const { return mDepth; }
+
+private:
+	uint32_t buildRecursive(uint32_t begin, uint32_t end, uint32_t bitTrail, uint32_t depth);
+	void makeLeaf(const LightBounds& bounds, uint32_t begin, uint32_t end, uint32_t bitTrail);
+	float nodeImportance(uint32_t nodeIdx, const glm::vec3& pos, const glm::vec3& norm) const;
+
+public:
+	std::vector<LightBVHNode> nodes;
+	std::vector<uint32_t> lightIndices;
+	std::vector<uint32_t> bitTrails;
+
+private:
+	std::vector<LightBounds> mLights;
+	std::vector<uint32_t> mParents;
+	std::vector<uint32_t> mLightLeaves;
+	uint32_t mDepth = 0;
+};
@@ -0,0 +1,223 @@
+#include "LightExtraction.h"
+#include "util/Timer.h"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LIGHT_EXTRACTION_SSE2
+#endif
+
+/**
+* Thin wrappers so that the kernel is written once for every lane width. Only separate
+*   multiplies and adds are used, fused forms would round differently from the glm path
+*/
+#if defined(__AVX2__)
+struct FloatLanes {
+	static constexpr uint32_t Width = 8;
+	__m256 v;
+
+	static FloatLanes load(const float* p) { return { _mm256_load_ps(p) }; }
+	static FloatLanes broadcast(float x) { return { _mm256_set1_ps(x) }; }
+	void store(float* p) const { _mm256_store_ps(p, v); }
+
+	friend FloatLanes operator + (FloatLanes a, FloatLanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+	friend FloatLanes operator - (FloatLanes a, FloatLanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	friend FloatLanes operator * (FloatLanes a, FloatLanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	friend FloatLanes operator / (FloatLanes a, FloatLanes b) { return { _mm256_div_ps(a.v, b.v) }; }
+	friend FloatLanes sqrt(FloatLanes a) { return { _mm256_sqrt_ps(a.v) }; }
+};
+#elif defined(LIGHT_EXTRACTION_SSE2)
+struct FloatLanes {
+	static constexpr uint32_t Width = 4;
+	__m128 v;
+
+	static FloatLanes load(const float* p) { return { _mm_load_ps(p) }; }
+	static FloatLanes broadcast(float x) { return { _mm_set1_ps(x) }; }
+	void store(float* p) const { _mm_store_ps(p, v); }
+
+	friend FloatLanes operator + (FloatLanes a, FloatLanes b) { return { _mm_add_ps(a.v, b.v) }; }
+	friend FloatLanes operator - (FloatLanes a, FloatLanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+	friend FloatLanes operator * (FloatLanes a, FloatLanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+	friend FloatLanes operator / (FloatLanes a, FloatLanes b) { return { _mm_div_ps(a.v, b.v) }; }
+	friend FloatLanes sqrt(FloatLanes a) { return { _mm_sqrt_ps(a.v) }; }
+};
+#else
+struct FloatLanes {
+	static constexpr uint32_t Width = 1;
+	float v;
+
+	static FloatLanes load(const float* p) { return { *p }; }
+	static FloatLanes broadcast(float x) { return { x }; }
+	void store(float* p) const { *p = v; }
+
+	friend FloatLanes operator + (FloatLanes a, FloatLanes b) { return { a.v + b.v }; }
+	friend FloatLanes operator - (FloatLanes a, FloatLanes b) { return { a.v - b.v }; }
+	friend FloatLanes operator * (FloatLanes a, FloatLanes b) { return { a.v * b.v }; }
+	friend FloatLanes operator / (FloatLanes a, FloatLanes b) { return { a.v / b.v }; }
+	friend FloatLanes sqrt(FloatLanes a) { return { std::sqrt(a.v) }; }
+};
+#endif
+
+constexpr uint32_t Width = FloatLanes::Width;
+
+struct Vec3Lanes {
+	FloatLanes x, y, z;
+};
+
+struct alignas(32) Vec3Block {
+	float x[Width];
+	float y[Width];
+	float z[Width];
+
+	Vec3Lanes load() const { return { FloatLanes::load(x), FloatLanes::load(y), FloatLanes::load(z) }; }
+
+	void store(const Vec3Lanes& v) {
+		v.x.store(x);
+		v.y.store(y);
+		v.z.store(z);
+	}
+};
+
+// Same association as glm's mat4 * vec4 with w = 1: (c0 * x + c1 * y) + (c2 * z + c3)
+static FloatLanes transformRow(const glm::mat4& m, int row, const Vec3Lanes& p) {
+	return
+		(FloatLanes::broadcast(m[0][row]) * p.x + FloatLanes::broadcast(m[1][row]) * p.y) +
+		(FloatLanes::broadcast(m[2][row]) * p.z + FloatLanes::broadcast(m[3][row]));
+}
+
+static Vec3Lanes transformPoint(const glm::mat4& m, const Vec3Lanes& p) {
+	return { transformRow(m, 0, p), transformRow(m, 1, p), transformRow(m, 2, p) };
+}
+
+void transformTriangleLights(
+	const glm::mat4& transform, const MeshVertex* vertices, const uint32_t* indices,
+	uint32_t numTriangles, TriangleLight* out
+) {
+	uint32_t numBlocks = numTriangles / Width;
+
+	for (uint32_t block = 0; block < numBlocks; block++) {
+		const uint32_t* blockIndices = indices + block * Width * 3;
+		Vec3Block pos[3];
+
+		for (uint32_t lane = 0; lane < Width; lane++) {
+			for (uint32_t k = 0; k < 3; k++) {
+				const glm::vec3& p = vertices[blockIndices[lane * 3 + k]].pos;
+				pos[k].x[lane] = p.x;
+				pos[k].y[lane] = p.y;
+				pos[k].z[lane] = p.z;
+			}
+		}
+		Vec3Lanes v0 = transformPoint(transform, pos[0].load());
+		Vec3Lanes v1 = transformPoint(transform, pos[1].load());
+		Vec3Lanes v2 = transformPoint(transform, pos[2].load());
+
+		Vec3Lanes e1 = { v1.x - v0.x, v1.y - v0.y, v1.z - v0.z };
+		Vec3Lanes e2 = { v2.x - v0.x, v2.y - v0.y, v2.z - v0.z };
+
+		Vec3Lanes n = {
+			e1.y * e2.z - e2.y * e1.z,
+			e1.z * e2.x - e2.z * e1.x,
+			e1.x * e2.y - e2.x * e1.y
+		};
+		FloatLanes length = sqrt((n.x * n.x + n.y * n.y) + n.z * n.z);
+		FloatLanes invLength = FloatLanes::broadcast(1.f) / length;
+
+		Vec3Block result[4];
+		result[0].store(v0);
+		result[1].store(v1);
+		result[2].store(v2);
+		result[3].store({ n.x * invLength, n.y * invLength, n.z * invLength });
+
+		alignas(32) float area[Width];
+		(FloatLanes::broadcast(.5f) * length).store(area);
+
+		for (uint32_t lane = 0; lane < Width; lane++) {
+			TriangleLight& tri = out[block * Width + lane];
+			tri.v0 = { result[0].x[lane], result[0].y[lane], result[0].z[lane] };
+			tri.v1 = { result[1].x[lane], result[1].y[lane], result[1].z[lane] };
+			tri.v2 = { result[2].x[lane], result[2].y[lane], result[2].z[lane] };
+			tri.nx = result[3].x[lane];
+			tri.ny = result[3].y[lane];
+			tri.nz = result[3].z[lane];
+			tri.area = area[lane];
+		}
+	}
+	uint32_t done = numBlocks * Width;
+	transformTriangleLightsScalar(transform, vertices, indices + done * 3, numTriangles - done, out + done);
+}
+
+void transformTriangleLightsScalar(
+	const glm::mat4& transform, const MeshVertex* vertices, const uint32_t* indices,
+	uint32_t numTriangles, TriangleLight* out
+) {
+	for (uint32_t i = 0; i < numTriangles; i++) {
+		TriangleLight& tri = out[i];
+		tri.v0 = glm::vec3(transform * glm::vec4(vertices[indices[i * 3 + 0]].pos, 1.f));
+		tri.v1 = glm::vec3(transform * glm::vec4(vertices[indices[i * 3 + 1]].pos, 1.f));
+		tri.v2 = glm::vec3(transform * glm::vec4(vertices[indices[i * 3 + 2]].pos, 1.f));
+
+		glm::vec3 n = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+		tri.area = .5f * glm::length(n);
+		n = glm::normalize(n);
+
+		tri.nx = n.x;
+		tri.ny = n.y;
+		tri.nz = n.z;
+	}
+}
+
+uint32_t triangleLightBatchWidth() {
+	return Width;
+}
+
+LightExtractionBenchmark benchmarkLightExtraction(uint32_t numTriangles, uint32_t seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> dist(-10.f, 10.f);
+
+	// Shared vertices like a typical mesh, indices shuffled so that gathers are not sequential
+	uint32_t numVertices = std::max(numTriangles / 2, 3u);
+	std::vector<MeshVertex> vertices(numVertices);
+
+	for (auto& vertex : vertices) {
+		vertex.pos = { dist(rng), dist(rng), dist(rng) };
+	}
+	std::vector<uint32_t> indices(numTriangles * 3);
+	std::uniform_int_distribution<uint32_t> vertexDist(0, numVertices - 1);
+
+	for (auto& index : indices) {
+		index = vertexDist(rng);
+	}
+	glm::mat4 transform = glm::translate(glm::mat4(1.f), glm::vec3(1.f, -2.f, 3.f));
+	transform = glm::rotate(transform, .3f, glm::vec3(1.f, 0.f, 0.f));
+	transform = glm::rotate(transform, .7f, glm::vec3(0.f, 1.f, 0.f));
+	transform = glm::scale(transform, glm::vec3(1.5f, .5f, 2.f));
+
+	std::vector<TriangleLight> scalar(numTriangles);
+	std::vector<TriangleLight> batch(numTriangles);
+
+	LightExtractionBenchmark result;
+	result.numTriangles = numTriangles;
+
+	Timer timer;
+	transformTriangleLightsScalar(transform, vertices.data(), indices.data(), numTriangles, scalar.data());
+	result.scalarMs = timer.get();
+
+	timer.reset();
+	transformTriangleLights(transform, vertices.data(), indices.data(), numTriangles, batch.data());
+	result.batchMs = timer.get();
+
+	for (uint32_t i = 0; i < numTriangles; i++) {
+		if (memcmp(&scalar[i], &batch[i], sizeof(TriangleLight)) != 0) {
+			result.numMismatches++;
+		}
+	}
+	return result;
+}
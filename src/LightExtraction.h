@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Model.h"
+#include "TriangleLight.h"
+
+/**
+* Writes v0, v1, v2, normal and area of out[i] for the triangle at indices[3i, 3i + 3), leaving
+*   radiance untouched. Triangles are gathered into SoA blocks and processed in SIMD lanes, the
+*   results are bitwise identical to transformTriangleLightsScalar. Degenerate triangles get a
+*   NaN normal just like glm::normalize would produce
+*/
+void transformTriangleLights(
+	const glm::mat4& transform, const MeshVertex* vertices, const uint32_t* indices,
+	uint32_t numTriangles, TriangleLight* out
+);
+
+// Reference path, transforms vertices with glm and normalizes the cross product of edges
+void transformTriangleLightsScalar(
+	const glm::mat4& transform, const MeshVertex* vertices, const uint32_t* indices,
+	uint32_t numTriangles, TriangleLight* out
+);
+
+// Number of triangles processed per SIMD block, 8 with AVX2, 4 with SSE2, otherwise 1
+uint32_t triangleLightBatchWidth();
+
+struct LightExtractionBenchmark {
+	uint32_t numTriangles = 0;
+	double scalarMs = 0.0;
+	double batchMs = 0.0;
+	uint32_t numMismatches = 0;
+};
+
+// Single threaded timing of both paths over random indexed geometry, compared bit by bit
+LightExtractionBenchmark benchmarkLightExtraction(uint32_t numTriangles, uint32_t seed = 0);
@@ -0,0 +1,88 @@
+#include "LightPresampler.h"
+#include "shader/HostDevice.h"
+
+#include <imgui.h>
+
+LightPresampler::LightPresampler(const zvk::Context* ctx) : BaseVkObject(ctx) {
+	auto createInfo = vk::QueryPoolCreateInfo()
+		.setQueryType(vk::QueryType::eTimestamp)
+		.setQueryCount(NumQueries);
+
+	mQueryPool = mCtx->device.createQueryPool(createInfo);
+}
+
+void LightPresampler::destroy() {
+	mCtx->device.destroyQueryPool(mQueryPool);
+}
+
+void LightPresampler::createPipeline(zvk::ShaderManager* shaderManager, const std::vector<vk::DescriptorSetLayout>& descLayouts) {
+	mPresamplePass = std::make_unique<zvk::ComputePipeline>(mCtx);
+	mPresamplePass->createPipeline(shaderManager, "shaders/light_presample.comp.spv", descLayouts);
+}
+
+void LightPresampler::execute(vk::CommandBuffer cmd, bool active, const DeviceScene* scene, const zvk::DescriptorSetBindingMap& descSetBindings) {
+	cmd.resetQueryPool(mQueryPool, 0, NumQueries);
+	cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, mQueryPool, PresampleBegin);
+
+	const auto lightingStages = vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader;
+
+	if (active && settings.enable && scene->numTriangleLights > 0) {
+		auto beforeWrite = vk::MemoryBarrier(vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eShaderWrite);
+
+		cmd.pipelineBarrier(lightingStages, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags{ 0 }, beforeWrite, {}, {});
+
+		mPresamplePass->execute(
+			cmd, vk::Extent3D(LightPresampleNumTiles * LightPresampleTileSize, 1, 1), vk::Extent3D(LightPresampleBlockSize, 1, 1),
+			descSetBindings
+		);
+		auto afterWrite = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, lightingStages, vk::DependencyFlags{ 0 }, afterWrite, {}, {});
+	}
+	else {
+		auto beforeClear = vk::MemoryBarrier(vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eTransferWrite);
+		auto afterClear = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+
+		cmd.pipelineBarrier(lightingStages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{ 0 }, beforeClear, {}, {});
+		cmd.fillBuffer(scene->lightTiles->buffer, 0, sizeof(glm::uvec4), 0);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, lightingStages, vk::DependencyFlags{ 0 }, afterClear, {}, {});
+	}
+	cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, mQueryPool, PresampleEnd);
+}
+
+void LightPresampler::beginLighting(vk::CommandBuffer cmd) {
+	cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, mQueryPool, LightingBegin);
+}
+
+void LightPresampler::endLighting(vk::CommandBuffer cmd) {
+	cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, mQueryPool, LightingEnd);
+	mQueriesWritten = true;
+}
+
+void LightPresampler::updateTimings() {
+	if (!mQueriesWritten) {
+		return;
+	}
+	auto [result, timestamps] = mCtx->device.getQueryPoolResults<uint64_t>(
+		mQueryPool, 0, NumQueries, NumQueries * sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64
+	);
+
+	if (result != vk::Result::eSuccess) {
+		return;
+	}
+	float period = mCtx->instance()->deviceProperties.limits.timestampPeriod * 1e-6f;
+	float presampleMs = static_cast<float>(timestamps[PresampleEnd] - timestamps[PresampleBegin]) * period;
+	float lightingMs = static_cast<float>(timestamps[LightingEnd] - timestamps[LightingBegin]) * period;
+
+	// Exponential moving average, single frames are too noisy to compare
+	mTimings.presampleMs = glm::mix(mTimings.presampleMs, presampleMs, .05f);
+	mTimings.lightingMs = glm::mix(mTimings.lightingMs, lightingMs, .05f);
+}
+
+void LightPresampler::GUI(bool& resetFrame, bool& clearReservoir) {
+	if (ImGui::Checkbox("Light Presampling", &settings.enable)) {
+		resetFrame = true;
+		clearReservoir = true;
+	}
+	ImGui::Text("Presample %.3f ms, lighting %.3f ms", mTimings.presampleMs, mTimings.lightingMs);
+}
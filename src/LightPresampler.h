@@ -0,0 +1,49 @@
+#pragma once
+
+#include <zvk.hpp>
+
+#include "Scene.h"
+
+/**
+* Fills LightPresampleNumTiles tiles of power sampled lights every frame so that light
+*   candidates of ReSTIR DI / PT come from a small, cache friendly working set. GPU
+*   timestamps around the presample and lighting passes compare both paths in the GUI
+*/
+class LightPresampler : public zvk::BaseVkObject {
+public:
+	struct Settings {
+		bool enable = true;
+	};
+
+	struct Timings {
+		float presampleMs = 0.f;
+		float lightingMs = 0.f;
+	};
+
+public:
+	LightPresampler(const zvk::Context* ctx);
+	~LightPresampler() { destroy(); }
+	void destroy();
+
+	void createPipeline(zvk::ShaderManager* shaderManager, const std::vector<vk::DescriptorSetLayout>& descLayouts);
+
+	// Presamples when active, otherwise clears the tile header so that shaders fall back to the alias table
+	void execute(vk::CommandBuffer cmd, bool active, const DeviceScene* scene, const zvk::DescriptorSetBindingMap& descSetBindings);
+	void beginLighting(vk::CommandBuffer cmd);
+	void endLighting(vk::CommandBuffer cmd);
+
+	// Must be called after the frame's fence has been waited on
+	void updateTimings();
+	void GUI(bool& resetFrame, bool& clearReservoir);
+
+public:
+	Settings settings;
+
+private:
+	enum Query { PresampleBegin, PresampleEnd, LightingBegin, LightingEnd, NumQueries };
+
+	std::unique_ptr<zvk::ComputePipeline> mPresamplePass;
+	vk::QueryPool mQueryPool;
+	bool mQueriesWritten = false;
+	Timings mTimings;
+};
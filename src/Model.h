@@ -38,6 +38,10 @@ struct MeshInstance {
 	uint32_t vertexOffset = 0;
 	uint32_t vertexCount = 0;
 	int materialIdx = InvalidResourceIdx;
+
+	// Only set on emissive meshes of object models, which are stored as light meshes
+	glm::vec3 emission = glm::vec3(0.f);
+	uint32_t emissionTextureIdx = InvalidResourceIdx;
 };
 
 class ModelInstance {
@@ -66,6 +70,8 @@ public:
 	uint32_t numMeshes() const { return mNumMeshes; }
 	uint32_t numIndices() const { return mNumIndices; }
 	uint32_t numVertices() const { return mNumVertices; }
+	uint32_t emissiveMeshOffset() const { return mEmissiveMeshOffset; }
+	uint32_t numEmissiveMeshes() const { return mNumEmissiveMeshes; }
 	uint32_t refId() const { return mRefId; }
 	glm::vec3 pos() const { return mPos; }
 	glm::vec3 scale() const { return mScale; }
@@ -83,6 +89,8 @@ private:
 	uint32_t mNumMeshes = 0;
 	uint32_t mNumIndices = 0;
 	uint32_t mNumVertices = 0;
+	uint32_t mEmissiveMeshOffset = 0;
+	uint32_t mNumEmissiveMeshes = 0;
 	uint32_t mRefId = 0;
 	bool mFlipNormal = false;
 
@@ -64,7 +64,7 @@ void PostProcessComp::createPipeline(zvk::ShaderManager* shaderManager, const st
 		.setLayout(mPipelineLayout)
 		.setStage(stageInfo);
 
-	auto result = mCtx->device.createComputePipeline({}, pipelineCreateInfo);
+	auto result = mCtx->device.createComputePipeline(mCtx->pipelineCache->cache, pipelineCreateInfo);
 
 	if (result.result != vk::Result::eSuccess) {
 		throw std::runtime_error("Failed to create PostProcessComp pipeline");
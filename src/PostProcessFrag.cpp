@@ -48,6 +48,10 @@ void PostProcessFrag::createPipeline(
 	zvk::ShaderManager* shaderManager, vk::Extent2D extent,
 	const std::vector<vk::DescriptorSetLayout>& descLayouts
 ) {
+	// Rebuilt when shaders are reloaded, keeping the render pass and frames
+	mCtx->device.destroyPipeline(mPipeline);
+	mCtx->device.destroyPipelineLayout(mPipelineLayout);
+
 	auto vertStageInfo = zvk::ShaderManager::shaderStageCreateInfo(
 		shaderManager->createShaderModule("shaders/post_proc.vert.spv"),
 		vk::ShaderStageFlagBits::eVertex
@@ -145,7 +149,7 @@ void PostProcessFrag::createPipeline(
 		.setBasePipelineHandle(nullptr)
 		.setBasePipelineIndex(-1);
 
-	auto result = mCtx->device.createGraphicsPipeline({}, pipelineCreateInfo);
+	auto result = mCtx->device.createGraphicsPipeline(mCtx->pipelineCache->cache, pipelineCreateInfo);
 
 	if (result.result != vk::Result::eSuccess) {
 		throw std::runtime_error("Failed to create PostProcessFrag pipeline");
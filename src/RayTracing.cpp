@@ -105,7 +105,7 @@ void RayTracingPipelineSimple::createPipeline(
 		.setGroups(groups)
 		.setMaxPipelineRayRecursionDepth(maxDepth);
 
-	auto result = zvk::ExtFunctions::createRayTracingPipelineKHR(mCtx->device, {}, {}, pipelineCreateInfo);
+	auto result = zvk::ExtFunctions::createRayTracingPipelineKHR(mCtx->device, {}, mCtx->pipelineCache->cache, pipelineCreateInfo);
 
 	if (result.result != vk::Result::eSuccess) {
 		throw std::runtime_error("Failed to create RayTracingPipelineSimple");
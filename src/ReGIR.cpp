@@ -0,0 +1,117 @@
+#include "ReGIR.h"
+#include "shader/HostDevice.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+ReGIRGrid::ReGIRGrid(const glm::vec3& boundMin, const glm::vec3& boundMax) {
+	// Pad so that flat scenes still get cells of nonzero size and boundary points fall inside
+	float padding = glm::length(boundMax - boundMin) * 1e-3f + 1e-4f;
+	mBoundMin = boundMin - padding;
+	mBoundMax = boundMax + padding;
+}
+
+uint32_t ReGIRGrid::numCells() {
+	return ReGIRGridDim * ReGIRGridDim * ReGIRGridDim;
+}
+
+std::optional<uint32_t> ReGIRGrid::cellIndex(const glm::vec3& pos) const {
+	if (glm::any(glm::lessThan(pos, mBoundMin)) || glm::any(glm::greaterThanEqual(pos, mBoundMax))) {
+		return std::nullopt;
+	}
+	glm::uvec3 cell = glm::min(glm::uvec3((pos - mBoundMin) / cellSize()), glm::uvec3(ReGIRGridDim - 1));
+	return cell.x + ReGIRGridDim * (cell.y + ReGIRGridDim * cell.z);
+}
+
+glm::vec3 ReGIRGrid::cellCenter(uint32_t cell) const {
+	glm::uvec3 coord(cell % ReGIRGridDim, (cell / ReGIRGridDim) % ReGIRGridDim, cell / (ReGIRGridDim * ReGIRGridDim));
+	return mBoundMin + (glm::vec3(coord) + .5f) * cellSize();
+}
+
+ReGIRReservoir ReGIRGrid::fillReservoir(
+	uint32_t cell, const std::vector<ReGIRLight>& lights, const LightSampleTable& sampler, const float* r
+) const {
+	ReGIRReservoir resv = { 0, 0.f };
+	float sumPower = sampler.sum();
+
+	if (sumPower <= 0.f) {
+		return resv;
+	}
+	glm::vec3 center = cellCenter(cell);
+	float radius = cellRadius();
+
+	float weightSum = 0.f;
+	float selectedTarget = 0.f;
+
+	for (uint32_t i = 0; i < ReGIRCandidatesPerReservoir; i++) {
+		uint32_t id = sampler.sample(r[i * 3 + 0], r[i * 3 + 1]);
+		const auto& light = lights[id];
+
+		float sourcePdf = light.power / sumPower;
+		glm::vec3 d = light.centroid - center;
+		float target = light.power / std::max(glm::dot(d, d), radius * radius);
+
+		if (sourcePdf <= 0.f) {
+			continue;
+		}
+		float weight = target / sourcePdf;
+		weightSum += weight;
+
+		if (r[i * 3 + 2] * weightSum < weight) {
+			resv.lightId = id;
+			selectedTarget = target;
+		}
+	}
+	resv.weight = (selectedTarget > 0.f) ? weightSum / (static_cast<float>(ReGIRCandidatesPerReservoir) * selectedTarget) : 0.f;
+	return resv;
+}
+
+ReGIRGrid::Validation ReGIRGrid::validate(
+	const std::vector<ReGIRLight>& lights, const LightSampleTable& sampler,
+	uint32_t numCells, uint32_t fillsPerCell, uint32_t seed
+) const {
+	Validation result;
+
+	if (lights.empty()) {
+		return result;
+	}
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	std::uniform_int_distribution<uint32_t> uniformCell(0, ReGIRGrid::numCells() - 1);
+
+	double expectedCount = 0.0;
+	double expectedPower = 0.0;
+
+	for (const auto& light : lights) {
+		expectedCount += (light.power > 0.f) ? 1.0 : 0.0;
+		expectedPower += light.power;
+	}
+	if (expectedCount == 0.0) {
+		return result;
+	}
+	std::vector<float> r(ReGIRCandidatesPerReservoir * 3);
+
+	for (uint32_t i = 0; i < numCells; i++) {
+		uint32_t cell = uniformCell(rng);
+		double sumWeight = 0.0;
+		double sumWeightedPower = 0.0;
+
+		for (uint32_t j = 0; j < fillsPerCell; j++) {
+			for (auto& x : r) {
+				x = uniform(rng);
+			}
+			auto resv = fillReservoir(cell, lights, sampler, r.data());
+			sumWeight += resv.weight;
+			sumWeightedPower += resv.weight * lights[resv.lightId].power;
+		}
+		double meanWeight = sumWeight / fillsPerCell;
+		double meanWeightedPower = sumWeightedPower / fillsPerCell;
+
+		result.maxCountError = std::max(result.maxCountError, static_cast<float>(std::abs(meanWeight / expectedCount - 1.0)));
+		result.maxPowerError = std::max(result.maxPowerError, static_cast<float>(std::abs(meanWeightedPower / expectedPower - 1.0)));
+	}
+	result.numCells = numCells;
+	result.numFills = numCells * fillsPerCell;
+	return result;
+}
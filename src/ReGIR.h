@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "TriangleLight.h"
+
+// Mirrored by ReGIRReservoir in layouts.glsl
+struct ReGIRReservoir {
+	uint32_t lightId;
+	float weight;
+};
+
+struct ReGIRLight {
+	glm::vec3 centroid;
+	float power;
+};
+
+/**
+* World-space grid of light reservoirs (ReGIR, Boksansky et al. 2021) spanning the scene bounds
+*   with ReGIRGridDim^3 cells. Each reservoir resamples ReGIRCandidatesPerReservoir power sampled
+*   lights with a target of power over squared distance to the cell center, clamped by the cell
+*   radius. This is the CPU reference of the cell layout and filling in regir.glsl
+*/
+class ReGIRGrid {
+public:
+	struct Validation {
+		float maxCountError = 0.f;
+		float maxPowerError = 0.f;
+		uint32_t numCells = 0;
+		uint32_t numFills = 0;
+	};
+
+	ReGIRGrid() = default;
+	ReGIRGrid(const glm::vec3& boundMin, const glm::vec3& boundMax);
+
+	static uint32_t numCells();
+
+	std::optional<uint32_t> cellIndex(const glm::vec3& pos) const;
+	glm::vec3 cellCenter(uint32_t cell) const;
+	glm::vec3 cellSize() const { return (mBoundMax - mBoundMin) / static_cast<float>(ReGIRGridDim); }
+	float cellRadius() const { return glm::length(cellSize()) * .5f; }
+
+	// r holds three numbers per candidate, two to pick from the alias table and one to resample
+	ReGIRReservoir fillReservoir(
+		uint32_t cell, const std::vector<ReGIRLight>& lights, const LightSampleTable& sampler, const float* r
+	) const;
+
+	// Checks that reservoir weights are unbiased: E[W] must match the number of lights with power
+	//   and E[W * power] the total power, both reported as relative errors
+	Validation validate(
+		const std::vector<ReGIRLight>& lights, const LightSampleTable& sampler,
+		uint32_t numCells, uint32_t fillsPerCell, uint32_t seed = 0
+	) const;
+
+	const glm::vec3& boundMin() const { return mBoundMin; }
+	const glm::vec3& boundMax() const { return mBoundMax; }
+
+private:
+	glm::vec3 mBoundMin = glm::vec3(0.f);
+	glm::vec3 mBoundMax = glm::vec3(0.f);
+};
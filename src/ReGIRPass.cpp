@@ -0,0 +1,46 @@
+#include "ReGIRPass.h"
+#include "shader/HostDevice.h"
+
+#include <imgui.h>
+
+void ReGIRPass::createPipeline(zvk::ShaderManager* shaderManager, const std::vector<vk::DescriptorSetLayout>& descLayouts) {
+	mFillPass = std::make_unique<zvk::ComputePipeline>(mCtx);
+	mFillPass->createPipeline(shaderManager, "shaders/regir_fill.comp.spv", descLayouts, sizeof(PushConstant));
+}
+
+void ReGIRPass::execute(vk::CommandBuffer cmd, bool active, const DeviceScene* scene, const zvk::DescriptorSetBindingMap& descSetBindings) {
+	const auto lightingStages = vk::PipelineStageFlagBits::eRayTracingShaderKHR | vk::PipelineStageFlagBits::eComputeShader;
+
+	if (active && settings.enable && scene->numTriangleLights > 0) {
+		auto beforeWrite = vk::MemoryBarrier(vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eShaderWrite);
+
+		cmd.pipelineBarrier(lightingStages, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags{ 0 }, beforeWrite, {}, {});
+
+		PushConstant pushConstant = {
+			glm::vec4(scene->regirGrid.boundMin(), 0.f),
+			glm::vec4(scene->regirGrid.boundMax(), 0.f)
+		};
+		mFillPass->execute(
+			cmd, vk::Extent3D(ReGIRGrid::numCells() * ReGIRReservoirsPerCell, 1, 1), vk::Extent3D(ReGIRBlockSize, 1, 1),
+			descSetBindings, &pushConstant
+		);
+		auto afterWrite = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, lightingStages, vk::DependencyFlags{ 0 }, afterWrite, {}, {});
+	}
+	else {
+		auto beforeClear = vk::MemoryBarrier(vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eTransferWrite);
+		auto afterClear = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+
+		cmd.pipelineBarrier(lightingStages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{ 0 }, beforeClear, {}, {});
+		cmd.fillBuffer(scene->regirReservoirs->buffer, 0, sizeof(glm::vec4) * 2, 0);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, lightingStages, vk::DependencyFlags{ 0 }, afterClear, {}, {});
+	}
+}
+
+void ReGIRPass::GUI(bool& resetFrame, bool& clearReservoir) {
+	if (ImGui::Checkbox("ReGIR", &settings.enable)) {
+		resetFrame = true;
+		clearReservoir = true;
+	}
+}
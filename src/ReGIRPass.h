@@ -0,0 +1,34 @@
+#pragma once
+
+#include <zvk.hpp>
+
+#include "Scene.h"
+
+/**
+* Refills the ReGIR light reservoir grid every frame for next event estimation at secondary path
+*   vertices. While inactive the grid header is cleared and shaders keep their regular sampler
+*/
+class ReGIRPass : public zvk::BaseVkObject {
+public:
+	struct Settings {
+		bool enable = true;
+	};
+
+	struct PushConstant {
+		glm::vec4 boundMin;
+		glm::vec4 boundMax;
+	};
+
+public:
+	ReGIRPass(const zvk::Context* ctx) : BaseVkObject(ctx) {}
+
+	void createPipeline(zvk::ShaderManager* shaderManager, const std::vector<vk::DescriptorSetLayout>& descLayouts);
+	void execute(vk::CommandBuffer cmd, bool active, const DeviceScene* scene, const zvk::DescriptorSetBindingMap& descSetBindings);
+	void GUI(bool& resetFrame, bool& clearReservoir);
+
+public:
+	Settings settings;
+
+private:
+	std::unique_ptr<zvk::ComputePipeline> mFillPass;
+};
@@ -25,6 +25,15 @@ const std::vector<const char*> DeviceExtensions = {
 	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
 };
 
+// GLSL sources compiled at runtime, prebuilt shaders/*.spv are used when this doesn't exist
+#ifdef SHADER_SOURCE_DIR
+const File::path ShaderSourceDir = SHADER_SOURCE_DIR;
+#else
+const File::path ShaderSourceDir = "src/shader";
+#endif
+
+// How often shader sources are checked for edits to hot reload
+constexpr double ShaderWatchIntervalMs = 500.0;
 
 template<uint32_t N> struct Data32 {
 	uint32_t data[N];
@@ -32,8 +41,8 @@ template<uint32_t N> struct Data32 {
 
 using DIReservoirData = Data32<12 + 4>;
 using GIReservoirData = Data32<8 + 4>;
-using GRISReservoirData = Data32<24 + 4>;
-using GRISReconnectionData = Data32</*12*/ 1>;
+using GRISReservoirData = Data32<20 + 4>;
+using GRISReconnectionData = Data32<12>;
 
 void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
 	// Log::bracketLine<0>("Resize to " + std::to_string(width) + "x" + std::to_string(height));
@@ -108,7 +117,7 @@ void Renderer::initVulkan() {
 		mContext = std::make_unique<zvk::Context>(mInstance.get(), DeviceExtensions, featureChain);
 		mSwapchain = std::make_unique<zvk::Swapchain>(mContext.get(), mWidth, mHeight, SWAPCHAIN_FORMAT, false);
 
-		mShaderManager = std::make_unique<zvk::ShaderManager>(mContext->device);
+		mShaderManager = std::make_unique<zvk::ShaderManager>(mContext->device, ShaderSourceDir, "cache/shaders");
 		mGUIManager = std::make_unique<GUIManager>(mContext.get(), mMainWindow, mSwapchain->numImages());
 
 		createCameraBuffer();
@@ -132,10 +141,21 @@ void Renderer::initVulkan() {
 		mResampledDIPass = std::make_unique<TestReSTIR>(mContext.get());
 		mResampledGIPass = std::make_unique<RayTracing>(mContext.get());
 		mGRISPass = std::make_unique<GRISReSTIR>(mContext.get());
+		mLightPresampler = std::make_unique<LightPresampler>(mContext.get());
+		mReGIRPass = std::make_unique<ReGIRPass>(mContext.get());
 		mVisualizeASPass = std::make_unique<zvk::ComputePipeline>(mContext.get());
 		mPostProcessPass = std::make_unique<PostProcessFrag>(mContext.get(), mSwapchain.get());
 
-		mScene.clear();
+		// Dynamic lights are edited on the host every frame, so light data has to outlive the upload
+		if (mScene.dynamicLights) {
+			for (const auto& light : mScene.triangleLights) {
+				mBaseLightRadiance.push_back(light.radiance);
+			}
+			mScene.resource.destroy();
+		}
+		else {
+			mScene.clear();
+		}
 
 		Log::newLine();
 
@@ -164,14 +184,85 @@ void Renderer::createPipeline() {
 		mRayImageDescLayout->layout,
 		mDeviceScene->rayTracingDescLayout->layout,
 	};
-	mGBufferPass->createPipeline(mSwapchain->extent(), mShaderManager.get(), descLayouts);
-	mNaiveDIPass->createPipeline(mShaderManager.get(), "shaders/di_naive.comp.spv", "shaders/di_naive.rgen.spv", descLayouts);
-	mNaiveGIPass->createPipeline(mShaderManager.get(), "shaders/gi_naive.comp.spv", "shaders/gi_naive.rgen.spv", descLayouts);
-	mResampledDIPass->createPipeline(mShaderManager.get(), descLayouts);
-	mResampledGIPass->createPipeline(mShaderManager.get(), "shaders/gi_resample_temporal.comp.spv", "shaders/gi_resample_temporal.rgen.spv", descLayouts);
-	mGRISPass->createPipeline(mShaderManager.get(), descLayouts);
-	mVisualizeASPass->createPipeline(mShaderManager.get(), "shaders/as_visualize.comp.spv", descLayouts);
-	mPostProcessPass->createPipeline(mShaderManager.get(), mSwapchain->extent(), descLayouts);
+	Timer timer;
+	bool warm = mContext->pipelineCache->warm();
+
+	addPipeline("GBuffer", [=, this]() { mGBufferPass->createPipeline(mSwapchain->extent(), mShaderManager.get(), descLayouts); });
+	addPipeline("Naive DI", [=, this]() { mNaiveDIPass->createPipeline(mShaderManager.get(), "shaders/di_naive.comp.spv", "shaders/di_naive.rgen.spv", descLayouts); });
+	addPipeline("Naive GI", [=, this]() { mNaiveGIPass->createPipeline(mShaderManager.get(), "shaders/gi_naive.comp.spv", "shaders/gi_naive.rgen.spv", descLayouts); });
+	addPipeline("ReSTIR DI", [=, this]() { mResampledDIPass->createPipeline(mShaderManager.get(), descLayouts); });
+	addPipeline("ReSTIR GI", [=, this]() { mResampledGIPass->createPipeline(mShaderManager.get(), "shaders/gi_resample_temporal.comp.spv", "shaders/gi_resample_temporal.rgen.spv", descLayouts); });
+	addPipeline("ReSTIR PT", [=, this]() { mGRISPass->createPipeline(mShaderManager.get(), descLayouts); });
+	addPipeline("Light Presampler", [=, this]() { mLightPresampler->createPipeline(mShaderManager.get(), descLayouts); });
+	addPipeline("ReGIR", [=, this]() { mReGIRPass->createPipeline(mShaderManager.get(), descLayouts); });
+	addPipeline("Visualize AS", [=, this]() { mVisualizeASPass->createPipeline(mShaderManager.get(), "shaders/as_visualize.comp.spv", descLayouts); });
+	addPipeline("Post Process", [=, this]() { mPostProcessPass->createPipeline(mShaderManager.get(), mSwapchain->extent(), descLayouts); });
+
+	// Cold and warm times compare startup without and with the on-disk pipeline cache
+	Log::line<0>(std::format("Pipelines created in {:.2f} ms, pipeline cache {}", timer.get(), warm ? "warm" : "cold"));
+
+	// Saved right away rather than only at exit, so a crash later in the session still leaves it warm
+	mContext->pipelineCache->save();
+}
+
+void Renderer::addPipeline(const std::string& name, const std::function<void()>& create) {
+	mShaderManager->beginRecording();
+	create();
+	mPipelineBuilds.push_back({ name, mShaderManager->endRecording(), create });
+}
+
+void Renderer::reloadShaders() {
+	auto changed = mShaderManager->changedShaders();
+
+	if (changed.empty()) {
+		return;
+	}
+	mContext->device.waitIdle();
+
+	std::set<File::path> reloaded, failed;
+	mShaderErrors.clear();
+
+	for (const auto& path : changed) {
+		try {
+			mShaderManager->reloadShaderModule(path);
+			reloaded.insert(path);
+		}
+		catch (const std::exception& e) {
+			failed.insert(path);
+			mShaderErrors += std::string(e.what()) + "\n";
+			Log::line<0>(e.what());
+		}
+	}
+
+	// Only passes using a reloaded shader are rebuilt, with their other stages coming from the module
+	//   and pipeline caches. Descriptors and reservoirs stay as they are
+	for (auto& build : mPipelineBuilds) {
+		auto uses = [&](const std::set<File::path>& paths) {
+			return std::any_of(build.shaders.begin(), build.shaders.end(), [&](const File::path& path) { return paths.contains(path); });
+		};
+		if (uses(failed)) {
+			Log::line<0>("Shader reload: keeping previous " + build.name + " pipeline");
+			continue;
+		}
+		if (!uses(reloaded)) {
+			continue;
+		}
+		Timer timer;
+
+		try {
+			mShaderManager->beginRecording();
+			build.create();
+			build.shaders = mShaderManager->endRecording();
+			Log::line<0>(std::format("Shader reload: rebuilt {} pipeline in {:.2f} ms", build.name, timer.get()));
+		}
+		catch (const std::exception& e) {
+			mShaderManager->endRecording();
+			mShaderErrors += build.name + ": " + e.what() + "\n";
+			Log::line<0>(build.name + ": " + e.what());
+		}
+	}
+	mContext->pipelineCache->save();
+	mCamera.update();
 }
 
 void Renderer::initScene() {
@@ -361,12 +452,44 @@ void Renderer::memorySyncHostAndDevice() {
 	mPrevCamera = mCamera;
 	mCamera.nextFrame(mRng);
 
+	mLightPresampler->updateTimings();
+
+	if (mScene.dynamicLights) {
+		animateLights();
+	}
+
 	if (mWriteScreenshot) {
 		writeScreenshot();
 		mWriteScreenshot = false;
 	}
 }
 
+void Renderer::animateLights() {
+	mLightUpdate = LightUpdate();
+
+	if (!mDynamicLightSettings.animate || mBaseLightRadiance.empty()) {
+		return;
+	}
+	Timer timer;
+	uint32_t numLights = static_cast<uint32_t>(mBaseLightRadiance.size());
+	uint32_t count = std::min(static_cast<uint32_t>(mDynamicLightSettings.lightsPerFrame), numLights);
+	float time = static_cast<float>(mRenderTimer.get() * 1e-3);
+
+	// Walk through lights in a window so that a frame touches a bounded number of table blocks
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t id = (mAnimatedLightCursor + i) % numLights;
+		float scale = .5f + .5f * std::sin(time + id * .618f);
+		mScene.setLightRadiance(id, mBaseLightRadiance[id] * scale);
+	}
+	mAnimatedLightCursor = (mAnimatedLightCursor + count) % numLights;
+
+	mLightUpdate = mScene.commitLightUpdates();
+	mLightUpdateMs = timer.get();
+
+	// Light changes invalidate accumulated samples
+	mCamera.update();
+}
+
 void Renderer::recreateFrame() {
 	int width, height;
 	glfwGetFramebufferSize(mMainWindow, &width, &height);
@@ -438,6 +561,16 @@ void Renderer::recordRenderCommand(vk::CommandBuffer cmd, uint32_t imageIdx) {
 	};
 
 	cmd.begin(beginInfo); {
+		zvk::DebugUtils::cmdBeginLabel(cmd, "Virtual Texture Streaming", { .3f, .3f, .3f, 1.f }); {
+			mDeviceScene->virtualTexture->update(cmd);
+			zvk::DebugUtils::cmdEndLabel(cmd);
+		}
+
+		zvk::DebugUtils::cmdBeginLabel(cmd, "Light Update", { .9f, .9f, .5f, 1.f }); {
+			mDeviceScene->updateLights(cmd, mScene, mLightUpdate);
+			zvk::DebugUtils::cmdEndLabel(cmd);
+		}
+
 		zvk::DebugUtils::cmdBeginLabel(cmd, std::format("G-buffer Pass[{}, {}]", mInFlightFrameIdx, curFrame), { 1.f, .5f, .3f, 1.f }); {
 			mGBufferPass->render(cmd, mSwapchain->extent(), mInFlightFrameIdx, curFrame, GBufferParam);
 			zvk::DebugUtils::cmdEndLabel(cmd);
@@ -450,6 +583,22 @@ void Renderer::recordRenderCommand(vk::CommandBuffer cmd, uint32_t imageIdx) {
 			vk::DependencyFlags{ 0 }, GBufferMemoryBarrier, {}, {}
 		);
 
+		// Only ReSTIR DI and ReSTIR PT draw their light candidates through the id-returning sampleLight
+		bool usePresampledLights =
+			mSettings.directMethod == RayTracingMethod::ResampledDI ||
+			mSettings.indirectMethod == RayTracingMethod::ResampledPT;
+
+		zvk::DebugUtils::cmdBeginLabel(cmd, "Light Presampling", { .9f, .8f, .3f, 1.f }); {
+			mLightPresampler->execute(cmd, usePresampledLights, mDeviceScene.get(), rayTracingBindings);
+			zvk::DebugUtils::cmdEndLabel(cmd);
+		}
+
+		zvk::DebugUtils::cmdBeginLabel(cmd, "ReGIR Grid Fill", { .9f, .6f, .3f, 1.f }); {
+			mReGIRPass->execute(cmd, mSettings.indirectMethod != RayTracingMethod::None, mDeviceScene.get(), rayTracingBindings);
+			zvk::DebugUtils::cmdEndLabel(cmd);
+		}
+		mLightPresampler->beginLighting(cmd);
+
 		zvk::DebugUtils::cmdBeginLabel(cmd, "Direct Lighting", { .5f, .3f, 1.f, 1.f }); {
 			if (mSettings.directMethod == RayTracingMethod::Naive) {
 				mNaiveDIPass->execute(cmd, mSwapchain->extent(), rayTracingBindings);
@@ -475,6 +624,7 @@ void Renderer::recordRenderCommand(vk::CommandBuffer cmd, uint32_t imageIdx) {
 			}
 			zvk::DebugUtils::cmdEndLabel(cmd);
 		}
+		mLightPresampler->endLighting(cmd);
 
 		auto rayImageMemoryBarrier = vk::MemoryBarrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
 
@@ -498,6 +648,7 @@ void Renderer::recordRenderCommand(vk::CommandBuffer cmd, uint32_t imageIdx) {
 			mGUIManager->render(cmd, mPostProcessPass->framebuffers[imageIdx], mSwapchain->extent());
 			zvk::DebugUtils::cmdEndLabel(cmd);
 		}
+		mDeviceScene->virtualTexture->finishFrame(cmd);
 	}
 	cmd.end();
 }
@@ -623,6 +774,35 @@ void Renderer::processGUI() {
 			}
 			ImGui::Separator();
 
+			if (mSettings.directMethod == RayTracingMethod::ResampledDI || mSettings.indirectMethod == RayTracingMethod::ResampledPT) {
+				mLightPresampler->GUI(resetFrame, clearReservoir);
+				ImGui::Separator();
+			}
+
+			if (mSettings.indirectMethod != RayTracingMethod::None) {
+				mReGIRPass->GUI(resetFrame, clearReservoir);
+				ImGui::Separator();
+			}
+
+			if (mScene.dynamicLights) {
+				ImGui::Checkbox("Animate Lights", &mDynamicLightSettings.animate);
+				ImGui::SameLine();
+				ImGui::SliderInt("Lights / Frame", &mDynamicLightSettings.lightsPerFrame, 1, 1 << 16);
+
+				size_t uploadBytes = 0;
+
+				for (auto [begin, end] : mLightUpdate.lightRanges) {
+					uploadBytes += (end - begin) * sizeof(PackedTriangleLight);
+				}
+				for (auto [begin, end] : mLightUpdate.tableRanges) {
+					uploadBytes += (end - begin) * sizeof(LightSampleTable::DistribT);
+				}
+				uploadBytes += mLightUpdate.bvhNodes.size() * sizeof(LightBVHNode);
+
+				ImGui::Text("Updated %u lights, host %.3f ms, upload %zu KB", mLightUpdate.numLights, mLightUpdateMs, uploadBytes >> 10);
+				ImGui::Separator();
+			}
+
 			ImGui::Checkbox("Accumulate", &mSettings.accumulate);
 
 			const char* toneMappingMethods[] = { "None", "Filmic", "ACES" };
@@ -651,6 +831,11 @@ void Renderer::processGUI() {
 
 		ImGui::EndMainMenuBar();
 	}
+	if (!mShaderErrors.empty()) {
+		ImGui::Begin("Shader Reload");
+		ImGui::TextUnformatted(mShaderErrors.c_str());
+		ImGui::End();
+	}
 	if (resetFrame || !mSettings.accumulate) {
 		mCamera.update();
 
@@ -824,6 +1009,8 @@ void Renderer::cleanupVulkan() {
 	mResampledDIPass.reset();
 	mResampledGIPass.reset();
 	mGRISPass.reset();
+	mLightPresampler.reset();
+	mReGIRPass.reset();
 	mVisualizeASPass.reset();
 	mPostProcessPass.reset();
 
@@ -872,6 +1059,10 @@ void Renderer::exec() {
 		else {
 			frameCount = 0;
 		}
+		if (mShaderWatchTimer.get() > ShaderWatchIntervalMs) {
+			reloadShaders();
+			mShaderWatchTimer.reset();
+		}
 		loop();
 
 		if (FPSTime > 1000.0) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
 #include <iostream>
 #include <optional>
 #include <limits>
@@ -16,6 +17,8 @@
 #include "RayTracing.h"
 #include "TestReSTIR.h"
 #include "GRISReSTIR.h"
+#include "LightPresampler.h"
+#include "ReGIRPass.h"
 #include "PostProcessFrag.h"
 
 class Renderer {
@@ -35,6 +38,11 @@ public:
 		float frameLimit = 0;
 	};
 
+	struct DynamicLightSettings {
+		bool animate = false;
+		int lightsPerFrame = 4096;
+	};
+
 	Renderer(const std::string& name, int width, int height, const std::string& sceneFile) :
 		mName(name), mWidth(width), mHeight(height), mSceneFile(sceneFile) {}
 
@@ -47,6 +55,9 @@ private:
 	void initVulkan();
 
 	void createPipeline();
+	// Creates a pipeline and records its shaders, to rebuild it when any of them is reloaded
+	void addPipeline(const std::string& name, const std::function<void()>& create);
+	void reloadShaders();
 
 	void initScene();
 	void createCameraBuffer();
@@ -57,6 +68,7 @@ private:
 	void initDescriptor();
 	void updateDescriptor();
 	void memorySyncHostAndDevice();
+	void animateLights();
 	void recreateFrame();
 
 	void createCommandBuffer();
@@ -90,6 +102,7 @@ private:
 	uint32_t mCurFrame[NumFramesInFlight] = { 0 };
 
 	Settings mSettings;
+	DynamicLightSettings mDynamicLightSettings;
 
 	std::unique_ptr<GUIManager> mGUIManager;
 
@@ -101,6 +114,15 @@ private:
 	std::unique_ptr<zvk::ShaderManager> mShaderManager;
 	std::unique_ptr<zvk::Swapchain> mSwapchain;
 
+	struct PipelineBuild {
+		std::string name;
+		std::set<File::path> shaders;
+		std::function<void()> create;
+	};
+	std::vector<PipelineBuild> mPipelineBuilds;
+	Timer mShaderWatchTimer;
+	std::string mShaderErrors;
+
 	vk::Pipeline mPipeline;
 	vk::PipelineLayout mPipelineLayout;
 
@@ -115,6 +137,11 @@ private:
 	Camera mCamera;
 	Camera mPrevCamera;
 	std::unique_ptr<DeviceScene> mDeviceScene;
+	// Only used when the scene enables dynamic lights
+	std::vector<glm::vec3> mBaseLightRadiance;
+	uint32_t mAnimatedLightCursor = 0;
+	LightUpdate mLightUpdate;
+	double mLightUpdateMs = 0;
 	std::unique_ptr<zvk::Buffer> mCameraBuffer[NumFramesInFlight];
 
 	std::unique_ptr<zvk::Image> mDirectOutput[NumFramesInFlight];
@@ -133,6 +160,8 @@ private:
 	std::unique_ptr<TestReSTIR> mResampledDIPass;
 	std::unique_ptr<RayTracing> mResampledGIPass;
 	std::unique_ptr<GRISReSTIR> mGRISPass;
+	std::unique_ptr<LightPresampler> mLightPresampler;
+	std::unique_ptr<ReGIRPass> mReGIRPass;
 	std::unique_ptr<zvk::ComputePipeline> mVisualizeASPass;
 	std::unique_ptr<PostProcessFrag> mPostProcessPass;
 
@@ -33,6 +33,27 @@ std::optional<uint32_t> Resource::addImage(const File::path& path, zvk::HostImag
 	return mImagePool.size() - 1;
 }
 
+zvk::HostImage* Resource::getEmissionImageByIndex(uint32_t index) const {
+	Log::check(index < mEmissionImagePool.size(), "Emission image index out of bound");
+	return mEmissionImagePool[index];
+}
+
+std::optional<uint32_t> Resource::addEmissionImage(const File::path& path) {
+	auto res = mMapPathToEmissionImageIndex.find(path);
+
+	if (res != mMapPathToEmissionImageIndex.end()) {
+		return res->second;
+	}
+	auto img = zvk::HostImage::createFromFile(path, zvk::HostImageType::Int8, zvk::HostImageFilter::Nearest, 4);
+
+	if (!img) {
+		return std::nullopt;
+	}
+	mMapPathToEmissionImageIndex[path] = static_cast<uint32_t>(mEmissionImagePool.size());
+	mEmissionImagePool.push_back(img);
+	return mEmissionImagePool.size() - 1;
+}
+
 Resource::Resource() {
 	Material emptyMat;
 	emptyMat.baseColor = glm::vec3(1.f, 0.f, 1.f);
@@ -125,9 +146,18 @@ ModelInstance* Resource::createNewModelInstance(const File::path& path, bool isL
 		return nullptr;
 	}
 
+	std::vector<MeshInstance> emissions(scene->mNumMaterials);
+
+	if (!isLight) {
+		for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
+			loadMaterialEmission(scene->mMaterials[i], path, emissions[i]);
+		}
+	}
+
 	std::stack<aiNode*> stack;
 	stack.push(scene->mRootNode);
 	model->mMeshOffset = static_cast<uint32_t>(meshInstances[isLight].size());
+	model->mEmissiveMeshOffset = static_cast<uint32_t>(meshInstances[MeshType::Light].size());
 
 	while (!stack.empty()) {
 		auto node = stack.top();
@@ -135,15 +165,33 @@ ModelInstance* Resource::createNewModelInstance(const File::path& path, bool isL
 
 		for (uint32_t i = 0; i < node->mNumMeshes; i++) {
 			auto mesh = scene->mMeshes[node->mMeshes[i]];
+
+			// Emissive meshes of objects are moved to light meshes so that they are importance sampled
+			if (!isLight && mesh->mMaterialIndex < emissions.size() && isEmissive(emissions[mesh->mMaterialIndex])) {
+				auto meshInstance = createNewMeshInstance(mesh, scene, true);
+				meshInstance.emission = emissions[mesh->mMaterialIndex].emission;
+				meshInstance.emissionTextureIdx = emissions[mesh->mMaterialIndex].emissionTextureIdx;
+				meshInstances[MeshType::Light].push_back(meshInstance);
+				model->mNumEmissiveMeshes++;
+				continue;
+			}
 			auto meshInstance = createNewMeshInstance(mesh, scene, isLight);
 			model->mNumIndices += meshInstance.indexCount;
 			model->mNumVertices += meshInstance.vertexCount;
 			meshInstances[isLight].push_back(meshInstance);
+			model->mNumMeshes++;
 		}
 		for (uint32_t i = 0; i < node->mNumChildren; i++) {
 			stack.push(node->mChildren[i]);
 		}
-		model->mNumMeshes += node->mNumMeshes;
+	}
+
+	if (model->mNumMeshes == 0) {
+		// Fully emissive objects keep an empty mesh so that their index range stays addressable
+		MeshInstance emptyMesh;
+		emptyMesh.indexOffset = static_cast<uint32_t>(indices[isLight].size());
+		emptyMesh.vertexOffset = static_cast<uint32_t>(vertices[isLight].size());
+		meshInstances[isLight].push_back(emptyMesh);
 	}
 
 	if (!isLight) {
@@ -178,9 +226,47 @@ ModelInstance* Resource::createNewModelInstance(const File::path& path, bool isL
 	}
 	Log::line<2>(std::to_string(scene->mNumMaterials) + " material(s)");
 	Log::line<2>(std::to_string(model->numMeshes()) + " mesh(es)");
+
+	if (model->numEmissiveMeshes() > 0) {
+		Log::line<2>(std::to_string(model->numEmissiveMeshes()) + " emissive mesh(es)");
+	}
 	return model;
 }
 
+void Resource::loadMaterialEmission(aiMaterial* aiMat, const File::path& modelPath, MeshInstance& emission) {
+	aiColor3D color(0.f, 0.f, 0.f);
+	aiMat->Get(AI_MATKEY_COLOR_EMISSIVE, color);
+	emission.emission = glm::vec3(color.r, color.g, color.b);
+
+	if (aiMat->GetTextureCount(aiTextureType_EMISSIVE) == 0) {
+		return;
+	}
+	aiString str;
+	aiMat->GetTexture(aiTextureType_EMISSIVE, 0, &str);
+	File::path imagePath(str.C_Str());
+
+	if (!imagePath.is_absolute()) {
+		imagePath = modelPath.parent_path() / imagePath;
+	}
+	auto imageIdx = addEmissionImage(imagePath);
+
+	if (!imageIdx) {
+		Log::line<2>("Emission texture " + imagePath.generic_string() + " failed to load");
+		return;
+	}
+	Log::line<2>("Emission texture " + imagePath.generic_string());
+	emission.emissionTextureIdx = *imageIdx;
+
+	// Formats without an emissive factor leave it black when only a map is given
+	if (emission.emission == glm::vec3(0.f)) {
+		emission.emission = glm::vec3(1.f);
+	}
+}
+
+bool Resource::isEmissive(const MeshInstance& mesh) {
+	return glm::max(mesh.emission.r, glm::max(mesh.emission.g, mesh.emission.b)) > 0.f;
+}
+
 ModelInstance* Resource::getModelInstanceByPath(const File::path& path, bool isLight) {
 	return nullptr;
 	auto res = mMapPathToUniqueModelInstance[isLight].find(path);
@@ -208,6 +294,12 @@ void Resource::clearDeviceMeshAndImage() {
 	}
 	mImagePool.clear();
 	mMapPathToImageIndex.clear();
+
+	for (auto image : mEmissionImagePool) {
+		delete image;
+	}
+	mEmissionImagePool.clear();
+	mMapPathToEmissionImageIndex.clear();
 	mMapPathToUniqueModelInstance[MeshType::Object].clear();
 	mMapPathToUniqueModelInstance[MeshType::Light].clear();
 }
@@ -35,6 +35,10 @@ public:
 	std::vector<zvk::HostImage*>& imagePool() { return mImagePool; }
 	const std::vector<zvk::HostImage*>& imagePool() const { return mImagePool; }
 
+	// Emission textures are only read on the host to integrate light power, never uploaded
+	zvk::HostImage* getEmissionImageByIndex(uint32_t index) const;
+	std::optional<uint32_t> addEmissionImage(const File::path& path);
+
 	ModelInstance* openModelInstance(
 		const File::path& path, bool isLight,
 		glm::vec3 pos, glm::vec3 scale = glm::vec3(1.0f), glm::vec3 rotation = glm::vec3(0.0f));
@@ -46,6 +50,8 @@ private:
 	ModelInstance* getModelInstanceByPath(const File::path& path, bool isLight);
 	ModelInstance* createNewModelInstance(const File::path& path, bool isLight);
 	MeshInstance createNewMeshInstance(aiMesh* mesh, const aiScene* scene, bool isLight);
+	void loadMaterialEmission(aiMaterial* aiMat, const File::path& modelPath, MeshInstance& emission);
+	static bool isEmissive(const MeshInstance& mesh);
 
 public:
 	std::vector<MeshVertex> vertices[MeshTypeCount];
@@ -59,5 +65,7 @@ public:
 private:
 	std::vector<zvk::HostImage*> mImagePool;
 	std::map<File::path, uint32_t> mMapPathToImageIndex;
+	std::vector<zvk::HostImage*> mEmissionImagePool;
+	std::map<File::path, uint32_t> mMapPathToEmissionImageIndex;
 	std::map<File::path, ModelInstance*> mMapPathToUniqueModelInstance[MeshTypeCount];
 };
\ No newline at end of file
@@ -1,10 +1,17 @@
 #include "Scene.h"
+#include "LightExtraction.h"
 #include "util/Error.h"
+#include "util/Timer.h"
+#include "util/Packing.h"
 #include "shader/HostDevice.h"
 
+#include <cstring>
+#include <format>
+#include <random>
 #include <sstream>
 #include <thread>
 #include <pugixml.hpp>
+#include <glm/gtc/constants.hpp>
 
 inline float luminance(const glm::vec3& color) {
 	return glm::dot(color, glm::vec3(0.299, 0.587, 0.114));
@@ -126,6 +133,16 @@ void Scene::clear() {
 	resource.destroy();
 	objectInstances.clear();
 	triangleLights.clear();
+	packedTriangleLights.clear();
+	sourceTriangleLights.clear();
+
+	delete environmentMap;
+	environmentMap = nullptr;
+	environmentSampleTable.clear();
+	lightBVH.clear();
+	lightSampleTable.clear();
+	mPendingLights.clear();
+	mLightPending.clear();
 }
 
 void Scene::loadXML(pugi::xml_node sceneNode) {
@@ -136,6 +153,9 @@ void Scene::loadXML(pugi::xml_node sceneNode) {
 	loadSampler(sceneNode.child("sampler"));
 	loadCamera(sceneNode.child("camera"));
 	loadModels(sceneNode.child("modelInstances"));
+	loadEnvironmentMap(sceneNode.child("envMap"));
+	loadVirtualTexture(sceneNode.child("virtualTexture"));
+	loadDynamicLights(sceneNode.child("dynamicLights"));
 }
 
 void Scene::loadIntegrator(pugi::xml_node integratorNode) {
@@ -201,6 +221,9 @@ void Scene::loadModels(pugi::xml_node modelNode) {
 		if (glm::length(instanceAndPower.second) > 0) {
 			lightTriangleCount += instanceAndPower.first->numIndices() / 3;
 		}
+		else {
+			lightTriangleCount += numEmissiveTriangles(instanceAndPower.first);
+		}
 		totalTriangleCount += instanceAndPower.first->numIndices() / 3;
 	}
 	triangleLights.resize(lightTriangleCount);
@@ -220,47 +243,35 @@ void Scene::loadModels(pugi::xml_node modelNode) {
 			uint32_t indexCount = modelInstance->numIndices();
 			uint32_t triangleCount = indexCount / 3;
 
-			auto transform = [&](const glm::vec3& pos) {
-				return glm::vec3(modelInstance->modelMatrix() * glm::vec4(pos, 1.f));
-			};
+			const auto& vertices = resource.vertices[Resource::Light];
+			const auto& indices = resource.indices[Resource::Light];
 
-			uint32_t maxThreads = std::min(triangleCount, std::thread::hardware_concurrency());
+			uint32_t maxThreads = std::max(std::min(triangleCount, std::thread::hardware_concurrency()), 1u);
 			std::vector<float> sumAreas(maxThreads, 0.f);
 
 			auto fillLightTriangle = [&](uint32_t begin, uint32_t end, uint32_t id) {
-				for (uint32_t i = begin; i < end; i++) {
-					TriangleLight tri{};
+				transformTriangleLights(
+					transform, vertices.data(), indices.data() + indexOffset + begin * 3,
+					end - begin, triangleLights.data() + lightTriangleOffset + begin
+				);
 
-					uint32_t i0 = resource.indices[Resource::Light][indexOffset + i * 3 + 0];
-					uint32_t i1 = resource.indices[Resource::Light][indexOffset + i * 3 + 1];
-					uint32_t i2 = resource.indices[Resource::Light][indexOffset + i * 3 + 2];
-
-					tri.v0 = transform(resource.vertices[Resource::Light][i0].pos);
-					tri.v1 = transform(resource.vertices[Resource::Light][i1].pos);
-					tri.v2 = transform(resource.vertices[Resource::Light][i2].pos);
-
-					glm::vec3 n = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
-					tri.area = .5f * glm::length(n);
-					n = glm::normalize(n);
+				for (uint32_t i = begin; i < end; i++) {
+					auto& tri = triangleLights[lightTriangleOffset + i];
 
 					if (modelInstance->flipNormal()) {
-						n = -n;
+						tri.nx = -tri.nx;
+						tri.ny = -tri.ny;
+						tri.nz = -tri.nz;
 					}
-
-					tri.nx = n.x;
-					tri.ny = n.y;
-					tri.nz = n.z;
-
 					sumAreas[id] += tri.area;
-					triangleLights[lightTriangleOffset + i] = tri;
 				}
 			};
 
 			std::vector<std::thread> threads(maxThreads);
 
 			for (uint32_t i = 0; i < maxThreads; i++) {
-				uint32_t begin = i * (triangleCount / maxThreads);
-				uint32_t end = std::min((i + 1) * (triangleCount / maxThreads), triangleCount);
+				uint32_t begin = i * triangleCount / maxThreads;
+				uint32_t end = (i + 1) * triangleCount / maxThreads;
 				threads[i] = std::thread(fillLightTriangle, begin, end, i);
 			}
 			for (auto& thread : threads) {
@@ -279,8 +290,8 @@ void Scene::loadModels(pugi::xml_node modelNode) {
 			};
 
 			for (uint32_t i = 0; i < maxThreads; i++) {
-				uint32_t begin = i * (triangleCount / maxThreads);
-				uint32_t end = std::min((i + 1) * (triangleCount / maxThreads), triangleCount);
+				uint32_t begin = i * triangleCount / maxThreads;
+				uint32_t end = (i + 1) * triangleCount / maxThreads;
 				threads[i] = std::thread(divideArea, begin, end);
 			}
 			for (auto& thread : threads) {
@@ -290,6 +301,14 @@ void Scene::loadModels(pugi::xml_node modelNode) {
 			lightTriangleOffset += triangleCount;
 		}
 		else {
+			uint32_t indexOffset = resource.meshInstances[Resource::Object][modelInstance->meshOffset()].indexOffset;
+
+			for (uint32_t i = 0; i < modelInstance->numIndices(); i++) {
+				uint32_t vertexIdx = resource.indices[Resource::Object][indexOffset + i];
+				glm::vec3 pos = glm::vec3(transform * glm::vec4(resource.vertices[Resource::Object][vertexIdx].pos, 1.f));
+				boundMin = glm::min(boundMin, pos);
+				boundMax = glm::max(boundMax, pos);
+			}
 			objectInstances.push_back(ObjectInstance{
 				.transform = transform,
 				.transformInv = transformInv,
@@ -298,15 +317,230 @@ void Scene::loadModels(pugi::xml_node modelNode) {
 				.indexOffset = resource.meshInstances[Resource::Object][modelInstance->meshOffset()].indexOffset,
 				.indexCount = modelInstance->mNumIndices
 			});
+
+			if (modelInstance->numEmissiveMeshes() > 0) {
+				fillEmissiveTriangles(modelInstance, lightTriangleOffset);
+				lightTriangleOffset += numEmissiveTriangles(modelInstance);
+			}
 		}
 	}
 }
 
+uint32_t Scene::numEmissiveTriangles(const ModelInstance* modelInstance) const {
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < modelInstance->numEmissiveMeshes(); i++) {
+		count += resource.meshInstances[Resource::Light][modelInstance->emissiveMeshOffset() + i].indexCount / 3;
+	}
+	return count;
+}
+
+void Scene::fillEmissiveTriangles(const ModelInstance* modelInstance, uint32_t lightOffset) {
+	Timer timer;
+	glm::mat4 transform = modelInstance->modelMatrix();
+	glm::mat3 transformInvT = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+	const auto& vertices = resource.vertices[Resource::Light];
+	const auto& indices = resource.indices[Resource::Light];
+
+	for (uint32_t m = 0; m < modelInstance->numEmissiveMeshes(); m++) {
+		const auto& mesh = resource.meshInstances[Resource::Light][modelInstance->emissiveMeshOffset() + m];
+		uint32_t triangleCount = mesh.indexCount / 3;
+
+		const zvk::HostImage* image = (mesh.emissionTextureIdx != InvalidResourceIdx) ?
+			resource.getEmissionImageByIndex(mesh.emissionTextureIdx) : nullptr;
+
+		// Each triangle emits the average of its texture footprint, so that the light's constant radiance
+		//   carries the same power as the textured surface
+		auto fillTriangle = [&](uint32_t begin, uint32_t end) {
+			transformTriangleLights(
+				transform, vertices.data(), indices.data() + mesh.indexOffset + begin * 3,
+				end - begin, triangleLights.data() + lightOffset + begin
+			);
+
+			for (uint32_t i = begin; i < end; i++) {
+				const auto& a = vertices[indices[mesh.indexOffset + i * 3 + 0]];
+				const auto& b = vertices[indices[mesh.indexOffset + i * 3 + 1]];
+				const auto& c = vertices[indices[mesh.indexOffset + i * 3 + 2]];
+
+				TriangleLight& tri = triangleLights[lightOffset + i];
+				glm::vec3 n = (tri.area > 0.f) ? glm::vec3(tri.nx, tri.ny, tri.nz) : glm::vec3(0.f, 0.f, 1.f);
+
+				// Emit on the side the shading normals face, winding is not reliable for objects
+				if (glm::dot(n, transformInvT * (a.norm + b.norm + c.norm)) < 0.f) {
+					n = -n;
+				}
+				if (modelInstance->flipNormal()) {
+					n = -n;
+				}
+				tri.nx = n.x;
+				tri.ny = n.y;
+				tri.nz = n.z;
+				tri.radiance = mesh.emission;
+
+				if (image) {
+					tri.radiance *= integrateTriangleTexture(
+						image->data<uint8_t>(), image->width, image->height,
+						glm::vec2(a.uvx, a.uvy), glm::vec2(b.uvx, b.uvy), glm::vec2(c.uvx, c.uvy)
+					);
+				}
+			}
+		};
+
+		uint32_t maxThreads = std::max(std::min(triangleCount, std::thread::hardware_concurrency()), 1u);
+		std::vector<std::thread> threads(maxThreads);
+
+		for (uint32_t i = 0; i < maxThreads; i++) {
+			uint32_t begin = i * triangleCount / maxThreads;
+			uint32_t end = (i + 1) * triangleCount / maxThreads;
+			threads[i] = std::thread(fillTriangle, begin, end);
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		lightOffset += triangleCount;
+	}
+	Log::line<2>("Emissive triangles = " + std::to_string(numEmissiveTriangles(modelInstance)) +
+		", integration time = " + std::to_string(timer.get()) + " ms");
+}
+
 void Scene::loadEnvironmentMap(pugi::xml_node envMapNode) {
-	//envMap = EnvironmentMap::create(scene.child("envMap").attribute("path").as_string());
+	if (!envMapNode) {
+		return;
+	}
+	auto envMapPath = path.parent_path() / envMapNode.attribute("path").as_string();
+	environmentMap = zvk::HostImage::createFromFile(envMapPath, zvk::HostImageType::Float32, zvk::HostImageFilter::Linear, 4);
+
+	if (!environmentMap) {
+		Log::line<1>("Environment map " + envMapPath.generic_string() + " failed to load");
+		return;
+	}
+	Timer timer;
+	uint32_t width = environmentMap->width;
+	uint32_t height = environmentMap->height;
+	const float* texels = environmentMap->data<float>();
+
+	// Equirectangular texels cover a solid angle proportional to sin(theta)
+	std::vector<float> distrib(size_t(width) * height);
+	uint32_t maxThreads = std::min(height, std::thread::hardware_concurrency());
+
+	auto fillRows = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			float sinTheta = glm::sin(glm::pi<float>() * (static_cast<float>(i) + .5f) / static_cast<float>(height));
+
+			for (uint32_t j = 0; j < width; j++) {
+				const float* texel = texels + (size_t(i) * width + j) * 4;
+				distrib[size_t(i) * width + j] = luminance(glm::vec3(texel[0], texel[1], texel[2])) * sinTheta;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads(maxThreads);
+
+	for (uint32_t i = 0; i < maxThreads; i++) {
+		uint32_t begin = i * height / maxThreads;
+		uint32_t end = (i + 1) * height / maxThreads;
+		threads[i] = std::thread(fillRows, begin, end);
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	environmentSampleTable.build(distrib.data(), width, height);
+
+	Log::line<1>("Environment map " + envMapPath.generic_string());
+	Log::line<2>("Size = " + std::to_string(width) + "x" + std::to_string(height));
+	Log::line<2>("Sum = " + std::to_string(environmentSampleTable.sumAll));
+	Log::line<2>("Build time = " + std::to_string(timer.get()) + " ms");
+}
+
+void Scene::loadVirtualTexture(pugi::xml_node virtualTextureNode) {
+	if (!virtualTextureNode) {
+		return;
+	}
+	auto& settings = virtualTextureSettings;
+
+	settings.enable = virtualTextureNode.attribute("enable").as_bool(true);
+	settings.minSize = virtualTextureNode.attribute("minSize").as_uint(settings.minSize);
+	settings.budget = virtualTextureNode.attribute("budget").as_uint(settings.budget);
+	settings.maxUploadsPerFrame = virtualTextureNode.attribute("maxUploadsPerFrame").as_uint(settings.maxUploadsPerFrame);
+
+	Log::line<1>("Virtual texture " + std::string(settings.enable ? "enabled" : "disabled"));
+	Log::line<2>("Min size = " + std::to_string(settings.minSize));
+	Log::line<2>("Budget = " + std::to_string(settings.budget) + " tiles");
+}
+
+void Scene::loadDynamicLights(pugi::xml_node dynamicLightsNode) {
+	if (!dynamicLightsNode) {
+		return;
+	}
+	dynamicLights = dynamicLightsNode.attribute("enable").as_bool(true);
+	Log::line<1>("Dynamic lights " + std::string(dynamicLights ? "enabled" : "disabled"));
+}
+
+void Scene::setLightRadiance(uint32_t lightId, const glm::vec3& radiance) {
+	packedTriangleLights[lightId].radiance = util::packRGB9E5(radiance);
+	triangleLights[lightId].radiance = util::unpackRGB9E5(packedTriangleLights[lightId].radiance);
+
+	if (!mLightPending[lightId]) {
+		mLightPending[lightId] = true;
+		mPendingLights.push_back(lightId);
+	}
+}
+
+LightUpdate Scene::commitLightUpdates() {
+	LightUpdate update;
+
+	if (mPendingLights.empty()) {
+		return update;
+	}
+	std::sort(mPendingLights.begin(), mPendingLights.end());
+	std::vector<std::pair<uint32_t, float>> powers;
+
+	for (uint32_t id : mPendingLights) {
+		float power = luminance(triangleLights[id].radiance * triangleLights[id].area);
+		lightSampleTable.update(id, power);
+		powers.push_back({ id, power });
+		mLightPending[id] = false;
+
+		if (!update.lightRanges.empty() && update.lightRanges.back().second == id) {
+			update.lightRanges.back().second++;
+		}
+		else {
+			update.lightRanges.push_back({ id, id + 1 });
+		}
+	}
+	update.tableRanges = lightSampleTable.commit();
+	update.bvhNodes = lightBVH.updatePower(powers);
+	update.numLights = static_cast<uint32_t>(mPendingLights.size());
+
+	mPendingLights.clear();
+	return update;
 }
 
 void Scene::buildLightDataStructure() {
+	if (!triangleLights.empty()) {
+		Log::line<1>("Light Encoding");
+		Timer timer;
+
+		if (keepSourceLights) {
+			sourceTriangleLights = triangleLights;
+		}
+		// Traced and sampled light geometry are both the decoded corners, snapping makes them lossless
+		auto quantization = quantizeTriangleLights(triangleLights);
+		packedTriangleLights.resize(triangleLights.size());
+
+		for (uint32_t i = 0; i < triangleLights.size(); i++) {
+			packedTriangleLights[i] = packTriangleLight(triangleLights[i]);
+			triangleLights[i] = unpackTriangleLight(packedTriangleLights[i]);
+		}
+		Log::line<2>("Vertices = " + std::to_string(quantization.numVertices) +
+			", max snap error = " + std::to_string(quantization.maxSnapError) +
+			", lossy lights = " + std::to_string(quantization.numLossyLights));
+		Log::line<2>("Size = " + std::to_string(zvk::sizeOf(packedTriangleLights) >> 10) + " KB, " +
+			std::to_string(zvk::sizeOf(triangleLights) >> 10) + " KB unpacked");
+		Log::line<2>("Encode time = " + std::to_string(timer.get()) + " ms");
+	}
+
 	Log::line<1>("Light Sample Table");
 	std::vector<float> powerDistrib(triangleLights.size());
 
@@ -315,10 +549,140 @@ void Scene::buildLightDataStructure() {
 	for (uint32_t i = 0; i < triangleLights.size(); i++) {
 		powerDistrib[i] = luminance(triangleLights[i].radiance * triangleLights[i].area);
 	}
+	Timer timer;
 	lightSampleTable.build(powerDistrib);
+	mLightPending.assign(triangleLights.size(), false);
+
+	Log::line<2>("Sum = " + std::to_string(lightSampleTable.sum()));
+	Log::line<2>("Num = " + std::to_string(lightSampleTable.size()) + ", blocks = " + std::to_string(lightSampleTable.numBlocks));
+	Log::line<2>("Build time = " + std::to_string(timer.get()) + " ms");
+
+	// Lights emit on the side their normal points to, SAMPLE_LIGHT_DOUBLE_SIDE is not supported by the BVH
+	std::vector<LightBounds> lightBounds(triangleLights.size());
+
+	for (uint32_t i = 0; i < triangleLights.size(); i++) {
+		const auto& light = triangleLights[i];
+		glm::vec3 norm(light.nx, light.ny, light.nz);
+
+		lightBounds[i].boundMin = glm::min(light.v0, glm::min(light.v1, light.v2));
+		lightBounds[i].boundMax = glm::max(light.v0, glm::max(light.v1, light.v2));
+		lightBounds[i].power = powerDistrib[i];
+		lightBounds[i].cosThetaE = 0.f;
+
+		if (light.area > 0.f) {
+			lightBounds[i].cone = { norm, 1.f, false };
+		}
+	}
+	Log::line<1>("Light BVH");
+	timer.reset();
+	lightBVH.build(lightBounds);
+
+	Log::line<2>("Nodes = " + std::to_string(lightBVH.nodes.size()) + ", depth = " + std::to_string(lightBVH.depth()));
+	Log::line<2>("Build time = " + std::to_string(timer.get()) + " ms");
+
+	for (const auto& light : triangleLights) {
+		boundMin = glm::min(boundMin, glm::min(light.v0, glm::min(light.v1, light.v2)));
+		boundMax = glm::max(boundMax, glm::max(light.v0, glm::max(light.v1, light.v2)));
+	}
+	if (glm::any(glm::greaterThan(boundMin, boundMax))) {
+		boundMin = boundMax = glm::vec3(0.f);
+	}
+	regirGrid = ReGIRGrid(boundMin, boundMax);
+
+	Log::line<1>("ReGIR");
+	Log::line<2>("Cell size = " + std::to_string(regirGrid.cellSize().x) + ", " +
+		std::to_string(regirGrid.cellSize().y) + ", " + std::to_string(regirGrid.cellSize().z));
+}
+
+bool LightUpdateValidation::passed() const {
+	return numTableMismatches == 0 && numDirtyMisses == 0 && maxNodePowerError < 1e-3f;
+}
+
+LightUpdateValidation validateLightUpdates(Scene& scene, uint32_t numBatches, uint32_t seed) {
+	LightUpdateValidation result;
+	uint32_t numLights = static_cast<uint32_t>(scene.triangleLights.size());
+
+	if (numLights == 0) {
+		return result;
+	}
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	auto inRanges = [](const std::vector<LightUpdate::Range>& ranges, uint32_t idx) {
+		return std::any_of(ranges.begin(), ranges.end(), [idx](const LightUpdate::Range& range) {
+			return idx >= range.first && idx < range.second;
+		});
+	};
+
+	for (uint32_t batch = 0; batch < numBatches; batch++) {
+		auto prevLights = scene.packedTriangleLights;
+		auto prevTable = scene.lightSampleTable.table;
+		auto prevNodes = scene.lightBVH.nodes;
+
+		// Log-uniform batch sizes, lights may repeat within a batch
+		uint32_t batchSize = std::max(static_cast<uint32_t>(std::pow(static_cast<float>(numLights), uniform(rng))), 1u);
+
+		for (uint32_t i = 0; i < batchSize; i++) {
+			uint32_t id = std::min(static_cast<uint32_t>(uniform(rng) * numLights), numLights - 1);
+
+			// Some lights are switched off so that whole blocks and subtrees can lose their power
+			glm::vec3 radiance(0.f);
+
+			if (uniform(rng) > .1f) {
+				radiance = glm::vec3(uniform(rng), uniform(rng), uniform(rng)) * 16.f;
+			}
+			scene.setLightRadiance(id, radiance);
+		}
+		auto update = scene.commitLightUpdates();
+		result.numLights += update.numLights;
+
+		for (uint32_t i = 0; i < numLights; i++) {
+			bool changed = std::memcmp(&prevLights[i], &scene.packedTriangleLights[i], sizeof(PackedTriangleLight)) != 0;
+			result.numDirtyMisses += changed && !inRanges(update.lightRanges, i);
+		}
+
+		std::vector<float> powers(numLights);
+
+		for (uint32_t i = 0; i < numLights; i++) {
+			powers[i] = luminance(scene.triangleLights[i].radiance * scene.triangleLights[i].area);
+		}
+		LightSampleTable reference(powers);
+		const auto& table = scene.lightSampleTable.table;
+
+		for (uint32_t i = 0; i < table.size(); i++) {
+			result.numTableMismatches += (table[i].prob != reference.table[i].prob || table[i].failId != reference.table[i].failId);
+
+			bool changed = (table[i].prob != prevTable[i].prob || table[i].failId != prevTable[i].failId);
+			result.numDirtyMisses += changed && !inRanges(update.tableRanges, i);
+		}
+
+		// Children are stored after their parents, so a reverse sweep sums subtrees bottom up
+		const auto& nodes = scene.lightBVH.nodes;
+		std::vector<double> nodePowers(nodes.size(), 0.0);
+
+		for (uint32_t i = static_cast<uint32_t>(nodes.size()); i-- > 0; ) {
+			const auto& node = nodes[i];
+
+			if (node.numLights == 0) {
+				nodePowers[i] = nodePowers[i + 1] + nodePowers[node.secondChild];
+			}
+			for (uint32_t j = node.lightOffset; j < node.lightOffset + node.numLights; j++) {
+				nodePowers[i] += powers[scene.lightBVH.lightIndices[j]];
+			}
+		}
+
+		for (uint32_t i = 0; i < nodes.size(); i++) {
+			float error = (nodePowers[i] > 0.0) ?
+				static_cast<float>(std::abs(nodes[i].power - nodePowers[i]) / nodePowers[i]) :
+				(nodes[i].power != 0.f ? FLT_MAX : 0.f);
+			result.maxNodePowerError = std::max(result.maxNodePowerError, error);
 
-	Log::line<2>("Sum = " + std::to_string(lightSampleTable.binomDistribs[0].prob));
-	Log::line<2>("Num = " + std::to_string(lightSampleTable.binomDistribs[0].failId));
+			bool changed = nodes[i].power != prevNodes[i].power;
+			result.numDirtyMisses += changed && !std::binary_search(update.bvhNodes.begin(), update.bvhNodes.end(), i);
+		}
+		result.numBatches++;
+	}
+	return result;
 }
 
 DeviceScene::DeviceScene(const zvk::Context* ctx, const Scene& scene, zvk::QueueIdx queueIdx) :
@@ -348,6 +712,52 @@ void DeviceScene::destroy() {
 	*/
 }
 
+void DeviceScene::updateLights(vk::CommandBuffer cmd, const Scene& scene, const LightUpdate& update) {
+	if (update.empty() || !mLightStagingBuffer) {
+		return;
+	}
+	auto staging = static_cast<uint8_t*>(mLightStagingBuffer->data);
+	vk::DeviceSize stagingOffset = 0;
+
+	auto stage = [&](std::vector<vk::BufferCopy>& copies, const void* src, size_t elementSize, uint32_t begin, uint32_t end) {
+		size_t size = elementSize * (end - begin);
+		memcpy(staging + stagingOffset, static_cast<const uint8_t*>(src) + elementSize * begin, size);
+		copies.push_back(vk::BufferCopy(stagingOffset, elementSize * begin, size));
+		stagingOffset += size;
+	};
+
+	std::vector<vk::BufferCopy> lightCopies;
+	std::vector<vk::BufferCopy> tableCopies;
+	std::vector<vk::BufferCopy> nodeCopies;
+
+	for (auto [begin, end] : update.lightRanges) {
+		stage(lightCopies, scene.packedTriangleLights.data(), sizeof(PackedTriangleLight), begin, end);
+	}
+	for (auto [begin, end] : update.tableRanges) {
+		stage(tableCopies, scene.lightSampleTable.table.data(), sizeof(LightSampleTable::DistribT), begin, end);
+	}
+	for (uint32_t node : update.bvhNodes) {
+		stage(nodeCopies, scene.lightBVH.nodes.data(), sizeof(LightBVHNode), node, node + 1);
+	}
+
+	auto beforeCopy = vk::MemoryBarrier(vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eTransferWrite);
+	auto afterCopy = vk::MemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+	auto shaderStages = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eRayTracingShaderKHR;
+
+	cmd.pipelineBarrier(shaderStages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags{ 0 }, beforeCopy, {}, {});
+
+	if (!lightCopies.empty()) {
+		cmd.copyBuffer(mLightStagingBuffer->buffer, triangleLights->buffer, lightCopies);
+	}
+	if (!tableCopies.empty()) {
+		cmd.copyBuffer(mLightStagingBuffer->buffer, lightSampleTable->buffer, tableCopies);
+	}
+	if (!nodeCopies.empty()) {
+		cmd.copyBuffer(mLightStagingBuffer->buffer, lightBVHNodes->buffer, nodeCopies);
+	}
+	cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, shaderStages, vk::DependencyFlags{ 0 }, afterCopy, {}, {});
+}
+
 void DeviceScene::initDescriptor() {
 	zvk::DescriptorWrite update(mCtx);
 
@@ -359,6 +769,17 @@ void DeviceScene::initDescriptor() {
 	update.add(resourceDescLayout.get(), resourceDescSet, 5, zvk::Descriptor::makeBuffer(instances.get()));
 	update.add(resourceDescLayout.get(), resourceDescSet, 6, zvk::Descriptor::makeBuffer(triangleLights.get()));
 	update.add(resourceDescLayout.get(), resourceDescSet, 7, zvk::Descriptor::makeBuffer(lightSampleTable.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 8, zvk::Descriptor::makeImage(virtualTexture->atlas.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 9, zvk::Descriptor::makeBuffer(virtualTexture->infos.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 10, zvk::Descriptor::makeBuffer(virtualTexture->pageTable.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 11, zvk::Descriptor::makeBuffer(virtualTexture->feedback.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 12, zvk::Descriptor::makeImage(environmentMap.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 13, zvk::Descriptor::makeBuffer(environmentSampleTable.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 14, zvk::Descriptor::makeBuffer(lightBVHNodes.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 15, zvk::Descriptor::makeBuffer(lightBVHLightIndices.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 16, zvk::Descriptor::makeBuffer(lightBVHTrails.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 17, zvk::Descriptor::makeBuffer(lightTiles.get()));
+	update.add(resourceDescLayout.get(), resourceDescSet, 18, zvk::Descriptor::makeBuffer(regirReservoirs.get()));
 
 	update.add(rayTracingDescLayout.get(), rayTracingDescSet, 0, vk::WriteDescriptorSetAccelerationStructureKHR(topAccelStructure->structure));
 
@@ -410,23 +831,132 @@ void DeviceScene::createBufferAndImages(const Scene& scene, zvk::QueueIdx queueI
 	);
 	zvk::DebugUtils::nameVkObject(mCtx->device, instances->buffer, "instances");
 
+	// Scenes lit only by an environment map have no triangle lights, keep the buffer non-empty
+	PackedTriangleLight placeholderLight{};
+
+	// Light data is a transfer destination so that dynamic lights can patch dirty ranges
 	triangleLights = zvk::Memory::createBufferFromHost(
-		mCtx, queueIdx, scene.triangleLights.data(), zvk::sizeOf(scene.triangleLights),
-		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
-			vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+		mCtx, queueIdx, numTriangleLights ? scene.packedTriangleLights.data() : &placeholderLight,
+		std::max(zvk::sizeOf(scene.packedTriangleLights), sizeof(PackedTriangleLight)),
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
 		vk::MemoryAllocateFlagBits::eDeviceAddress
 	);
 	zvk::DebugUtils::nameVkObject(mCtx->device, triangleLights->buffer, "triangleLights");
 
 	lightSampleTable = zvk::Memory::createBufferFromHost(
-		mCtx, queueIdx, scene.lightSampleTable.binomDistribs.data(), zvk::sizeOf(scene.lightSampleTable.binomDistribs),
-		vk::BufferUsageFlagBits::eStorageBuffer,
+		mCtx, queueIdx, scene.lightSampleTable.table.data(), zvk::sizeOf(scene.lightSampleTable.table),
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
 		vk::MemoryAllocateFlagBits::eDeviceAddress
 	);
 	zvk::DebugUtils::nameVkObject(mCtx->device, lightSampleTable->buffer, "lightSampleTable");
 
+	// Without triangle lights a single zero node is bound, it is never traversed as sumPower is zero
+	const auto& lightBVH = scene.lightBVH;
+	LightBVHNode placeholderNode{};
+	uint32_t placeholderIndex = 0;
+
+	lightBVHNodes = zvk::Memory::createBufferFromHost(
+		mCtx, queueIdx, lightBVH.empty() ? &placeholderNode : lightBVH.nodes.data(),
+		std::max(zvk::sizeOf(lightBVH.nodes), sizeof(LightBVHNode)),
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::MemoryAllocateFlagBits::eDeviceAddress
+	);
+	zvk::DebugUtils::nameVkObject(mCtx->device, lightBVHNodes->buffer, "lightBVHNodes");
+
+	lightBVHLightIndices = zvk::Memory::createBufferFromHost(
+		mCtx, queueIdx, lightBVH.empty() ? &placeholderIndex : lightBVH.lightIndices.data(),
+		std::max(zvk::sizeOf(lightBVH.lightIndices), sizeof(uint32_t)),
+		vk::BufferUsageFlagBits::eStorageBuffer,
+		vk::MemoryAllocateFlagBits::eDeviceAddress
+	);
+	zvk::DebugUtils::nameVkObject(mCtx->device, lightBVHLightIndices->buffer, "lightBVHLightIndices");
+
+	lightBVHTrails = zvk::Memory::createBufferFromHost(
+		mCtx, queueIdx, lightBVH.empty() ? &placeholderIndex : lightBVH.bitTrails.data(),
+		std::max(zvk::sizeOf(lightBVH.bitTrails), sizeof(uint32_t)),
+		vk::BufferUsageFlagBits::eStorageBuffer,
+		vk::MemoryAllocateFlagBits::eDeviceAddress
+	);
+	zvk::DebugUtils::nameVkObject(mCtx->device, lightBVHTrails->buffer, "lightBVHTrails");
+
+	if (scene.dynamicLights) {
+		// Large enough for an update touching every light, so it never has to grow
+		mLightStagingBuffer = zvk::Memory::createBuffer(
+			mCtx, triangleLights->size + lightSampleTable->size + lightBVHNodes->size,
+			vk::BufferUsageFlagBits::eTransferSrc,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+		);
+		mLightStagingBuffer->mapMemory();
+	}
+
+	// Filled on device by LightPresampler, a zero header keeps sampleLight on the alias table until then
+	lightTiles = zvk::Memory::createBuffer(
+		mCtx, sizeof(glm::uvec4) + sizeof(PresampledLight) * LightPresampleNumTiles * LightPresampleTileSize,
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::MemoryPropertyFlagBits::eDeviceLocal
+	);
+	zvk::DebugUtils::nameVkObject(mCtx->device, lightTiles->buffer, "lightTiles");
+
+	// Same for ReGIR, the header is written by ReGIRPass and cleared while the grid is unused
+	regirGrid = scene.regirGrid;
+	regirReservoirs = zvk::Memory::createBuffer(
+		mCtx, sizeof(glm::vec4) * 2 + sizeof(ReGIRReservoir) * ReGIRGrid::numCells() * ReGIRReservoirsPerCell,
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::MemoryPropertyFlagBits::eDeviceLocal
+	);
+	zvk::DebugUtils::nameVkObject(mCtx->device, regirReservoirs->buffer, "regirReservoirs");
+	{
+		auto cmd = zvk::Command::createOneTimeSubmit(mCtx, queueIdx);
+		cmd->cmd.fillBuffer(lightTiles->buffer, 0, sizeof(glm::uvec4), 0);
+		cmd->cmd.fillBuffer(regirReservoirs->buffer, 0, sizeof(glm::vec4) * 2, 0);
+		cmd->submitAndWait();
+	}
+
+	// Without an environment map a black texel and an empty table (sumAll = 0) are bound instead
+	auto envMap = scene.environmentMap;
+	auto envSampleTable = scene.environmentSampleTable.table;
+
+	if (!envMap) {
+		envMap = zvk::HostImage::createEmpty(1, 1, zvk::HostImageType::Float32, zvk::HostImageFilter::Nearest, 4);
+		memset(envMap->data(), 0, envMap->byteSize());
+		envSampleTable = { { 0.f, 1 }, { 0.f, 1 } };
+	}
+
+	environmentMap = zvk::Memory::createTexture2D(
+		mCtx, queueIdx, envMap,
+		vk::ImageTiling::eOptimal,
+		vk::ImageLayout::eShaderReadOnlyOptimal,
+		vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		vk::MemoryPropertyFlagBits::eDeviceLocal
+	);
+	environmentMap->createSampler(vk::Filter::eLinear);
+	zvk::DebugUtils::nameVkObject(mCtx->device, environmentMap->image, "environmentMap");
+
+	environmentSampleTable = zvk::Memory::createBufferFromHost(
+		mCtx, queueIdx, envSampleTable.data(), zvk::sizeOf(envSampleTable),
+		vk::BufferUsageFlagBits::eStorageBuffer,
+		vk::MemoryAllocateFlagBits::eDeviceAddress
+	);
+	zvk::DebugUtils::nameVkObject(mCtx->device, environmentSampleTable->buffer, "environmentSampleTable");
+
+	if (envMap != scene.environmentMap) {
+		delete envMap;
+	}
+
 	auto images = scene.resource.imagePool();
 
+	virtualTexture = std::make_unique<DeviceVirtualTexture>(mCtx, queueIdx, scene.virtualTextureSettings, images);
+
+	// Virtual textures are streamed through the tile atlas, only keep a placeholder in the array
+	auto placeholder = zvk::HostImage::createEmpty(1, 1, zvk::HostImageType::Int8, zvk::HostImageFilter::Nearest, 4);
+	memset(placeholder->data(), 0xff, placeholder->byteSize());
+
+	for (uint32_t i = 0; i < images.size(); i++) {
+		if (virtualTexture->isVirtual(i)) {
+			images[i] = placeholder;
+		}
+	}
+
 	// Load one extra texture to ensure the array is not empty
 	auto extImage = zvk::HostImage::createFromFile("res/texture.jpg", zvk::HostImageType::Int8, zvk::HostImageFilter::Nearest, 4);
 	images.push_back(extImage);
@@ -443,59 +973,47 @@ void DeviceScene::createBufferAndImages(const Scene& scene, zvk::QueueIdx queueI
 		textures.push_back(std::move(image));
 	}
 	delete extImage;
+	delete placeholder;
 }
 
 void DeviceScene::createAccelerationStructure(const Scene& scene, zvk::QueueIdx queueIdx) {
 	Log::line<0>("Creating acceleration structures");
 
-	std::unique_ptr<zvk::Buffer> lightIndicesBuf;
+	std::unique_ptr<zvk::Buffer> lightPositionsBuf;
 	std::vector<vk::AccelerationStructureInstanceKHR> instances;
 
-	if (/* build light AS */ true) {
-		std::vector<uint32_t> lightIndices(numTriangleLights * 3);
+	// All BLASes are built together, object BLASes are indexed from 1 with slot 0 for the light BLAS
+	zvk::AccelerationStructureBuilder builder(mCtx);
+
+	if (numTriangleLights > 0) {
+		// Shading data stays in packed triangleLights, the BLAS only reads a non-indexed stream of decoded positions
+		std::vector<glm::vec3> lightPositions(numTriangleLights * 3);
 
 		for (uint32_t i = 0; i < numTriangleLights; i++) {
-			lightIndices[3 * i + 0] = 4 * i + 0;
-			lightIndices[3 * i + 1] = 4 * i + 1;
-			lightIndices[3 * i + 2] = 4 * i + 2;
+			lightPositions[3 * i + 0] = scene.triangleLights[i].v0;
+			lightPositions[3 * i + 1] = scene.triangleLights[i].v1;
+			lightPositions[3 * i + 2] = scene.triangleLights[i].v2;
 		}
-		lightIndicesBuf = zvk::Memory::createBufferFromHost(
-			mCtx, queueIdx, lightIndices.data(), zvk::sizeOf(lightIndices),
-			vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
-				vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
-				vk::BufferUsageFlagBits::eShaderDeviceAddress,
+		lightPositionsBuf = zvk::Memory::createBufferFromHost(
+			mCtx, queueIdx, lightPositions.data(), zvk::sizeOf(lightPositions),
+			vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
 			vk::MemoryAllocateFlagBits::eDeviceAddress
 		);
 
 		zvk::AccelerationStructureTriangleMesh meshData {
-			.vertexAddress = triangleLights->address(),
-			.indexAddress = lightIndicesBuf->address(),
-			.vertexStride = sizeof(glm::vec4),
+			.vertexAddress = lightPositionsBuf->address(),
+			.indexAddress = 0,
+			.vertexStride = sizeof(glm::vec3),
 			.vertexFormat = vk::Format::eR32G32B32Sfloat,
-			.indexType = vk::IndexType::eUint32,
-			.maxVertex = numTriangleLights * 3,
+			.indexType = vk::IndexType::eNoneKHR,
+			.maxVertex = numTriangleLights * 3 - 1,
 			.numIndices = numTriangleLights * 3,
 			.indexOffset = 0
 		};
 
-		auto lightBLAS = std::make_unique<zvk::AccelerationStructure>(
-			mCtx, queueIdx, meshData, vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace
-		);
-		zvk::DebugUtils::nameVkObject(mCtx->device, lightBLAS->structure, "lightBLAS");
-		meshAccelStructures.push_back(std::move(lightBLAS));
-
-		vk::TransformMatrixKHR transform;
-		glm::mat4 matrix(1.f);
-		memcpy(&transform, &matrix, 12 * sizeof(float));
-
-		instances.push_back(
-			vk::AccelerationStructureInstanceKHR()
-				.setTransform(transform)
-				.setInstanceCustomIndex(0)
-				.setMask(0xff)
-				.setInstanceShaderBindingTableRecordOffset(0)
-				.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable)
-				.setAccelerationStructureReference(meshAccelStructures[0]->address)
+		builder.add(
+			meshData,
+			vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace | vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction
 		);
 	}
 
@@ -514,12 +1032,46 @@ void DeviceScene::createAccelerationStructure(const Scene& scene, zvk::QueueIdx
 			.numIndices = model->numIndices(),
 			.indexOffset = firstMesh.indexOffset
 		};
+		builder.add(meshData, vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+	}
+
+	meshAccelStructures = builder.build(queueIdx);
 
-		auto BLAS = std::make_unique<zvk::AccelerationStructure>(
-			mCtx, queueIdx, meshData, vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace
+	const auto& stats = builder.statistics();
+	Log::line<1>(std::format("BLAS: {} in {} batches built in {:.2f} ms, {} KB ({} KB before compaction), {} KB scratch",
+		stats.numStructures, stats.numBatches, stats.buildTimeMs,
+		stats.storageSize / 1024, stats.uncompactedSize / 1024, stats.scratchSize / 1024));
+
+	if (numTriangleLights == 0) {
+		meshAccelStructures.insert(meshAccelStructures.begin(), nullptr);
+	}
+	else {
+		const auto& lightBLAS = meshAccelStructures[0];
+
+		Log::line<1>(std::format("Light BLAS: {} triangles, {} KB (compacted from {} KB)",
+			numTriangleLights, lightBLAS->size / 1024, lightBLAS->uncompactedSize / 1024));
+		Log::line<1>(std::format("Light shading data: {} KB", triangleLights->size / 1024));
+
+		zvk::DebugUtils::nameVkObject(mCtx->device, lightBLAS->structure, "lightBLAS");
+
+		vk::TransformMatrixKHR transform;
+		glm::mat4 matrix(1.f);
+		memcpy(&transform, &matrix, 12 * sizeof(float));
+
+		instances.push_back(
+			vk::AccelerationStructureInstanceKHR()
+				.setTransform(transform)
+				.setInstanceCustomIndex(0)
+				.setMask(0xff)
+				.setInstanceShaderBindingTableRecordOffset(0)
+				.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable)
+				.setAccelerationStructureReference(meshAccelStructures[0]->address)
 		);
-		zvk::DebugUtils::nameVkObject(mCtx->device, BLAS->structure, "objectBLAS_" + model->name());
-		meshAccelStructures.push_back(std::move(BLAS));
+	}
+
+	for (uint32_t i = 0; i < scene.resource.uniqueModelInstances[Resource::Object].size(); i++) {
+		auto model = scene.resource.uniqueModelInstances[Resource::Object][i];
+		zvk::DebugUtils::nameVkObject(mCtx->device, meshAccelStructures[i + 1]->structure, "objectBLAS_" + model->name());
 	}
 
 	for (uint32_t i = 0; i < scene.resource.modelInstances[Resource::Object].size(); i++) {
@@ -576,6 +1128,39 @@ void DeviceScene::createDescriptor() {
 		zvk::Descriptor::makeBinding(
 			7, vk::DescriptorType::eStorageBuffer, rayTracingStageFlags
 		),
+		zvk::Descriptor::makeBinding(
+			8, vk::DescriptorType::eCombinedImageSampler, gbufferStageFlags | rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			9, vk::DescriptorType::eStorageBuffer, gbufferStageFlags | rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			10, vk::DescriptorType::eStorageBuffer, gbufferStageFlags | rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			11, vk::DescriptorType::eStorageBuffer, gbufferStageFlags | rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			12, vk::DescriptorType::eCombinedImageSampler, rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			13, vk::DescriptorType::eStorageBuffer, rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			14, vk::DescriptorType::eStorageBuffer, rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			15, vk::DescriptorType::eStorageBuffer, rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			16, vk::DescriptorType::eStorageBuffer, rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			17, vk::DescriptorType::eStorageBuffer, rayTracingStageFlags
+		),
+		zvk::Descriptor::makeBinding(
+			18, vk::DescriptorType::eStorageBuffer, rayTracingStageFlags
+		),
 	};
 
 	std::vector<vk::DescriptorSetLayoutBinding> accelStructBindings = {
@@ -11,6 +11,11 @@
 #include "Model.h"
 #include "Camera.h"
 #include "Resource.h"
+#include "DeviceVirtualTexture.h"
+#include "LightBVH.h"
+#include "ReGIR.h"
+#include "SphericalTriangle.h"
+#include "TriangleLight.h"
 
 struct ObjectInstance {
 	glm::mat4 transform;
@@ -26,21 +31,38 @@ struct ObjectInstance {
 	float pad2;
 };
 
-struct TriangleLight {
+// Mirrored by PresampledLight in layouts.glsl, only ever written on device by light_presample.comp
+struct PresampledLight {
 	glm::vec3 v0;
-	float nx;
+	float pmf;
 	glm::vec3 v1;
-	float ny;
+	uint32_t id;
 	glm::vec3 v2;
-	float nz;
-	glm::vec3 radiance;
-	float area;
+	uint32_t radiance;
+};
+
+/**
+* Dirty data of one batch of light power changes, in elements of the respective host arrays
+*/
+struct LightUpdate {
+	using Range = std::pair<uint32_t, uint32_t>;
+
+	std::vector<Range> lightRanges;
+	std::vector<Range> tableRanges;
+	std::vector<uint32_t> bvhNodes;
+	uint32_t numLights = 0;
+
+	bool empty() const { return numLights == 0; }
 };
 
 class Scene
 {
 public:
 	void load(const File::path& path);
+
+	// Dynamic lights only, radiance changes are batched until commitLightUpdates()
+	void setLightRadiance(uint32_t lightId, const glm::vec3& radiance);
+	LightUpdate commitLightUpdates();
 	void clear();
 
 private:
@@ -50,7 +72,11 @@ private:
 	void loadCamera(pugi::xml_node cameraNode);
 	void loadModels(pugi::xml_node modelNode);
 	void loadEnvironmentMap(pugi::xml_node envMapNode);
+	void loadVirtualTexture(pugi::xml_node virtualTextureNode);
+	void loadDynamicLights(pugi::xml_node dynamicLightsNode);
 
+	uint32_t numEmissiveTriangles(const ModelInstance* modelInstance) const;
+	void fillEmissiveTriangles(const ModelInstance* modelInstance, uint32_t lightOffset);
 	void buildLightDataStructure();
 
 	std::pair<ModelInstance*, glm::vec3> loadModelInstance(const pugi::xml_node& modelNode);
@@ -59,12 +85,51 @@ public:
 	Camera camera;
 	Resource resource;
 	std::vector<ObjectInstance> objectInstances;
+	// Decoded from packedTriangleLights so that host side light structures and light BLASes match what shaders see
 	std::vector<TriangleLight> triangleLights;
-	DiscreteSampler1D<float> lightSampleTable;
+	std::vector<PackedTriangleLight> packedTriangleLights;
+	// Lights as extracted, before quantization and packing. Only kept if keepSourceLights is set before load()
+	std::vector<TriangleLight> sourceTriangleLights;
+	bool keepSourceLights = false;
+	LightSampleTable lightSampleTable;
+	LightBVH lightBVH;
+	ReGIRGrid regirGrid;
+	glm::vec3 boundMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundMax = glm::vec3(-FLT_MAX);
+	zvk::HostImage* environmentMap = nullptr;
+	DiscreteSampler2D<float> environmentSampleTable;
+	VirtualTextureSettings virtualTextureSettings;
+	bool dynamicLights = false;
 	uint32_t numObjectInstances = 0;
 	File::path path;
+
+private:
+	std::vector<uint32_t> mPendingLights;
+	std::vector<bool> mLightPending;
 };
 
+struct LightUpdateValidation {
+	uint32_t numBatches = 0;
+	uint32_t numLights = 0;
+
+	// Sample table entries differing from a table built from scratch with the same powers
+	uint32_t numTableMismatches = 0;
+	// Changed lights, table entries or BVH nodes missing from LightUpdate, which would never reach the device
+	uint32_t numDirtyMisses = 0;
+	// Largest relative difference of BVH node powers from sums over the lights below them. The BVH
+	//   topology depends on light powers, so a rebuild can not be compared node by node
+	float maxNodePowerError = 0.f;
+
+	bool passed() const;
+};
+
+/**
+* Applies batches of random radiance changes, from single lights to about all of them, through
+*   setLightRadiance and commitLightUpdates and checks every batch against structures computed
+*   from scratch. Leaves the lights of the scene changed
+*/
+LightUpdateValidation validateLightUpdates(Scene& scene, uint32_t numBatches, uint32_t seed = 0);
+
 class DeviceScene : public zvk::BaseVkObject {
 public:
 	DeviceScene(const zvk::Context* ctx, const Scene& scene, zvk::QueueIdx queueIdx);
@@ -73,6 +138,9 @@ public:
 
 	void initDescriptor();
 
+	// Copies the dirty ranges of a light update through a staging buffer, dynamic light scenes only
+	void updateLights(vk::CommandBuffer cmd, const Scene& scene, const LightUpdate& update);
+
 private:
 	void createBufferAndImages(const Scene& scene, zvk::QueueIdx queueIdx);
 	void createAccelerationStructure(const Scene& scene, zvk::QueueIdx queueIdx);
@@ -86,7 +154,15 @@ public:
 	std::unique_ptr<zvk::Buffer> instances;
 	std::unique_ptr<zvk::Buffer> triangleLights;
 	std::unique_ptr<zvk::Buffer> lightSampleTable;
+	std::unique_ptr<zvk::Buffer> lightBVHNodes;
+	std::unique_ptr<zvk::Buffer> lightBVHLightIndices;
+	std::unique_ptr<zvk::Buffer> lightBVHTrails;
+	std::unique_ptr<zvk::Buffer> lightTiles;
+	std::unique_ptr<zvk::Buffer> regirReservoirs;
+	std::unique_ptr<zvk::Buffer> environmentSampleTable;
+	std::unique_ptr<zvk::Image> environmentMap;
 	std::vector<std::unique_ptr<zvk::Image>> textures;
+	std::unique_ptr<DeviceVirtualTexture> virtualTexture;
 
 	std::unique_ptr<zvk::AccelerationStructure> topAccelStructure;
 	std::vector<std::unique_ptr<zvk::AccelerationStructure>> meshAccelStructures;
@@ -96,6 +172,7 @@ public:
 	uint32_t numMaterials = 0;
 	uint32_t numTriangles = 0;
 	uint32_t numTriangleLights;
+	ReGIRGrid regirGrid;
 
 	std::unique_ptr<zvk::DescriptorSetLayout> resourceDescLayout;
 	std::unique_ptr<zvk::DescriptorSetLayout> rayTracingDescLayout;
@@ -104,4 +181,5 @@ public:
 
 private:
 	std::unique_ptr<zvk::DescriptorPool> mDescriptorPool;
+	std::unique_ptr<zvk::Buffer> mLightStagingBuffer;
 };
\ No newline at end of file
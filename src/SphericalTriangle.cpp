@@ -0,0 +1,203 @@
+#include "SphericalTriangle.h"
+#include "shader/HostDevice.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+constexpr float Pi = 3.14159265358979323846f;
+constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+
+static float angleBetween(const glm::vec3& a, const glm::vec3& b) {
+	if (glm::dot(a, b) < 0.f) {
+		return Pi - 2.f * std::asin(std::min(glm::length(a + b) * .5f, 1.f));
+	}
+	return 2.f * std::asin(std::min(glm::length(b - a) * .5f, 1.f));
+}
+
+static float lengthSquared(const glm::vec3& v) {
+	return glm::dot(v, v);
+}
+
+float sphericalTriangleArea(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+	glm::vec3 ab = glm::cross(a, b);
+	glm::vec3 bc = glm::cross(b, c);
+	glm::vec3 ca = glm::cross(c, a);
+
+	if (lengthSquared(ab) == 0.f || lengthSquared(bc) == 0.f || lengthSquared(ca) == 0.f) {
+		return 0.f;
+	}
+	ab = glm::normalize(ab);
+	bc = glm::normalize(bc);
+	ca = glm::normalize(ca);
+
+	float alpha = angleBetween(ab, -ca);
+	float beta = angleBetween(bc, -ab);
+	float gamma = angleBetween(ca, -bc);
+
+	return std::abs(alpha + beta + gamma - Pi);
+}
+
+float triangleSolidAngle(const glm::vec3& va, const glm::vec3& vb, const glm::vec3& vc, const glm::vec3& p) {
+	return sphericalTriangleArea(glm::normalize(va - p), glm::normalize(vb - p), glm::normalize(vc - p));
+}
+
+bool useSphericalTriangleSampling(float solidAngle) {
+	return solidAngle > SphericalTriangleMinSolidAngle && solidAngle < SphericalTriangleMaxSolidAngle;
+}
+
+glm::vec2 sampleSphericalTriangle(
+	const glm::vec3& va, const glm::vec3& vb, const glm::vec3& vc, const glm::vec3& p, float u0, float u1
+) {
+	glm::vec3 a = glm::normalize(va - p);
+	glm::vec3 b = glm::normalize(vb - p);
+	glm::vec3 c = glm::normalize(vc - p);
+
+	glm::vec3 nab = glm::cross(a, b);
+	glm::vec3 nbc = glm::cross(b, c);
+	glm::vec3 nca = glm::cross(c, a);
+
+	if (lengthSquared(nab) == 0.f || lengthSquared(nbc) == 0.f || lengthSquared(nca) == 0.f) {
+		return glm::vec2(1.f / 3.f);
+	}
+	nab = glm::normalize(nab);
+	nbc = glm::normalize(nbc);
+	nca = glm::normalize(nca);
+
+	float alpha = angleBetween(nab, -nca);
+	float beta = angleBetween(nbc, -nab);
+	float gamma = angleBetween(nca, -nbc);
+
+	// Pick the sub-triangle area, then the point of c' on arc ac that produces it
+	float areaPi = Pi + u0 * (alpha + beta + gamma - Pi);
+	float cosAlpha = std::cos(alpha);
+	float sinAlpha = std::sin(alpha);
+	float sinPhi = std::sin(areaPi) * cosAlpha - std::cos(areaPi) * sinAlpha;
+	float cosPhi = std::cos(areaPi) * cosAlpha + std::sin(areaPi) * sinAlpha;
+	float k1 = cosPhi + cosAlpha;
+	float k2 = sinPhi - sinAlpha * glm::dot(a, b);
+
+	float cosBp = std::clamp((k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) / ((k2 * sinPhi + k1 * cosPhi) * sinAlpha), -1.f, 1.f);
+	float sinBp = std::sqrt(std::max(1.f - cosBp * cosBp, 0.f));
+	glm::vec3 cp = cosBp * a + sinBp * glm::normalize(c - glm::dot(c, a) * a);
+
+	// Then the direction along arc bc'
+	float cosTheta = 1.f - u1 * (1.f - glm::dot(cp, b));
+	float sinTheta = std::sqrt(std::max(1.f - cosTheta * cosTheta, 0.f));
+	glm::vec3 perp = cp - glm::dot(cp, b) * b;
+	glm::vec3 w = (lengthSquared(perp) > 0.f) ? cosTheta * b + sinTheta * glm::normalize(perp) : b;
+
+	glm::vec3 e1 = vb - va;
+	glm::vec3 e2 = vc - va;
+	glm::vec3 s1 = glm::cross(w, e2);
+	float divisor = glm::dot(s1, e1);
+
+	if (divisor == 0.f) {
+		return glm::vec2(1.f / 3.f);
+	}
+	glm::vec3 s = p - va;
+	float b1 = std::clamp(glm::dot(s, s1) / divisor, 0.f, 1.f);
+	float b2 = std::clamp(glm::dot(w, glm::cross(s, e1)) / divisor, 0.f, 1.f);
+
+	if (b1 + b2 > 1.f) {
+		float sum = b1 + b2;
+		b1 /= sum;
+		b2 /= sum;
+	}
+	return glm::vec2(b1, b2);
+}
+
+SphericalTriangleValidation validateSphericalTriangleSampling(
+	const std::vector<TriangleLight>& lights, uint32_t numTriangles, uint32_t numSamples, uint32_t seed
+) {
+	SphericalTriangleValidation result;
+
+	if (lights.empty()) {
+		return result;
+	}
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(0.f, OneMinusEpsilon);
+
+	auto sampleSphere = [&]() {
+		float z = 1.f - 2.f * uniform(rng);
+		float r = std::sqrt(std::max(1.f - z * z, 0.f));
+		float phi = 2.f * Pi * uniform(rng);
+		return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+	};
+
+	// Give up on lights that never subtend a solid angle in range, e.g. degenerate ones
+	for (uint32_t attempt = 0; attempt < numTriangles * 16 && result.numTriangles < numTriangles; attempt++) {
+		const auto& light = lights[std::min(static_cast<size_t>(uniform(rng) * lights.size()), lights.size() - 1)];
+
+		if (light.area <= 0.f) {
+			continue;
+		}
+		glm::vec3 norm(light.nx, light.ny, light.nz);
+		glm::vec3 centroid = (light.v0 + light.v1 + light.v2) / 3.f;
+		float extent = std::max({ glm::length(light.v1 - light.v0), glm::length(light.v2 - light.v0), glm::length(light.v2 - light.v1) });
+
+		glm::vec3 dir = sampleSphere();
+
+		if (glm::dot(dir, norm) < 0.f) {
+			dir = -dir;
+		}
+		glm::vec3 p = centroid + dir * extent * (.25f + 2.f * uniform(rng));
+		float solidAngle = triangleSolidAngle(light.v0, light.v1, light.v2, p);
+
+		if (!useSphericalTriangleSampling(solidAngle)) {
+			continue;
+		}
+		glm::vec3 axis = sampleSphere();
+		auto integrand = [&](const glm::vec3& w) {
+			float t = 1.f + glm::dot(w, axis);
+			return t * t;
+		};
+
+		// Reference estimates from uniform area sampling, whose solid angle pdf is dist^2 / (cos * area)
+		double areaNormalization = 0.0;
+		double sphericalNormalization = 0.0;
+		double areaIntegral = 0.0;
+		double sphericalIntegral = 0.0;
+
+		for (uint32_t i = 0; i < numSamples; i++) {
+			float r = std::sqrt(uniform(rng));
+			float v = uniform(rng);
+			glm::vec3 pos = light.v0 * (1.f - r) + light.v1 * (r * (1.f - v)) + light.v2 * (r * v);
+			glm::vec3 d = pos - p;
+			float dist2 = glm::dot(d, d);
+			glm::vec3 w = d / std::sqrt(dist2);
+			float invPdf = std::abs(glm::dot(norm, w)) * light.area / dist2;
+
+			areaNormalization += invPdf / solidAngle;
+			areaIntegral += integrand(w) * invPdf;
+
+			glm::vec2 bary = sampleSphericalTriangle(light.v0, light.v1, light.v2, p, uniform(rng), uniform(rng));
+			glm::vec3 spherePos = light.v0 * (1.f - bary.x - bary.y) + light.v1 * bary.x + light.v2 * bary.y;
+			glm::vec3 sphereD = spherePos - p;
+			float sphereDist2 = glm::dot(sphereD, sphereD);
+			glm::vec3 sphereDir = sphereD / std::sqrt(sphereDist2);
+			float sphereCos = std::abs(glm::dot(norm, sphereDir));
+
+			if (sphereCos > 0.f) {
+				sphericalNormalization += solidAngle * sphereDist2 / (sphereCos * light.area);
+			}
+			sphericalIntegral += integrand(sphereDir) * solidAngle;
+		}
+		areaNormalization /= numSamples;
+		sphericalNormalization /= numSamples;
+		areaIntegral /= numSamples;
+		sphericalIntegral /= numSamples;
+
+		result.maxNormalizationError = std::max(result.maxNormalizationError, static_cast<float>(std::abs(areaNormalization - 1.0)));
+		result.maxSampledNormalizationError = std::max(
+			result.maxSampledNormalizationError, static_cast<float>(std::abs(sphericalNormalization - 1.0))
+		);
+
+		if (areaIntegral > 0.0) {
+			float error = static_cast<float>(std::abs(sphericalIntegral - areaIntegral) / areaIntegral);
+			result.maxIntegralError = std::max(result.maxIntegralError, error);
+		}
+		result.numTriangles++;
+	}
+	return result;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "TriangleLight.h"
+
+/**
+* CPU version of the solid angle triangle sampling in math.glsl and light_sampling.glsl
+*/
+float sphericalTriangleArea(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+float triangleSolidAngle(const glm::vec3& va, const glm::vec3& vb, const glm::vec3& vc, const glm::vec3& p);
+bool useSphericalTriangleSampling(float solidAngle);
+
+// Returns barycentrics of vb and vc for the point on the triangle in the sampled direction
+glm::vec2 sampleSphericalTriangle(
+	const glm::vec3& va, const glm::vec3& vb, const glm::vec3& vc, const glm::vec3& p, float u0, float u1
+);
+
+struct SphericalTriangleValidation {
+	// |E[1 / pdf] / solid angle - 1| under uniform area sampling, checks triangleSolidAngle
+	float maxNormalizationError = 0.f;
+	// |E[1 / area pdf] / area - 1| over sampleSphericalTriangle samples, with the area pdf implied by a
+	//   solid angle pdf of 1 / solid angle. Checks the samples are uniform in solid angle
+	float maxSampledNormalizationError = 0.f;
+	// Relative difference of a smooth integrand estimated with solid angle samples and with area samples
+	float maxIntegralError = 0.f;
+	uint32_t numTriangles = 0;
+};
+
+/**
+* Monte Carlo check of sampleSphericalTriangle against uniform area sampling, with reference
+*   points placed so that the lights subtend angles in the range sampled by solid angle
+*/
+SphericalTriangleValidation validateSphericalTriangleSampling(
+	const std::vector<TriangleLight>& lights, uint32_t numTriangles, uint32_t numSamples, uint32_t seed = 0
+);
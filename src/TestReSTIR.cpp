@@ -36,10 +36,6 @@ void TestReSTIR::render(vk::CommandBuffer cmd, vk::Extent2D extent, const zvk::D
 }
 
 void TestReSTIR::createPipeline(zvk::ShaderManager* shaderManager, const std::vector<vk::DescriptorSetLayout>& descLayouts) {
-    mPathTracePass = std::make_unique<RayTracing>(mCtx);
-    mSpatialReusePass = std::make_unique<RayTracing>(mCtx);
-    mTemporalReusePass = std::make_unique<RayTracing>(mCtx);
-
     mPathTracePass->createPipeline(shaderManager, "shaders/di_path_gen.comp.spv", "shaders/di_path_gen.rgen.spv", descLayouts, sizeof(Settings));
     mTemporalReusePass->createPipeline(shaderManager, "shaders/di_temporal.comp.spv", "shaders/di_temporal.rgen.spv", descLayouts, sizeof(Settings));
     mSpatialReusePass->createPipeline(shaderManager, "shaders/di_spatial.comp.spv", "shaders/di_spatial.rgen.spv", descLayouts, sizeof(Settings));
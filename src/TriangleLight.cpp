@@ -0,0 +1,286 @@
+#include "TriangleLight.h"
+#include "util/Packing.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <unordered_map>
+
+// Larger edges would overflow to infinity, such lights are clamped
+constexpr float MaxHalf = 65504.f;
+
+constexpr int64_t MaxFootprintTexels = 1 << 18;
+constexpr uint32_t FootprintStrata = 16;
+
+PackedTriangleLight packTriangleLight(const TriangleLight& light) {
+	glm::vec3 edge1 = glm::clamp(light.v1 - light.v0, glm::vec3(-MaxHalf), glm::vec3(MaxHalf));
+	glm::vec3 edge2 = glm::clamp(light.v2 - light.v0, glm::vec3(-MaxHalf), glm::vec3(MaxHalf));
+
+	PackedTriangleLight packed;
+	packed.v0 = light.v0;
+	packed.normal = util::encodeOctahedral(glm::vec3(light.nx, light.ny, light.nz));
+	packed.edges[0] = util::packHalf2x16(edge1.x, edge1.y);
+	packed.edges[1] = util::packHalf2x16(edge1.z, edge2.x);
+	packed.edges[2] = util::packHalf2x16(edge2.y, edge2.z);
+	packed.radiance = util::packRGB9E5(light.radiance);
+	return packed;
+}
+
+TriangleLight unpackTriangleLight(const PackedTriangleLight& packed) {
+	glm::vec3 edge1(util::unpackHalfLow(packed.edges[0]), util::unpackHalfHigh(packed.edges[0]), util::unpackHalfLow(packed.edges[1]));
+	glm::vec3 edge2(util::unpackHalfHigh(packed.edges[1]), util::unpackHalfLow(packed.edges[2]), util::unpackHalfHigh(packed.edges[2]));
+	glm::vec3 norm = util::decodeOctahedral(packed.normal);
+
+	TriangleLight light;
+	light.v0 = packed.v0;
+	light.v1 = packed.v0 + edge1;
+	light.v2 = packed.v0 + edge2;
+	light.nx = norm.x;
+	light.ny = norm.y;
+	light.nz = norm.z;
+	light.radiance = util::unpackRGB9E5(packed.radiance);
+	light.area = .5f * glm::length(glm::cross(edge1, edge2));
+	return light;
+}
+
+TriangleLightPackingError measurePackingError(const std::vector<TriangleLight>& lights) {
+	TriangleLightPackingError error;
+
+	for (const auto& light : lights) {
+		TriangleLight decoded = unpackTriangleLight(packTriangleLight(light));
+
+		float maxEdge = std::max({
+			glm::length(light.v1 - light.v0), glm::length(light.v2 - light.v0), glm::length(light.v2 - light.v1)
+		});
+		float maxChannel = std::max({ light.radiance.x, light.radiance.y, light.radiance.z });
+
+		if (maxEdge > 0.f) {
+			float positionError = std::max(glm::length(decoded.v1 - light.v1), glm::length(decoded.v2 - light.v2));
+			error.maxPositionError = std::max(error.maxPositionError, positionError / maxEdge);
+		}
+		if (light.area > 0.f) {
+			float normalError = glm::length(glm::vec3(decoded.nx - light.nx, decoded.ny - light.ny, decoded.nz - light.nz));
+			error.maxNormalError = std::max(error.maxNormalError, normalError);
+			error.maxAreaError = std::max(error.maxAreaError, std::abs(decoded.area - light.area) / light.area);
+		}
+		if (maxChannel > 0.f) {
+			glm::vec3 diff = glm::abs(decoded.radiance - light.radiance);
+			error.maxRadianceError = std::max(error.maxRadianceError, std::max({ diff.x, diff.y, diff.z }) / maxChannel);
+		}
+	}
+	return error;
+}
+
+// Halves hold integers up to 2^11 exactly and their subnormals are spaced 2^-24
+constexpr int HalfMantissaBits = 11;
+constexpr int MinGridExponent = -24;
+// Multiples of 32 are exact up to MaxHalf, coarser grids cannot help edges that overflow
+constexpr int MaxGridExponent = 5;
+constexpr uint32_t MaxQuantizationPasses = 16;
+
+// Smallest power of two grid on which the edges of the triangle are exact halves
+static int gridExponent(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) {
+	glm::vec3 extent = glm::max(glm::abs(v1 - v0), glm::abs(v2 - v0));
+	float maxComponent = std::max({ extent.x, extent.y, extent.z });
+
+	if (!(maxComponent > 0.f)) {
+		return MinGridExponent;
+	}
+	int exponent;
+	std::frexp(maxComponent, &exponent);
+	return std::clamp(exponent - HalfMantissaBits, MinGridExponent, MaxGridExponent);
+}
+
+static glm::vec3 snapToGrid(const glm::vec3& v, int exponent) {
+	auto snap = [exponent](float x) { return std::ldexp(std::round(std::ldexp(x, -exponent)), exponent); };
+	return glm::vec3(snap(v.x), snap(v.y), snap(v.z));
+}
+
+static bool edgesFitGrid(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, int exponent) {
+	glm::vec3 extent = glm::max(glm::abs(v1 - v0), glm::abs(v2 - v0));
+	float limit = std::ldexp(1.f, exponent + HalfMantissaBits);
+	return extent.x <= limit && extent.y <= limit && extent.z <= limit;
+}
+
+struct CornerKey {
+	std::array<uint32_t, 3> bits;
+
+	bool operator == (const CornerKey& rhs) const = default;
+};
+
+struct CornerKeyHash {
+	size_t operator () (const CornerKey& key) const {
+		uint64_t h = 0;
+
+		for (uint32_t b : key.bits) {
+			h = (h ^ b) * 0x100000001b3ull;
+			h ^= h >> 29;
+		}
+		return static_cast<size_t>(h);
+	}
+};
+
+TriangleLightQuantization quantizeTriangleLights(std::vector<TriangleLight>& lights) {
+	TriangleLightQuantization result;
+
+	// Corners are identified by their exact bits, so emitters sharing a vertex share its grid
+	std::unordered_map<CornerKey, uint32_t, CornerKeyHash> cornerIndices;
+	std::vector<uint32_t> corners(lights.size() * 3);
+	std::vector<glm::vec3> positions;
+
+	for (size_t i = 0; i < lights.size(); i++) {
+		const glm::vec3* v[] = { &lights[i].v0, &lights[i].v1, &lights[i].v2 };
+
+		for (uint32_t j = 0; j < 3; j++) {
+			CornerKey key = { std::bit_cast<uint32_t>(v[j]->x), std::bit_cast<uint32_t>(v[j]->y), std::bit_cast<uint32_t>(v[j]->z) };
+			auto [it, inserted] = cornerIndices.try_emplace(key, static_cast<uint32_t>(positions.size()));
+
+			if (inserted) {
+				positions.push_back(*v[j]);
+			}
+			corners[i * 3 + j] = it->second;
+		}
+	}
+	result.numVertices = static_cast<uint32_t>(positions.size());
+
+	std::vector<int> lightExponents(lights.size());
+	std::vector<glm::vec3> snapped(positions.size());
+
+	for (size_t i = 0; i < lights.size(); i++) {
+		lightExponents[i] = gridExponent(lights[i].v0, lights[i].v1, lights[i].v2);
+	}
+
+	// A vertex takes the coarsest grid of the emitters around it, which also lies on their finer grids.
+	//   Snapping may lengthen edges past the half range of small neighbors, whose grids are then coarsened
+	for (uint32_t pass = 0; pass < MaxQuantizationPasses; pass++) {
+		std::vector<int> vertexExponents(positions.size(), MinGridExponent);
+
+		for (size_t i = 0; i < corners.size(); i++) {
+			vertexExponents[corners[i]] = std::max(vertexExponents[corners[i]], lightExponents[i / 3]);
+		}
+		for (size_t i = 0; i < positions.size(); i++) {
+			snapped[i] = snapToGrid(positions[i], vertexExponents[i]);
+		}
+		bool changed = false;
+
+		for (size_t i = 0; i < lights.size(); i++) {
+			const glm::vec3& v0 = snapped[corners[i * 3 + 0]];
+			const glm::vec3& v1 = snapped[corners[i * 3 + 1]];
+			const glm::vec3& v2 = snapped[corners[i * 3 + 2]];
+
+			if (lightExponents[i] < MaxGridExponent && !edgesFitGrid(v0, v1, v2, lightExponents[i])) {
+				lightExponents[i] = std::min(std::max(lightExponents[i] + 1, gridExponent(v0, v1, v2)), MaxGridExponent);
+				changed = true;
+			}
+		}
+		if (!changed) {
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < lights.size(); i++) {
+		auto& light = lights[i];
+
+		float maxEdge = std::max({
+			glm::length(light.v1 - light.v0), glm::length(light.v2 - light.v0), glm::length(light.v2 - light.v1)
+		});
+		const glm::vec3* v[] = { &light.v0, &light.v1, &light.v2 };
+
+		if (maxEdge > 0.f) {
+			for (uint32_t j = 0; j < 3; j++) {
+				float error = glm::length(snapped[corners[i * 3 + j]] - *v[j]) / maxEdge;
+				result.maxSnapError = std::max(result.maxSnapError, error);
+			}
+		}
+		light.v0 = snapped[corners[i * 3 + 0]];
+		light.v1 = snapped[corners[i * 3 + 1]];
+		light.v2 = snapped[corners[i * 3 + 2]];
+
+		TriangleLight decoded = unpackTriangleLight(packTriangleLight(light));
+
+		if (decoded.v1 != light.v1 || decoded.v2 != light.v2) {
+			result.numLossyLights++;
+		}
+	}
+	return result;
+}
+
+static const std::array<float, 256>& srgbToLinearTable() {
+	static const std::array<float, 256> table = [] {
+		std::array<float, 256> t;
+
+		for (uint32_t i = 0; i < 256; i++) {
+			float v = static_cast<float>(i) / 255.f;
+			t[i] = (v <= .04045f) ? v / 12.92f : std::pow((v + .055f) / 1.055f, 2.4f);
+		}
+		return t;
+	}();
+	return table;
+}
+
+static float cross2(glm::vec2 a, glm::vec2 b) {
+	return a.x * b.y - a.y * b.x;
+}
+
+glm::vec3 integrateTriangleTexture(
+	const uint8_t* rgba, uint32_t width, uint32_t height, glm::vec2 uv0, glm::vec2 uv1, glm::vec2 uv2
+) {
+	const auto& toLinear = srgbToLinearTable();
+	int64_t w = width;
+	int64_t h = height;
+
+	auto fetch = [&](int64_t x, int64_t y) {
+		const uint8_t* texel = rgba + (((y % h + h) % h) * w + (x % w + w) % w) * 4;
+		return glm::vec3(toLinear[texel[0]], toLinear[texel[1]], toLinear[texel[2]]);
+	};
+
+	glm::vec2 size(static_cast<float>(width), static_cast<float>(height));
+	glm::vec2 p0 = uv0 * size;
+	glm::vec2 p1 = uv1 * size;
+	glm::vec2 p2 = uv2 * size;
+	float area2 = cross2(p1 - p0, p2 - p0);
+
+	glm::vec2 boundMin = glm::min(p0, glm::min(p1, p2)) - .5f;
+	glm::vec2 boundMax = glm::max(p0, glm::max(p1, p2)) - .5f;
+	int64_t x0 = static_cast<int64_t>(std::ceil(boundMin.x));
+	int64_t y0 = static_cast<int64_t>(std::ceil(boundMin.y));
+	int64_t x1 = static_cast<int64_t>(std::floor(boundMax.x));
+	int64_t y1 = static_cast<int64_t>(std::floor(boundMax.y));
+
+	if (area2 != 0.f && (x1 - x0 + 1) * (y1 - y0 + 1) <= MaxFootprintTexels) {
+		glm::vec3 sum(0.f);
+		uint32_t count = 0;
+
+		for (int64_t y = y0; y <= y1; y++) {
+			for (int64_t x = x0; x <= x1; x++) {
+				glm::vec2 center(static_cast<float>(x) + .5f, static_cast<float>(y) + .5f);
+
+				// Edge functions take the sign of the footprint so that both windings are accepted
+				float e0 = cross2(p2 - p1, center - p1) * area2;
+				float e1 = cross2(p0 - p2, center - p2) * area2;
+				float e2 = cross2(p1 - p0, center - p0) * area2;
+
+				if (e0 >= 0.f && e1 >= 0.f && e2 >= 0.f) {
+					sum += fetch(x, y);
+					count++;
+				}
+			}
+		}
+		if (count > 0) {
+			return sum / static_cast<float>(count);
+		}
+	}
+	glm::vec3 sum(0.f);
+
+	for (uint32_t i = 0; i < FootprintStrata; i++) {
+		for (uint32_t j = 0; j < FootprintStrata; j++) {
+			float su = std::sqrt((static_cast<float>(i) + .5f) / FootprintStrata);
+			float v = (static_cast<float>(j) + .5f) / FootprintStrata;
+			glm::vec2 p = p0 * (1.f - su) + p1 * (su * (1.f - v)) + p2 * (su * v);
+
+			sum += fetch(static_cast<int64_t>(std::floor(p.x)), static_cast<int64_t>(std::floor(p.y)));
+		}
+	}
+	return sum / static_cast<float>(FootprintStrata * FootprintStrata);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "util/AliasTable.h"
+#include "shader/HostDevice.h"
+
+// Power proportional light sampler, uploaded as the light sample table and sampled by sampleLightTable
+using LightSampleTable = BlockDiscreteSampler<float, LightTableBlockSize>;
+
+struct TriangleLight {
+	glm::vec3 v0;
+	float nx;
+	glm::vec3 v1;
+	float ny;
+	glm::vec3 v2;
+	float nz;
+	glm::vec3 radiance;
+	float area;
+};
+
+/**
+* 32 byte GPU form of TriangleLight, mirrored in layouts.glsl and decoded by loadTriangleLight in
+*   triangle_light.glsl. Edges relative to v0 are stored as halves, the normal in octahedral
+*   snorm16 and radiance as RGB9E5. Area is not stored but derived from the decoded edges
+*/
+struct PackedTriangleLight {
+	glm::vec3 v0;
+	uint32_t normal;
+	// edge1.xy, edge1.z | edge2.x, edge2.yz
+	uint32_t edges[3];
+	uint32_t radiance;
+};
+
+PackedTriangleLight packTriangleLight(const TriangleLight& light);
+TriangleLight unpackTriangleLight(const PackedTriangleLight& light);
+
+struct TriangleLightPackingError {
+	float maxPositionError = 0.f;
+	float maxNormalError = 0.f;
+	float maxRadianceError = 0.f;
+	float maxAreaError = 0.f;
+};
+
+// Position errors are relative to the longest edge, radiance errors to the brightest channel
+TriangleLightPackingError measurePackingError(const std::vector<TriangleLight>& lights);
+
+struct TriangleLightQuantization {
+	uint32_t numVertices = 0;
+	// Lights whose edges still round when packed, only those with edges beyond the half range
+	uint32_t numLossyLights = 0;
+	// Largest corner displacement relative to the longest edge of its light
+	float maxSnapError = 0.f;
+};
+
+/**
+* Snaps light corners to power of two grids on which packed edges are exact halves, so lights
+*   decode to the snapped corners bit for bit. Each vertex is snapped once for every emitter
+*   sharing it, which keeps decoded emitter meshes watertight
+*/
+TriangleLightQuantization quantizeTriangleLights(std::vector<TriangleLight>& lights);
+
+
+/**
+* Average linear color of an sRGB RGBA8 texture over the UV footprint of a triangle with wrap
+*   addressing. Texels whose centers fall inside the footprint are averaged, footprints that
+*   miss every texel center or cover more than MaxFootprintTexels fall back to stratified
+*   barycentric samples
+*/
+glm::vec3 integrateTriangleTexture(
+	const uint8_t* rgba, uint32_t width, uint32_t height, glm::vec2 uv0, glm::vec2 uv1, glm::vec2 uv2
+);
\ No newline at end of file
@@ -0,0 +1,481 @@
+#include "VirtualTexture.h"
+#include "util/Error.h"
+#include "util/Math.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <set>
+
+uint32_t VirtualPageTable::mipCount(uint32_t width, uint32_t height) {
+	uint32_t numMips = 1;
+
+	while (std::max(width, height) > VirtualTextureTileSize && numMips < VirtualTextureMaxMips) {
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+		numMips++;
+	}
+	return numMips;
+}
+
+uint32_t VirtualPageTable::tilesX(const VirtualTextureInfo& info, uint32_t mip) {
+	return util::ceilDiv(std::max(info.width >> mip, 1u), VirtualTextureTileSize);
+}
+
+uint32_t VirtualPageTable::tilesY(const VirtualTextureInfo& info, uint32_t mip) {
+	return util::ceilDiv(std::max(info.height >> mip, 1u), VirtualTextureTileSize);
+}
+
+void VirtualPageTable::addResidentTexture() {
+	mInfos.push_back({ 0, 0, 0, 0 });
+}
+
+uint32_t VirtualPageTable::addVirtualTexture(uint32_t width, uint32_t height) {
+	auto info = VirtualTextureInfo {
+		.width = width,
+		.height = height,
+		.numMips = mipCount(width, height),
+		.pageOffset = static_cast<uint32_t>(mEntries.size())
+	};
+
+	if (mInfos.size() >= (1 << 12) || tilesX(info, 0) > 256 || tilesY(info, 0) > 256) {
+		Log::exception("VirtualPageTable: texture exceeds addressable tile range");
+	}
+
+	uint32_t numPages = 0;
+
+	for (uint32_t mip = 0; mip < info.numMips; mip++) {
+		numPages += tilesX(info, mip) * tilesY(info, mip);
+	}
+	mEntries.resize(mEntries.size() + numPages, VirtualTextureInvalidPage);
+	markDirty(info.pageOffset);
+	markDirty(info.pageOffset + numPages - 1);
+
+	mInfos.push_back(info);
+	return static_cast<uint32_t>(mInfos.size() - 1);
+}
+
+bool VirtualPageTable::isValidTile(const VirtualTextureTile& tile) const {
+	if (tile.texture >= mInfos.size() || !isVirtual(tile.texture)) {
+		return false;
+	}
+	const auto& info = mInfos[tile.texture];
+	return tile.mip < info.numMips && tile.x < tilesX(info, tile.mip) && tile.y < tilesY(info, tile.mip);
+}
+
+uint32_t VirtualPageTable::pageIndex(const VirtualTextureTile& tile) const {
+	const auto& info = mInfos[tile.texture];
+	uint32_t offset = info.pageOffset;
+
+	for (uint32_t mip = 0; mip < tile.mip; mip++) {
+		offset += tilesX(info, mip) * tilesY(info, mip);
+	}
+	return offset + tile.y * tilesX(info, tile.mip) + tile.x;
+}
+
+void VirtualPageTable::map(const VirtualTextureTile& tile, uint32_t slot) {
+	uint32_t page = pageIndex(tile);
+	mEntries[page] = slot;
+	markDirty(page);
+}
+
+void VirtualPageTable::unmap(const VirtualTextureTile& tile) {
+	uint32_t page = pageIndex(tile);
+	mEntries[page] = VirtualTextureInvalidPage;
+	markDirty(page);
+}
+
+std::optional<std::pair<uint32_t, uint32_t>> VirtualPageTable::dirtyRange() const {
+	if (mDirtyBegin >= mDirtyEnd) {
+		return std::nullopt;
+	}
+	return std::make_pair(mDirtyBegin, mDirtyEnd);
+}
+
+void VirtualPageTable::clearDirty() {
+	mDirtyBegin = mDirtyEnd = 0;
+}
+
+void VirtualPageTable::markDirty(uint32_t page) {
+	if (mDirtyBegin >= mDirtyEnd) {
+		mDirtyBegin = page;
+		mDirtyEnd = page + 1;
+	}
+	else {
+		mDirtyBegin = std::min(mDirtyBegin, page);
+		mDirtyEnd = std::max(mDirtyEnd, page + 1);
+	}
+}
+
+TileStreamer::TileStreamer(VirtualPageTable* pageTable, uint32_t budget, uint32_t maxUploadsPerFrame) :
+	mPageTable(pageTable), mBudget(budget), mMaxUploadsPerFrame(maxUploadsPerFrame)
+{
+	mFreeSlots.resize(budget);
+
+	for (uint32_t i = 0; i < budget; i++) {
+		mFreeSlots[i] = budget - i - 1;
+	}
+}
+
+std::vector<VirtualTileUpload> TileStreamer::pinCoarsestMips() {
+	std::vector<VirtualTileUpload> uploads;
+	const auto& infos = mPageTable->infos();
+
+	for (uint32_t i = 0; i < infos.size(); i++) {
+		if (!mPageTable->isVirtual(i)) {
+			continue;
+		}
+		// The coarsest mip always fits in a single tile
+		auto tile = VirtualTextureTile{ i, infos[i].numMips - 1, 0, 0 };
+		auto slot = allocateSlot();
+
+		if (!slot) {
+			Log::exception("TileStreamer: budget too small to pin the coarsest mip of every texture");
+		}
+		mPageTable->map(tile, *slot);
+		uploads.push_back({ tile, *slot });
+	}
+	return uploads;
+}
+
+std::vector<VirtualTileUpload> TileStreamer::processFeedback(const uint32_t* feedback, size_t count) {
+	mFrame++;
+	mStatistics = Statistics();
+
+	std::vector<uint32_t> requests(feedback, feedback + count);
+	std::sort(requests.begin(), requests.end());
+	requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+
+	std::vector<VirtualTextureTile> missing;
+
+	for (auto key : requests) {
+		if (key == VirtualTextureInvalidPage) {
+			continue;
+		}
+		auto tile = unpackVirtualTextureTile(key);
+
+		if (!mPageTable->isValidTile(tile)) {
+			continue;
+		}
+		mStatistics.requested++;
+
+		if (auto res = mResident.find(key); res != mResident.end()) {
+			res->second.lastUsedFrame = mFrame;
+			mLRU.splice(mLRU.begin(), mLRU, res->second.lruIter);
+		}
+		else if (mPageTable->entry(tile) == VirtualTextureInvalidPage) {
+			missing.push_back(tile);
+		}
+	}
+	mStatistics.missing = static_cast<uint32_t>(missing.size());
+
+	// Coarse tiles first, a request for a fine tile is useless until its parents are there
+	std::stable_sort(missing.begin(), missing.end(), [](const VirtualTextureTile& a, const VirtualTextureTile& b) {
+		return a.mip > b.mip;
+	});
+
+	std::vector<VirtualTileUpload> uploads;
+
+	for (const auto& tile : missing) {
+		if (uploads.size() >= mMaxUploadsPerFrame) {
+			break;
+		}
+		auto slot = allocateSlot();
+
+		if (!slot) {
+			break;
+		}
+		uint32_t key = packVirtualTextureTile(tile);
+		mLRU.push_front(key);
+		mResident[key] = ResidentTile{ *slot, mFrame, mLRU.begin() };
+		mPageTable->map(tile, *slot);
+		uploads.push_back({ tile, *slot });
+	}
+	mStatistics.uploaded = static_cast<uint32_t>(uploads.size());
+	return uploads;
+}
+
+std::optional<uint32_t> TileStreamer::allocateSlot() {
+	if (!mFreeSlots.empty()) {
+		uint32_t slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		return slot;
+	}
+
+	if (mLRU.empty()) {
+		return std::nullopt;
+	}
+	uint32_t key = mLRU.back();
+	auto& victim = mResident[key];
+
+	// Everything left was requested this frame, evicting it would only cause thrashing
+	if (victim.lastUsedFrame == mFrame) {
+		return std::nullopt;
+	}
+	uint32_t slot = victim.slot;
+	mPageTable->unmap(unpackVirtualTextureTile(key));
+	mLRU.pop_back();
+	mResident.erase(key);
+	mStatistics.evicted++;
+
+	return slot;
+}
+
+static float srgbToLinear(float x) {
+	return (x <= 0.04045f) ? x / 12.92f : std::pow((x + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float x) {
+	return (x <= 0.0031308f) ? x * 12.92f : 1.055f * std::pow(x, 1.f / 2.4f) - 0.055f;
+}
+
+VirtualTextureSource::VirtualTextureSource(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t numMips) {
+	mLevels.resize(numMips);
+	mLevels[0] = { width, height, std::vector<uint8_t>(rgba, rgba + size_t(width) * height * 4) };
+
+	// Color is sRGB encoded like the atlas, so averaged in linear space. Alpha is linear already
+	float toLinear[256];
+
+	for (uint32_t i = 0; i < 256; i++) {
+		toLinear[i] = srgbToLinear(i / 255.f);
+	}
+
+	for (uint32_t mip = 1; mip < numMips; mip++) {
+		const auto& src = mLevels[mip - 1];
+		auto& dst = mLevels[mip];
+
+		dst.width = std::max(src.width / 2, 1u);
+		dst.height = std::max(src.height / 2, 1u);
+		dst.data.resize(size_t(dst.width) * dst.height * 4);
+
+		for (uint32_t y = 0; y < dst.height; y++) {
+			for (uint32_t x = 0; x < dst.width; x++) {
+				uint32_t x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+				uint32_t y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+
+				const uint8_t* texels[] = {
+					&src.data[(size_t(y0) * src.width + x0) * 4], &src.data[(size_t(y0) * src.width + x1) * 4],
+					&src.data[(size_t(y1) * src.width + x0) * 4], &src.data[(size_t(y1) * src.width + x1) * 4]
+				};
+				uint8_t* texel = &dst.data[(size_t(y) * dst.width + x) * 4];
+
+				for (uint32_t c = 0; c < 3; c++) {
+					float sum = toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] + toLinear[texels[3][c]];
+					texel[c] = static_cast<uint8_t>(std::clamp(linearToSrgb(sum * .25f), 0.f, 1.f) * 255.f + .5f);
+				}
+				uint32_t alpha = texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3];
+				texel[3] = static_cast<uint8_t>((alpha + 2) / 4);
+			}
+		}
+	}
+}
+
+void VirtualTextureSource::copyTile(uint32_t mip, uint32_t tileX, uint32_t tileY, uint8_t* dst) const {
+	const auto& level = mLevels[mip];
+	int originX = static_cast<int>(tileX * VirtualTextureTileSize) - static_cast<int>(VirtualTextureTileBorder);
+	int originY = static_cast<int>(tileY * VirtualTextureTileSize) - static_cast<int>(VirtualTextureTileBorder);
+
+	for (uint32_t y = 0; y < VirtualTexturePaddedTileSize; y++) {
+		int srcY = std::clamp(originY + static_cast<int>(y), 0, static_cast<int>(level.height) - 1);
+
+		for (uint32_t x = 0; x < VirtualTexturePaddedTileSize; x++) {
+			int srcX = std::clamp(originX + static_cast<int>(x), 0, static_cast<int>(level.width) - 1);
+			memcpy(
+				dst + (size_t(y) * VirtualTexturePaddedTileSize + x) * 4,
+				level.data.data() + (size_t(srcY) * level.width + srcX) * 4, 4
+			);
+		}
+	}
+}
+
+size_t VirtualTextureSource::byteSize() const {
+	size_t size = 0;
+
+	for (const auto& level : mLevels) {
+		size += level.data.size();
+	}
+	return size;
+}
+
+bool VirtualTextureValidation::passed() const {
+	return numTableMismatches == 0 && numDirtyMisses == 0 && numUploadViolations == 0 && numLRUViolations == 0 &&
+		maxMipError <= 1;
+}
+
+static uint32_t validateMipFiltering() {
+	// 0 and 255 alternating average to 0.5 in linear space, which is 188 in sRGB. A flat image stays flat
+	const uint32_t Size = 4;
+	std::vector<uint8_t> checker(Size * Size * 4), flat(Size * Size * 4, 100);
+
+	for (uint32_t i = 0; i < Size * Size; i++) {
+		uint8_t value = ((i % Size + i / Size) % 2) ? 255 : 0;
+		std::fill_n(&checker[i * 4], 4, value);
+	}
+	VirtualTextureSource checkerSource(checker.data(), Size, Size, 3);
+	VirtualTextureSource flatSource(flat.data(), Size, Size, 3);
+
+	std::vector<uint8_t> tile(VirtualTexturePaddedTileSize * VirtualTexturePaddedTileSize * 4);
+	uint32_t maxError = 0;
+
+	for (uint32_t mip = 1; mip < 3; mip++) {
+		checkerSource.copyTile(mip, 0, 0, tile.data());
+
+		for (uint32_t i = 0; i < tile.size(); i++) {
+			uint32_t expected = (i % 4 == 3) ? 128 : 188;
+			maxError = std::max(maxError, static_cast<uint32_t>(std::abs(int(tile[i]) - int(expected))));
+		}
+		flatSource.copyTile(mip, 0, 0, tile.data());
+
+		for (auto value : tile) {
+			maxError = std::max(maxError, static_cast<uint32_t>(std::abs(int(value) - 100)));
+		}
+	}
+	return maxError;
+}
+
+VirtualTextureValidation validateVirtualTexture(uint32_t numFrames, uint32_t seed) {
+	VirtualTextureValidation result;
+	result.numFrames = numFrames;
+	result.maxMipError = validateMipFiltering();
+
+	VirtualPageTable pageTable;
+	pageTable.addResidentTexture();
+	pageTable.addVirtualTexture(1024, 1024);
+	pageTable.addVirtualTexture(700, 300);
+	pageTable.addResidentTexture();
+	pageTable.addVirtualTexture(4096, 128);
+
+	const uint32_t Budget = 48;
+	const uint32_t MaxUploadsPerFrame = 8;
+
+	TileStreamer streamer(&pageTable, Budget, MaxUploadsPerFrame);
+	std::set<uint32_t> pinned;
+
+	for (const auto& upload : streamer.pinCoarsestMips()) {
+		pinned.insert(packVirtualTextureTile(upload.tile));
+	}
+
+	// Key of the tile each page belongs to, tiles ordered as they are in the page table
+	std::vector<uint32_t> pageKeys(pageTable.entries().size(), VirtualTextureInvalidPage);
+	std::vector<uint32_t> tiles;
+
+	for (uint32_t texture = 0; texture < pageTable.infos().size(); texture++) {
+		if (!pageTable.isVirtual(texture)) {
+			continue;
+		}
+		const auto& info = pageTable.infos()[texture];
+
+		for (uint32_t mip = 0; mip < info.numMips; mip++) {
+			for (uint32_t y = 0; y < VirtualPageTable::tilesY(info, mip); y++) {
+				for (uint32_t x = 0; x < VirtualPageTable::tilesX(info, mip); x++) {
+					VirtualTextureTile tile{ texture, mip, x, y };
+					pageKeys[pageTable.pageIndex(tile)] = packVirtualTextureTile(tile);
+					tiles.push_back(packVirtualTextureTile(tile));
+				}
+			}
+		}
+	}
+	std::vector<uint32_t> entries = pageTable.entries();
+	std::vector<uint64_t> lastRequested(pageKeys.size(), 0);
+	pageTable.clearDirty();
+
+	std::default_random_engine rng(seed);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	for (uint64_t frame = 1; frame <= numFrames; frame++) {
+		const uint32_t Window = 40;
+		uint32_t windowBegin = static_cast<uint32_t>(frame * 3 % tiles.size());
+		uint32_t numFeedback = 64 + rng() % 256;
+
+		std::vector<uint32_t> feedback;
+
+		for (uint32_t i = 0; i < numFeedback; i++) {
+			float u = uniform(rng);
+
+			if (u < .02f) {
+				feedback.push_back(VirtualTextureInvalidPage);
+			}
+			else if (u < .12f) {
+				feedback.push_back(tiles[rng() % tiles.size()]);
+			}
+			else {
+				feedback.push_back(tiles[(windowBegin + rng() % Window) % tiles.size()]);
+			}
+		}
+		for (auto key : feedback) {
+			if (key != VirtualTextureInvalidPage) {
+				lastRequested[pageTable.pageIndex(unpackVirtualTextureTile(key))] = frame;
+			}
+		}
+		auto uploads = streamer.processFeedback(feedback.data(), feedback.size());
+		const auto& stats = streamer.statistics();
+
+		result.numRequests += stats.requested;
+		result.numUploads += static_cast<uint32_t>(uploads.size());
+
+		if (uploads.size() > MaxUploadsPerFrame) {
+			result.numUploadViolations++;
+		}
+		for (size_t i = 0; i < uploads.size(); i++) {
+			uint32_t page = pageTable.pageIndex(uploads[i].tile);
+
+			if ((i > 0 && uploads[i].tile.mip > uploads[i - 1].tile.mip) || lastRequested[page] != frame ||
+				entries[page] != VirtualTextureInvalidPage
+			) {
+				result.numUploadViolations++;
+			}
+			if (pageTable.entries()[page] != uploads[i].slot) {
+				result.numTableMismatches++;
+			}
+		}
+
+		const auto& newEntries = pageTable.entries();
+		auto dirty = pageTable.dirtyRange();
+		std::set<uint32_t> slots;
+		std::vector<uint32_t> evicted;
+		uint64_t oldestKept = std::numeric_limits<uint64_t>::max();
+		bool evictable = false;
+
+		for (uint32_t page = 0; page < newEntries.size(); page++) {
+			if (newEntries[page] != entries[page] && (!dirty || page < dirty->first || page >= dirty->second)) {
+				result.numDirtyMisses++;
+			}
+			bool isPinned = pinned.contains(pageKeys[page]);
+
+			if (newEntries[page] != VirtualTextureInvalidPage) {
+				if (newEntries[page] >= Budget || !slots.insert(newEntries[page]).second) {
+					result.numTableMismatches++;
+				}
+				if (!isPinned) {
+					oldestKept = std::min(oldestKept, lastRequested[page]);
+					evictable |= (lastRequested[page] < frame);
+				}
+			}
+			else if (isPinned) {
+				result.numTableMismatches++;
+			}
+			else if (entries[page] != VirtualTextureInvalidPage) {
+				evicted.push_back(page);
+			}
+		}
+		if (slots.size() != streamer.numResident() || evicted.size() != stats.evicted) {
+			result.numTableMismatches++;
+		}
+		// Missing tiles left waiting while a tile not needed this frame could have made room
+		if (uploads.size() < std::min(MaxUploadsPerFrame, stats.missing) && evictable) {
+			result.numUploadViolations++;
+		}
+		for (uint32_t page : evicted) {
+			if (lastRequested[page] == frame || lastRequested[page] > oldestKept) {
+				result.numLRUViolations++;
+			}
+		}
+		result.numEvictions += static_cast<uint32_t>(evicted.size());
+
+		entries = newEntries;
+		pageTable.clearDirty();
+	}
+	return result;
+}
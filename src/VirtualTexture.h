@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "shader/HostDevice.h"
+
+/**
+* Host side of sparse virtual texturing. Nothing here touches Vulkan objects so that
+*   page table and streaming decisions can be driven and inspected without a device
+*/
+
+struct VirtualTextureTile {
+	uint32_t texture;
+	uint32_t mip;
+	uint32_t x;
+	uint32_t y;
+};
+
+// Must match packVirtualTextureTile in virtual_texture.glsl
+inline uint32_t packVirtualTextureTile(const VirtualTextureTile& tile) {
+	return (tile.texture << 20) | (tile.mip << 16) | (tile.y << 8) | tile.x;
+}
+
+inline VirtualTextureTile unpackVirtualTextureTile(uint32_t key) {
+	return { key >> 20, (key >> 16) & 0xf, key & 0xff, (key >> 8) & 0xff };
+}
+
+// Mirrored by VirtualTextureInfo in layouts.glsl, one per texture in the image pool
+struct VirtualTextureInfo {
+	uint32_t width;
+	uint32_t height;
+	uint32_t numMips;
+	uint32_t pageOffset;
+};
+
+class VirtualPageTable {
+public:
+	static uint32_t mipCount(uint32_t width, uint32_t height);
+	static uint32_t tilesX(const VirtualTextureInfo& info, uint32_t mip);
+	static uint32_t tilesY(const VirtualTextureInfo& info, uint32_t mip);
+
+	void addResidentTexture();
+	uint32_t addVirtualTexture(uint32_t width, uint32_t height);
+
+	bool isVirtual(uint32_t texture) const { return mInfos[texture].numMips > 0; }
+	bool isValidTile(const VirtualTextureTile& tile) const;
+	uint32_t pageIndex(const VirtualTextureTile& tile) const;
+	uint32_t entry(const VirtualTextureTile& tile) const { return mEntries[pageIndex(tile)]; }
+
+	void map(const VirtualTextureTile& tile, uint32_t slot);
+	void unmap(const VirtualTextureTile& tile);
+
+	std::optional<std::pair<uint32_t, uint32_t>> dirtyRange() const;
+	void clearDirty();
+
+	const std::vector<VirtualTextureInfo>& infos() const { return mInfos; }
+	const std::vector<uint32_t>& entries() const { return mEntries; }
+
+private:
+	void markDirty(uint32_t page);
+
+private:
+	std::vector<VirtualTextureInfo> mInfos;
+	std::vector<uint32_t> mEntries;
+	uint32_t mDirtyBegin = 0;
+	uint32_t mDirtyEnd = 0;
+};
+
+struct VirtualTileUpload {
+	VirtualTextureTile tile;
+	uint32_t slot;
+};
+
+/**
+* Decides which tiles live in the physical tile cache. Tiles requested through feedback are
+*   streamed in coarse-to-fine order and the least recently requested tile is evicted once
+*   the budget is reached. The coarsest mip of every texture is pinned so that lookups can
+*   always fall back to some resident data
+*/
+class TileStreamer {
+public:
+	struct Statistics {
+		uint32_t requested = 0;
+		uint32_t missing = 0;
+		uint32_t uploaded = 0;
+		uint32_t evicted = 0;
+	};
+
+	TileStreamer() = default;
+	TileStreamer(VirtualPageTable* pageTable, uint32_t budget, uint32_t maxUploadsPerFrame);
+
+	std::vector<VirtualTileUpload> pinCoarsestMips();
+	std::vector<VirtualTileUpload> processFeedback(const uint32_t* feedback, size_t count);
+
+	uint32_t budget() const { return mBudget; }
+	uint32_t numResident() const { return mBudget - static_cast<uint32_t>(mFreeSlots.size()); }
+	const Statistics& statistics() const { return mStatistics; }
+
+private:
+	std::optional<uint32_t> allocateSlot();
+
+private:
+	struct ResidentTile {
+		uint32_t slot;
+		uint64_t lastUsedFrame;
+		std::list<uint32_t>::iterator lruIter;
+	};
+
+	VirtualPageTable* mPageTable = nullptr;
+	uint32_t mBudget = 0;
+	uint32_t mMaxUploadsPerFrame = 0;
+	uint64_t mFrame = 0;
+
+	std::vector<uint32_t> mFreeSlots;
+	// Front is the most recently requested tile, pinned tiles are never in this list
+	std::list<uint32_t> mLRU;
+	std::unordered_map<uint32_t, ResidentTile> mResident;
+	Statistics mStatistics;
+};
+
+/**
+* Box filtered sRGB RGBA8 mip chain of a virtual texture, kept in host memory as the source
+*   that tiles are copied from. Color is filtered in linear space
+*/
+class VirtualTextureSource {
+public:
+	VirtualTextureSource() = default;
+	VirtualTextureSource(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t numMips);
+
+	// Writes a VirtualTexturePaddedTileSize^2 RGBA8 block with edge-clamped borders
+	void copyTile(uint32_t mip, uint32_t tileX, uint32_t tileY, uint8_t* dst) const;
+
+	size_t byteSize() const;
+
+private:
+	struct Level {
+		uint32_t width;
+		uint32_t height;
+		std::vector<uint8_t> data;
+	};
+	std::vector<Level> mLevels;
+};
+
+struct VirtualTextureValidation {
+	uint32_t numFrames = 0;
+	uint32_t numRequests = 0;
+	uint32_t numUploads = 0;
+	uint32_t numEvictions = 0;
+
+	// Page table entries disagreeing with what the streamer uploaded or evicted, slots mapped twice
+	//   or out of budget, and pinned tiles unmapped. Any is a bug
+	uint32_t numTableMismatches = 0;
+	// Changed entries outside the dirty range, which would never reach the device
+	uint32_t numDirtyMisses = 0;
+	// Uploads over the per frame limit, not coarse to fine, or of tiles not requested that frame.
+	//   Also frames uploading less than they could while some tile was evictable
+	uint32_t numUploadViolations = 0;
+	// Evicted tiles that were requested the same frame or more recently than a tile kept
+	uint32_t numLRUViolations = 0;
+	// Largest difference in 8-bit units of filtered mips from linear space averages
+	uint32_t maxMipError = 0;
+
+	bool passed() const;
+};
+
+/**
+* Drives a page table and TileStreamer through numFrames of synthetic feedback, a request window
+*   panning over the tiles of a few virtual textures plus scattered and invalid keys, under a
+*   budget small enough to evict every frame. The page table is diffed against the uploads and
+*   evictions each frame. Also checks sRGB mip filtering of VirtualTextureSource
+*/
+VirtualTextureValidation validateVirtualTexture(uint32_t numFrames, uint32_t seed = 0);
@@ -0,0 +1,269 @@
+#include "AccelerationStructure.h"
+#include "util/Error.h"
+#include "util/Timer.h"
+
+#include <format>
+#include <utility>
+
+NAMESPACE_BEGIN(cpu)
+
+void MeshAccelStructure::build(const std::vector<glm::vec3>& trianglePositions, const BVHBuildSettings& settings) {
+	uint32_t numTriangles = static_cast<uint32_t>(trianglePositions.size() / 3);
+	std::vector<AABB> bounds(numTriangles);
+
+	for (uint32_t i = 0; i < numTriangles; i++) {
+		bounds[i].expand(trianglePositions[i * 3 + 0]);
+		bounds[i].expand(trianglePositions[i * 3 + 1]);
+		bounds[i].expand(trianglePositions[i * 3 + 2]);
+	}
+	bvh.build(bounds, settings);
+	positions.resize(trianglePositions.size());
+
+	for (uint32_t i = 0; i < numTriangles; i++) {
+		uint32_t prim = bvh.primIndices[i];
+		positions[i * 3 + 0] = trianglePositions[prim * 3 + 0];
+		positions[i * 3 + 1] = trianglePositions[prim * 3 + 1];
+		positions[i * 3 + 2] = trianglePositions[prim * 3 + 2];
+	}
+	wide.build(bvh, positions);
+}
+
+static bool intersectSlabs(const AABB& box, const Ray& ray, const glm::vec3& invDir, float& tEntry) {
+	float tNear = ray.tMin;
+	float tFar = ray.tMax;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float t0 = (box.boundMin[axis] - ray.origin[axis]) * invDir[axis];
+		float t1 = (box.boundMax[axis] - ray.origin[axis]) * invDir[axis];
+
+		if (t0 > t1) {
+			std::swap(t0, t1);
+		}
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1 * 1.0000004f);
+	}
+	tEntry = tNear;
+	return tNear <= tFar;
+}
+
+static glm::vec3 safeInverse(const glm::vec3& dir) {
+	glm::vec3 invDir;
+
+	for (int axis = 0; axis < 3; axis++) {
+		invDir[axis] = 1.f / ((dir[axis] == 0.f) ? std::copysign(1e-30f, dir[axis]) : dir[axis]);
+	}
+	return invDir;
+}
+
+bool MeshAccelStructure::intersectReference(Ray& ray, Intersection& isec) const {
+	if (bvh.empty()) {
+		return false;
+	}
+	WatertightRay wray(ray);
+	glm::vec3 invDir = safeInverse(ray.dir);
+
+	uint32_t stack[BVH::MaxDepth * 2];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	bool found = false;
+
+	while (stackSize > 0) {
+		const BVHNode& node = bvh.nodes[stack[--stackSize]];
+		float tEntry;
+
+		if (!intersectSlabs(AABB{ node.boundMin, node.boundMax }, ray, invDir, tEntry)) {
+			continue;
+		}
+		if (node.numPrims == 0) {
+			stack[stackSize++] = node.offset;
+			stack[stackSize++] = static_cast<uint32_t>(&node - bvh.nodes.data()) + 1;
+			continue;
+		}
+		for (uint32_t i = node.offset; i < node.offset + node.numPrims; i++) {
+			TriangleHit hit;
+
+			if (intersectTriangle(wray, positions[i * 3 + 0], positions[i * 3 + 1], positions[i * 3 + 2], ray.tMin, ray.tMax, hit)) {
+				ray.tMax = hit.t;
+				isec.bary = glm::vec2(hit.b1, hit.b2);
+				isec.triangleIdx = bvh.primIndices[i];
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+void AccelerationStructure::build(const Scene& scene, const BVHBuildSettings& settings) {
+	clear();
+
+	const auto& resource = scene.resource;
+	const auto& uniqueModels = resource.uniqueModelInstances[Resource::Object];
+	const auto& vertices = resource.vertices[Resource::Object];
+	const auto& indices = resource.indices[Resource::Object];
+
+	// Light BLAS first so that object meshes are indexed by refId + 1, like meshAccelStructures
+	meshes.resize(uniqueModels.size() + 1);
+	std::vector<glm::vec3> positions;
+
+	Timer timer;
+
+	// Decoded corners, the same the light BLAS of DeviceScene is built from and lights are sampled on
+	if (!scene.triangleLights.empty()) {
+		positions.resize(scene.triangleLights.size() * 3);
+
+		for (size_t i = 0; i < scene.triangleLights.size(); i++) {
+			positions[i * 3 + 0] = scene.triangleLights[i].v0;
+			positions[i * 3 + 1] = scene.triangleLights[i].v1;
+			positions[i * 3 + 2] = scene.triangleLights[i].v2;
+		}
+		meshes[0].build(positions, settings);
+	}
+
+	for (size_t i = 0; i < uniqueModels.size(); i++) {
+		auto model = uniqueModels[i];
+		uint32_t indexOffset = resource.meshInstances[Resource::Object][model->meshOffset()].indexOffset;
+
+		positions.resize(model->numIndices());
+
+		for (uint32_t j = 0; j < model->numIndices(); j++) {
+			positions[j] = vertices[indices[indexOffset + j]].pos;
+		}
+		meshes[i + 1].build(positions, settings);
+	}
+	mStatistics.meshBuildMs = timer.get();
+
+	for (const auto& mesh : meshes) {
+		mStatistics.wideBuildMs += mesh.wide.statistics().buildMs;
+		mStatistics.wideBytes += mesh.wide.byteSize();
+	}
+
+	if (!scene.triangleLights.empty()) {
+		instances.push_back({ glm::mat4(1.f), glm::mat4(1.f), 0, 0 });
+	}
+	const auto& modelInstances = resource.modelInstances[Resource::Object];
+
+	for (uint32_t i = 0; i < modelInstances.size(); i++) {
+		glm::mat4 transform = modelInstances[i]->modelMatrix();
+		instances.push_back({ transform, glm::inverse(transform), i + 1, modelInstances[i]->refId() + 1 });
+	}
+
+	timer.reset();
+	std::vector<AABB> instanceBounds(instances.size());
+
+	for (size_t i = 0; i < instances.size(); i++) {
+		instanceBounds[i] = meshes[instances[i].meshIdx].bvh.bounds().transform(instances[i].transform);
+	}
+	topLevel.build(instanceBounds, BVHBuildSettings{ .maxLeafSize = 1 });
+	mStatistics.topBuildMs = timer.get();
+
+	for (const auto& mesh : meshes) {
+		mStatistics.numTriangles += mesh.numTriangles();
+		mStatistics.meshSAHCost += mesh.bvh.statistics().sahCost * mesh.numTriangles();
+	}
+	if (mStatistics.numTriangles > 0) {
+		mStatistics.meshSAHCost /= static_cast<float>(mStatistics.numTriangles);
+	}
+	mStatistics.numMeshes = static_cast<uint32_t>(meshes.size());
+	mStatistics.numInstances = static_cast<uint32_t>(instances.size());
+	mStatistics.topSAHCost = topLevel.statistics().sahCost;
+}
+
+bool AccelerationStructure::intersect(Ray& ray, Intersection& isec) const {
+	return traverse<false, false>(ray, &isec);
+}
+
+bool AccelerationStructure::occluded(const Ray& ray) const {
+	Ray shadowRay = ray;
+	return traverse<true, false>(shadowRay, nullptr);
+}
+
+bool AccelerationStructure::intersectReference(Ray& ray, Intersection& isec) const {
+	return traverse<false, true>(ray, &isec);
+}
+
+template<bool AnyHit, bool Reference>
+bool AccelerationStructure::traverse(Ray& ray, Intersection* isec) const {
+	if (topLevel.empty()) {
+		return false;
+	}
+	glm::vec3 invDir = safeInverse(ray.dir);
+
+	uint32_t stack[BVH::MaxDepth * 2];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	bool found = false;
+
+	while (stackSize > 0) {
+		uint32_t index = stack[--stackSize];
+		const BVHNode& node = topLevel.nodes[index];
+		float tEntry;
+
+		if (!intersectSlabs(AABB{ node.boundMin, node.boundMax }, ray, invDir, tEntry)) {
+			continue;
+		}
+		if (node.numPrims == 0) {
+			stack[stackSize++] = node.offset;
+			stack[stackSize++] = index + 1;
+			continue;
+		}
+		const auto& instance = instances[topLevel.primIndices[node.offset]];
+		const auto& mesh = meshes[instance.meshIdx];
+
+		// Directions are not renormalized so that distances stay comparable across instances
+		Ray objectRay = ray;
+
+		if (instance.customIndex != 0) {
+			objectRay.origin = glm::vec3(instance.transformInv * glm::vec4(ray.origin, 1.f));
+			objectRay.dir = glm::vec3(instance.transformInv * glm::vec4(ray.dir, 0.f));
+		}
+		if constexpr (AnyHit) {
+			if (mesh.occluded(objectRay)) {
+				return true;
+			}
+		}
+		else {
+			bool hit = Reference ? mesh.intersectReference(objectRay, *isec) : mesh.intersect(objectRay, *isec);
+
+			if (hit) {
+				ray.tMax = objectRay.tMax;
+				isec->instanceIdx = instance.customIndex;
+				found = true;
+			}
+		}
+	}
+	return found;
+}
+
+void AccelerationStructure::clear() {
+	meshes.clear();
+	instances.clear();
+	topLevel.clear();
+	mStatistics = Statistics();
+}
+
+void AccelerationStructure::logStatistics() const {
+	Log::line<1>("CPU Acceleration Structure");
+	Log::line<2>(std::format("Meshes = {}, instances = {}, triangles = {}",
+		mStatistics.numMeshes, mStatistics.numInstances, mStatistics.numTriangles));
+	Log::line<2>(std::format("BLAS build = {:.2f} ms, TLAS build = {:.2f} ms",
+		mStatistics.meshBuildMs, mStatistics.topBuildMs));
+	Log::line<2>(std::format("8-wide BLAS collapse = {:.2f} ms, {:.2f} MB",
+		mStatistics.wideBuildMs, static_cast<double>(mStatistics.wideBytes) / (1024.0 * 1024.0)));
+	Log::line<2>(std::format("SAH cost: BLAS = {:.2f} (triangle weighted), TLAS = {:.2f}",
+		mStatistics.meshSAHCost, mStatistics.topSAHCost));
+
+	for (size_t i = 0; i < meshes.size(); i++) {
+		const auto& stats = meshes[i].bvh.statistics();
+
+		if (meshes[i].numTriangles() == 0) {
+			continue;
+		}
+		Log::line<3>(std::format("{}[{}]: triangles = {}, nodes = {}, depth = {}, SAH = {:.2f}, {:.2f} ms",
+			(i == 0) ? "Light" : "Object", i, meshes[i].numTriangles(), stats.numNodes, stats.maxDepth,
+			stats.sahCost, stats.buildMs));
+	}
+}
+
+NAMESPACE_END(cpu)
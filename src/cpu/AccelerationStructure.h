@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+
+#include "BVH.h"
+#include "BVH8.h"
+#include "Ray.h"
+#include "Scene.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Triangles of one unique model in object space. Vertex positions are copied in leaf order,
+*   so triangle i of a leaf range sits at positions[3i, 3i + 3) and primitive ids are looked up
+*   through bvh.primIndices. The binary BVH is collapsed into wide for traversal
+*/
+struct MeshAccelStructure {
+	BVH bvh;
+	BVH8 wide;
+	std::vector<glm::vec3> positions;
+
+	uint32_t numTriangles() const { return static_cast<uint32_t>(positions.size() / 3); }
+	void build(const std::vector<glm::vec3>& trianglePositions, const BVHBuildSettings& settings);
+
+	bool intersect(Ray& ray, Intersection& isec) const { return wide.intersect(ray, isec); }
+	bool occluded(const Ray& ray) const { return wide.occluded(ray); }
+
+	// Scalar traversal of the binary BVH, used to validate the wide kernels
+	bool intersectReference(Ray& ray, Intersection& isec) const;
+};
+
+struct AccelStructureInstance {
+	glm::mat4 transform;
+	glm::mat4 transformInv;
+	// Reported as Intersection::instanceIdx, the light instance is 0 and objects start from 1
+	uint32_t customIndex;
+	uint32_t meshIdx;
+};
+
+/**
+* Host mirror of DeviceScene::createAccelerationStructure: mesh 0 is the light BLAS over
+*   triangleLights in world space, followed by one BLAS per unique object model, and the TLAS
+*   is a BVH over the world space bounds of all instances. Hits are reported in the layout of
+*   Intersection from layouts.glsl, with triangleIdx relative to the hit BLAS
+*/
+class AccelerationStructure {
+public:
+	struct Statistics {
+		uint32_t numMeshes = 0;
+		uint32_t numInstances = 0;
+		uint64_t numTriangles = 0;
+		double meshBuildMs = 0.0;
+		double topBuildMs = 0.0;
+		double wideBuildMs = 0.0;
+		uint64_t wideBytes = 0;
+		// Sum of per mesh SAH costs weighted by triangle count, and the TLAS cost over instances
+		float meshSAHCost = 0.f;
+		float topSAHCost = 0.f;
+	};
+
+	void build(const Scene& scene, const BVHBuildSettings& settings = {});
+	void clear();
+
+	const Statistics& statistics() const { return mStatistics; }
+	void logStatistics() const;
+
+	// Closest hit, ray is in world space and ray.tMax is shortened to the hit distance
+	bool intersect(Ray& ray, Intersection& isec) const;
+	bool occluded(const Ray& ray) const;
+	bool intersectReference(Ray& ray, Intersection& isec) const;
+
+private:
+	template<bool AnyHit, bool Reference>
+	bool traverse(Ray& ray, Intersection* isec) const;
+
+public:
+	std::vector<MeshAccelStructure> meshes;
+	std::vector<AccelStructureInstance> instances;
+	BVH topLevel;
+
+private:
+	Statistics mStatistics;
+};
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,238 @@
+#include "BVH.h"
+#include "util/Timer.h"
+
+#include <algorithm>
+#include <array>
+#include <thread>
+
+NAMESPACE_BEGIN(cpu)
+
+float AABB::surfaceArea() const {
+	if (empty()) {
+		return 0.f;
+	}
+	glm::vec3 d = boundMax - boundMin;
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+AABB AABB::transform(const glm::mat4& matrix) const {
+	AABB result;
+
+	if (empty()) {
+		return result;
+	}
+	for (uint32_t i = 0; i < 8; i++) {
+		glm::vec3 corner(
+			(i & 1) ? boundMax.x : boundMin.x,
+			(i & 2) ? boundMax.y : boundMin.y,
+			(i & 4) ? boundMax.z : boundMin.z
+		);
+		result.expand(glm::vec3(matrix * glm::vec4(corner, 1.f)));
+	}
+	return result;
+}
+
+void BVH::build(const std::vector<AABB>& primBounds, const BVHBuildSettings& settings) {
+	clear();
+
+	if (primBounds.empty()) {
+		return;
+	}
+	Timer timer;
+	uint32_t numPrims = static_cast<uint32_t>(primBounds.size());
+
+	mSettings = settings;
+	mSettings.maxLeafSize = std::max(mSettings.maxLeafSize, 1u);
+	mSettings.numBins = std::clamp(mSettings.numBins, 2u, MaxBins);
+	mMaxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	// Only lives for the duration of the build so that BVH stays movable
+	std::atomic<uint32_t> numActiveThreads = 1;
+	mNumActiveThreads = &numActiveThreads;
+
+	mPrimRefs.resize(numPrims);
+
+	for (uint32_t i = 0; i < numPrims; i++) {
+		mPrimRefs[i] = { primBounds[i], primBounds[i].centroid(), i };
+	}
+	auto root = buildRecursive(0, numPrims, 0);
+	mNumActiveThreads = nullptr;
+	flatten(root.get(), 0);
+
+	primIndices.resize(numPrims);
+
+	for (uint32_t i = 0; i < numPrims; i++) {
+		primIndices[i] = mPrimRefs[i].prim;
+	}
+
+	float rootArea = std::max(root->bounds.surfaceArea(), FLT_MIN);
+
+	for (const auto& node : nodes) {
+		float area = AABB{ node.boundMin, node.boundMax }.surfaceArea() / rootArea;
+		mStatistics.sahCost += (node.numPrims > 0) ? area * node.numPrims : area * mSettings.traversalCost;
+	}
+	mStatistics.numNodes = static_cast<uint32_t>(nodes.size());
+	mStatistics.buildMs = timer.get();
+
+	mPrimRefs.clear();
+	mPrimRefs.shrink_to_fit();
+}
+
+void BVH::clear() {
+	nodes.clear();
+	primIndices.clear();
+	mStatistics = Statistics();
+}
+
+AABB BVH::bounds() const {
+	if (empty()) {
+		return AABB();
+	}
+	return AABB{ nodes[0].boundMin, nodes[0].boundMax };
+}
+
+std::unique_ptr<BVH::BuildNode> BVH::buildRecursive(uint32_t begin, uint32_t end, uint32_t depth) {
+	auto node = std::make_unique<BuildNode>();
+	node->begin = begin;
+	node->end = end;
+
+	AABB centroidBounds;
+
+	for (uint32_t i = begin; i < end; i++) {
+		node->bounds.expand(mPrimRefs[i].bounds);
+		centroidBounds.expand(mPrimRefs[i].centroid);
+	}
+	uint32_t count = end - begin;
+
+	if (count <= 1 || depth >= MaxDepth) {
+		return node;
+	}
+	glm::vec3 extent = centroidBounds.boundMax - centroidBounds.boundMin;
+	uint32_t mid = begin;
+
+	if (extent.x <= 0.f && extent.y <= 0.f && extent.z <= 0.f) {
+		// Coincident centroids cannot be separated by any plane, halve the range instead
+		if (count <= mSettings.maxLeafSize) {
+			return node;
+		}
+		mid = begin + count / 2;
+	}
+	else {
+		const uint32_t numBins = mSettings.numBins;
+		std::array<std::array<AABB, MaxBins>, 3> binBounds;
+		std::array<std::array<uint32_t, MaxBins>, 3> binCounts{};
+
+		auto binIndex = [&](const glm::vec3& centroid, int axis) {
+			float scale = numBins / extent[axis];
+			uint32_t bin = static_cast<uint32_t>((centroid[axis] - centroidBounds.boundMin[axis]) * scale);
+			return std::min(bin, numBins - 1);
+		};
+
+		// All three axes are binned in the same pass over the primitives
+		for (uint32_t i = begin; i < end; i++) {
+			const auto& ref = mPrimRefs[i];
+
+			for (int axis = 0; axis < 3; axis++) {
+				if (extent[axis] > 0.f) {
+					uint32_t bin = binIndex(ref.centroid, axis);
+					binBounds[axis][bin].expand(ref.bounds);
+					binCounts[axis][bin]++;
+				}
+			}
+		}
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		uint32_t bestBin = 0;
+
+		for (int axis = 0; axis < 3; axis++) {
+			if (extent[axis] <= 0.f) {
+				continue;
+			}
+			std::array<float, MaxBins> rightAreas;
+			std::array<uint32_t, MaxBins> rightCounts;
+			AABB right;
+			uint32_t rightCount = 0;
+
+			for (uint32_t i = numBins - 1; i > 0; i--) {
+				right.expand(binBounds[axis][i]);
+				rightCount += binCounts[axis][i];
+				rightAreas[i] = right.surfaceArea();
+				rightCounts[i] = rightCount;
+			}
+			AABB left;
+			uint32_t leftCount = 0;
+
+			// Split i puts bins [0, i) on the left
+			for (uint32_t i = 1; i < numBins; i++) {
+				left.expand(binBounds[axis][i - 1]);
+				leftCount += binCounts[axis][i - 1];
+
+				if (leftCount == 0 || rightCounts[i] == 0) {
+					continue;
+				}
+				float cost = left.surfaceArea() * leftCount + rightAreas[i] * rightCounts[i];
+
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = i;
+				}
+			}
+		}
+		float nodeArea = std::max(node->bounds.surfaceArea(), FLT_MIN);
+		float splitCost = mSettings.traversalCost + bestCost / nodeArea;
+
+		if (count <= mSettings.maxLeafSize && (bestAxis == -1 || static_cast<float>(count) <= splitCost)) {
+			return node;
+		}
+		if (bestAxis == -1) {
+			mid = begin + count / 2;
+		}
+		else {
+			auto iter = std::partition(mPrimRefs.begin() + begin, mPrimRefs.begin() + end, [&](const PrimRef& ref) {
+				return binIndex(ref.centroid, bestAxis) < bestBin;
+			});
+			mid = static_cast<uint32_t>(iter - mPrimRefs.begin());
+		}
+	}
+
+	bool parallel = false;
+
+	if (count >= mSettings.parallelThreshold) {
+		parallel = mNumActiveThreads->fetch_add(1) < mMaxThreads;
+
+		if (!parallel) {
+			(*mNumActiveThreads)--;
+		}
+	}
+
+	if (parallel) {
+		std::thread leftThread([&]() { node->children[0] = buildRecursive(begin, mid, depth + 1); });
+		node->children[1] = buildRecursive(mid, end, depth + 1);
+		leftThread.join();
+		(*mNumActiveThreads)--;
+	}
+	else {
+		node->children[0] = buildRecursive(begin, mid, depth + 1);
+		node->children[1] = buildRecursive(mid, end, depth + 1);
+	}
+	return node;
+}
+
+uint32_t BVH::flatten(const BuildNode* node, uint32_t depth) {
+	uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back(BVHNode{ node->bounds.boundMin, 0, node->bounds.boundMax, 0 });
+	mStatistics.maxDepth = std::max(mStatistics.maxDepth, depth);
+
+	if (!node->children[0]) {
+		nodes[index].offset = node->begin;
+		nodes[index].numPrims = node->end - node->begin;
+		mStatistics.numLeaves++;
+		return index;
+	}
+	flatten(node->children[0].get(), depth + 1);
+	nodes[index].offset = flatten(node->children[1].get(), depth + 1);
+	return index;
+}
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "util/NamespaceDecl.h"
+
+NAMESPACE_BEGIN(cpu)
+
+struct AABB {
+	glm::vec3 boundMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundMax = glm::vec3(-FLT_MAX);
+
+	void expand(const glm::vec3& p) {
+		boundMin = glm::min(boundMin, p);
+		boundMax = glm::max(boundMax, p);
+	}
+
+	void expand(const AABB& box) {
+		boundMin = glm::min(boundMin, box.boundMin);
+		boundMax = glm::max(boundMax, box.boundMax);
+	}
+
+	bool empty() const { return boundMin.x > boundMax.x; }
+	glm::vec3 centroid() const { return (boundMin + boundMax) * .5f; }
+	float surfaceArea() const;
+	AABB transform(const glm::mat4& matrix) const;
+};
+
+// Interior nodes keep their first child right after themselves and the second at offset,
+//   leaves have numPrims > 0 and index a range of primIndices starting at offset
+struct BVHNode {
+	glm::vec3 boundMin;
+	uint32_t offset;
+	glm::vec3 boundMax;
+	uint32_t numPrims;
+};
+
+struct BVHBuildSettings {
+	uint32_t maxLeafSize = 4;
+	uint32_t numBins = 16;
+	// Cost of visiting a node relative to intersecting one primitive
+	float traversalCost = 1.f;
+	// Smaller ranges are never handed to another thread
+	uint32_t parallelThreshold = 1 << 14;
+};
+
+/**
+* Binary BVH with binned SAH splits. Subtrees above parallelThreshold primitives are built on
+*   separate threads, then the tree is flattened in depth first order
+*/
+class BVH {
+public:
+	static constexpr uint32_t MaxDepth = 64;
+	static constexpr uint32_t MaxBins = 32;
+
+	struct Statistics {
+		uint32_t numNodes = 0;
+		uint32_t numLeaves = 0;
+		uint32_t maxDepth = 0;
+		double buildMs = 0.0;
+		// Expected cost of a random ray hitting the root, in units of primitive intersections
+		float sahCost = 0.f;
+	};
+
+	void build(const std::vector<AABB>& primBounds, const BVHBuildSettings& settings = {});
+	void clear();
+
+	bool empty() const { return nodes.empty(); }
+	AABB bounds() const;
+	const Statistics& statistics() const { return mStatistics; }
+
+private:
+	// Primitives are moved around during partitioning instead of indices, which keeps binning passes sequential in memory
+	struct PrimRef {
+		AABB bounds;
+		glm::vec3 centroid;
+		uint32_t prim;
+	};
+
+	struct BuildNode {
+		AABB bounds;
+		uint32_t begin;
+		uint32_t end;
+		std::unique_ptr<BuildNode> children[2];
+	};
+
+	std::unique_ptr<BuildNode> buildRecursive(uint32_t begin, uint32_t end, uint32_t depth);
+	uint32_t flatten(const BuildNode* node, uint32_t depth);
+
+public:
+	std::vector<BVHNode> nodes;
+	std::vector<uint32_t> primIndices;
+
+private:
+	std::vector<PrimRef> mPrimRefs;
+	BVHBuildSettings mSettings;
+	std::atomic<uint32_t>* mNumActiveThreads = nullptr;
+	uint32_t mMaxThreads = 1;
+	Statistics mStatistics;
+};
+
+NAMESPACE_END(cpu)
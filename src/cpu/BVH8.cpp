@@ -0,0 +1,392 @@
+#include "BVH8.h"
+#include "util/Timer.h"
+
+#include <algorithm>
+#include <cmath>
+
+NAMESPACE_BEGIN(cpu)
+
+constexpr uint32_t BlockSize = 8;
+
+// Widens slab exits so that rounding in the dequantized bounds never culls a hit (pbrt's 1 + 2 * gamma(3))
+constexpr float RobustExitScale = 1.f + 2.f * (3.f * 0x1p-24f) / (1.f - 3.f * 0x1p-24f);
+
+static float quantizationScale(float extent) {
+	if (!(extent > 0.f)) {
+		return 1.f;
+	}
+	// One spare step absorbs rounding of origin + q * scale at the top of the range
+	return std::exp2(std::ceil(std::log2(extent / 254.f)));
+}
+
+void BVH8::build(const BVH& bvh, const std::vector<glm::vec3>& positions) {
+	clear();
+
+	if (bvh.empty()) {
+		return;
+	}
+	mBinary = &bvh;
+	mPositions = &positions;
+
+	Timer timer;
+
+	uint32_t numBinaryNodes = static_cast<uint32_t>(bvh.nodes.size());
+	mSubtreeBegin.resize(numBinaryNodes);
+	mSubtreeCount.resize(numBinaryNodes);
+
+	// Children are always stored after their parents, and a left subtree's range precedes the right one's
+	for (uint32_t i = numBinaryNodes; i-- > 0; ) {
+		const auto& node = bvh.nodes[i];
+
+		if (node.numPrims > 0) {
+			mSubtreeBegin[i] = node.offset;
+			mSubtreeCount[i] = node.numPrims;
+		}
+		else {
+			mSubtreeBegin[i] = mSubtreeBegin[i + 1];
+			mSubtreeCount[i] = mSubtreeCount[i + 1] + mSubtreeCount[node.offset];
+		}
+	}
+	collapse(0);
+
+	mSubtreeBegin.clear();
+	mSubtreeCount.clear();
+	mBinary = nullptr;
+	mPositions = nullptr;
+
+	uint32_t numLanes = 0;
+
+	for (const auto& block : blocks) {
+		numLanes += std::popcount(block.validMask);
+	}
+	mStatistics.numNodes = static_cast<uint32_t>(nodes.size());
+	mStatistics.numBlocks = static_cast<uint32_t>(blocks.size());
+	mStatistics.laneOccupancy = static_cast<float>(numLanes) / (blocks.size() * 8);
+	mStatistics.buildMs = timer.get();
+}
+
+void BVH8::clear() {
+	nodes.clear();
+	blocks.clear();
+	mStatistics = Statistics();
+}
+
+size_t BVH8::byteSize() const {
+	return nodes.size() * sizeof(BVH8Node) + blocks.size() * sizeof(TriangleBlock8);
+}
+
+uint32_t BVH8::collapse(uint32_t binaryNode) {
+	const auto& binaryNodes = mBinary->nodes;
+
+	auto expandable = [&](uint32_t idx) {
+		return binaryNodes[idx].numPrims == 0 && mSubtreeCount[idx] > BlockSize;
+	};
+	auto area = [&](uint32_t idx) {
+		return AABB{ binaryNodes[idx].boundMin, binaryNodes[idx].boundMax }.surfaceArea();
+	};
+
+	uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back(BVH8Node{});
+
+	// Open the largest interior children first until all eight slots are used
+	std::vector<uint32_t> children = { binaryNode };
+
+	while (children.size() < 8) {
+		int best = -1;
+
+		for (int i = 0; i < children.size(); i++) {
+			if (expandable(children[i]) && (best == -1 || area(children[i]) > area(children[best]))) {
+				best = i;
+			}
+		}
+		if (best == -1) {
+			break;
+		}
+		uint32_t opened = children[best];
+		children[best] = opened + 1;
+		children.push_back(binaryNodes[opened].offset);
+	}
+
+	BVH8Node node{};
+	AABB bounds;
+
+	for (uint32_t child : children) {
+		bounds.expand(AABB{ binaryNodes[child].boundMin, binaryNodes[child].boundMax });
+	}
+	node.origin = bounds.boundMin;
+
+	for (int axis = 0; axis < 3; axis++) {
+		node.scale[axis] = quantizationScale(bounds.boundMax[axis] - bounds.boundMin[axis]);
+	}
+
+	for (uint32_t i = 0; i < children.size(); i++) {
+		uint32_t child = children[i];
+		const auto& childNode = binaryNodes[child];
+
+		for (int axis = 0; axis < 3; axis++) {
+			float origin = node.origin[axis];
+			float scale = node.scale[axis];
+
+			auto decode = [&](int q) { return origin + static_cast<float>(q) * scale; };
+
+			int qMin = std::clamp(static_cast<int>(std::floor((childNode.boundMin[axis] - origin) / scale)), 0, 255);
+			int qMax = std::clamp(static_cast<int>(std::ceil((childNode.boundMax[axis] - origin) / scale)), 0, 255);
+
+			while (qMin > 0 && decode(qMin) > childNode.boundMin[axis]) {
+				qMin--;
+			}
+			while (qMax < 255 && decode(qMax) < childNode.boundMax[axis]) {
+				qMax++;
+			}
+			node.qMin[axis][i] = static_cast<uint8_t>(qMin);
+			node.qMax[axis][i] = static_cast<uint8_t>(qMax);
+		}
+		node.validMask |= 1 << i;
+
+		if (expandable(child)) {
+			node.children[i] = collapse(child);
+		}
+		else {
+			uint32_t begin = mSubtreeBegin[child];
+			uint32_t count = mSubtreeCount[child];
+
+			node.leafMask |= 1 << i;
+			node.children[i] = makeBlocks(begin, begin + count);
+			node.numBlocks[i] = (count + BlockSize - 1) / BlockSize;
+		}
+	}
+	nodes[index] = node;
+	return index;
+}
+
+uint32_t BVH8::makeBlocks(uint32_t begin, uint32_t end) {
+	const auto& positions = *mPositions;
+	uint32_t first = static_cast<uint32_t>(blocks.size());
+
+	for (uint32_t blockBegin = begin; blockBegin < end; blockBegin += BlockSize) {
+		TriangleBlock8 block{};
+		uint32_t count = std::min(end - blockBegin, BlockSize);
+
+		for (uint32_t lane = 0; lane < BlockSize; lane++) {
+			uint32_t slot = blockBegin + ((lane < count) ? lane : 0);
+
+			for (int axis = 0; axis < 3; axis++) {
+				block.v0[axis][lane] = positions[slot * 3 + 0][axis];
+				block.v1[axis][lane] = positions[slot * 3 + 1][axis];
+				block.v2[axis][lane] = positions[slot * 3 + 2][axis];
+			}
+			block.primIds[lane] = mBinary->primIndices[slot];
+		}
+		block.validMask = (1u << count) - 1;
+		blocks.push_back(block);
+	}
+	return first;
+}
+
+bool BVH8::intersect(Ray& ray, Intersection& isec) const {
+	return traverse<false>(ray, &isec);
+}
+
+bool BVH8::occluded(const Ray& ray) const {
+	Ray shadowRay = ray;
+	return traverse<true>(shadowRay, nullptr);
+}
+
+template<bool AnyHit>
+bool BVH8::intersectBlock(const TriangleBlock8& block, const WatertightRay& wray, Ray& ray, Intersection* isec) const {
+	const int kx = wray.kx;
+	const int ky = wray.ky;
+	const int kz = wray.kz;
+
+	Float8 ox = Float8::broadcast(wray.origin[kx]);
+	Float8 oy = Float8::broadcast(wray.origin[ky]);
+	Float8 oz = Float8::broadcast(wray.origin[kz]);
+
+	Float8 aX = Float8::load(block.v0[kx]) - ox;
+	Float8 aY = Float8::load(block.v0[ky]) - oy;
+	Float8 aZ = Float8::load(block.v0[kz]) - oz;
+	Float8 bX = Float8::load(block.v1[kx]) - ox;
+	Float8 bY = Float8::load(block.v1[ky]) - oy;
+	Float8 bZ = Float8::load(block.v1[kz]) - oz;
+	Float8 cX = Float8::load(block.v2[kx]) - ox;
+	Float8 cY = Float8::load(block.v2[ky]) - oy;
+	Float8 cZ = Float8::load(block.v2[kz]) - oz;
+
+	Float8 sx = Float8::broadcast(wray.sx);
+	Float8 sy = Float8::broadcast(wray.sy);
+	Float8 sz = Float8::broadcast(wray.sz);
+
+	Float8 ax = aX - sx * aZ;
+	Float8 ay = aY - sy * aZ;
+	Float8 bx = bX - sx * bZ;
+	Float8 by = bY - sy * bZ;
+	Float8 cx = cX - sx * cZ;
+	Float8 cy = cY - sy * cZ;
+
+	Float8 u = cx * by - cy * bx;
+	Float8 v = ax * cy - ay * cx;
+	Float8 w = bx * ay - by * ax;
+
+	Float8 zero = Float8::broadcast(0.f);
+	uint32_t valid = block.validMask;
+
+	// Lanes on an edge or vertex go through the scalar test, which redoes the edge functions in double
+	uint32_t fallback = (equal(u, zero) | equal(v, zero) | equal(w, zero)) & valid;
+
+	uint32_t anyNegative = lessThan(u, zero) | lessThan(v, zero) | lessThan(w, zero);
+	uint32_t anyPositive = greaterThan(u, zero) | greaterThan(v, zero) | greaterThan(w, zero);
+
+	Float8 det = u + v + w;
+	Float8 t = u * (sz * aZ) + v * (sz * bZ) + w * (sz * cZ);
+	Float8 absDet = abs(det);
+	Float8 signedT = mulSign(t, det);
+
+	uint32_t outside =
+		(anyNegative & anyPositive) | equal(det, zero) |
+		lessThan(signedT, Float8::broadcast(ray.tMin) * absDet) |
+		greaterThan(signedT, Float8::broadcast(ray.tMax) * absDet);
+
+	uint32_t hits = valid & ~fallback & ~outside;
+
+	if constexpr (AnyHit) {
+		if (hits) {
+			return true;
+		}
+	}
+	int bestLane = -1;
+	float bestT = ray.tMax;
+	TriangleHit bestHit;
+
+	if (hits) {
+		Float8 invDet = Float8::broadcast(1.f) / det;
+		Float8 tHit = t * invDet;
+
+		for (uint32_t mask = hits; mask; mask &= mask - 1) {
+			uint32_t lane = firstLane(mask);
+
+			if (bestLane == -1 || tHit[lane] < bestT) {
+				bestLane = static_cast<int>(lane);
+				bestT = tHit[lane];
+				bestHit = { tHit[lane], v[lane] * invDet[lane], w[lane] * invDet[lane] };
+			}
+		}
+	}
+
+	for (uint32_t mask = fallback; mask; mask &= mask - 1) {
+		uint32_t lane = firstLane(mask);
+		glm::vec3 v0(block.v0[0][lane], block.v0[1][lane], block.v0[2][lane]);
+		glm::vec3 v1(block.v1[0][lane], block.v1[1][lane], block.v1[2][lane]);
+		glm::vec3 v2(block.v2[0][lane], block.v2[1][lane], block.v2[2][lane]);
+		TriangleHit hit;
+
+		if (intersectTriangle(wray, v0, v1, v2, ray.tMin, ray.tMax, hit)) {
+			if constexpr (AnyHit) {
+				return true;
+			}
+			if (bestLane == -1 || hit.t < bestT) {
+				bestLane = static_cast<int>(lane);
+				bestT = hit.t;
+				bestHit = hit;
+			}
+		}
+	}
+
+	if (bestLane == -1) {
+		return false;
+	}
+	if constexpr (!AnyHit) {
+		ray.tMax = bestHit.t;
+		isec->bary = glm::vec2(bestHit.b1, bestHit.b2);
+		isec->triangleIdx = block.primIds[bestLane];
+	}
+	return true;
+}
+
+template<bool AnyHit>
+bool BVH8::traverse(Ray& ray, Intersection* isec) const {
+	if (nodes.empty()) {
+		return false;
+	}
+	WatertightRay wray(ray);
+	Float8 origin[3];
+	Float8 invDir[3];
+
+	for (int axis = 0; axis < 3; axis++) {
+		// Zero components would turn into 0 * inf = NaN in the slab test
+		float d = ray.dir[axis];
+		d = (d == 0.f) ? std::copysign(1e-30f, d) : d;
+
+		origin[axis] = Float8::broadcast(ray.origin[axis]);
+		invDir[axis] = Float8::broadcast(1.f / d);
+	}
+
+	struct Entry {
+		uint32_t index;
+		uint32_t numBlocks;
+		float t;
+	};
+	Entry stack[StackSize];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, 0, -MaxRayDistance };
+
+	bool found = false;
+
+	while (stackSize > 0) {
+		Entry entry = stack[--stackSize];
+
+		if (entry.t > ray.tMax) {
+			continue;
+		}
+		if (entry.numBlocks > 0) {
+			for (uint32_t i = 0; i < entry.numBlocks; i++) {
+				if (intersectBlock<AnyHit>(blocks[entry.index + i], wray, ray, isec)) {
+					if constexpr (AnyHit) {
+						return true;
+					}
+					found = true;
+				}
+			}
+			continue;
+		}
+		const BVH8Node& node = nodes[entry.index];
+		Float8 tEntry = Float8::broadcast(ray.tMin);
+		Float8 tExit = Float8::broadcast(ray.tMax);
+
+		for (int axis = 0; axis < 3; axis++) {
+			Float8 nodeOrigin = Float8::broadcast(node.origin[axis]);
+			Float8 scale = Float8::broadcast(node.scale[axis]);
+			Float8 lo = nodeOrigin + Float8::fromBytes(node.qMin[axis]) * scale;
+			Float8 hi = nodeOrigin + Float8::fromBytes(node.qMax[axis]) * scale;
+
+			Float8 t0 = (lo - origin[axis]) * invDir[axis];
+			Float8 t1 = (hi - origin[axis]) * invDir[axis];
+
+			tEntry = max(tEntry, min(t0, t1));
+			tExit = min(tExit, max(t0, t1) * Float8::broadcast(RobustExitScale));
+		}
+		uint32_t hitMask = lessEqual(tEntry, tExit) & node.validMask;
+
+		if (!hitMask) {
+			continue;
+		}
+		Entry hits[8];
+		uint32_t numHits = 0;
+
+		for (uint32_t mask = hitMask; mask; mask &= mask - 1) {
+			uint32_t lane = firstLane(mask);
+			uint32_t numBlocks = (node.leafMask >> lane & 1) ? node.numBlocks[lane] : 0;
+			hits[numHits++] = { node.children[lane], numBlocks, tEntry[lane] };
+		}
+
+		if constexpr (!AnyHit) {
+			// Farthest first so that the nearest child ends up on top of the stack
+			std::sort(hits, hits + numHits, [](const Entry& a, const Entry& b) { return a.t > b.t; });
+		}
+		for (uint32_t i = 0; i < numHits; i++) {
+			stack[stackSize++] = hits[i];
+		}
+	}
+	return found;
+}
+
+NAMESPACE_END(cpu)
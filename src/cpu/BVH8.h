@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+
+#include "BVH.h"
+#include "Ray.h"
+#include "SIMD.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Eight children with bounds quantized to 8 bits per plane on a power of two grid anchored at
+*   origin, so that dequantization is exact up to the final addition. Leaf children point to
+*   numBlocks consecutive triangle blocks. Block counts are 32 bit since leaves forced at
+*   BVH::MaxDepth may hold any number of triangles
+*/
+struct BVH8Node {
+	glm::vec3 origin;
+	uint8_t validMask;
+	uint8_t leafMask;
+	uint8_t pad[2];
+	glm::vec3 scale;
+	uint8_t qMin[3][8];
+	uint8_t qMax[3][8];
+	uint32_t numBlocks[8];
+	uint32_t children[8];
+};
+
+// Up to eight triangles in SoA layout, unused lanes repeat the first triangle and are masked out
+struct TriangleBlock8 {
+	float v0[3][8];
+	float v1[3][8];
+	float v2[3][8];
+	uint32_t primIds[8];
+	uint32_t validMask;
+};
+
+/**
+* 8-wide BVH collapsed from a binary BVH, intersected with AVX2 slab tests and an 8-wide
+*   watertight triangle kernel. Binary subtrees of at most eight triangles become one block
+*/
+class BVH8 {
+public:
+	static constexpr uint32_t StackSize = 512;
+
+	struct Statistics {
+		uint32_t numNodes = 0;
+		uint32_t numBlocks = 0;
+		// Fraction of block lanes holding a triangle
+		float laneOccupancy = 0.f;
+		double buildMs = 0.0;
+	};
+
+	void build(const BVH& bvh, const std::vector<glm::vec3>& positions);
+	void clear();
+
+	bool empty() const { return nodes.empty(); }
+
+	// Closest hit, shortens ray.tMax and writes bary and triangleIdx
+	bool intersect(Ray& ray, Intersection& isec) const;
+	bool occluded(const Ray& ray) const;
+
+	size_t byteSize() const;
+	const Statistics& statistics() const { return mStatistics; }
+
+private:
+	uint32_t collapse(uint32_t binaryNode);
+	uint32_t makeBlocks(uint32_t begin, uint32_t end);
+
+	template<bool AnyHit>
+	bool traverse(Ray& ray, Intersection* isec) const;
+
+	template<bool AnyHit>
+	bool intersectBlock(const TriangleBlock8& block, const WatertightRay& wray, Ray& ray, Intersection* isec) const;
+
+public:
+	std::vector<BVH8Node> nodes;
+	std::vector<TriangleBlock8> blocks;
+
+private:
+	const BVH* mBinary = nullptr;
+	const std::vector<glm::vec3>* mPositions = nullptr;
+	std::vector<uint32_t> mSubtreeBegin;
+	std::vector<uint32_t> mSubtreeCount;
+	Statistics mStatistics;
+};
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,360 @@
+#include "DistributedRender.h"
+#include "util/Error.h"
+
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <thread>
+
+NAMESPACE_BEGIN(cpu)
+
+// Messages are a header followed by size bytes of payload, integers in host byte order as both ends
+//   are expected to be x86 or ARM little endian machines
+enum class MessageType : uint32_t {
+	// Worker -> coordinator on connection
+	Hello,
+	// Coordinator -> worker, JobMessage followed by the scene file path
+	Job,
+	Tile,
+	// Worker -> coordinator, tile index followed by the RGB sums of the tile's pixels row by row
+	TileResult,
+	Done
+};
+
+struct MessageHeader {
+	MessageType type;
+	uint32_t size;
+};
+
+constexpr uint32_t ProtocolMagic = 0x52505452;
+constexpr uint32_t ProtocolVersion = 1;
+
+// Longest scene path accepted in a job message
+constexpr uint32_t MaxSceneFileLength = 4096;
+
+struct HelloMessage {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numThreads;
+};
+
+struct JobMessage {
+	uint32_t width;
+	uint32_t height;
+	uint32_t samplesPerPixel;
+	uint32_t samplesPerPass;
+	uint32_t maxDepth;
+	uint32_t tileSize;
+	uint32_t mode;
+	uint32_t seed;
+};
+
+struct TileMessage {
+	uint32_t tileIdx;
+	TileScheduler::Tile tile;
+};
+
+static size_t tileArea(const TileScheduler::Tile& tile) {
+	return size_t(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+}
+
+static bool sendMessage(Socket& socket, MessageType type, const void* data = nullptr, size_t size = 0, const void* extra = nullptr, size_t extraSize = 0) {
+	MessageHeader header = { type, static_cast<uint32_t>(size + extraSize) };
+
+	return socket.sendAll(&header, sizeof(header)) &&
+		(size == 0 || socket.sendAll(data, size)) &&
+		(extraSize == 0 || socket.sendAll(extra, extraSize));
+}
+
+// Sizes come from the peer unchecked, so anything longer than the largest payload the receiver
+//   expects fails before allocating
+static bool recvMessage(Socket& socket, MessageHeader& header, std::vector<char>& payload, size_t maxSize) {
+	if (!socket.recvAll(&header, sizeof(header)) || header.size > maxSize) {
+		return false;
+	}
+	payload.resize(header.size);
+	return header.size == 0 || socket.recvAll(payload.data(), payload.size());
+}
+
+RenderCoordinator::RenderCoordinator(const Settings& settings) :
+	mSettings(settings),
+	mTiles(settings.tracer.width, settings.tracer.height, settings.tileSize),
+	mListenSocket(Socket::listen(settings.port))
+{}
+
+std::vector<float> RenderCoordinator::run(const std::function<bool()>& giveUp) {
+	mTimer.reset();
+	mPending.clear();
+	mTileStates.assign(mTiles.numTiles(), TileState());
+	mNumDone = 0;
+	mSumTileMs = 0.0;
+	mAccum.assign(size_t(mSettings.tracer.width) * mSettings.tracer.height, glm::vec3(0.f));
+	mStatistics = Statistics();
+	mStatistics.numTiles = mTiles.numTiles();
+
+	for (uint32_t i = 0; i < mTiles.numTiles(); i++) {
+		mPending.push_back(i);
+	}
+	std::vector<std::thread> handlers;
+
+	bool gaveUp = false;
+
+	while (!finished()) {
+		Socket socket = mListenSocket.accept(100);
+
+		if (socket.valid()) {
+			mNumConnected++;
+
+			handlers.emplace_back([this](Socket socket) {
+				serveWorker(std::move(socket));
+				mNumConnected--;
+			}, std::move(socket));
+		}
+		else if (mNumConnected == 0 && giveUp && giveUp()) {
+			gaveUp = true;
+			break;
+		}
+	}
+	for (auto& handler : handlers) {
+		handler.join();
+	}
+	mStatistics.ms = mTimer.get();
+
+	if (gaveUp) {
+		throw std::runtime_error(std::format("Render abandoned with {} of {} tiles done, no worker connected", mNumDone, mTiles.numTiles()));
+	}
+
+	std::vector<float> rgb(mAccum.size() * 3);
+	float scale = 1.f / std::max(mSettings.tracer.samplesPerPixel, 1u);
+
+	for (size_t i = 0; i < mAccum.size(); i++) {
+		rgb[i * 3 + 0] = mAccum[i].x * scale;
+		rgb[i * 3 + 1] = mAccum[i].y * scale;
+		rgb[i * 3 + 2] = mAccum[i].z * scale;
+	}
+	return rgb;
+}
+
+void RenderCoordinator::serveWorker(Socket socket) {
+	std::string peer = socket.peerName();
+	MessageHeader header;
+	std::vector<char> payload;
+
+	if (!recvMessage(socket, header, payload, sizeof(HelloMessage)) || header.type != MessageType::Hello || payload.size() != sizeof(HelloMessage)) {
+		Log::line<1>(std::format("Rejected {}: no hello", peer));
+		return;
+	}
+	auto hello = *reinterpret_cast<const HelloMessage*>(payload.data());
+
+	if (hello.magic != ProtocolMagic || hello.version != ProtocolVersion) {
+		Log::line<1>(std::format("Rejected {}: protocol version {}, expected {}", peer, hello.version, ProtocolVersion));
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStatistics.numWorkers++;
+	}
+	Log::line<1>(std::format("Worker {} connected, {} threads", peer, hello.numThreads));
+
+	const auto& tracer = mSettings.tracer;
+	JobMessage job = {
+		tracer.width, tracer.height, tracer.samplesPerPixel, tracer.samplesPerPass, tracer.maxDepth, tracer.tileSize,
+		static_cast<uint32_t>(tracer.mode), tracer.seed
+	};
+
+	if (!sendMessage(socket, MessageType::Job, &job, sizeof(job), mSettings.sceneFile.data(), mSettings.sceneFile.size())) {
+		Log::line<1>(std::format("Lost worker {} before the job was sent", peer));
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStatistics.numLostWorkers++;
+		return;
+	}
+
+	while (auto tileIdx = nextTile()) {
+		TileMessage tileMessage = { *tileIdx, mTiles.tile(*tileIdx) };
+		double dispatchMs = mTimer.get();
+		bool received = sendMessage(socket, MessageType::Tile, &tileMessage, sizeof(tileMessage));
+
+		// Polled so that a worker overtaken on its last tile doesn't keep the render from returning
+		bool overtaken = false;
+
+		while (received && !socket.waitReadable(100)) {
+			if (finished()) {
+				overtaken = true;
+				break;
+			}
+		}
+		if (overtaken) {
+			releaseTile(*tileIdx);
+			break;
+		}
+		size_t expectedSize = sizeof(uint32_t) + tileArea(tileMessage.tile) * sizeof(glm::vec3);
+
+		received = received && recvMessage(socket, header, payload, expectedSize) &&
+			header.type == MessageType::TileResult && payload.size() == expectedSize &&
+			*reinterpret_cast<const uint32_t*>(payload.data()) == *tileIdx;
+
+		if (!received) {
+			Log::line<1>(std::format("Lost worker {}, tile {} requeued", peer, *tileIdx));
+			releaseTile(*tileIdx);
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStatistics.numLostWorkers++;
+			return;
+		}
+		completeTile(*tileIdx, payload.data() + sizeof(uint32_t), mTimer.get() - dispatchMs);
+	}
+	sendMessage(socket, MessageType::Done);
+}
+
+std::optional<uint32_t> RenderCoordinator::nextTile() {
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	while (mNumDone < mTiles.numTiles()) {
+		double now = mTimer.get();
+
+		while (!mPending.empty()) {
+			uint32_t tileIdx = mPending.front();
+			mPending.pop_front();
+
+			// Tiles requeued by a lost worker may have been finished by a re-dispatched copy since
+			if (!mTileStates[tileIdx].done) {
+				mTileStates[tileIdx].numInFlight++;
+				mTileStates[tileIdx].dispatchMs = now;
+				mStatistics.numDispatches++;
+				return tileIdx;
+			}
+		}
+		// Nothing left to hand out, so an idle worker duplicates the tile in flight the longest if
+		//   it is late compared to the tiles done so far
+		if (mNumDone > 0) {
+			double lateMs = std::max(mSettings.minStragglerMs, mSettings.stragglerFactor * mSumTileMs / mNumDone);
+			std::optional<uint32_t> straggler;
+
+			for (uint32_t i = 0; i < mTiles.numTiles(); i++) {
+				const auto& state = mTileStates[i];
+
+				if (!state.done && state.numInFlight == 1 && now - state.dispatchMs > lateMs &&
+					(!straggler || state.dispatchMs < mTileStates[*straggler].dispatchMs)
+				) {
+					straggler = i;
+				}
+			}
+			if (straggler) {
+				mTileStates[*straggler].numInFlight++;
+				mTileStates[*straggler].dispatchMs = now;
+				mStatistics.numDispatches++;
+				mStatistics.numRedispatches++;
+				return straggler;
+			}
+		}
+		mCondition.wait_for(lock, std::chrono::milliseconds(100));
+	}
+	return std::nullopt;
+}
+
+void RenderCoordinator::completeTile(uint32_t tileIdx, const char* sums, double tileMs) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto& state = mTileStates[tileIdx];
+	state.numInFlight--;
+
+	if (state.done) {
+		mStatistics.numDuplicates++;
+		return;
+	}
+	const auto& tile = mTiles.tile(tileIdx);
+	size_t rowSize = size_t(tile.x1 - tile.x0) * sizeof(glm::vec3);
+
+	for (uint32_t y = tile.y0; y < tile.y1; y++) {
+		std::memcpy(&mAccum[size_t(y) * mSettings.tracer.width + tile.x0], sums + (y - tile.y0) * rowSize, rowSize);
+	}
+	state.done = true;
+	mNumDone++;
+	mSumTileMs += tileMs;
+	mCondition.notify_all();
+}
+
+void RenderCoordinator::releaseTile(uint32_t tileIdx) {
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto& state = mTileStates[tileIdx];
+	state.numInFlight--;
+
+	if (!state.done && state.numInFlight == 0) {
+		mPending.push_back(tileIdx);
+		mCondition.notify_all();
+	}
+}
+
+bool RenderCoordinator::finished() {
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mNumDone == mTiles.numTiles();
+}
+
+void runRenderWorker(const std::string& host, uint16_t port, uint32_t numThreads, uint32_t tileDelayMs) {
+	if (numThreads == 0) {
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	Socket socket = Socket::connect(host, port);
+	HelloMessage hello = { ProtocolMagic, ProtocolVersion, numThreads };
+	MessageHeader header;
+	std::vector<char> payload;
+
+	if (!sendMessage(socket, MessageType::Hello, &hello, sizeof(hello)) ||
+		!recvMessage(socket, header, payload, sizeof(JobMessage) + MaxSceneFileLength) ||
+		header.type != MessageType::Job || payload.size() < sizeof(JobMessage)
+	) {
+		throw std::runtime_error(std::format("No job from {}:{}", host, port));
+	}
+	auto job = *reinterpret_cast<const JobMessage*>(payload.data());
+	std::string sceneFile(payload.data() + sizeof(JobMessage), payload.size() - sizeof(JobMessage));
+
+	Log::line<0>(std::format("Render worker, {}x{}, {} spp, scene = {}", job.width, job.height, job.samplesPerPixel, sceneFile));
+
+	Scene scene;
+	scene.load(sceneFile);
+
+	AccelerationStructure accel;
+	accel.build(scene);
+
+	PathTracer::Settings settings;
+	settings.width = job.width;
+	settings.height = job.height;
+	settings.samplesPerPixel = job.samplesPerPixel;
+	settings.samplesPerPass = job.samplesPerPass;
+	settings.maxDepth = job.maxDepth;
+	settings.tileSize = job.tileSize;
+	settings.mode = static_cast<PathTracer::Mode>(job.mode);
+	settings.seed = job.seed;
+	settings.numThreads = numThreads;
+
+	PathTracer tracer(scene, accel, settings);
+	uint32_t numTiles = 0;
+	Timer timer;
+
+	while (recvMessage(socket, header, payload, sizeof(TileMessage)) && header.type == MessageType::Tile && payload.size() == sizeof(TileMessage)) {
+		auto tileMessage = *reinterpret_cast<const TileMessage*>(payload.data());
+		const auto& tile = tileMessage.tile;
+		uint32_t tileWidth = tile.x1 - tile.x0;
+		std::vector<glm::vec3> sums(tileArea(tile));
+
+		TileScheduler scheduler(tileWidth, tile.y1 - tile.y0, settings.tileSize);
+
+		scheduler.run(numThreads, [&](const TileScheduler::Tile& subTile, uint32_t subTileIdx) {
+			for (uint32_t y = subTile.y0; y < subTile.y1; y++) {
+				for (uint32_t x = subTile.x0; x < subTile.x1; x++) {
+					sums[size_t(y) * tileWidth + x] = tracer.accumulatePixel(glm::uvec2(tile.x0 + x, tile.y0 + y));
+				}
+			}
+		});
+
+		if (tileDelayMs > 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(tileDelayMs));
+		}
+		if (!sendMessage(socket, MessageType::TileResult, &tileMessage.tileIdx, sizeof(uint32_t), sums.data(), sums.size() * sizeof(glm::vec3))) {
+			break;
+		}
+		numTiles++;
+	}
+	// Done, or the coordinator closed the connection once all tiles were in
+	Log::line<1>(std::format("Rendered {} tiles in {:.2f} s", numTiles, timer.get() * 1e-3));
+}
+
+NAMESPACE_END(cpu)
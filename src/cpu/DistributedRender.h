@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "PathTracer.h"
+#include "Socket.h"
+#include "util/Timer.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Coordinator of a PathTracer render split over worker processes, local or on other hosts, which
+*   connect over TCP. The film is cut into tiles handed out one at a time to whichever worker asks,
+*   and workers send back the sums of all samples of a tile's pixels, which are seeded per sample
+*   and pixel with makeSeed as in PathTracer::renderPass, so the merged image matches a single
+*   process render bit for bit. A tile taken much longer than average is handed to an idle worker
+*   too and the first result wins, tiles of workers that disconnect go back to the queue
+*/
+class RenderCoordinator {
+public:
+	struct Settings {
+		// Workers load the scene themselves, remote hosts need it at the same path
+		std::string sceneFile;
+		PathTracer::Settings tracer;
+		// Size of tiles sent to workers, each worker splits them again by tracer.tileSize
+		uint32_t tileSize = 64;
+		// 0 picks a free port
+		uint16_t port = 0;
+		// A tile in flight for this many times the average tile time is sent again
+		float stragglerFactor = 3.f;
+		// and at least this long, so that the first tiles don't all look late
+		double minStragglerMs = 2000.0;
+	};
+
+	struct Statistics {
+		uint32_t numWorkers = 0;
+		uint32_t numTiles = 0;
+		uint32_t numDispatches = 0;
+		uint32_t numRedispatches = 0;
+		// Results of tiles that were already in, from workers overtaken after re-dispatch
+		uint32_t numDuplicates = 0;
+		uint32_t numLostWorkers = 0;
+		double ms = 0.0;
+	};
+
+	// Starts listening, so that workers can connect before run()
+	explicit RenderCoordinator(const Settings& settings);
+
+	uint16_t port() const { return mListenSocket.localPort(); }
+
+	// Serves workers until all tiles are in, returns the image as PathTracer::resolve does. giveUp is
+	//   polled while no worker is connected, run() throws once it returns true
+	std::vector<float> run(const std::function<bool()>& giveUp = {});
+	const Statistics& statistics() const { return mStatistics; }
+
+private:
+	struct TileState {
+		bool done = false;
+		uint32_t numInFlight = 0;
+		double dispatchMs = 0.0;
+	};
+
+	void serveWorker(Socket socket);
+	// Next tile for a worker, nullopt once all are in
+	std::optional<uint32_t> nextTile();
+	// Copies the tile's pixel sums unless another worker delivered them first
+	void completeTile(uint32_t tileIdx, const char* sums, double tileMs);
+	// Puts a tile of a lost or overtaken worker back unless it is done or still in flight elsewhere
+	void releaseTile(uint32_t tileIdx);
+	bool finished();
+
+private:
+	Settings mSettings;
+	TileScheduler mTiles;
+	Socket mListenSocket;
+	Timer mTimer;
+
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::deque<uint32_t> mPending;
+	std::vector<TileState> mTileStates;
+	uint32_t mNumDone = 0;
+	double mSumTileMs = 0.0;
+	std::atomic<uint32_t> mNumConnected = 0;
+
+	// Sum of all samples per pixel, as PathTracer's
+	std::vector<glm::vec3> mAccum;
+	Statistics mStatistics;
+};
+
+/**
+* Connects to a coordinator, loads the scene it names and renders tiles until told it is done.
+*   numThreads 0 uses all hardware threads, tileDelayMs holds back every result to make the worker a
+*   straggler when testing re-dispatch
+*/
+void runRenderWorker(const std::string& host, uint16_t port, uint32_t numThreads, uint32_t tileDelayMs = 0);
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,120 @@
+#include "EXR.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+NAMESPACE_BEGIN(cpu)
+
+// All values are little endian, as on every platform this builds for
+class EXRHeader {
+public:
+	template<typename T>
+	void put(const T& value) {
+		const char* bytes = reinterpret_cast<const char*>(&value);
+		data.insert(data.end(), bytes, bytes + sizeof(T));
+	}
+
+	void putString(const std::string& str) {
+		data.insert(data.end(), str.begin(), str.end());
+		data.push_back('\0');
+	}
+
+	void beginAttribute(const std::string& name, const std::string& type, int32_t size) {
+		putString(name);
+		putString(type);
+		put(size);
+	}
+
+	void putBox(int32_t xMax, int32_t yMax) {
+		put(int32_t(0));
+		put(int32_t(0));
+		put(xMax);
+		put(yMax);
+	}
+
+	std::vector<char> data;
+};
+
+bool writeEXR(const File::path& path, uint32_t width, uint32_t height, const float* rgb) {
+	constexpr int32_t PixelTypeFloat = 2;
+	// Channels are stored in alphabetical order
+	const char* channelNames[] = { "B", "G", "R" };
+	const int channelOffsets[] = { 2, 1, 0 };
+
+	EXRHeader header;
+	header.put(uint32_t(20000630));
+	header.put(uint32_t(2));
+
+	header.beginAttribute("channels", "chlist", 3 * 18 + 1);
+
+	for (auto name : channelNames) {
+		header.putString(name);
+		header.put(PixelTypeFloat);
+		header.put(uint32_t(0));
+		header.put(int32_t(1));
+		header.put(int32_t(1));
+	}
+	header.data.push_back('\0');
+
+	header.beginAttribute("compression", "compression", 1);
+	header.data.push_back(0);
+
+	int32_t xMax = static_cast<int32_t>(width) - 1;
+	int32_t yMax = static_cast<int32_t>(height) - 1;
+
+	header.beginAttribute("dataWindow", "box2i", 16);
+	header.putBox(xMax, yMax);
+
+	header.beginAttribute("displayWindow", "box2i", 16);
+	header.putBox(xMax, yMax);
+
+	header.beginAttribute("lineOrder", "lineOrder", 1);
+	header.data.push_back(0);
+
+	header.beginAttribute("pixelAspectRatio", "float", 4);
+	header.put(1.f);
+
+	header.beginAttribute("screenWindowCenter", "v2f", 8);
+	header.put(0.f);
+	header.put(0.f);
+
+	header.beginAttribute("screenWindowWidth", "float", 4);
+	header.put(1.f);
+
+	header.data.push_back('\0');
+
+	// One scanline per block without compression, each led by its y and byte count
+	uint64_t lineBytes = uint64_t(width) * 3 * sizeof(float);
+	uint64_t blockBytes = sizeof(int32_t) * 2 + lineBytes;
+	uint64_t firstBlock = header.data.size() + sizeof(uint64_t) * height;
+
+	for (uint32_t y = 0; y < height; y++) {
+		header.put(firstBlock + blockBytes * y);
+	}
+
+	std::ofstream file(path, std::ios::binary);
+
+	if (!file) {
+		return false;
+	}
+	file.write(header.data.data(), header.data.size());
+
+	std::vector<float> line(size_t(width) * 3);
+
+	for (uint32_t y = 0; y < height; y++) {
+		for (int c = 0; c < 3; c++) {
+			for (uint32_t x = 0; x < width; x++) {
+				line[size_t(c) * width + x] = rgb[(size_t(y) * width + x) * 3 + channelOffsets[c]];
+			}
+		}
+		int32_t lineY = static_cast<int32_t>(y);
+		int32_t size = static_cast<int32_t>(lineBytes);
+		file.write(reinterpret_cast<const char*>(&lineY), sizeof(lineY));
+		file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		file.write(reinterpret_cast<const char*>(line.data()), lineBytes);
+	}
+	return static_cast<bool>(file);
+}
+
+NAMESPACE_END(cpu)
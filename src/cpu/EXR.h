@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+#include "util/File.h"
+#include "util/NamespaceDecl.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Writes interleaved RGB floats, rows top to bottom, as an uncompressed scanline OpenEXR file
+*   with 32 bit float B, G and R channels. Returns false if the file cannot be written
+*/
+bool writeEXR(const File::path& path, uint32_t width, uint32_t height, const float* rgb);
+
+NAMESPACE_END(cpu)
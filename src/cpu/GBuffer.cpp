@@ -0,0 +1,56 @@
+#include "GBuffer.h"
+
+NAMESPACE_BEGIN(cpu)
+
+GBuffer::GBuffer(const PathTracer& tracer, const AccelerationStructure& accel, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t numThreads) :
+	mWidth(width), mHeight(height), mTexels(size_t(width) * height)
+{
+	TileScheduler scheduler(width, height, tileSize);
+
+	scheduler.run(numThreads, [&](const TileScheduler::Tile& tile, uint32_t tileIdx) {
+		for (uint32_t y = tile.y0; y < tile.y1; y++) {
+			for (uint32_t x = tile.x0; x < tile.x1; x++) {
+				Ray ray = tracer.cameraRay({ x, y });
+				Intersection isec;
+
+				if (!accel.intersect(ray, isec)) {
+					continue;
+				}
+				SurfaceInfo surf;
+				tracer.loadSurfaceInfo(isec, surf);
+
+				if (surf.isLight) {
+					continue;
+				}
+				auto& texel = mTexels[index1D({ x, y })];
+				texel.pos = surf.pos - ray.dir * 1e-4f;
+				texel.norm = surf.norm;
+				texel.albedo = surf.albedo;
+				texel.wo = -ray.dir;
+				texel.matIndex = surf.matIndex;
+				texel.instanceIdx = isec.instanceIdx;
+				texel.valid = true;
+			}
+		}
+	});
+}
+
+std::optional<uint32_t> GBuffer::index(const glm::vec2& uv) const {
+	if (uv.x < 0.f || uv.y < 0.f || uv.x > 1.f || uv.y > 1.f) {
+		return std::nullopt;
+	}
+	uint32_t x = static_cast<uint32_t>(uv.x * static_cast<float>(mWidth));
+	uint32_t y = static_cast<uint32_t>(uv.y * static_cast<float>(mHeight));
+
+	// texelFetch out of the image returns 0, which is read as no depth
+	if (x >= mWidth || y >= mHeight || !mTexels[index1D({ x, y })].valid) {
+		return std::nullopt;
+	}
+	return index1D({ x, y });
+}
+
+SurfaceInfo GBuffer::surface(const GBufferTexel& texel) const {
+	return SurfaceInfo{ texel.pos, texel.norm, texel.albedo, texel.matIndex, false };
+}
+
+NAMESPACE_END(cpu)
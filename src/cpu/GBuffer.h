@@ -0,0 +1,47 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+
+#include "PathTracer.h"
+
+NAMESPACE_BEGIN(cpu)
+
+// What the GBuffer holds for a pixel, with pos reconstructed from depth as the shaders do
+struct GBufferTexel {
+	glm::vec3 pos;
+	glm::vec3 norm;
+	glm::vec3 albedo;
+	glm::vec3 wo;
+	uint32_t matIndex;
+	uint32_t instanceIdx;
+	bool valid = false;
+};
+
+/**
+* Stand-in for the rasterized GBuffer of the host ReSTIR passes: primary hits traced once from
+*   the camera, which stays still, so the previous frame's GBuffer is this one. Lights are left
+*   uncovered, none of the passes shade them
+*/
+class GBuffer {
+public:
+	GBuffer(const PathTracer& tracer, const AccelerationStructure& accel, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t numThreads);
+
+	uint32_t width() const { return mWidth; }
+	uint32_t height() const { return mHeight; }
+	size_t size() const { return mTexels.size(); }
+
+	uint32_t index1D(glm::uvec2 index) const { return index.y * mWidth + index.x; }
+	const GBufferTexel& operator [] (uint32_t index) const { return mTexels[index]; }
+
+	// Pixel the shaders read at uv, ivec2(uv * filmSize), if it is on the film and covered
+	std::optional<uint32_t> index(const glm::vec2& uv) const;
+	SurfaceInfo surface(const GBufferTexel& texel) const;
+
+private:
+	uint32_t mWidth;
+	uint32_t mHeight;
+	std::vector<GBufferTexel> mTexels;
+};
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,468 @@
+#include "PathTracer.h"
+#include "SphericalTriangle.h"
+#include "util/Timer.h"
+
+#include <array>
+#include <cmath>
+
+NAMESPACE_BEGIN(cpu)
+
+static float srgbToLinear(float x) {
+	return (x <= .04045f) ? x / 12.92f : std::pow((x + .055f) / 1.055f, 2.4f);
+}
+
+static const std::array<float, 256>& srgbTable() {
+	static const std::array<float, 256> table = []() {
+		std::array<float, 256> table;
+
+		for (uint32_t i = 0; i < 256; i++) {
+			table[i] = srgbToLinear(i / 255.f);
+		}
+		return table;
+	}();
+	return table;
+}
+
+// Int8 images are uploaded as sRGB formats, so the decode matches what samplers return
+static glm::vec3 fetchTexel(const zvk::HostImage& image, int x, int y) {
+	x = (x % image.width + image.width) % image.width;
+	y = (y % image.height + image.height) % image.height;
+	size_t offset = (size_t(y) * image.width + x) * image.channels;
+	glm::vec3 texel;
+
+	for (int c = 0; c < 3; c++) {
+		int channel = std::min(c, image.channels - 1);
+
+		if (image.dataType == zvk::HostImageType::Int8) {
+			texel[c] = srgbTable()[image.data<uint8_t>()[offset + channel]];
+		}
+		else {
+			texel[c] = image.data<float>()[offset + channel];
+		}
+	}
+	return texel;
+}
+
+// Level 0 lookup with repeat addressing and the image's own filter, as the samplers created for textures
+static glm::vec3 sampleImage(const zvk::HostImage& image, const glm::vec2& uv) {
+	glm::vec2 coord = uv * glm::vec2(image.width, image.height);
+
+	if (image.filter == zvk::HostImageFilter::Nearest) {
+		return fetchTexel(image, static_cast<int>(std::floor(coord.x)), static_cast<int>(std::floor(coord.y)));
+	}
+	coord -= .5f;
+	glm::vec2 base = glm::floor(coord);
+	glm::vec2 f = coord - base;
+	int x = static_cast<int>(base.x);
+	int y = static_cast<int>(base.y);
+
+	return glm::mix(
+		glm::mix(fetchTexel(image, x, y), fetchTexel(image, x + 1, y), f.x),
+		glm::mix(fetchTexel(image, x, y + 1), fetchTexel(image, x + 1, y + 1), f.x),
+		f.y
+	);
+}
+
+PathTracer::PathTracer(const Scene& scene, const AccelerationStructure& accel, const Settings& settings) :
+	mScene(scene), mAccel(accel), mSettings(settings),
+	mScheduler(settings.width, settings.height, settings.tileSize)
+{
+	Camera camera = scene.camera;
+	camera.update();
+
+	mCameraPos = camera.pos();
+	mCameraRight = camera.right();
+	mCameraUp = camera.up();
+	mCameraFront = camera.front();
+	mTanFOV = std::tan(glm::radians(camera.FOV() * .5f));
+
+	mAccum.assign(size_t(settings.width) * settings.height, glm::vec3(0.f));
+
+	mStatistics.numThreads = (settings.numThreads == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : settings.numThreads;
+	mStatistics.numTiles = mScheduler.numTiles();
+}
+
+bool PathTracer::renderPass() {
+	if (finished()) {
+		return false;
+	}
+	uint32_t firstSample = mSampleCount;
+	uint32_t numSamples = std::min(std::max(mSettings.samplesPerPass, 1u), mSettings.samplesPerPixel - mSampleCount);
+
+	Timer timer;
+
+	mScheduler.run(mStatistics.numThreads, [&](const TileScheduler::Tile& tile, uint32_t tileIdx) {
+		for (uint32_t y = tile.y0; y < tile.y1; y++) {
+			for (uint32_t x = tile.x0; x < tile.x1; x++) {
+				mAccum[size_t(y) * mSettings.width + x] += renderPixel(glm::uvec2(x, y), firstSample, numSamples);
+			}
+		}
+	});
+	mStatistics.ms += timer.get();
+	mStatistics.numSamples += uint64_t(numSamples) * mSettings.width * mSettings.height;
+	mStatistics.numSteals = mScheduler.numSteals();
+	mStatistics.numPasses++;
+	mSampleCount += numSamples;
+
+	return true;
+}
+
+glm::vec3 PathTracer::renderPixel(glm::uvec2 index, uint32_t firstSample, uint32_t numSamples) const {
+	glm::vec3 sum(0.f);
+
+	for (uint32_t i = 0; i < numSamples; i++) {
+		uint32_t rng = makeSeed(makeSeed(mSettings.seed, firstSample + i), index);
+		sum += tracePath(index, rng);
+	}
+	return sum;
+}
+
+glm::vec3 PathTracer::accumulatePixel(glm::uvec2 index) const {
+	glm::vec3 accum(0.f);
+	uint32_t samplesPerPass = std::max(mSettings.samplesPerPass, 1u);
+
+	for (uint32_t first = 0; first < mSettings.samplesPerPixel; first += samplesPerPass) {
+		accum += renderPixel(index, first, std::min(samplesPerPass, mSettings.samplesPerPixel - first));
+	}
+	return accum;
+}
+
+std::vector<float> PathTracer::resolve() const {
+	std::vector<float> rgb(mAccum.size() * 3);
+	float scale = (mSampleCount > 0) ? 1.f / mSampleCount : 0.f;
+
+	for (size_t i = 0; i < mAccum.size(); i++) {
+		rgb[i * 3 + 0] = mAccum[i].x * scale;
+		rgb[i * 3 + 1] = mAccum[i].y * scale;
+		rgb[i * 3 + 2] = mAccum[i].z * scale;
+	}
+	return rgb;
+}
+
+Ray PathTracer::cameraRay(glm::uvec2 index) const {
+	glm::vec2 uv = (glm::vec2(index) + .5f) / glm::vec2(mSettings.width, mSettings.height);
+	glm::vec2 ndc = glm::vec2(uv.x, 1.f - uv.y) * 2.f - 1.f;
+	float aspect = static_cast<float>(mSettings.width) / mSettings.height;
+
+	glm::vec3 dir = glm::normalize(glm::vec3(ndc * glm::vec2(aspect, 1.f) * mTanFOV, 1.f));
+
+	Ray ray;
+	ray.origin = mCameraPos;
+	ray.dir = glm::normalize(mCameraRight * dir.x + mCameraUp * dir.y + mCameraFront * dir.z);
+	return ray;
+}
+
+void PathTracer::loadSurfaceInfo(const Intersection& isec, SurfaceInfo& surf) const {
+	glm::vec3 bary(1.f - isec.bary.x - isec.bary.y, isec.bary.x, isec.bary.y);
+
+	if (isec.instanceIdx == 0 && isec.triangleIdx == EnvironmentLightId) {
+		glm::vec3 dir = planeToSphere(isec.bary);
+
+		surf.pos = dir * MaxRayDistance;
+		surf.norm = -dir;
+		surf.albedo = sampleImage(*mScene.environmentMap, isec.bary);
+		surf.isLight = true;
+		return;
+	}
+	if (isec.instanceIdx == 0) {
+		const auto& light = mScene.triangleLights[isec.triangleIdx];
+
+		surf.pos = light.v0 * bary.x + light.v1 * bary.y + light.v2 * bary.z;
+		surf.norm = glm::vec3(light.nx, light.ny, light.nz);
+		surf.albedo = light.radiance;
+		surf.isLight = true;
+		return;
+	}
+	const auto& resource = mScene.resource;
+	const auto& instance = mScene.objectInstances[isec.instanceIdx - 1];
+	const auto& indices = resource.indices[Resource::Object];
+	const auto& vertices = resource.vertices[Resource::Object];
+
+	surf.matIndex = resource.materialIndices[instance.indexOffset / 3 + isec.triangleIdx];
+	surf.isLight = false;
+
+	const auto& v0 = vertices[indices[instance.indexOffset + isec.triangleIdx * 3 + 0]];
+	const auto& v1 = vertices[indices[instance.indexOffset + isec.triangleIdx * 3 + 1]];
+	const auto& v2 = vertices[indices[instance.indexOffset + isec.triangleIdx * 3 + 2]];
+
+	glm::vec3 pos = v0.pos * bary.x + v1.pos * bary.y + v2.pos * bary.z;
+	glm::vec3 norm = v0.norm * bary.x + v1.norm * bary.y + v2.norm * bary.z;
+	glm::vec2 uv(
+		v0.uvx * bary.x + v1.uvx * bary.y + v2.uvx * bary.z,
+		v0.uvy * bary.x + v1.uvy * bary.y + v2.uvy * bary.z
+	);
+
+	surf.pos = glm::vec3(instance.transform * glm::vec4(pos, 1.f));
+	surf.norm = glm::normalize(glm::mat3(instance.transformInvT) * norm);
+
+	const auto& material = resource.materials[surf.matIndex];
+	const auto& images = resource.imagePool();
+
+	// Virtual textures are read from the full resolution host image instead of the streamed atlas
+	if (material.textureIdx == InvalidResourceIdx || material.textureIdx >= images.size() || !images[material.textureIdx]) {
+		surf.albedo = material.baseColor;
+	}
+	else {
+		surf.albedo = sampleImage(*images[material.textureIdx], uv);
+	}
+}
+
+bool PathTracer::hasEnvironmentMap() const {
+	return mScene.environmentMap && mScene.environmentSampleTable.sumAll > 0.f;
+}
+
+float PathTracer::environmentSelectProb() const {
+	if (!hasEnvironmentMap()) {
+		return 0.f;
+	}
+	return mScene.triangleLights.empty() ? 1.f : .5f;
+}
+
+glm::vec3 PathTracer::environmentRadiance(const glm::vec3& dir) const {
+	return sampleImage(*mScene.environmentMap, sphereToPlane(dir));
+}
+
+float PathTracer::environmentMapPdf(const glm::vec3& dir) const {
+	const auto& table = mScene.environmentSampleTable;
+	glm::uvec2 size(table.width, table.height);
+	glm::vec2 uv = sphereToPlane(dir);
+	glm::uvec2 texel = glm::min(glm::uvec2(uv * glm::vec2(size)), size - 1u);
+
+	float sinTheta = std::sin(Pi * (static_cast<float>(texel.y) + .5f) / static_cast<float>(size.y));
+	float texelPdf = luminance(fetchTexel(*mScene.environmentMap, texel.x, texel.y)) * sinTheta / table.sumAll;
+	float sinDir = std::sqrt(glm::max(1.f - dir.z * dir.z, 1e-8f));
+
+	return texelPdf * static_cast<float>(size.x * size.y) / (2.f * Pi * Pi * sinDir);
+}
+
+glm::vec3 PathTracer::sampleEnvironmentMap(glm::vec3& wi, float& pdf, const glm::vec4& r) const {
+	const auto& table = mScene.environmentSampleTable;
+	glm::uvec2 size(table.width, table.height);
+	auto [row, column] = table.sample(r.x, r.y, r.z, r.w);
+
+	// The column and row picks only use the integer part of N * r, the rest jitters within the texel
+	glm::vec2 jitter = glm::fract(glm::vec2(r.z * static_cast<float>(size.x), r.x * static_cast<float>(size.y)));
+	glm::vec2 uv = (glm::vec2(column, row) + jitter) / glm::vec2(size);
+
+	wi = planeToSphere(uv);
+	pdf = environmentMapPdf(wi);
+	return environmentRadiance(wi);
+}
+
+glm::vec3 PathTracer::sampleTriangleLight(
+	const TriangleLight& light, const glm::vec3& ref, glm::vec3& wi, float& dist, float& pdf, float& jacobian, glm::vec2& bary, const glm::vec2& r
+) const {
+	float solidAngle = triangleSolidAngle(light.v0, light.v1, light.v2, ref);
+	bool spherical = useSphericalTriangleSampling(solidAngle);
+
+	bary = spherical ? sampleSphericalTriangle(light.v0, light.v1, light.v2, ref, r.x, r.y) : uvToBary(r);
+
+	glm::vec3 pos = light.v0 * (1.f - bary.x - bary.y) + light.v1 * bary.x + light.v2 * bary.y;
+	dist = glm::distance(ref, pos);
+
+	glm::vec3 n(light.nx, light.ny, light.nz);
+	wi = (pos - ref) / dist;
+	jacobian = absDot(n, wi) / square(dist);
+	pdf = spherical ? 1.f / solidAngle : 1.f / jacobian / light.area;
+
+	// Lights are single sided, SAMPLE_LIGHT_DOUBLE_SIDE is off
+	return (glm::dot(n, wi) > 0.f) ? glm::vec3(0.f) : light.radiance;
+}
+
+glm::vec3 PathTracer::sampleLight(const glm::vec3& ref, glm::vec3& wi, float& dist, float& pdf, glm::vec4 r) const {
+	float envProb = environmentSelectProb();
+
+	if (r.x < envProb) {
+		r.x /= envProb;
+		dist = MaxRayDistance;
+		glm::vec3 radiance = sampleEnvironmentMap(wi, pdf, r);
+		pdf *= envProb;
+		return radiance;
+	}
+	r.x = (r.x - envProb) / (1.f - envProb);
+
+	// SAMPLE_LIGHT_BVH is on, the normal is not used to guide the pick
+	auto sample = mScene.lightBVH.sample(ref, glm::vec3(0.f), r.x);
+
+	if (!sample) {
+		pdf = 0.f;
+		return glm::vec3(0.f);
+	}
+	float jacobian;
+	glm::vec2 bary;
+	glm::vec3 radiance = sampleTriangleLight(mScene.triangleLights[sample->lightId], ref, wi, dist, pdf, jacobian, bary, glm::vec2(r.z, r.w));
+	pdf *= sample->pmf * (1.f - envProb);
+	return radiance;
+}
+
+glm::vec3 PathTracer::sampleLightByPower(
+	const glm::vec3& ref, glm::vec3& wi, float& dist, float& pdf, float& jacobian, glm::vec2& bary, uint32_t& id, const glm::vec4& r
+) const {
+	float sumPower = mScene.lightSampleTable.sum();
+
+	if (sumPower <= 0.f) {
+		pdf = 0.f;
+		return glm::vec3(0.f);
+	}
+	id = mScene.lightSampleTable.sample(r.x, r.y);
+
+	const auto& light = mScene.triangleLights[id];
+	glm::vec3 radiance = sampleTriangleLight(light, ref, wi, dist, pdf, jacobian, bary, glm::vec2(r.z, r.w));
+	pdf *= luminance(light.radiance) * light.area / sumPower;
+	return radiance;
+}
+
+float PathTracer::triangleLightDirectionPdf(const TriangleLight& light, const glm::vec3& ref, float dist, float cosTheta) const {
+	float solidAngle = triangleSolidAngle(light.v0, light.v1, light.v2, ref);
+	return useSphericalTriangleSampling(solidAngle) ? 1.f / solidAngle : dist * dist / std::abs(cosTheta) / light.area;
+}
+
+float PathTracer::triangleLightPdf(const glm::vec3& ref, uint32_t id, float dist, float cosTheta) const {
+	float pmf = mScene.lightBVH.pmf(ref, glm::vec3(0.f), id);
+	return pmf * triangleLightDirectionPdf(mScene.triangleLights[id], ref, dist, cosTheta) * (1.f - environmentSelectProb());
+}
+
+float PathTracer::triangleLightPowerPdf(const glm::vec3& ref, uint32_t id, float dist, float cosTheta) const {
+	const auto& light = mScene.triangleLights[id];
+	float pmf = luminance(light.radiance) * light.area / mScene.lightSampleTable.sum();
+	return pmf * triangleLightDirectionPdf(light, ref, dist, cosTheta) * (1.f - environmentSelectProb());
+}
+
+Intersection PathTracer::environmentIntersection(const glm::vec3& dir) const {
+	return Intersection{ sphereToPlane(dir), 0, EnvironmentLightId };
+}
+
+glm::vec3 PathTracer::sampleLight(
+	const glm::vec3& ref, glm::vec3& wi, float& dist, float& pdf, float& jacobian, glm::vec2& bary, uint32_t& id, glm::vec4 r
+) const {
+	float envProb = environmentSelectProb();
+
+	if (r.x < envProb) {
+		r.x /= envProb;
+		glm::vec3 radiance = sampleEnvironmentMap(wi, pdf, r);
+		dist = MaxRayDistance;
+		jacobian = 1.f / square(MaxRayDistance);
+		bary = sphereToPlane(wi);
+		id = EnvironmentLightId;
+		pdf *= envProb;
+		return radiance;
+	}
+	r.x = (r.x - envProb) / (1.f - envProb);
+
+	glm::vec3 radiance = sampleLightByPower(ref, wi, dist, pdf, jacobian, bary, id, r);
+	pdf *= 1.f - envProb;
+	return radiance;
+}
+
+float PathTracer::sampledLightPdf(const glm::vec3& ref, uint32_t id, const glm::vec3& wi, float dist, float cosTheta) const {
+	if (id == EnvironmentLightId) {
+		return environmentLightPdf(wi);
+	}
+	return triangleLightPowerPdf(ref, id, dist, cosTheta);
+}
+
+float PathTracer::environmentLightPdf(const glm::vec3& dir) const {
+	return environmentMapPdf(dir) * environmentSelectProb();
+}
+
+bool PathTracer::visible(const glm::vec3& from, const glm::vec3& to) const {
+	Ray ray;
+	ray.origin = from;
+	ray.dir = glm::normalize(to - from);
+	ray.tMax = glm::distance(to, from) - MinRayDistance;
+	return !mAccel.occluded(ray);
+}
+
+glm::vec3 PathTracer::tracePath(glm::uvec2 index, uint32_t& rng) const {
+	// Number of bounces between camera and light of the contributions this mode keeps
+	uint32_t minLightDepth = (mSettings.mode == Mode::Full) ? 0 : (mSettings.mode == Mode::Direct) ? 1 : 2;
+	uint32_t maxLightDepth = (mSettings.mode == Mode::Direct) ? 1 : mSettings.maxDepth;
+
+	auto inRange = [&](uint32_t depth) { return depth >= minLightDepth && depth <= maxLightDepth; };
+
+	Ray ray = cameraRay(index);
+
+	glm::vec3 radiance(0.f);
+	glm::vec3 throughput(1.f);
+	glm::vec3 lastPos;
+	glm::vec3 wo = -ray.dir;
+
+	BSDFSample s;
+	// Hits reached by BSDF sampling only get an MIS weight if light sampling could have produced them
+	bool lastSampledLight = false;
+
+	for (uint32_t bounce = 0; bounce < mSettings.maxDepth; bounce++) {
+		Intersection isec;
+
+		if (!mAccel.intersect(ray, isec)) {
+			if (inRange(bounce) && hasEnvironmentMap()) {
+				float weight = (!lastSampledLight || isSampleTypeDelta(s.type)) ? 1.f : MISWeight(s.pdf, environmentLightPdf(ray.dir));
+				radiance += environmentRadiance(ray.dir) * weight * throughput;
+			}
+			break;
+		}
+		SurfaceInfo surf;
+		loadSurfaceInfo(isec, surf);
+
+		if (surf.isLight) {
+			float cosTheta = -glm::dot(ray.dir, surf.norm);
+
+			if (inRange(bounce) && cosTheta > 0.f) {
+				float weight = 1.f;
+
+				if (lastSampledLight && !isSampleTypeDelta(s.type)) {
+					float dist = glm::length(surf.pos - lastPos);
+					weight = MISWeight(s.pdf, triangleLightPdf(lastPos, isec.triangleIdx, dist, cosTheta));
+				}
+				radiance += surf.albedo * weight * throughput;
+			}
+			break;
+		}
+		const auto& mat = mScene.resource.materials[surf.matIndex];
+		lastSampledLight = inRange(bounce + 1) && !isBSDFDelta(mat);
+
+		if (/* sample direct lighting */ lastSampledLight) {
+			glm::vec3 lightDir;
+			float lightDist, lightPdf;
+			glm::vec3 lightRadiance = sampleLight(surf.pos, lightDir, lightDist, lightPdf, sample4f(rng));
+
+			Ray shadowRay;
+			shadowRay.origin = surf.pos;
+			shadowRay.dir = lightDir;
+			shadowRay.tMax = lightDist - MinRayDistance;
+
+			if (lightPdf > 1e-6f && !mAccel.occluded(shadowRay)) {
+				float bsdfPdf = evalPdf(mat, surf.norm, wo, lightDir);
+				float weight = MISWeight(lightPdf, bsdfPdf);
+
+				radiance += lightRadiance * evalBSDF(mat, surf.albedo, surf.norm, wo, lightDir) * satDot(surf.norm, lightDir) / lightPdf * weight * throughput;
+			}
+		}
+		if (bounce + 1 > maxLightDepth) {
+			break;
+		}
+		if (/* russian roulette */ bounce > 4) {
+			float pdfTerminate = glm::max(1.f - luminance(throughput), 0.f);
+
+			if (sample1f(rng) < pdfTerminate) {
+				break;
+			}
+			throughput /= (1.f - pdfTerminate);
+		}
+
+		if (!sampleBSDF(mat, surf.albedo, surf.norm, wo, sample3f(rng), s) || s.pdf < 1e-6f) {
+			break;
+		}
+		float cosTheta = isSampleTypeDelta(s.type) ? 1.f : absDot(surf.norm, s.wi);
+		throughput *= s.bsdf * cosTheta / s.pdf;
+		lastPos = surf.pos;
+
+		wo = -s.wi;
+		ray.origin = surf.pos + s.wi * 1e-4f;
+		ray.dir = s.wi;
+		ray.tMax = MaxRayDistance;
+	}
+	return clampColor(radiance);
+}
+
+NAMESPACE_END(cpu)
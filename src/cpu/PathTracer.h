@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vector>
+
+#include "AccelerationStructure.h"
+#include "Shading.h"
+#include "TileScheduler.h"
+
+NAMESPACE_BEGIN(cpu)
+
+// Mirrors SurfaceInfo in ray_layouts.glsl, albedo holds radiance on lights
+struct SurfaceInfo {
+	glm::vec3 pos;
+	glm::vec3 norm;
+	glm::vec3 albedo;
+	uint32_t matIndex;
+	bool isLight;
+};
+
+/**
+* Headless reference path tracer, the host counterpart of gi_naive.glsl and di_naive.glsl.
+*   Materials, light BVH sampling, environment map sampling and MIS follow the shaders, with
+*   primary rays traced from the pinhole camera instead of read from the GBuffer. Pixels are
+*   rendered in tiles on a work stealing scheduler and accumulated progressively, one pass of
+*   samplesPerPass samples at a time
+*/
+class PathTracer {
+public:
+	enum class Mode {
+		// Lights reached after one bounce, NEE and BSDF sampling combined with MIS, as di_naive
+		Direct,
+		// Lights reached after two or more bounces, as gi_naive
+		Indirect,
+		// Emission seen by the camera plus Direct and Indirect
+		Full
+	};
+
+	struct Settings {
+		uint32_t width = 1280;
+		uint32_t height = 720;
+		uint32_t samplesPerPixel = 64;
+		uint32_t samplesPerPass = 4;
+		// MaxTracingDepth in gi_naive
+		uint32_t maxDepth = 15;
+		uint32_t tileSize = 16;
+		Mode mode = Mode::Full;
+		uint32_t seed = 0;
+		// 0 uses all hardware threads
+		uint32_t numThreads = 0;
+	};
+
+	struct Statistics {
+		uint32_t numThreads = 0;
+		uint32_t numTiles = 0;
+		uint32_t numPasses = 0;
+		uint64_t numSteals = 0;
+		uint64_t numSamples = 0;
+		double ms = 0.0;
+
+		double samplesPerSecond() const { return numSamples / (ms * 1e-3); }
+	};
+
+	PathTracer(const Scene& scene, const AccelerationStructure& accel, const Settings& settings);
+
+	// Renders one pass over all tiles, returns false once samplesPerPixel have been taken
+	bool renderPass();
+	bool finished() const { return mSampleCount >= mSettings.samplesPerPixel; }
+
+	uint32_t sampleCount() const { return mSampleCount; }
+	const Statistics& statistics() const { return mStatistics; }
+
+	// Current estimate as interleaved RGB floats, rows top to bottom
+	std::vector<float> resolve() const;
+
+	glm::vec3 tracePath(glm::uvec2 index, uint32_t& rng) const;
+	// Sum of numSamples samples of a pixel starting at firstSample, seeded per sample and pixel
+	glm::vec3 renderPixel(glm::uvec2 index, uint32_t firstSample, uint32_t numSamples) const;
+	// Sum of all samplesPerPixel samples, added up pass by pass as renderPass does, so that pixels
+	//   rendered elsewhere match a local render bit for bit
+	glm::vec3 accumulatePixel(glm::uvec2 index) const;
+
+	void loadSurfaceInfo(const Intersection& isec, SurfaceInfo& surf) const;
+	glm::vec3 sampleLight(const glm::vec3& ref, glm::vec3& wi, float& dist, float& pdf, glm::vec4 r) const;
+	float triangleLightPdf(const glm::vec3& ref, uint32_t id, float dist, float cosTheta) const;
+	float environmentLightPdf(const glm::vec3& dir) const;
+	glm::vec3 environmentRadiance(const glm::vec3& dir) const;
+	bool hasEnvironmentMap() const;
+
+	// Escaped direction as a light hit that loadSurfaceInfo places at MaxRayDistance, as in ray_layouts.glsl
+	Intersection environmentIntersection(const glm::vec3& dir) const;
+
+	// Power proportional pick from the light sample table and its pdf, as sampleLightByPower and
+	//   triangleLightPowerPdf in light_sampling.glsl
+	glm::vec3 sampleLightByPower(
+		const glm::vec3& ref, glm::vec3& wi, float& dist, float& pdf, float& jacobian, glm::vec2& bary, uint32_t& id, const glm::vec4& r
+	) const;
+	float triangleLightPowerPdf(const glm::vec3& ref, uint32_t id, float dist, float cosTheta) const;
+
+	// Environment map or power proportional pick keeping the light id, and its pdf, as used by the ReSTIR shaders
+	glm::vec3 sampleLight(
+		const glm::vec3& ref, glm::vec3& wi, float& dist, float& pdf, float& jacobian, glm::vec2& bary, uint32_t& id, glm::vec4 r
+	) const;
+	float sampledLightPdf(const glm::vec3& ref, uint32_t id, const glm::vec3& wi, float dist, float cosTheta) const;
+
+	Ray cameraRay(glm::uvec2 index) const;
+	// Shadow ray between two points, ending MinRayDistance short of to
+	bool visible(const glm::vec3& from, const glm::vec3& to) const;
+
+private:
+	float environmentSelectProb() const;
+	float environmentMapPdf(const glm::vec3& dir) const;
+	glm::vec3 sampleEnvironmentMap(glm::vec3& wi, float& pdf, const glm::vec4& r) const;
+	glm::vec3 sampleTriangleLight(
+		const TriangleLight& light, const glm::vec3& ref, glm::vec3& wi, float& dist, float& pdf, float& jacobian, glm::vec2& bary, const glm::vec2& r
+	) const;
+	float triangleLightDirectionPdf(const TriangleLight& light, const glm::vec3& ref, float dist, float cosTheta) const;
+
+private:
+	const Scene& mScene;
+	const AccelerationStructure& mAccel;
+	Settings mSettings;
+	TileScheduler mScheduler;
+
+	glm::vec3 mCameraPos;
+	glm::vec3 mCameraRight;
+	glm::vec3 mCameraUp;
+	glm::vec3 mCameraFront;
+	float mTanFOV;
+
+	// Sum of all samples taken so far per pixel
+	std::vector<glm::vec3> mAccum;
+	uint32_t mSampleCount = 0;
+	Statistics mStatistics;
+};
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+#include <glm/glm.hpp>
+
+#include "util/NamespaceDecl.h"
+
+NAMESPACE_BEGIN(cpu)
+
+// Mirrors ray_layouts.glsl
+constexpr float MinRayDistance = 1e-4f;
+constexpr float MaxRayDistance = 1e7f;
+constexpr uint32_t InvalidHitIndex = 0xffffffff;
+// Marks the primary vertex, read from the GBuffer instead of the scene
+constexpr uint32_t SpecialHitIndex = 0xfffffffe;
+// Light id of the environment map in light sampled ReSTIR vertices, see PathTracer::environmentIntersection
+constexpr uint32_t EnvironmentLightId = 0xffffffff;
+
+struct Ray {
+	glm::vec3 origin;
+	float tMin = MinRayDistance;
+	glm::vec3 dir;
+	float tMax = MaxRayDistance;
+};
+
+// Mirrors Intersection in layouts.glsl, bary weights the second and third vertex
+struct Intersection {
+	glm::vec2 bary = glm::vec2(0.f);
+	uint32_t instanceIdx = InvalidHitIndex;
+	uint32_t triangleIdx = InvalidHitIndex;
+
+	bool hit() const { return instanceIdx != InvalidHitIndex; }
+};
+
+/**
+* Per ray setup of the watertight ray-triangle test (Woop et al. 2013). Vertices are
+*   translated to the ray origin, permuted so that the dominant direction axis is z and sheared
+*   so that the ray points along +z, after which edge tests are exact up to the final sign
+*/
+struct WatertightRay {
+	glm::vec3 origin;
+	int kx, ky, kz;
+	float sx, sy, sz;
+
+	WatertightRay() = default;
+
+	explicit WatertightRay(const Ray& ray) : origin(ray.origin) {
+		glm::vec3 absDir = glm::abs(ray.dir);
+		kz = (absDir.x > absDir.y) ? ((absDir.x > absDir.z) ? 0 : 2) : ((absDir.y > absDir.z) ? 1 : 2);
+		kx = (kz + 1) % 3;
+		ky = (kx + 1) % 3;
+
+		// Keep the winding so that the signs of U, V and W stay meaningful
+		if (ray.dir[kz] < 0.f) {
+			std::swap(kx, ky);
+		}
+		sx = ray.dir[kx] / ray.dir[kz];
+		sy = ray.dir[ky] / ray.dir[kz];
+		sz = 1.f / ray.dir[kz];
+	}
+};
+
+struct TriangleHit {
+	float t;
+	float b1;
+	float b2;
+};
+
+/**
+* Scalar watertight test, the reference for the 8-wide leaf kernel which evaluates the same
+*   expressions in the same order. Edge functions that are exactly zero are recomputed in double
+*/
+inline bool intersectTriangle(
+	const WatertightRay& ray, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+	float tMin, float tMax, TriangleHit& hit
+) {
+	glm::vec3 a = v0 - ray.origin;
+	glm::vec3 b = v1 - ray.origin;
+	glm::vec3 c = v2 - ray.origin;
+
+	float ax = a[ray.kx] - ray.sx * a[ray.kz];
+	float ay = a[ray.ky] - ray.sy * a[ray.kz];
+	float bx = b[ray.kx] - ray.sx * b[ray.kz];
+	float by = b[ray.ky] - ray.sy * b[ray.kz];
+	float cx = c[ray.kx] - ray.sx * c[ray.kz];
+	float cy = c[ray.ky] - ray.sy * c[ray.kz];
+
+	float u = cx * by - cy * bx;
+	float v = ax * cy - ay * cx;
+	float w = bx * ay - by * ax;
+
+	if (u == 0.f || v == 0.f || w == 0.f) {
+		u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+		v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+		w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+	}
+	if ((u < 0.f || v < 0.f || w < 0.f) && (u > 0.f || v > 0.f || w > 0.f)) {
+		return false;
+	}
+	float det = u + v + w;
+
+	if (det == 0.f) {
+		return false;
+	}
+	float az = ray.sz * a[ray.kz];
+	float bz = ray.sz * b[ray.kz];
+	float cz = ray.sz * c[ray.kz];
+	float t = u * az + v * bz + w * cz;
+
+	float absDet = std::abs(det);
+	float signedT = std::signbit(det) ? -t : t;
+
+	if (signedT < tMin * absDet || signedT > tMax * absDet) {
+		return false;
+	}
+	float invDet = 1.f / det;
+	hit = { t * invDet, v * invDet, w * invDet };
+	return true;
+}
+
+NAMESPACE_END(cpu)
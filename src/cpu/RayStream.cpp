@@ -0,0 +1,380 @@
+#include "RayStream.h"
+#include "SIMD.h"
+
+#include <array>
+#include <thread>
+
+NAMESPACE_BEGIN(cpu)
+
+constexpr float RobustExitScale = 1.0000004f;
+
+void RayStream::resize(size_t size) {
+	for (int axis = 0; axis < 3; axis++) {
+		origin[axis].resize(size);
+		dir[axis].resize(size);
+	}
+	tMin.resize(size);
+	tMax.resize(size);
+}
+
+void RayStream::set(size_t i, const Ray& ray) {
+	for (int axis = 0; axis < 3; axis++) {
+		origin[axis][i] = ray.origin[axis];
+		dir[axis][i] = ray.dir[axis];
+	}
+	tMin[i] = ray.tMin;
+	tMax[i] = ray.tMax;
+}
+
+Ray RayStream::get(size_t i) const {
+	Ray ray;
+	ray.origin = glm::vec3(origin[0][i], origin[1][i], origin[2][i]);
+	ray.dir = glm::vec3(dir[0][i], dir[1][i], dir[2][i]);
+	ray.tMin = tMin[i];
+	ray.tMax = tMax[i];
+	return ray;
+}
+
+/**
+* Up to SIMDWidth rays gathered from a stream. Unused lanes are never part of an active mask
+*/
+struct RayPacket {
+	float origin[3][SIMDWidth];
+	float dir[3][SIMDWidth];
+	float tMin[SIMDWidth];
+	float tMax[SIMDWidth];
+	uint32_t rayIdx[SIMDWidth];
+	uint32_t numRays;
+
+	Ray ray(uint32_t lane) const {
+		Ray ray;
+		ray.origin = glm::vec3(origin[0][lane], origin[1][lane], origin[2][lane]);
+		ray.dir = glm::vec3(dir[0][lane], dir[1][lane], dir[2][lane]);
+		ray.tMin = tMin[lane];
+		ray.tMax = tMax[lane];
+		return ray;
+	}
+
+	uint32_t fullMask() const { return (1u << numRays) - 1; }
+};
+
+static uint32_t octant(const RayStream& rays, size_t i) {
+	return (rays.dir[0][i] < 0.f ? 1 : 0) | (rays.dir[1][i] < 0.f ? 2 : 0) | (rays.dir[2][i] < 0.f ? 4 : 0);
+}
+
+/**
+* Stable counting sort of ray indices by direction octant, then split into packets that never
+*   straddle two octants. Returns the first index of each packet in order, plus a final end
+*/
+static std::vector<uint32_t> makePackets(const RayStream& rays, std::vector<uint32_t>& order) {
+	uint32_t numRays = static_cast<uint32_t>(rays.size());
+	std::array<uint32_t, 9> octantBegin = {};
+
+	for (uint32_t i = 0; i < numRays; i++) {
+		octantBegin[octant(rays, i) + 1]++;
+	}
+	for (int i = 0; i < 8; i++) {
+		octantBegin[i + 1] += octantBegin[i];
+	}
+	std::array<uint32_t, 8> cursor;
+	std::copy(octantBegin.begin(), octantBegin.begin() + 8, cursor.begin());
+
+	order.resize(numRays);
+
+	for (uint32_t i = 0; i < numRays; i++) {
+		order[cursor[octant(rays, i)]++] = i;
+	}
+	std::vector<uint32_t> packetBegins;
+
+	for (int i = 0; i < 8; i++) {
+		for (uint32_t begin = octantBegin[i]; begin < octantBegin[i + 1]; begin += SIMDWidth) {
+			packetBegins.push_back(begin);
+		}
+	}
+	packetBegins.push_back(numRays);
+	return packetBegins;
+}
+
+static void gatherPacket(const RayStream& rays, const uint32_t* indices, uint32_t count, RayPacket& packet) {
+	packet.numRays = count;
+
+	for (uint32_t lane = 0; lane < SIMDWidth; lane++) {
+		// Padding lanes repeat the first ray, they are masked out but keep the slab math finite
+		uint32_t idx = indices[(lane < count) ? lane : 0];
+
+		for (int axis = 0; axis < 3; axis++) {
+			packet.origin[axis][lane] = rays.origin[axis][idx];
+			packet.dir[axis][lane] = rays.dir[axis][idx];
+		}
+		packet.tMin[lane] = rays.tMin[idx];
+		packet.tMax[lane] = rays.tMax[idx];
+		packet.rayIdx[lane] = idx;
+	}
+}
+
+/**
+* Depth first traversal of a binary BVH by a whole packet. Each entry carries the lanes that
+*   reached it, nodes are tested against those lanes with the current tMax of each lane, and
+*   children are visited nearest first along the mean packet direction. leaf(node, mask) returns
+*   lanes that are done and leave every remaining entry
+*/
+template<typename LeafFunc>
+static uint32_t traversePacket(const BVH& bvh, const RayPacket& packet, uint32_t activeMask, LeafFunc&& leaf) {
+	if (bvh.empty() || !activeMask) {
+		return activeMask;
+	}
+	Float8 origin[3];
+	Float8 invDir[3];
+	glm::vec3 meanDir(0.f);
+
+	for (int axis = 0; axis < 3; axis++) {
+		float inv[SIMDWidth];
+
+		for (uint32_t lane = 0; lane < SIMDWidth; lane++) {
+			float d = packet.dir[axis][lane];
+			inv[lane] = 1.f / ((d == 0.f) ? std::copysign(1e-30f, d) : d);
+			meanDir[axis] += (activeMask >> lane & 1) ? d : 0.f;
+		}
+		origin[axis] = Float8::load(packet.origin[axis]);
+		invDir[axis] = Float8::load(inv);
+	}
+	struct Entry {
+		uint32_t node;
+		uint32_t mask;
+	};
+	Entry stack[BVH::MaxDepth * 2 + 2];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = { 0, activeMask };
+
+	while (stackSize > 0) {
+		Entry entry = stack[--stackSize];
+		uint32_t mask = entry.mask & activeMask;
+
+		if (!mask) {
+			continue;
+		}
+		const BVHNode& node = bvh.nodes[entry.node];
+		Float8 tEntry = Float8::load(packet.tMin);
+		Float8 tExit = Float8::load(packet.tMax);
+
+		for (int axis = 0; axis < 3; axis++) {
+			Float8 t0 = (Float8::broadcast(node.boundMin[axis]) - origin[axis]) * invDir[axis];
+			Float8 t1 = (Float8::broadcast(node.boundMax[axis]) - origin[axis]) * invDir[axis];
+
+			tEntry = max(tEntry, min(t0, t1));
+			tExit = min(tExit, max(t0, t1) * Float8::broadcast(RobustExitScale));
+		}
+		uint32_t hitMask = lessEqual(tEntry, tExit) & mask;
+
+		if (!hitMask) {
+			continue;
+		}
+		if (node.numPrims > 0) {
+			activeMask &= ~leaf(node, hitMask);
+
+			if (!activeMask) {
+				break;
+			}
+			continue;
+		}
+		uint32_t left = entry.node + 1;
+		uint32_t right = node.offset;
+
+		const auto& leftNode = bvh.nodes[left];
+		const auto& rightNode = bvh.nodes[right];
+		glm::vec3 centroidDiff = (leftNode.boundMin + leftNode.boundMax) - (rightNode.boundMin + rightNode.boundMax);
+
+		// Push the farther child first so that the nearer one is popped next
+		if (glm::dot(centroidDiff, meanDir) > 0.f) {
+			std::swap(left, right);
+		}
+		stack[stackSize++] = { right, hitMask };
+		stack[stackSize++] = { left, hitMask };
+	}
+	return activeMask;
+}
+
+static void transformPacket(const AccelStructureInstance& instance, const RayPacket& packet, uint32_t mask, RayPacket& out) {
+	out = packet;
+
+	if (instance.customIndex == 0) {
+		return;
+	}
+	for (; mask; mask &= mask - 1) {
+		uint32_t lane = firstLane(mask);
+		glm::vec3 origin(packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane]);
+		glm::vec3 dir(packet.dir[0][lane], packet.dir[1][lane], packet.dir[2][lane]);
+
+		origin = glm::vec3(instance.transformInv * glm::vec4(origin, 1.f));
+		dir = glm::vec3(instance.transformInv * glm::vec4(dir, 0.f));
+
+		for (int axis = 0; axis < 3; axis++) {
+			out.origin[axis][lane] = origin[axis];
+			out.dir[axis][lane] = dir[axis];
+		}
+	}
+}
+
+static void intersectPacket(const AccelerationStructure& accel, RayPacket& packet, Intersection* hits) {
+	auto instanceLeaf = [&](const BVHNode& node, uint32_t mask) -> uint32_t {
+		const auto& instance = accel.instances[accel.topLevel.primIndices[node.offset]];
+		const auto& mesh = accel.meshes[instance.meshIdx];
+
+		RayPacket objectPacket;
+		transformPacket(instance, packet, mask, objectPacket);
+
+		WatertightRay wrays[SIMDWidth];
+
+		for (uint32_t m = mask; m; m &= m - 1) {
+			uint32_t lane = firstLane(m);
+			wrays[lane] = WatertightRay(objectPacket.ray(lane));
+		}
+		uint32_t hitMask = 0;
+
+		auto triangleLeaf = [&](const BVHNode& leafNode, uint32_t leafMask) -> uint32_t {
+			for (uint32_t i = leafNode.offset; i < leafNode.offset + leafNode.numPrims; i++) {
+				const glm::vec3* v = &mesh.positions[i * 3];
+
+				for (uint32_t m = leafMask; m; m &= m - 1) {
+					uint32_t lane = firstLane(m);
+					TriangleHit hit;
+
+					if (intersectTriangle(wrays[lane], v[0], v[1], v[2], objectPacket.tMin[lane], objectPacket.tMax[lane], hit)) {
+						objectPacket.tMax[lane] = hit.t;
+						hits[lane].bary = glm::vec2(hit.b1, hit.b2);
+						hits[lane].triangleIdx = mesh.bvh.primIndices[i];
+						hitMask |= 1u << lane;
+					}
+				}
+			}
+			return 0;
+		};
+		traversePacket(mesh.bvh, objectPacket, mask, triangleLeaf);
+
+		for (uint32_t m = hitMask; m; m &= m - 1) {
+			uint32_t lane = firstLane(m);
+			packet.tMax[lane] = objectPacket.tMax[lane];
+			hits[lane].instanceIdx = instance.customIndex;
+		}
+		return 0;
+	};
+	traversePacket(accel.topLevel, packet, packet.fullMask(), instanceLeaf);
+}
+
+static uint32_t occludedPacket(const AccelerationStructure& accel, const RayPacket& packet) {
+	uint32_t occludedMask = 0;
+
+	auto instanceLeaf = [&](const BVHNode& node, uint32_t mask) -> uint32_t {
+		const auto& instance = accel.instances[accel.topLevel.primIndices[node.offset]];
+		const auto& mesh = accel.meshes[instance.meshIdx];
+
+		RayPacket objectPacket;
+		transformPacket(instance, packet, mask, objectPacket);
+
+		WatertightRay wrays[SIMDWidth];
+
+		for (uint32_t m = mask; m; m &= m - 1) {
+			uint32_t lane = firstLane(m);
+			wrays[lane] = WatertightRay(objectPacket.ray(lane));
+		}
+		uint32_t instanceOccluded = 0;
+
+		auto triangleLeaf = [&](const BVHNode& leafNode, uint32_t leafMask) -> uint32_t {
+			uint32_t done = 0;
+
+			for (uint32_t i = leafNode.offset; i < leafNode.offset + leafNode.numPrims && leafMask; i++) {
+				const glm::vec3* v = &mesh.positions[i * 3];
+
+				for (uint32_t m = leafMask; m; m &= m - 1) {
+					uint32_t lane = firstLane(m);
+					TriangleHit hit;
+
+					if (intersectTriangle(wrays[lane], v[0], v[1], v[2], objectPacket.tMin[lane], objectPacket.tMax[lane], hit)) {
+						done |= 1u << lane;
+					}
+				}
+				leafMask &= ~done;
+			}
+			instanceOccluded |= done;
+			return done;
+		};
+		traversePacket(mesh.bvh, objectPacket, mask, triangleLeaf);
+
+		occludedMask |= instanceOccluded;
+		return instanceOccluded;
+	};
+	traversePacket(accel.topLevel, packet, packet.fullMask(), instanceLeaf);
+	return occludedMask;
+}
+
+template<typename Func>
+static void forEachPacketParallel(const std::vector<uint32_t>& packetBegins, uint32_t numThreads, Func&& tracePacket) {
+	uint32_t numPackets = static_cast<uint32_t>(packetBegins.size() - 1);
+
+	if (numThreads == 0) {
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	numThreads = std::max(std::min(numThreads, numPackets), 1u);
+
+	auto traceRange = [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			tracePacket(packetBegins[i], packetBegins[i + 1] - packetBegins[i]);
+		}
+	};
+	std::vector<std::thread> threads(numThreads);
+
+	for (uint32_t i = 0; i < numThreads; i++) {
+		uint32_t begin = i * numPackets / numThreads;
+		uint32_t end = (i + 1) * numPackets / numThreads;
+		threads[i] = std::thread(traceRange, begin, end);
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void intersectStream(const AccelerationStructure& accel, RayStream& rays, std::vector<Intersection>& hits, uint32_t numThreads) {
+	hits.assign(rays.size(), Intersection());
+
+	if (rays.size() == 0) {
+		return;
+	}
+	std::vector<uint32_t> order;
+	auto packetBegins = makePackets(rays, order);
+
+	forEachPacketParallel(packetBegins, numThreads, [&](uint32_t begin, uint32_t count) {
+		RayPacket packet;
+		gatherPacket(rays, order.data() + begin, count, packet);
+
+		Intersection packetHits[SIMDWidth];
+		intersectPacket(accel, packet, packetHits);
+
+		for (uint32_t lane = 0; lane < count; lane++) {
+			hits[packet.rayIdx[lane]] = packetHits[lane];
+			rays.tMax[packet.rayIdx[lane]] = packet.tMax[lane];
+		}
+	});
+}
+
+void occludedStream(const AccelerationStructure& accel, const RayStream& rays, std::vector<uint8_t>& occluded, uint32_t numThreads) {
+	occluded.assign(rays.size(), 0);
+
+	if (rays.size() == 0) {
+		return;
+	}
+	std::vector<uint32_t> order;
+	auto packetBegins = makePackets(rays, order);
+
+	forEachPacketParallel(packetBegins, numThreads, [&](uint32_t begin, uint32_t count) {
+		RayPacket packet;
+		gatherPacket(rays, order.data() + begin, count, packet);
+
+		uint32_t mask = occludedPacket(accel, packet);
+
+		for (uint32_t lane = 0; lane < count; lane++) {
+			occluded[packet.rayIdx[lane]] = (mask >> lane) & 1;
+		}
+	});
+}
+
+NAMESPACE_END(cpu)
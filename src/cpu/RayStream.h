@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "AccelerationStructure.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Rays in SoA layout. Stream traversal groups rays of the same direction octant into packets of
+*   SIMDWidth, tests each BVH node against all live rays of a packet at once and masks out lanes
+*   that miss, so coherent batches such as camera rays or shadow rays towards one light share
+*   most node visits
+*/
+struct RayStream {
+	std::vector<float> origin[3];
+	std::vector<float> dir[3];
+	std::vector<float> tMin;
+	std::vector<float> tMax;
+
+	size_t size() const { return tMin.size(); }
+	void resize(size_t size);
+
+	void set(size_t i, const Ray& ray);
+	Ray get(size_t i) const;
+};
+
+/**
+* Closest hits of all rays, written to hits in input order in the layout of Intersection. tMax of
+*   each hit ray is shortened to the hit distance. Leaves are tested with the scalar watertight
+*   test, so results match AccelerationStructure::intersectReference ray by ray
+*/
+void intersectStream(
+	const AccelerationStructure& accel, RayStream& rays, std::vector<Intersection>& hits, uint32_t numThreads = 0
+);
+
+// Any hit visibility, lanes stop taking part in traversal as soon as they are occluded
+void occludedStream(
+	const AccelerationStructure& accel, const RayStream& rays, std::vector<uint8_t>& occluded, uint32_t numThreads = 0
+);
+
+NAMESPACE_END(cpu)
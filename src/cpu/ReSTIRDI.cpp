@@ -0,0 +1,432 @@
+#include "ReSTIRDI.h"
+#include "util/Timer.h"
+
+#include <cmath>
+
+NAMESPACE_BEGIN(cpu)
+
+static uint32_t resolveNumThreads(uint32_t numThreads) {
+	return (numThreads == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : numThreads;
+}
+
+static PathTracer::Settings makeTracerSettings(const ReSTIRDI::Settings& settings) {
+	PathTracer::Settings tracerSettings;
+	tracerSettings.width = settings.width;
+	tracerSettings.height = settings.height;
+	tracerSettings.mode = PathTracer::Mode::Direct;
+	tracerSettings.numThreads = settings.numThreads;
+	return tracerSettings;
+}
+
+ReSTIRDI::ReSTIRDI(const Scene& scene, const AccelerationStructure& accel, const Settings& settings) :
+	mScene(scene), mAccel(accel), mSettings(settings),
+	mScheduler(settings.width, settings.height, settings.tileSize),
+	mNumThreads(resolveNumThreads(settings.numThreads)),
+	mTracer(scene, accel, makeTracerSettings(settings)),
+	mGBuffer(mTracer, accel, settings.width, settings.height, settings.tileSize, mNumThreads)
+{
+	reset();
+}
+
+void ReSTIRDI::reset() {
+	size_t numPixels = mGBuffer.size();
+	DIReservoir resv;
+	DIReservoirReset(resv);
+	DIPathSampleInit(resv.pathSample);
+
+	mReservoirs[0].assign(numPixels, resv);
+	mReservoirs[1].assign(numPixels, resv);
+	mTempReservoirs.assign(numPixels, resv);
+	mFrame.assign(numPixels, glm::vec3(0.f));
+
+	mThisFrame = 0;
+	mFrameIndex = 0;
+}
+
+void ReSTIRDI::renderFrame() {
+	if (mFrameIndex > 0) {
+		mThisFrame ^= 1;
+	}
+	Timer timer;
+
+	forEachPixel([&](glm::uvec2 index) { generatePath(index); });
+	forEachPixel([&](glm::uvec2 index) { temporalReuse(index); });
+	forEachPixel([&](glm::uvec2 index) { spatialReuse(index); });
+
+	mMs += timer.get();
+	mFrameIndex++;
+}
+
+uint32_t ReSTIRDI::frameSeed() const {
+	return makeSeed(mSettings.seed, mFrameIndex);
+}
+
+glm::vec3 ReSTIRDI::sampleLi(
+	const SurfaceInfo& surf, const Material& mat, const glm::vec3& wo, uint32_t rng, uint32_t& resvRng, DIReservoir& resv,
+	SampleMode sampleMode
+) const {
+	glm::vec3 radiance(0.f);
+	DIPathSample pathSample;
+	pathSample.rng = rng;
+
+	glm::vec4 lightRandSample = sample4f(rng);
+	glm::vec3 scatterRandSample = sample3f(rng);
+
+	if (sampleMode != SampleMode::BSDF && !isBSDFDelta(mat)) {
+		glm::vec3 lightDir;
+		glm::vec2 lightBary;
+		float lightDist, lightPdf, lightJacobian;
+		uint32_t lightId;
+
+		glm::vec3 lightRadiance = mTracer.sampleLight(
+			surf.pos, lightDir, lightDist, lightPdf, lightJacobian, lightBary, lightId, lightRandSample
+		);
+
+		Ray shadowRay;
+		shadowRay.origin = surf.pos;
+		shadowRay.dir = lightDir;
+		shadowRay.tMax = lightDist - MinRayDistance;
+
+		if (lightPdf > 1e-6f && !mAccel.occluded(shadowRay)) {
+			float bsdfPdf = evalPdf(mat, surf.norm, wo, lightDir);
+			float weight = MISWeight(lightPdf, bsdfPdf);
+
+			if (sampleMode == SampleMode::Light) {
+				weight = 1.f;
+			}
+			glm::vec3 contrib = lightRadiance * evalBSDF(mat, surf.albedo, surf.norm, wo, lightDir) * satDot(surf.norm, lightDir) / lightPdf * weight;
+			float sampleWeight = luminance(contrib);
+
+			if (std::isnan(sampleWeight) || sampleWeight < 0.f) {
+				sampleWeight = 0.f;
+			}
+			pathSample.isec = Intersection{ lightBary, 0, lightId };
+			pathSample.Li = lightRadiance * weight;
+			pathSample.jacobian = lightJacobian;
+			pathSample.samplePdf = lightPdf;
+			pathSample.isLightSample = true;
+
+			DIReservoirAddSample(resv, pathSample, sampleWeight, sample1f(resvRng));
+			radiance += contrib;
+		}
+	}
+	BSDFSample s;
+	pathSample.isLightSample = false;
+
+	if (sampleMode != SampleMode::Light && sampleBSDF(mat, surf.albedo, surf.norm, wo, scatterRandSample, s) && s.pdf > 1e-6f) {
+		Ray ray;
+		ray.origin = surf.pos;
+		ray.dir = s.wi;
+		Intersection isec;
+
+		if (!mAccel.intersect(ray, isec) && mTracer.hasEnvironmentMap()) {
+			isec = mTracer.environmentIntersection(s.wi);
+		}
+
+		if (isec.hit()) {
+			SurfaceInfo hit;
+			mTracer.loadSurfaceInfo(isec, hit);
+			float cosTheta = -glm::dot(s.wi, hit.norm);
+
+			if (hit.isLight && cosTheta > 0.f) {
+				float dist = glm::length(hit.pos - surf.pos);
+				float lightPdf = mTracer.sampledLightPdf(surf.pos, isec.triangleIdx, s.wi, dist, cosTheta);
+				float weight = MISWeight(s.pdf, lightPdf);
+
+				if (sampleMode == SampleMode::BSDF || isSampleTypeDelta(s.type)) {
+					weight = 1.f;
+				}
+				float cosTerm = isSampleTypeDelta(s.type) ? 1.f : satDot(surf.norm, s.wi);
+				glm::vec3 contrib = hit.albedo * s.bsdf * cosTerm / s.pdf * weight;
+
+				pathSample.isec = isec;
+				pathSample.Li = hit.albedo * weight;
+				pathSample.jacobian = std::abs(cosTheta) / square(dist);
+				pathSample.samplePdf = s.pdf;
+				pathSample.isLightSample = false;
+
+				// di_reservoir.glsl adds the unclamped luminance here
+				DIReservoirAddSample(resv, pathSample, luminance(contrib), sample1f(resvRng));
+				radiance += contrib;
+			}
+		}
+	}
+	DIReservoirResetIfInvalid(resv);
+
+	// This is importance sampling, not resampling
+	if (resv.sampleCount > 0 && DIPathSampleIsValid(resv.pathSample) && resv.weight > 0.f) {
+		resv.pathSample.Li *= resv.resampleWeight / resv.weight;
+		resv.weight = resv.resampleWeight;
+	}
+	else {
+		DIPathSampleInit(resv.pathSample);
+		resv.weight = 0.f;
+		resv.resampleWeight = 0.f;
+	}
+	resv.sampleCount = 1;
+
+	return radiance;
+}
+
+void ReSTIRDI::randomReplay(DIReservoir& dstResv, const SurfaceInfo& dstSurf, const DIReservoir& srcResv, const glm::vec3& wo, uint32_t& rng) const {
+	const auto& dstMat = mScene.resource.materials[dstSurf.matIndex];
+
+	DIReservoir replayResv;
+	DIReservoirReset(replayResv);
+
+	sampleLi(dstSurf, dstMat, wo, srcResv.pathSample.rng, rng, replayResv, mSettings.sampleMode);
+	float jacobian = 1.f;
+
+	DIPathSample replaySample = replayResv.pathSample;
+
+	if (DIPathSampleIsValid(replaySample)) {
+		SurfaceInfo replaySurf;
+		mTracer.loadSurfaceInfo(replaySample.isec, replaySurf);
+
+		glm::vec3 wi = glm::normalize(replaySurf.pos - dstSurf.pos);
+
+		glm::vec3 Li = replaySample.Li * evalBSDF(dstMat, dstSurf.albedo, dstSurf.norm, wo, wi) * satDot(dstSurf.norm, wi) / replaySample.samplePdf;
+		float dstPHat = luminance(Li * jacobian);
+
+		replayResv.resampleWeight = srcResv.resampleWeight * dstPHat / srcResv.weight;
+		replayResv.sampleCount = srcResv.sampleCount;
+	}
+	else {
+		replayResv.resampleWeight = 0.f;
+	}
+
+	if (DIReservoirIsValid(replayResv)) {
+		DIReservoirMerge(dstResv, replayResv, sample1f(rng));
+	}
+}
+
+void ReSTIRDI::reconnection(DIReservoir& dstResv, const SurfaceInfo& dstSurf, DIReservoir srcResv, const glm::vec3& wo, uint32_t& rng) const {
+	const auto& dstMat = mScene.resource.materials[dstSurf.matIndex];
+	DIPathSample srcSample = srcResv.pathSample;
+
+	bool srcSampleValid = false;
+	float dstPHat = 0.f;
+	float dstSamplePdf = 0.f;
+	float dstJacobian = 0.f;
+
+	// The shaders load the reconnection vertex before the validity check, the host can't read an
+	//   invalid intersection
+	if (DIPathSampleIsValid(srcSample)) {
+		SurfaceInfo rcSurf;
+		mTracer.loadSurfaceInfo(srcSample.isec, rcSurf);
+
+		float dist = glm::distance(rcSurf.pos, dstSurf.pos);
+		glm::vec3 wi = glm::normalize(rcSurf.pos - dstSurf.pos);
+
+		float cosTheta = -glm::dot(rcSurf.norm, wi);
+		dstJacobian = std::abs(cosTheta) / square(dist);
+		float jacobian = dstJacobian / srcSample.jacobian;
+
+		if (dist > 1e-4f && cosTheta > 0.f && !std::isnan(jacobian) && srcSample.jacobian > 0.f && mTracer.visible(dstSurf.pos, rcSurf.pos)) {
+			srcSampleValid = true;
+
+			if (!std::isnan(srcSample.samplePdf) && srcSample.samplePdf > 1e-6f) {
+				glm::vec3 Li = srcSample.Li * evalBSDF(dstMat, dstSurf.albedo, dstSurf.norm, wo, wi) * satDot(dstSurf.norm, wi) / srcSample.samplePdf;
+				dstPHat = luminance(Li * jacobian);
+			}
+
+			if (srcSample.isLightSample) {
+				dstSamplePdf = mTracer.sampledLightPdf(dstSurf.pos, srcSample.isec.triangleIdx, wi, dist, cosTheta);
+			}
+			else {
+				dstSamplePdf = evalPdf(dstMat, dstSurf.norm, wo, wi);
+			}
+		}
+	}
+	if (srcSampleValid) {
+		srcSample.jacobian = dstJacobian;
+		srcSample.samplePdf = dstSamplePdf;
+
+		if (srcSample.samplePdf < 1e-6f || std::isnan(srcSample.samplePdf)) {
+			srcSample.samplePdf = 0.f;
+		}
+		srcResv.pathSample = srcSample;
+		srcResv.resampleWeight *= dstPHat / srcResv.weight;
+
+		if (std::isnan(srcResv.resampleWeight)) {
+			srcResv.resampleWeight = 0.f;
+		}
+	}
+	else {
+		srcResv.resampleWeight = 0.f;
+	}
+
+	if (DIReservoirIsValid(srcResv)) {
+		DIReservoirMerge(dstResv, srcResv, sample1f(rng));
+	}
+}
+
+void ReSTIRDI::reuseAndMerge(DIReservoir& dstResv, const SurfaceInfo& dstSurf, const DIReservoir& srcResv, const glm::vec3& wo, uint32_t& rng) const {
+	if (mSettings.shiftMode == ShiftMode::Reconnection) {
+		reconnection(dstResv, dstSurf, srcResv, wo, rng);
+	}
+	else if (mSettings.shiftMode == ShiftMode::Replay) {
+		randomReplay(dstResv, dstSurf, srcResv, wo, rng);
+	}
+}
+
+void ReSTIRDI::generatePath(glm::uvec2 index) {
+	const auto& texel = mGBuffer[index1D(index)];
+
+	DIReservoir resv;
+	DIReservoirReset(resv);
+	DIPathSampleInit(resv.pathSample);
+
+	if (texel.valid) {
+		uint32_t rng = makeSeed(frameSeed(), index);
+		uint32_t resvRng = ~rng;
+
+		sampleLi(mGBuffer.surface(texel), mScene.resource.materials[texel.matIndex], texel.wo, rng, resvRng, resv, mSettings.sampleMode);
+	}
+	mReservoirs[mThisFrame][index1D(index)] = resv;
+}
+
+void ReSTIRDI::temporalReuse(glm::uvec2 index) {
+	const auto& texel = mGBuffer[index1D(index)];
+
+	if (!texel.valid) {
+		return;
+	}
+	glm::vec2 uv = (glm::vec2(index) + .5f) / glm::vec2(mSettings.width, mSettings.height);
+
+	uint32_t rng = makeSeed(frameSeed(), index) ^ 1;
+	uint32_t resvRng = ~rng;
+
+	DIReservoir resv = mReservoirs[mThisFrame][index1D(index)];
+
+	if (mSettings.temporalReuse) {
+		SurfaceInfo dstSurf = mGBuffer.surface(texel);
+
+		// The camera is still, so motion vectors are 0 and the previous GBuffer is this one
+		auto prevIdx = mGBuffer.index(uv);
+
+		if (mFrameIndex > 0 && prevIdx) {
+			const auto& prev = mGBuffer[*prevIdx];
+
+			if (prev.matIndex == texel.matIndex && prev.instanceIdx == texel.instanceIdx &&
+				glm::dot(prev.norm, texel.norm) >= .95f && glm::distance(texel.pos, prev.pos) <= .5f
+			) {
+				const auto& temporalResv = mReservoirs[mThisFrame ^ 1][*prevIdx];
+
+				if (DIReservoirIsValid(temporalResv)) {
+					reuseAndMerge(resv, dstSurf, temporalResv, texel.wo, resvRng);
+				}
+			}
+		}
+		if (DIReservoirIsValid(resv) && DIPathSampleIsValid(resv.pathSample)) {
+			SurfaceInfo surf;
+			mTracer.loadSurfaceInfo(resv.pathSample.isec, surf);
+
+			if (!mTracer.visible(texel.pos, surf.pos)) {
+				resv.resampleWeight = 0.f;
+			}
+		}
+	}
+	DIReservoirCapSample(resv, 40);
+
+	DIReservoirResetIfInvalid(resv);
+	mTempReservoirs[index1D(index)] = resv;
+}
+
+void ReSTIRDI::spatialReuse(glm::uvec2 index) {
+	const auto& texel = mGBuffer[index1D(index)];
+	mFrame[index1D(index)] = glm::vec3(0.f);
+
+	if (!texel.valid) {
+		return;
+	}
+	glm::vec2 filmSize(mSettings.width, mSettings.height);
+	glm::vec2 uv = (glm::vec2(index) + .5f) / filmSize;
+
+	uint32_t rng = makeSeed(frameSeed(), index) ^ 2;
+
+	const auto& mat = mScene.resource.materials[texel.matIndex];
+	glm::vec3 radiance(0.f);
+
+	DIReservoir resv = mTempReservoirs[index1D(index)];
+
+	if (mSettings.spatialReuse) {
+		const uint32_t ResampleNum = 10;
+		const float ResampleRadius = 20.f;
+		glm::vec2 texelSize = 1.f / filmSize;
+
+		SurfaceInfo dstSurf = mGBuffer.surface(texel);
+
+		for (uint32_t i = 0; i < ResampleNum; i++) {
+			glm::vec2 neighbor = uv + toConcentricDisk(sample2f(rng)) * ResampleRadius * texelSize;
+			auto neighborIdx = mGBuffer.index(neighbor);
+
+			if (!neighborIdx) {
+				continue;
+			}
+			const auto& neighborTexel = mGBuffer[*neighborIdx];
+
+			if (glm::dot(neighborTexel.norm, texel.norm) < .9f || glm::distance(texel.pos, neighborTexel.pos) > .4f) {
+				continue;
+			}
+			const auto& neighborResv = mTempReservoirs[*neighborIdx];
+
+			if (DIReservoirIsValid(neighborResv)) {
+				reuseAndMerge(resv, dstSurf, neighborResv, texel.wo, rng);
+			}
+		}
+
+		if (DIReservoirIsValid(resv) && DIPathSampleIsValid(resv.pathSample)) {
+			SurfaceInfo surf;
+			mTracer.loadSurfaceInfo(resv.pathSample.isec, surf);
+
+			if (!mTracer.visible(texel.pos, surf.pos)) {
+				resv.resampleWeight = 0.f;
+			}
+		}
+	}
+	DIReservoirCapSample(resv, 40);
+	DIReservoirResetIfInvalid(resv);
+	mReservoirs[mThisFrame][index1D(index)] = resv;
+
+	if (DIReservoirIsValid(resv) && DIPathSampleIsValid(resv.pathSample)) {
+		const auto& pathSample = resv.pathSample;
+
+		SurfaceInfo surf;
+		mTracer.loadSurfaceInfo(pathSample.isec, surf);
+
+		glm::vec3 wi = glm::normalize(surf.pos - texel.pos);
+
+		if (resv.sampleCount > 0) {
+			glm::vec3 Li = pathSample.Li * evalBSDF(mat, texel.albedo, texel.norm, texel.wo, wi) * satDot(texel.norm, wi) / pathSample.samplePdf;
+
+			if (!isBlack(Li)) {
+				radiance = Li / luminance(Li) * resv.resampleWeight / float(resv.sampleCount);
+			}
+		}
+	}
+	mFrame[index1D(index)] = clampColor(radiance);
+}
+
+glm::vec3 ReSTIRDI::referenceRadiance(glm::uvec2 index, uint32_t numSamples, uint32_t seed) const {
+	const auto& texel = mGBuffer[index1D(index)];
+
+	if (!texel.valid) {
+		return glm::vec3(0.f);
+	}
+	SurfaceInfo surf = mGBuffer.surface(texel);
+	const auto& mat = mScene.resource.materials[texel.matIndex];
+	glm::vec3 sum(0.f);
+
+	for (uint32_t i = 0; i < numSamples; i++) {
+		uint32_t rng = makeSeed(makeSeed(seed, i), index);
+		uint32_t resvRng = ~rng;
+
+		DIReservoir resv;
+		DIReservoirReset(resv);
+		sum += clampColor(sampleLi(surf, mat, texel.wo, rng, resvRng, resv, SampleMode::Both));
+	}
+	return sum / static_cast<float>(std::max(numSamples, 1u));
+}
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+
+#include "GBuffer.h"
+#include "shader/HostDeviceReservoir.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Host counterpart of TestReSTIR: di_path_gen, di_temporal and di_spatial run as three passes over
+*   per pixel DIReservoir arrays laid out as the GPU buffers, each pass parallel over tiles. The
+*   GBuffer is the traced one of GBuffer.h, so temporal reuse finds the same pixel of the previous
+*   frame. Lights are picked from the environment map or by power from the light sample table, the
+*   distribution light tiles are presampled from on the GPU
+*/
+class ReSTIRDI {
+public:
+	// Same values as TestReSTIR::ShiftType and TestReSTIR::SampleType
+	enum class ShiftMode { Reconnection, Replay, Hybrid };
+	enum class SampleMode { Light, BSDF, Both };
+
+	struct Settings {
+		uint32_t width = 1280;
+		uint32_t height = 720;
+		ShiftMode shiftMode = ShiftMode::Reconnection;
+		SampleMode sampleMode = SampleMode::Light;
+		bool temporalReuse = false;
+		bool spatialReuse = true;
+		uint32_t tileSize = 16;
+		uint32_t seed = 0;
+		// 0 uses all hardware threads
+		uint32_t numThreads = 0;
+	};
+
+	ReSTIRDI(const Scene& scene, const AccelerationStructure& accel, const Settings& settings);
+
+	// Runs the three passes once. The first frame after construction or reset() skips temporal reuse
+	void renderFrame();
+	// Clears all reservoirs, as clearReservoir on the GPU
+	void reset();
+
+	uint32_t frameIndex() const { return mFrameIndex; }
+	double ms() const { return mMs; }
+
+	// Output of di_spatial in the last frame
+	const std::vector<glm::vec3>& frame() const { return mFrame; }
+	const std::vector<DIReservoir>& reservoirs() const { return mReservoirs[mThisFrame]; }
+
+	/**
+	* Direct lighting from triangle lights and the environment map at the primary hit, the MIS combination of light and BSDF
+	*   candidates that sampleLi resamples from, averaged over numSamples. 0 off the GBuffer
+	*/
+	glm::vec3 referenceRadiance(glm::uvec2 index, uint32_t numSamples, uint32_t seed) const;
+	bool hasPrimaryHit(glm::uvec2 index) const { return mGBuffer[index1D(index)].valid; }
+
+private:
+	template<typename Func>
+	void forEachPixel(Func&& func) {
+		mScheduler.run(mNumThreads, [&](const TileScheduler::Tile& tile, uint32_t tileIdx) {
+			for (uint32_t y = tile.y0; y < tile.y1; y++) {
+				for (uint32_t x = tile.x0; x < tile.x1; x++) {
+					func(glm::uvec2(x, y));
+				}
+			}
+		});
+	}
+
+	uint32_t index1D(glm::uvec2 index) const { return index.y * mSettings.width + index.x; }
+	uint32_t frameSeed() const;
+
+	// sampleMode is passed in since the reference always samples both
+	glm::vec3 sampleLi(
+		const SurfaceInfo& surf, const Material& mat, const glm::vec3& wo, uint32_t rng, uint32_t& resvRng, DIReservoir& resv,
+		SampleMode sampleMode
+	) const;
+	void randomReplay(DIReservoir& dstResv, const SurfaceInfo& dstSurf, const DIReservoir& srcResv, const glm::vec3& wo, uint32_t& rng) const;
+	void reconnection(DIReservoir& dstResv, const SurfaceInfo& dstSurf, DIReservoir srcResv, const glm::vec3& wo, uint32_t& rng) const;
+	void reuseAndMerge(DIReservoir& dstResv, const SurfaceInfo& dstSurf, const DIReservoir& srcResv, const glm::vec3& wo, uint32_t& rng) const;
+
+	void generatePath(glm::uvec2 index);
+	void temporalReuse(glm::uvec2 index);
+	void spatialReuse(glm::uvec2 index);
+
+private:
+	const Scene& mScene;
+	const AccelerationStructure& mAccel;
+	Settings mSettings;
+	TileScheduler mScheduler;
+	uint32_t mNumThreads;
+
+	// Scene queries shared with the reference path tracer
+	PathTracer mTracer;
+
+	GBuffer mGBuffer;
+	// uDIReservoir and uDIReservoirPrev swap every frame, uDIReservoirTemp holds temporal results
+	std::vector<DIReservoir> mReservoirs[2];
+	std::vector<DIReservoir> mTempReservoirs;
+	std::vector<glm::vec3> mFrame;
+
+	uint32_t mThisFrame = 0;
+	uint32_t mFrameIndex = 0;
+	double mMs = 0.0;
+};
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,537 @@
+#include "ReSTIRPT.h"
+#include "util/Timer.h"
+
+#include <cmath>
+
+NAMESPACE_BEGIN(cpu)
+
+static uint32_t resolveNumThreads(uint32_t numThreads) {
+	return (numThreads == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : numThreads;
+}
+
+static PathTracer::Settings makeTracerSettings(const ReSTIRPT::Settings& settings) {
+	PathTracer::Settings tracerSettings;
+	tracerSettings.width = settings.width;
+	tracerSettings.height = settings.height;
+	tracerSettings.mode = PathTracer::Mode::Indirect;
+	tracerSettings.numThreads = settings.numThreads;
+	return tracerSettings;
+}
+
+// Whether hybrid shift picks the edge into a vertex as the reconnection edge
+static bool canReconnect(bool lastConnectible, bool connectible, bool deltaScatter, float dist) {
+	return lastConnectible && connectible && !deltaScatter && dist > GRISDistanceThreshold;
+}
+
+// contribWeight of a reservoir after resampling, the unbiased contribution weight of its sample
+static void finalizeReservoir(GRISReservoir& resv) {
+	float pHat = GRISToScalar(resv.pathSample.F);
+
+	if (GRISPathSampleIsValid(resv.pathSample) && resv.resampleWeight > 0.f && pHat > 0.f) {
+		resv.contribWeight = resv.resampleWeight / pHat;
+	}
+	else {
+		// sampleCount stays, the pixel still counts as a technique in later MIS weights
+		resv.pathSample.rcIsec.instanceIdx = InvalidHitIndex;
+		resv.pathSample.F = glm::vec3(0.f);
+		resv.resampleWeight = 0.f;
+		resv.contribWeight = 0.f;
+	}
+}
+
+ReSTIRPT::ReSTIRPT(const Scene& scene, const AccelerationStructure& accel, const Settings& settings) :
+	mScene(scene), mAccel(accel), mSettings(settings),
+	mScheduler(settings.width, settings.height, settings.tileSize),
+	mNumThreads(resolveNumThreads(settings.numThreads)),
+	mTracer(scene, accel, makeTracerSettings(settings)),
+	mGBuffer(mTracer, accel, settings.width, settings.height, settings.tileSize, mNumThreads)
+{
+	reset();
+}
+
+void ReSTIRPT::reset() {
+	size_t numPixels = mGBuffer.size();
+	GRISReservoir resv;
+	GRISPathSampleReset(resv.pathSample);
+	GRISReservoirReset(resv);
+
+	mReservoirs[0].assign(numPixels, resv);
+	mReservoirs[1].assign(numPixels, resv);
+	mTempReservoirs.assign(numPixels, resv);
+	mFrame.assign(numPixels, glm::vec3(0.f));
+
+	mThisFrame = 0;
+	mFrameIndex = 0;
+}
+
+void ReSTIRPT::renderFrame() {
+	if (mFrameIndex > 0) {
+		mThisFrame ^= 1;
+	}
+	Timer timer;
+
+	forEachPixel([&](glm::uvec2 index) { generatePath(index); });
+	forEachPixel([&](glm::uvec2 index) { temporalReuse(index); });
+	forEachPixel([&](glm::uvec2 index) { spatialReuse(index); });
+
+	mMs += timer.get();
+	mFrameIndex++;
+}
+
+uint32_t ReSTIRPT::frameSeed() const {
+	return makeSeed(mSettings.seed, mFrameIndex);
+}
+
+template<typename Func>
+glm::vec3 ReSTIRPT::tracePath(const GBufferTexel& primary, uint32_t rng, Func&& onSample) const {
+	bool hybrid = (mSettings.shiftMode == ShiftMode::Hybrid);
+	bool reconnection = (mSettings.shiftMode == ShiftMode::Reconnection);
+
+	GRISPathSample pathSample;
+	GRISPathSampleReset(pathSample);
+	pathSample.primaryRng = rng;
+	uint32_t rcVertexId = 0;
+
+	glm::vec3 radiance(0.f);
+	glm::vec3 throughput(1.f);
+	// Throughput past the reconnection vertex, over the pdf of rcWi but without the BSDF there,
+	//   which is evaluated again after shifting
+	glm::vec3 rcThroughput(1.f);
+
+	SurfaceInfo surf = mGBuffer.surface(primary);
+	Intersection isec;
+	isec.instanceIdx = SpecialHitIndex;
+
+	Ray ray;
+	ray.dir = -primary.wo;
+	glm::vec3 wo = primary.wo;
+	glm::vec3 lastPos;
+
+	// pdf of the last scatter direction times the russian roulette survival before it
+	float lastPdf = 0.f;
+	bool lastConnectible = false;
+	bool lastDelta = false;
+	bool lastSampledLight = false;
+
+	for (uint32_t bounce = 0; bounce < GRISMaxPathLength; bounce++) {
+		if (bounce > 0) {
+			if (!mAccel.intersect(ray, isec)) {
+				if (!mTracer.hasEnvironmentMap()) {
+					break;
+				}
+				isec = mTracer.environmentIntersection(ray.dir);
+			}
+			mTracer.loadSurfaceInfo(isec, surf);
+		}
+		float cosPrevWi = glm::dot(ray.dir, surf.norm);
+		float distToPrev = glm::distance(lastPos, surf.pos);
+
+		if (surf.isLight) {
+			// NEE covers lights behind connectible vertices, except through their delta lobes
+			if (bounce > 1 && (!lastSampledLight || lastDelta) && cosPrevWi < 0.f) {
+				GRISPathSample lightSample = pathSample;
+				GRISPathFlagsSetPathLength(lightSample.flags, bounce + 1);
+				lightSample.F = surf.albedo * throughput;
+
+				if (rcVertexId == 0) {
+					lightSample.rcIsec = isec;
+				}
+				else {
+					lightSample.rcLi = surf.albedo * rcThroughput;
+				}
+				onSample(lightSample);
+				radiance += lightSample.F;
+			}
+			break;
+		}
+		const auto& mat = mScene.resource.materials[surf.matIndex];
+		bool connectible = isBSDFConnectible(mat);
+
+		if (bounce > 0 && rcVertexId == 0 &&
+			(hybrid ? canReconnect(lastConnectible, connectible, lastDelta, distToPrev) : (reconnection && bounce == 1))
+		) {
+			rcVertexId = bounce;
+			pathSample.rcIsec = isec;
+			pathSample.rcRng = rng;
+			pathSample.rcPrevSamplePdf = lastPdf;
+			pathSample.rcJacobian = std::abs(cosPrevWi) / square(distToPrev);
+
+			GRISPathFlagsSetRcVertexId(pathSample.flags, bounce);
+			GRISPathFlagsSetRcVertexType(pathSample.flags, RcVertexTypeSurface);
+			GRISPathFlagsSetDeltaScatter(pathSample.flags, lastDelta ? GRISDeltaScatterIntoRc : 0);
+		}
+		glm::vec4 lightRandSample = sample4f(rng);
+
+		bool sampleLight = (bounce > 0 && connectible);
+
+		if (/* sample direct lighting */ sampleLight) {
+			glm::vec3 lightDir;
+			glm::vec2 lightBary;
+			float lightDist, lightPdf, lightJacobian;
+			uint32_t lightId;
+
+			glm::vec3 lightRadiance = mTracer.sampleLight(
+				surf.pos, lightDir, lightDist, lightPdf, lightJacobian, lightBary, lightId, lightRandSample
+			);
+
+			Ray shadowRay;
+			shadowRay.origin = surf.pos;
+			shadowRay.dir = lightDir;
+			shadowRay.tMax = lightDist - MinRayDistance;
+
+			if (lightPdf > 1e-6f && !mAccel.occluded(shadowRay)) {
+				glm::vec3 scatterTerm = evalBSDF(mat, surf.albedo, surf.norm, wo, lightDir) * satDot(surf.norm, lightDir);
+
+				GRISPathSample lightSample = pathSample;
+				GRISPathFlagsSetPathLength(lightSample.flags, bounce + 2);
+				lightSample.F = lightRadiance * scatterTerm / lightPdf * throughput;
+
+				if (rcVertexId == 0 && hybrid && canReconnect(connectible, true, false, lightDist)) {
+					lightSample.rcIsec = Intersection{ lightBary, 0, lightId };
+					lightSample.rcRng = rng;
+					lightSample.rcPrevSamplePdf = lightPdf;
+					lightSample.rcJacobian = lightJacobian;
+					lightSample.rcLi = lightRadiance;
+					lightSample.rcWi = glm::vec3(0.f);
+
+					GRISPathFlagsSetRcVertexId(lightSample.flags, bounce + 1);
+					GRISPathFlagsSetRcVertexType(lightSample.flags, RcVertexTypeLightSampled);
+				}
+				else if (rcVertexId == 0) {
+					lightSample.rcIsec = Intersection{ lightBary, 0, lightId };
+				}
+				else if (rcVertexId == bounce) {
+					lightSample.rcWi = lightDir;
+					lightSample.rcLi = lightRadiance / lightPdf;
+				}
+				else {
+					lightSample.rcLi = lightRadiance * scatterTerm / lightPdf * rcThroughput;
+				}
+				onSample(lightSample);
+				radiance += lightSample.F;
+			}
+		}
+		float survival = 1.f;
+
+		if (/* russian roulette */ bounce > 4) {
+			float pdfTerminate = glm::max(1.f - luminance(throughput) * mSettings.rrScale, 0.f);
+
+			if (sample1f(rng) < pdfTerminate) {
+				break;
+			}
+			survival = 1.f - pdfTerminate;
+			throughput /= survival;
+			rcThroughput /= survival;
+		}
+		BSDFSample s;
+
+		if (!sampleBSDF(mat, surf.albedo, surf.norm, wo, sample3f(rng), s) || s.pdf < 1e-6f) {
+			break;
+		}
+		bool delta = isSampleTypeDelta(s.type);
+		float cosTheta = delta ? 1.f : absDot(surf.norm, s.wi);
+		glm::vec3 scatterTerm = s.bsdf * cosTheta / s.pdf;
+		throughput *= scatterTerm;
+
+		if (rcVertexId > 0 && rcVertexId == bounce) {
+			pathSample.rcWi = s.wi;
+			rcThroughput = glm::vec3(1.f / (s.pdf * survival));
+
+			uint32_t deltaScatter = GRISPathFlagsDeltaScatter(pathSample.flags) | (delta ? GRISDeltaScatterOutOfRc : 0);
+			GRISPathFlagsSetDeltaScatter(pathSample.flags, deltaScatter);
+		}
+		else if (rcVertexId > 0) {
+			rcThroughput *= scatterTerm;
+		}
+		lastPos = surf.pos;
+		lastPdf = s.pdf * survival;
+		lastConnectible = connectible;
+		lastDelta = delta;
+		lastSampledLight = sampleLight;
+
+		wo = -s.wi;
+		ray.origin = surf.pos + s.wi * 1e-4f;
+		ray.dir = s.wi;
+		ray.tMax = MaxRayDistance;
+	}
+	return radiance;
+}
+
+bool ReSTIRPT::replayPrefix(
+	const GBufferTexel& primary, uint32_t rng, uint32_t rcVertexId, GRISReconnectionData& rcData, SurfaceInfo& rcPrevSurf
+) const {
+	bool hybrid = (mSettings.shiftMode == ShiftMode::Hybrid);
+
+	glm::vec3 throughput(1.f);
+	SurfaceInfo surf = mGBuffer.surface(primary);
+	Intersection isec;
+	isec.instanceIdx = SpecialHitIndex;
+
+	Ray ray;
+	ray.dir = -primary.wo;
+	glm::vec3 wo = primary.wo;
+	glm::vec3 lastPos;
+	bool lastConnectible = false;
+	bool lastDelta = false;
+
+	// Draws the same random numbers as tracePath
+	for (uint32_t bounce = 0; bounce < rcVertexId; bounce++) {
+		if (bounce > 0) {
+			if (!mAccel.intersect(ray, isec)) {
+				return false;
+			}
+			mTracer.loadSurfaceInfo(isec, surf);
+
+			if (surf.isLight) {
+				return false;
+			}
+		}
+		const auto& mat = mScene.resource.materials[surf.matIndex];
+		bool connectible = isBSDFConnectible(mat);
+
+		if (hybrid && bounce > 0 && canReconnect(lastConnectible, connectible, lastDelta, glm::distance(lastPos, surf.pos))) {
+			return false;
+		}
+		if (bounce + 1 == rcVertexId) {
+			rcData.rcPrevIsec = isec;
+			rcData.rcPrevWo = wo;
+			rcData.rcPrevThroughput = throughput;
+			rcPrevSurf = surf;
+			return true;
+		}
+		sample4f(rng);
+
+		if (/* russian roulette */ bounce > 4) {
+			float pdfTerminate = glm::max(1.f - luminance(throughput) * mSettings.rrScale, 0.f);
+
+			if (sample1f(rng) < pdfTerminate) {
+				return false;
+			}
+			throughput /= (1.f - pdfTerminate);
+		}
+		BSDFSample s;
+
+		if (!sampleBSDF(mat, surf.albedo, surf.norm, wo, sample3f(rng), s) || s.pdf < 1e-6f) {
+			return false;
+		}
+		bool delta = isSampleTypeDelta(s.type);
+		float cosTheta = delta ? 1.f : absDot(surf.norm, s.wi);
+		throughput *= s.bsdf * cosTheta / s.pdf;
+
+		lastPos = surf.pos;
+		lastConnectible = connectible;
+		lastDelta = delta;
+
+		wo = -s.wi;
+		ray.origin = surf.pos + s.wi * 1e-4f;
+		ray.dir = s.wi;
+		ray.tMax = MaxRayDistance;
+	}
+	return false;
+}
+
+glm::vec3 ReSTIRPT::shiftPath(const GRISPathSample& pathSample, uint32_t dst) const {
+	const auto& primary = mGBuffer[dst];
+
+	if (!primary.valid || !GRISPathSampleIsValid(pathSample)) {
+		return glm::vec3(0.f);
+	}
+	uint32_t pathLength = GRISPathFlagsPathLength(pathSample.flags);
+	uint32_t rcVertexId = GRISPathFlagsRcVertexId(pathSample.flags);
+
+	if (rcVertexId == 0) {
+		// Random replay, the candidate of the same length has to be one without reconnection too
+		glm::vec3 F(0.f);
+
+		tracePath(primary, pathSample.primaryRng, [&](const GRISPathSample& replaySample) {
+			if (GRISPathFlagsPathLength(replaySample.flags) == pathLength && GRISPathFlagsRcVertexId(replaySample.flags) == 0) {
+				F = replaySample.F;
+			}
+		});
+		return F;
+	}
+	if (GRISPathFlagsDeltaScatter(pathSample.flags) != 0) {
+		return glm::vec3(0.f);
+	}
+	GRISReconnectionData rcData;
+	SurfaceInfo rcPrevSurf;
+
+	if (!replayPrefix(primary, pathSample.primaryRng, rcVertexId, rcData, rcPrevSurf)) {
+		return glm::vec3(0.f);
+	}
+	SurfaceInfo rcSurf;
+	mTracer.loadSurfaceInfo(pathSample.rcIsec, rcSurf);
+
+	const auto& rcPrevMat = mScene.resource.materials[rcPrevSurf.matIndex];
+	bool isLightVertex = (GRISPathFlagsRcVertexType(pathSample.flags) != RcVertexTypeSurface);
+
+	float dist = glm::distance(rcPrevSurf.pos, rcSurf.pos);
+	glm::vec3 wi = (rcSurf.pos - rcPrevSurf.pos) / dist;
+	float cosTheta = -glm::dot(wi, rcSurf.norm);
+
+	if (mSettings.shiftMode == ShiftMode::Hybrid && !canReconnect(isBSDFConnectible(rcPrevMat), true, false, dist)) {
+		return glm::vec3(0.f);
+	}
+	if ((isLightVertex && cosTheta <= 0.f) || !(pathSample.rcJacobian > 0.f) || !mTracer.visible(rcPrevSurf.pos, rcSurf.pos)) {
+		return glm::vec3(0.f);
+	}
+	float jacobian = std::abs(cosTheta) / square(dist) / pathSample.rcJacobian;
+
+	// Cosines as tracePath takes them, clamped for light samples, absolute for BSDF samples
+	float cosPrev = isLightVertex ? satDot(rcPrevSurf.norm, wi) : absDot(rcPrevSurf.norm, wi);
+	glm::vec3 Li = pathSample.rcLi;
+
+	if (!isLightVertex) {
+		const auto& rcMat = mScene.resource.materials[rcSurf.matIndex];
+		// Only connectible vertices sample lights, and their BSDF samples reaching lights don't count
+		bool lightSampledWi = (rcVertexId + 2 == pathLength) && isBSDFConnectible(rcMat);
+		float cosWi = lightSampledWi ? satDot(rcSurf.norm, pathSample.rcWi) : absDot(rcSurf.norm, pathSample.rcWi);
+
+		Li *= evalBSDF(rcMat, rcSurf.albedo, rcSurf.norm, -wi, pathSample.rcWi) * cosWi;
+	}
+	glm::vec3 scatterTerm = evalBSDF(rcPrevMat, rcPrevSurf.albedo, rcPrevSurf.norm, rcData.rcPrevWo, wi) * cosPrev;
+	return rcData.rcPrevThroughput * scatterTerm * Li * jacobian / pathSample.rcPrevSamplePdf;
+}
+
+GRISReservoir ReSTIRPT::resample(const uint32_t* pixels, const GRISReservoir* reservoirs, uint32_t count, uint32_t& rng) const {
+	GRISReservoir resv;
+	GRISPathSampleReset(resv.pathSample);
+	GRISReservoirReset(resv);
+
+	for (uint32_t i = 0; i < count; i++) {
+		GRISReservoir candidate = reservoirs[i];
+		const auto& pathSample = reservoirs[i].pathSample;
+		float weight = 0.f;
+
+		if (GRISPathSampleIsValid(pathSample) && candidate.contribWeight > 0.f) {
+			glm::vec3 F = (i == 0) ? pathSample.F : shiftPath(pathSample, pixels[0]);
+			float pHat = GRISToScalar(F);
+
+			if (pHat > 0.f) {
+				// Generalized balance heuristic over the pixels, every term is the sample's target
+				//   at one of them in the measure it was generated in
+				float sumPHat = 0.f;
+
+				for (uint32_t j = 0; j < count; j++) {
+					float pHatJ = (j == i) ? GRISToScalar(pathSample.F) : (j == 0) ? pHat : GRISToScalar(shiftPath(pathSample, pixels[j]));
+					sumPHat += reservoirs[j].sampleCount * pHatJ;
+				}
+				float misWeight = candidate.sampleCount * GRISToScalar(pathSample.F) / sumPHat;
+
+				weight = misWeight * pHat * candidate.contribWeight;
+				candidate.pathSample.F = F;
+			}
+		}
+		candidate.resampleWeight = std::isnan(weight) ? 0.f : weight;
+		GRISReservoirMerge(resv, candidate, sample1f(rng));
+	}
+	finalizeReservoir(resv);
+	return resv;
+}
+
+void ReSTIRPT::generatePath(glm::uvec2 index) {
+	const auto& texel = mGBuffer[index1D(index)];
+
+	GRISReservoir resv;
+	GRISPathSampleReset(resv.pathSample);
+	GRISReservoirReset(resv);
+
+	if (texel.valid) {
+		uint32_t rng = makeSeed(frameSeed(), index);
+		uint32_t resvRng = ~rng;
+
+		// Candidates of different lengths live in disjoint domains, so stream RIS needs no MIS
+		tracePath(texel, rng, [&](const GRISPathSample& pathSample) {
+			float weight = GRISToScalar(pathSample.F);
+
+			if (!isResampleWeightInvalid(weight)) {
+				GRISReservoirAddSample(resv, pathSample, weight, sample1f(resvRng));
+			}
+		});
+		resv.sampleCount = 1.f;
+		finalizeReservoir(resv);
+	}
+	mReservoirs[mThisFrame][index1D(index)] = resv;
+}
+
+void ReSTIRPT::temporalReuse(glm::uvec2 index) {
+	const auto& texel = mGBuffer[index1D(index)];
+	GRISReservoir resv = mReservoirs[mThisFrame][index1D(index)];
+
+	if (texel.valid && mSettings.temporalReuse && mFrameIndex > 0) {
+		glm::vec2 uv = (glm::vec2(index) + .5f) / glm::vec2(mSettings.width, mSettings.height);
+
+		// The camera is still, so motion vectors are 0 and the previous GBuffer is this one
+		auto prevIdx = mGBuffer.index(uv);
+
+		if (prevIdx) {
+			const auto& prev = mGBuffer[*prevIdx];
+
+			if (prev.matIndex == texel.matIndex && prev.instanceIdx == texel.instanceIdx &&
+				glm::dot(prev.norm, texel.norm) >= .95f && glm::distance(texel.pos, prev.pos) <= .5f
+			) {
+				uint32_t rng = makeSeed(frameSeed(), index) ^ 1;
+
+				GRISReservoir temporalResv = mReservoirs[mThisFrame ^ 1][*prevIdx];
+				GRISReservoirCapSample(temporalResv, mSettings.cap);
+
+				uint32_t pixels[] = { index1D(index), *prevIdx };
+				GRISReservoir reservoirs[] = { resv, temporalResv };
+				resv = resample(pixels, reservoirs, 2, rng);
+			}
+		}
+	}
+	mTempReservoirs[index1D(index)] = resv;
+}
+
+void ReSTIRPT::spatialReuse(glm::uvec2 index) {
+	const auto& texel = mGBuffer[index1D(index)];
+	GRISReservoir resv = mTempReservoirs[index1D(index)];
+
+	if (texel.valid && mSettings.spatialReuse) {
+		glm::vec2 filmSize(mSettings.width, mSettings.height);
+		glm::vec2 uv = (glm::vec2(index) + .5f) / filmSize;
+		glm::vec2 texelSize = 1.f / filmSize;
+
+		uint32_t rng = makeSeed(frameSeed(), index) ^ 2;
+
+		std::vector<uint32_t> pixels = { index1D(index) };
+		std::vector<GRISReservoir> reservoirs = { resv };
+
+		for (uint32_t i = 0; i < mSettings.numSpatialNeighbors; i++) {
+			glm::vec2 neighbor = uv + toConcentricDisk(sample2f(rng)) * mSettings.spatialRadius * texelSize;
+			auto neighborIdx = mGBuffer.index(neighbor);
+
+			if (!neighborIdx || std::find(pixels.begin(), pixels.end(), *neighborIdx) != pixels.end()) {
+				continue;
+			}
+			const auto& neighborTexel = mGBuffer[*neighborIdx];
+
+			if (glm::dot(neighborTexel.norm, texel.norm) < .9f || glm::distance(texel.pos, neighborTexel.pos) > .4f) {
+				continue;
+			}
+			pixels.push_back(*neighborIdx);
+			reservoirs.push_back(mTempReservoirs[*neighborIdx]);
+		}
+		resv = resample(pixels.data(), reservoirs.data(), static_cast<uint32_t>(pixels.size()), rng);
+	}
+	mReservoirs[mThisFrame][index1D(index)] = resv;
+	mFrame[index1D(index)] = clampColor(resv.pathSample.F * resv.contribWeight);
+}
+
+glm::vec3 ReSTIRPT::referenceRadiance(glm::uvec2 index, uint32_t numSamples, uint32_t seed) const {
+	const auto& texel = mGBuffer[index1D(index)];
+
+	if (!texel.valid) {
+		return glm::vec3(0.f);
+	}
+	glm::vec3 sum(0.f);
+
+	for (uint32_t i = 0; i < numSamples; i++) {
+		uint32_t rng = makeSeed(makeSeed(seed, i), index);
+		sum += clampColor(tracePath(texel, rng, [](const GRISPathSample&) {}));
+	}
+	return sum / static_cast<float>(std::max(numSamples, 1u));
+}
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+
+#include "GBuffer.h"
+#include "shader/HostDeviceReservoir.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Host counterpart of GRISReSTIR: path generation, temporal and spatial resampling of indirect
+*   lighting as three passes over per pixel GRISReservoir arrays, each pass parallel over tiles.
+*   Unlike the shaders it is meant to be unbiased, so that its frames are an oracle to hold the
+*   output of each GPU pass against:
+*
+*   - Every light contribution of a path is its own candidate, with the reconnection vertex the
+*     first one the shift's rule picks along it. Shifting checks that the rule picks the same
+*     vertex at the destination, so that shifts are invertible
+*   - The shifted prefix is replayed in primary sample space and the reconnection vertex kept in
+*     area measure, making the Jacobian the ratio of geometry terms cos / d^2 at the reconnection
+*     vertex over the pdf the source sampled it with, with Replay as the special case of no
+*     reconnection vertex and Reconnection the one of always reconnecting at the first bounce
+*   - Candidates are combined with the generalized balance heuristic over all reused pixels with
+*     sampleCount as confidence, instead of dividing by the summed sampleCount
+*   - Light sampling picks the environment map or a light by power from the light sample table at
+*     connectible vertices, with hits on lights and escaped rays counted behind the other vertices
+*     and delta lobes, instead of combining the two with MIS, so whether a shifted path still
+*     counts only depends on its vertices' materials. Environment samples are lights at
+*     MaxRayDistance, see PathTracer::environmentIntersection
+*
+*   The GBuffer is the traced one of GBuffer.h, so temporal reuse reads the same pixel
+*/
+class ReSTIRPT {
+public:
+	// Same values as GRISReSTIR::ShiftType
+	enum class ShiftMode { Reconnection, Replay, Hybrid };
+
+	struct Settings {
+		uint32_t width = 1280;
+		uint32_t height = 720;
+		ShiftMode shiftMode = ShiftMode::Hybrid;
+		float rrScale = 1.f;
+		bool temporalReuse = false;
+		bool spatialReuse = true;
+		// Confidence of the previous frame's reservoir is capped to this many samples
+		float cap = 20.f;
+		uint32_t numSpatialNeighbors = 3;
+		float spatialRadius = 20.f;
+		uint32_t tileSize = 16;
+		uint32_t seed = 0;
+		// 0 uses all hardware threads
+		uint32_t numThreads = 0;
+	};
+
+	ReSTIRPT(const Scene& scene, const AccelerationStructure& accel, const Settings& settings);
+
+	// Runs the three passes once. The first frame after construction or reset() skips temporal reuse
+	void renderFrame();
+	void reset();
+
+	uint32_t frameIndex() const { return mFrameIndex; }
+	double ms() const { return mMs; }
+
+	// F * contribWeight of the reservoirs after the last pass of the last frame
+	const std::vector<glm::vec3>& frame() const { return mFrame; }
+	const std::vector<GRISReservoir>& reservoirs() const { return mReservoirs[mThisFrame]; }
+
+	// Sum of all candidates of the paths resampled from, averaged over numSamples. 0 off the GBuffer
+	glm::vec3 referenceRadiance(glm::uvec2 index, uint32_t numSamples, uint32_t seed) const;
+	bool hasPrimaryHit(glm::uvec2 index) const { return mGBuffer[index1D(index)].valid; }
+
+	/**
+	* F of pathSample moved to the primary vertex of pixel dst, in the measure of the pixel it was
+	*   generated at. Shifting a sample to its own pixel gives back its F, 0 if the shift fails
+	*/
+	glm::vec3 shiftPath(const GRISPathSample& pathSample, uint32_t dst) const;
+
+private:
+	template<typename Func>
+	void forEachPixel(Func&& func) {
+		mScheduler.run(mNumThreads, [&](const TileScheduler::Tile& tile, uint32_t tileIdx) {
+			for (uint32_t y = tile.y0; y < tile.y1; y++) {
+				for (uint32_t x = tile.x0; x < tile.x1; x++) {
+					func(glm::uvec2(x, y));
+				}
+			}
+		});
+	}
+
+	uint32_t index1D(glm::uvec2 index) const { return index.y * mSettings.width + index.x; }
+	uint32_t frameSeed() const;
+
+	/**
+	* Traces the path of rng from the primary vertex as gris_path_trace does, calling
+	*   onSample(pathSample) for every light contribution. Returns the sum of their F
+	*/
+	template<typename Func>
+	glm::vec3 tracePath(const GBufferTexel& primary, uint32_t rng, Func&& onSample) const;
+	// Follows the path of rng up to the vertex before the reconnection vertex, false if it ends
+	//   before or the reconnection rule picks an earlier vertex
+	bool replayPrefix(const GBufferTexel& primary, uint32_t rng, uint32_t rcVertexId, GRISReconnectionData& rcData, SurfaceInfo& rcPrevSurf) const;
+
+	// Resamples reservoirs[i] of pixels[i] into pixels[0], whose own reservoir is reservoirs[0]
+	GRISReservoir resample(const uint32_t* pixels, const GRISReservoir* reservoirs, uint32_t count, uint32_t& rng) const;
+
+	void generatePath(glm::uvec2 index);
+	void temporalReuse(glm::uvec2 index);
+	void spatialReuse(glm::uvec2 index);
+
+private:
+	const Scene& mScene;
+	const AccelerationStructure& mAccel;
+	Settings mSettings;
+	TileScheduler mScheduler;
+	uint32_t mNumThreads;
+
+	// Scene queries shared with the reference path tracer
+	PathTracer mTracer;
+	GBuffer mGBuffer;
+
+	// uGRISReservoir and uGRISReservoirPrev swap every frame, uGRISReservoirTemp holds temporal results
+	std::vector<GRISReservoir> mReservoirs[2];
+	std::vector<GRISReservoir> mTempReservoirs;
+	std::vector<glm::vec3> mFrame;
+
+	uint32_t mThisFrame = 0;
+	uint32_t mFrameIndex = 0;
+	double mMs = 0.0;
+};
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "PathTracer.h"
+#include "util/Timer.h"
+
+NAMESPACE_BEGIN(cpu)
+
+struct ReSTIRValidation {
+	struct Frame {
+		// Frames rendered so far, including this one
+		uint32_t frameCount;
+		// Mean over pixels of E[frame] - reference relative to the mean of the reference, with
+		//   the standard error of that mean
+		double relativeBias;
+		double relativeBiasError;
+		// Mean over pixels of the variance of a frame across runs, relative to the squared mean
+		//   of the reference
+		double relativeVariance;
+		// Relative RMSE of the average of the first frameCount frames of a run
+		double accumulatedRelativeRMSE;
+	};
+	std::vector<Frame> frames;
+
+	double referenceMean = 0.0;
+	// Standard error of the mean of the reference relative to it
+	double referenceRelativeError = 0.0;
+	uint32_t numPixels = 0;
+	double referenceMs = 0.0;
+	double restirMs = 0.0;
+};
+
+/**
+* Runs numRuns independent sequences of numFrames frames of a host ReSTIR pass (ReSTIRDI or
+*   ReSTIRPT) and compares every frame against the brute force estimate its referenceRadiance
+*   gives with referenceSamples per pixel, taken on the pixels the GBuffer covers
+*/
+template<typename ReSTIR>
+ReSTIRValidation validateReSTIR(
+	const Scene& scene, const AccelerationStructure& accel, const typename ReSTIR::Settings& settings,
+	uint32_t numFrames, uint32_t numRuns, uint32_t referenceSamples
+) {
+	ReSTIRValidation result;
+	numRuns = std::max(numRuns, 2u);
+
+	size_t numPixels = size_t(settings.width) * settings.height;
+	auto value = [](const glm::vec3& color) { return (double(color.x) + color.y + color.z) / 3.0; };
+
+	// Two halves of the reference give its noise along with it
+	std::vector<double> reference(numPixels, 0.0);
+	std::vector<double> referenceVariance(numPixels, 0.0);
+	std::vector<uint8_t> covered(numPixels, 0);
+
+	Timer timer;
+	{
+		ReSTIR restir(scene, accel, settings);
+		TileScheduler scheduler(settings.width, settings.height, settings.tileSize);
+		uint32_t numThreads = (settings.numThreads == 0) ? std::max(std::thread::hardware_concurrency(), 1u) : settings.numThreads;
+		uint32_t halfSamples = std::max(referenceSamples / 2, 1u);
+
+		scheduler.run(numThreads, [&](const TileScheduler::Tile& tile, uint32_t tileIdx) {
+			for (uint32_t y = tile.y0; y < tile.y1; y++) {
+				for (uint32_t x = tile.x0; x < tile.x1; x++) {
+					size_t idx = size_t(y) * settings.width + x;
+					double a = value(restir.referenceRadiance({ x, y }, halfSamples, ~settings.seed));
+					double b = value(restir.referenceRadiance({ x, y }, halfSamples, ~settings.seed ^ 0x5bd1e995u));
+
+					reference[idx] = (a + b) * .5;
+					referenceVariance[idx] = (a - b) * (a - b) * .25;
+					covered[idx] = restir.hasPrimaryHit({ x, y });
+				}
+			}
+		});
+	}
+	result.referenceMs = timer.get();
+
+	double sumReference = 0.0;
+	double sumReferenceVariance = 0.0;
+
+	for (size_t i = 0; i < numPixels; i++) {
+		if (covered[i]) {
+			sumReference += reference[i];
+			sumReferenceVariance += referenceVariance[i];
+			result.numPixels++;
+		}
+	}
+	if (result.numPixels == 0) {
+		return result;
+	}
+	result.referenceMean = sumReference / result.numPixels;
+
+	double normalizer = std::max(result.referenceMean, 1e-12);
+	result.referenceRelativeError = std::sqrt(sumReferenceVariance) / result.numPixels / normalizer;
+
+	std::vector<double> sum(numFrames * numPixels, 0.0);
+	std::vector<double> sumSqr(numFrames * numPixels, 0.0);
+	std::vector<double> sumRMSE(numFrames, 0.0);
+	std::vector<double> accumulated(numPixels);
+
+	for (uint32_t run = 0; run < numRuns; run++) {
+		auto runSettings = settings;
+		runSettings.seed = makeSeed(settings.seed, run);
+
+		ReSTIR restir(scene, accel, runSettings);
+		std::fill(accumulated.begin(), accumulated.end(), 0.0);
+
+		for (uint32_t frame = 0; frame < numFrames; frame++) {
+			restir.renderFrame();
+			double sumSqrError = 0.0;
+
+			for (size_t i = 0; i < numPixels; i++) {
+				if (!covered[i]) {
+					continue;
+				}
+				double v = value(restir.frame()[i]);
+				sum[frame * numPixels + i] += v;
+				sumSqr[frame * numPixels + i] += v * v;
+
+				accumulated[i] += v;
+				double error = accumulated[i] / (frame + 1) - reference[i];
+				sumSqrError += error * error;
+			}
+			sumRMSE[frame] += std::sqrt(sumSqrError / result.numPixels) / normalizer;
+		}
+		result.restirMs += restir.ms();
+	}
+
+	for (uint32_t frame = 0; frame < numFrames; frame++) {
+		double sumBias = 0.0;
+		double sumVariance = 0.0;
+
+		for (size_t i = 0; i < numPixels; i++) {
+			if (!covered[i]) {
+				continue;
+			}
+			double mean = sum[frame * numPixels + i] / numRuns;
+			double variance = (sumSqr[frame * numPixels + i] - mean * mean * numRuns) / (numRuns - 1);
+
+			sumBias += mean - reference[i];
+			sumVariance += std::max(variance, 0.0);
+		}
+		ReSTIRValidation::Frame stats;
+		stats.frameCount = frame + 1;
+		stats.relativeBias = sumBias / result.numPixels / normalizer;
+		// Treats pixels as independent, spatial reuse correlates neighbors so this is a lower bound
+		stats.relativeBiasError = std::sqrt(sumVariance / numRuns + sumReferenceVariance) / result.numPixels / normalizer;
+		stats.relativeVariance = sumVariance / result.numPixels / (normalizer * normalizer);
+		stats.accumulatedRelativeRMSE = sumRMSE[frame] / numRuns;
+
+		result.frames.push_back(stats);
+	}
+	return result;
+}
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,406 @@
+#include "ReservoirValidation.h"
+#include "Shading.h"
+#include "shader/HostDeviceReservoir.h"
+#include "util/Timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+NAMESPACE_BEGIN(cpu)
+
+// Significance of every statistic. Seeds are fixed, so a pass is reproducible and a failure is a
+//   distribution off by far more than noise
+constexpr double MinPValue = 1e-4;
+
+// Confidence the previous frame's reservoir is capped to in the temporal chain, as GRISReSTIR
+constexpr float TemporalCap = 20.f;
+
+bool ReservoirValidation::Test::passed() const {
+	return chiSquarePValue >= MinPValue && ksPValue >= MinPValue && numImpossible == 0;
+}
+
+bool ReservoirValidation::passed() const {
+	return std::all_of(tests.begin(), tests.end(), [](const Test& test) { return test.passed(); });
+}
+
+// Regularized upper incomplete gamma function Q(a, x), Numerical Recipes 6.2
+static double gammaQ(double a, double x) {
+	if (x <= 0.0) {
+		return 1.0;
+	}
+	double logPrefix = -x + a * std::log(x) - std::lgamma(a);
+
+	if (x < a + 1.0) {
+		double term = 1.0 / a;
+		double sum = term;
+
+		for (int n = 1; n < 1000 && std::abs(term) > std::abs(sum) * 1e-15; n++) {
+			term *= x / (a + n);
+			sum += term;
+		}
+		return std::max(1.0 - sum * std::exp(logPrefix), 0.0);
+	}
+	// Continued fraction by the modified Lentz method
+	const double Tiny = 1e-300;
+	double b = x + 1.0 - a;
+	double c = 1.0 / Tiny;
+	double d = 1.0 / b;
+	double h = d;
+
+	for (int i = 1; i < 1000; i++) {
+		double an = -i * (i - a);
+		b += 2.0;
+		d = an * d + b;
+		d = (std::abs(d) < Tiny) ? Tiny : d;
+		c = b + an / c;
+		c = (std::abs(c) < Tiny) ? Tiny : c;
+		d = 1.0 / d;
+		double delta = d * c;
+		h *= delta;
+
+		if (std::abs(delta - 1.0) < 1e-15) {
+			break;
+		}
+	}
+	return std::exp(logPrefix) * h;
+}
+
+static double chiSquarePValue(double chiSquare, uint32_t dof) {
+	return (dof == 0) ? 1.0 : gammaQ(dof * .5, chiSquare * .5);
+}
+
+// Asymptotic Kolmogorov distribution with Stephens' correction for n samples
+static double ksPValue(double distance, double n) {
+	double sqrtN = std::sqrt(n);
+	double lambda = (sqrtN + .12 + .11 / sqrtN) * distance;
+
+	if (lambda < .2) {
+		return 1.0;
+	}
+	double sum = 0.0;
+
+	for (int j = 1; j <= 100; j++) {
+		double term = 2.0 * ((j & 1) ? 1.0 : -1.0) * std::exp(-2.0 * j * j * lambda * lambda);
+		sum += term;
+
+		if (std::abs(term) < 1e-12) {
+			break;
+		}
+	}
+	return std::clamp(sum, 0.0, 1.0);
+}
+
+/**
+* Adapters from DI and GRIS reservoirs to the routines under test. The sample's id (its index in
+*   the stream's candidate list) lives in a seed field both path samples have
+*/
+struct DIOps {
+	using Reservoir = DIReservoir;
+
+	static void reset(Reservoir& resv) {
+		DIPathSampleInit(resv.pathSample);
+		DIReservoirReset(resv);
+	}
+
+	static void addSample(Reservoir& resv, uint32_t id, float weight, float r) {
+		DIPathSample pathSample;
+		pathSample.isec.instanceIdx = 0;
+		pathSample.rng = id;
+		DIReservoirAddSample(resv, pathSample, weight, r);
+	}
+
+	static void merge(Reservoir& resv, const Reservoir& rhs, float r) { DIReservoirMerge(resv, rhs, r); }
+	static void capSample(Reservoir& resv, float cap) { DIReservoirCapSample(resv, static_cast<uint32_t>(cap)); }
+
+	static bool hasSample(const Reservoir& resv) { return DIPathSampleIsValid(resv.pathSample); }
+	static uint32_t sampleId(const Reservoir& resv) { return resv.pathSample.rng; }
+	static float sampleCount(const Reservoir& resv) { return static_cast<float>(resv.sampleCount); }
+};
+
+struct GRISOps {
+	using Reservoir = GRISReservoir;
+
+	static void reset(Reservoir& resv) {
+		GRISPathSampleReset(resv.pathSample);
+		GRISReservoirReset(resv);
+	}
+
+	static void addSample(Reservoir& resv, uint32_t id, float weight, float r) {
+		GRISPathSample pathSample;
+		pathSample.rcIsec.instanceIdx = 0;
+		pathSample.primaryRng = id;
+		GRISReservoirAddSample(resv, pathSample, weight, r);
+	}
+
+	static void merge(Reservoir& resv, const Reservoir& rhs, float r) { GRISReservoirMerge(resv, rhs, r); }
+	static void capSample(Reservoir& resv, float cap) { GRISReservoirCapSample(resv, cap); }
+
+	static bool hasSample(const Reservoir& resv) { return GRISPathSampleIsValid(resv.pathSample); }
+	static uint32_t sampleId(const Reservoir& resv) { return resv.pathSample.primaryRng; }
+	static float sampleCount(const Reservoir& resv) { return resv.sampleCount; }
+};
+
+enum class SelectionMode { Stream, Merge, CappedMerge };
+
+/**
+* Streams through NumCandidates weights, rotated by a random offset each time. Merge modes split
+*   them into random chunks, each streamed into its own reservoir, with CappedMerge capping those
+*   to 2 samples before merging, which scales their weights by 2 / size
+*/
+template<typename Ops>
+static ReservoirValidation::Test testSelection(const char* name, SelectionMode mode, uint32_t numStreams, uint32_t seed) {
+	constexpr uint32_t NumCandidates = 12;
+	constexpr float Weights[NumCandidates] = { 0.f, 1e-3f, .02f, .5f, 1.f, 1.f, 2.f, 3.5f, 0.f, 10.f, 40.f, 100.f };
+	constexpr float ChunkCap = 2.f;
+
+	using Reservoir = typename Ops::Reservoir;
+
+	std::vector<double> expected(NumCandidates, 0.0);
+	std::vector<uint64_t> counts(NumCandidates, 0);
+	ReservoirValidation::Test test;
+	test.name = name;
+
+	for (uint32_t stream = 0; stream < numStreams; stream++) {
+		uint32_t rng = makeSeed(seed, stream);
+		uint32_t offset = urand(rng) % NumCandidates;
+
+		// Chunks end after candidates whose bit is set, the last one always does
+		uint32_t chunkEnds = (mode == SelectionMode::Stream) ? 0 : urand(rng);
+		chunkEnds |= 1u << (NumCandidates - 1);
+
+		Reservoir resv, chunk;
+		Ops::reset(resv);
+		Ops::reset(chunk);
+
+		uint32_t chunkBegin = 0;
+		float scales[NumCandidates];
+
+		for (uint32_t i = 0; i < NumCandidates; i++) {
+			uint32_t id = (i + offset) % NumCandidates;
+			Ops::addSample((mode == SelectionMode::Stream) ? resv : chunk, id, Weights[id], sample1f(rng));
+
+			if (mode == SelectionMode::Stream || !((chunkEnds >> i) & 1)) {
+				continue;
+			}
+			float size = static_cast<float>(i + 1 - chunkBegin);
+			float scale = (mode == SelectionMode::CappedMerge && size > ChunkCap) ? ChunkCap / size : 1.f;
+
+			for (uint32_t j = chunkBegin; j <= i; j++) {
+				scales[(j + offset) % NumCandidates] = scale;
+			}
+			if (mode == SelectionMode::CappedMerge) {
+				Ops::capSample(chunk, ChunkCap);
+			}
+			Ops::merge(resv, chunk, sample1f(rng));
+			Ops::reset(chunk);
+			chunkBegin = i + 1;
+		}
+		double sumWeight = 0.0;
+
+		for (uint32_t id = 0; id < NumCandidates; id++) {
+			sumWeight += Weights[id] * ((mode == SelectionMode::Stream) ? 1.f : scales[id]);
+		}
+		for (uint32_t id = 0; id < NumCandidates; id++) {
+			expected[id] += Weights[id] * ((mode == SelectionMode::Stream) ? 1.f : scales[id]) / sumWeight;
+		}
+		if (Ops::hasSample(resv)) {
+			counts[Ops::sampleId(resv) % NumCandidates]++;
+		}
+	}
+	// Pearson's statistic, with per stream probabilities that differ in the capped mode the
+	//   variance of a count is at most its expectation, which keeps the test conservative
+	for (uint32_t id = 0; id < NumCandidates; id++) {
+		if (expected[id] <= 0.0) {
+			test.numImpossible += counts[id];
+			continue;
+		}
+		double diff = counts[id] - expected[id];
+		test.chiSquare += diff * diff / expected[id];
+		test.dof++;
+	}
+	test.dof--;
+	test.chiSquarePValue = chiSquarePValue(test.chiSquare, test.dof);
+	return test;
+}
+
+enum class ContribMode { Stream, Merge, TemporalChain };
+
+// Target of the contribution weight tests, 0 over [0.75, 1)
+static float targetPdf(float x) {
+	return (x < .75f) ? .25f + 4.f * x * x : 0.f;
+}
+
+// Integral of targetPdf over [0, x) divided by the total of 0.75
+static double targetCDF(double x) {
+	x = std::min(x, .75);
+	return (.25 * x + 4.0 / 3.0 * x * x * x) / .75;
+}
+
+template<typename Ops>
+static typename Ops::Reservoir streamCandidates(uint32_t count, std::vector<float>& candidates, uint32_t& rng) {
+	typename Ops::Reservoir resv;
+	Ops::reset(resv);
+
+	for (uint32_t i = 0; i < count; i++) {
+		// The source pdf is 1, so weights are pHat
+		float x = sample1f(rng);
+		Ops::addSample(resv, static_cast<uint32_t>(candidates.size()), targetPdf(x), sample1f(rng));
+		candidates.push_back(x);
+	}
+	return resv;
+}
+
+/**
+* E[W * f(Y)] is the integral of f over where the target is non zero, for any f, so the mean of
+*   W over the selected samples landing in a bin is the bin's width there
+*/
+template<typename Ops>
+static ReservoirValidation::Test testContribWeight(const char* name, ContribMode mode, uint32_t numStreams, uint32_t seed) {
+	constexpr uint32_t NumBins = 16;
+	constexpr uint32_t MaxCandidates = 32;
+	constexpr uint32_t NumFrames = 8;
+
+	using Reservoir = typename Ops::Reservoir;
+
+	std::vector<double> sum(NumBins, 0.0);
+	std::vector<double> sumSqr(NumBins, 0.0);
+	std::vector<std::pair<float, double>> selected;
+	selected.reserve(numStreams);
+
+	std::vector<float> candidates;
+	ReservoirValidation::Test test;
+	test.name = name;
+
+	for (uint32_t stream = 0; stream < numStreams; stream++) {
+		uint32_t rng = makeSeed(seed, stream);
+		candidates.clear();
+
+		Reservoir resv;
+
+		if (mode == ContribMode::Stream) {
+			resv = streamCandidates<Ops>(1 + urand(rng) % MaxCandidates, candidates, rng);
+		}
+		else if (mode == ContribMode::Merge) {
+			Reservoir lhs = streamCandidates<Ops>(1 + urand(rng) % MaxCandidates, candidates, rng);
+			Reservoir rhs = streamCandidates<Ops>(1 + urand(rng) % MaxCandidates, candidates, rng);
+
+			Ops::reset(resv);
+			Ops::merge(resv, lhs, sample1f(rng));
+			Ops::merge(resv, rhs, sample1f(rng));
+		}
+		else {
+			// As temporal reuse at a still pixel: the previous reservoir capped, then merged after
+			//   the new one. Few candidates a frame so that the cap kicks in
+			resv = streamCandidates<Ops>(1 + urand(rng) % 8, candidates, rng);
+
+			for (uint32_t frame = 1; frame < NumFrames; frame++) {
+				Reservoir prev = resv;
+				Ops::capSample(prev, TemporalCap);
+				Reservoir current = streamCandidates<Ops>(1 + urand(rng) % 8, candidates, rng);
+
+				Ops::reset(resv);
+				Ops::merge(resv, current, sample1f(rng));
+				Ops::merge(resv, prev, sample1f(rng));
+			}
+		}
+		if (!Ops::hasSample(resv)) {
+			continue;
+		}
+		float x = candidates[Ops::sampleId(resv)];
+		float pHat = targetPdf(x);
+
+		if (pHat <= 0.f) {
+			test.numImpossible++;
+			continue;
+		}
+		// pHat * W, which doesn't depend on the sample picked
+		double pHatContribWeight = static_cast<double>(resv.resampleWeight) / Ops::sampleCount(resv);
+		double contribWeight = pHatContribWeight / pHat;
+
+		uint32_t bin = std::min(static_cast<uint32_t>(x * NumBins), NumBins - 1);
+		sum[bin] += contribWeight;
+		sumSqr[bin] += contribWeight * contribWeight;
+		selected.push_back({ x, pHatContribWeight });
+	}
+	// Bins are independent up to the one stream each sample comes from, so the z scores of their
+	//   means sum to a chi-square of as many degrees of freedom
+	for (uint32_t bin = 0; bin < NumBins; bin++) {
+		double lo = static_cast<double>(bin) / NumBins;
+		double hi = static_cast<double>(bin + 1) / NumBins;
+		double expected = std::max(std::min(hi, .75) - lo, 0.0);
+
+		if (expected <= 0.0) {
+			continue;
+		}
+		double mean = sum[bin] / numStreams;
+		double variance = std::max(sumSqr[bin] / numStreams - mean * mean, 1e-30) / numStreams;
+
+		test.chiSquare += (mean - expected) * (mean - expected) / variance;
+		test.dof++;
+	}
+	test.chiSquarePValue = chiSquarePValue(test.chiSquare, test.dof);
+
+	// Weighted empirical CDF against the target's, at the Kish effective sample count
+	std::sort(selected.begin(), selected.end());
+	double sumWeight = 0.0;
+	double sumWeightSqr = 0.0;
+
+	for (const auto& [x, weight] : selected) {
+		sumWeight += weight;
+		sumWeightSqr += weight * weight;
+	}
+	if (sumWeight > 0.0) {
+		double cdf = 0.0;
+
+		for (const auto& [x, weight] : selected) {
+			double target = targetCDF(x);
+			test.ksDistance = std::max(test.ksDistance, std::abs(cdf - target));
+			cdf += weight / sumWeight;
+			test.ksDistance = std::max(test.ksDistance, std::abs(cdf - target));
+		}
+		test.ksPValue = ksPValue(test.ksDistance, sumWeight * sumWeight / sumWeightSqr);
+	}
+	return test;
+}
+
+ReservoirValidation validateReservoirs(uint32_t numStreams, uint32_t seed) {
+	ReservoirValidation result;
+	result.numStreams = numStreams;
+	result.tests.resize(12);
+	Timer timer;
+
+	// Tests run on their own threads, each drawing from its own seed so that results don't depend
+	//   on the number of cores
+	std::vector<std::thread> threads;
+
+	auto launch = [&](auto test) {
+		uint32_t index = static_cast<uint32_t>(threads.size());
+		uint32_t testSeed = makeSeed(seed, index);
+
+		threads.emplace_back([&result, index, testSeed, numStreams, test]() {
+			result.tests[index] = test(numStreams, testSeed);
+		});
+	};
+	launch([](uint32_t n, uint32_t s) { return testSelection<DIOps>("DIReservoirAddSample selection", SelectionMode::Stream, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testSelection<DIOps>("DIReservoirMerge selection", SelectionMode::Merge, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testSelection<DIOps>("DIReservoirCapSample selection", SelectionMode::CappedMerge, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testSelection<GRISOps>("GRISReservoirAddSample selection", SelectionMode::Stream, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testSelection<GRISOps>("GRISReservoirMerge selection", SelectionMode::Merge, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testSelection<GRISOps>("GRISReservoirCapSample selection", SelectionMode::CappedMerge, n, s); });
+
+	launch([](uint32_t n, uint32_t s) { return testContribWeight<DIOps>("DIReservoirAddSample contribution weight", ContribMode::Stream, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testContribWeight<DIOps>("DIReservoirMerge contribution weight", ContribMode::Merge, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testContribWeight<DIOps>("DI temporal chain contribution weight", ContribMode::TemporalChain, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testContribWeight<GRISOps>("GRISReservoirAddSample contribution weight", ContribMode::Stream, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testContribWeight<GRISOps>("GRISReservoirMerge contribution weight", ContribMode::Merge, n, s); });
+	launch([](uint32_t n, uint32_t s) { return testContribWeight<GRISOps>("GRIS temporal chain contribution weight", ContribMode::TemporalChain, n, s); });
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	result.ms = timer.get();
+	return result;
+}
+
+NAMESPACE_END(cpu)
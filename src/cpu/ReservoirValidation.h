@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "util/NamespaceDecl.h"
+
+NAMESPACE_BEGIN(cpu)
+
+struct ReservoirValidation {
+	struct Test {
+		std::string name;
+		// Chi-square statistic over the bins with non zero expectation, with its degrees of freedom
+		//   and p-value
+		double chiSquare = 0.0;
+		uint32_t dof = 0;
+		double chiSquarePValue = 1.0;
+		// Kolmogorov-Smirnov distance of the selected samples weighted by pHat * W from the target
+		//   distribution, and its p-value at the effective sample count. 1 for discrete tests
+		double ksDistance = 0.0;
+		double ksPValue = 1.0;
+		// Selected samples the target gives 0, any is a bug
+		uint64_t numImpossible = 0;
+
+		bool passed() const;
+	};
+	std::vector<Test> tests;
+
+	uint32_t numStreams = 0;
+	double ms = 0.0;
+
+	bool passed() const;
+};
+
+/**
+* Runs the reservoir routines of HostDeviceReservoir.h, which the shaders compile as well, over
+*   numStreams synthetic candidate streams per test, DI and GRIS reservoirs alike:
+*
+*   - Selection: candidates with fixed discrete weights, some 0, streamed, merged from chunks and
+*     merged from capped chunks. Counts of the candidate picked go against w_i / sum w
+*   - Contribution weight: candidates uniform over [0, 1) resampled to a target that is 0 over
+*     part of it, streamed, merged and through a capped temporal chain. The histogram of
+*     W = resampleWeight / (sampleCount * pHat) goes against the bin widths, the selected samples
+*     weighted by pHat * W against the target's CDF
+*/
+ReservoirValidation validateReservoirs(uint32_t numStreams, uint32_t seed = 0);
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "util/NamespaceDecl.h"
+
+/**
+* Eight float lanes for host kernels. Builds with AVX2 map every operation to one instruction,
+*   other builds fall back to plain loops with identical results. Comparisons return bitmasks
+*   with lane i in bit i. Only separate multiplies and adds are used so that lane results match
+*   scalar code written in the same order
+*/
+
+NAMESPACE_BEGIN(cpu)
+
+constexpr uint32_t SIMDWidth = 8;
+constexpr uint32_t SIMDFullMask = 0xff;
+
+#if defined(__AVX2__)
+struct Float8 {
+	__m256 v;
+
+	static Float8 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+	static Float8 broadcast(float x) { return { _mm256_set1_ps(x) }; }
+
+	static Float8 fromBytes(const uint8_t* p) {
+		__m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+		return { _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)) };
+	}
+
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+	float operator [] (uint32_t i) const {
+		alignas(32) float lanes[8];
+		_mm256_store_ps(lanes, v);
+		return lanes[i];
+	}
+};
+
+inline Float8 operator + (Float8 a, Float8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline Float8 operator - (Float8 a, Float8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline Float8 operator * (Float8 a, Float8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline Float8 operator / (Float8 a, Float8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+
+inline Float8 min(Float8 a, Float8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline Float8 max(Float8 a, Float8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline Float8 sqrt(Float8 a) { return { _mm256_sqrt_ps(a.v) }; }
+
+inline Float8 abs(Float8 a) {
+	return { _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v) };
+}
+
+// a with its sign flipped in lanes where b is negative
+inline Float8 mulSign(Float8 a, Float8 b) {
+	return { _mm256_xor_ps(a.v, _mm256_and_ps(b.v, _mm256_set1_ps(-0.f))) };
+}
+
+inline Float8 select(uint32_t mask, Float8 a, Float8 b) {
+	__m256i bits = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+	__m256i laneMask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask)), bits), bits);
+	return { _mm256_blendv_ps(b.v, a.v, _mm256_castsi256_ps(laneMask)) };
+}
+
+inline uint32_t lessThan(Float8 a, Float8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+inline uint32_t lessEqual(Float8 a, Float8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+inline uint32_t greaterThan(Float8 a, Float8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)); }
+inline uint32_t greaterEqual(Float8 a, Float8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+inline uint32_t equal(Float8 a, Float8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ)); }
+#else
+struct Float8 {
+	float v[8];
+
+	static Float8 load(const float* p) {
+		Float8 r;
+		std::memcpy(r.v, p, sizeof(r.v));
+		return r;
+	}
+
+	static Float8 broadcast(float x) {
+		Float8 r;
+		std::fill(r.v, r.v + 8, x);
+		return r;
+	}
+
+	static Float8 fromBytes(const uint8_t* p) {
+		Float8 r;
+		for (uint32_t i = 0; i < 8; i++) {
+			r.v[i] = static_cast<float>(p[i]);
+		}
+		return r;
+	}
+
+	void store(float* p) const { std::memcpy(p, v, sizeof(v)); }
+
+	float operator [] (uint32_t i) const { return v[i]; }
+};
+
+template<typename Op>
+inline Float8 laneWise(Float8 a, Float8 b, Op op) {
+	Float8 r;
+	for (uint32_t i = 0; i < 8; i++) {
+		r.v[i] = op(a.v[i], b.v[i]);
+	}
+	return r;
+}
+
+template<typename Op>
+inline uint32_t laneMask(Float8 a, Float8 b, Op op) {
+	uint32_t mask = 0;
+	for (uint32_t i = 0; i < 8; i++) {
+		mask |= op(a.v[i], b.v[i]) ? (1u << i) : 0u;
+	}
+	return mask;
+}
+
+inline Float8 operator + (Float8 a, Float8 b) { return laneWise(a, b, [](float x, float y) { return x + y; }); }
+inline Float8 operator - (Float8 a, Float8 b) { return laneWise(a, b, [](float x, float y) { return x - y; }); }
+inline Float8 operator * (Float8 a, Float8 b) { return laneWise(a, b, [](float x, float y) { return x * y; }); }
+inline Float8 operator / (Float8 a, Float8 b) { return laneWise(a, b, [](float x, float y) { return x / y; }); }
+
+// Operand order follows minps / maxps, the second operand is returned for NaNs
+inline Float8 min(Float8 a, Float8 b) { return laneWise(a, b, [](float x, float y) { return (x < y) ? x : y; }); }
+inline Float8 max(Float8 a, Float8 b) { return laneWise(a, b, [](float x, float y) { return (x > y) ? x : y; }); }
+inline Float8 sqrt(Float8 a) { return laneWise(a, a, [](float x, float) { return std::sqrt(x); }); }
+inline Float8 abs(Float8 a) { return laneWise(a, a, [](float x, float) { return std::abs(x); }); }
+
+inline Float8 mulSign(Float8 a, Float8 b) {
+	return laneWise(a, b, [](float x, float y) { return std::signbit(y) ? -x : x; });
+}
+
+inline Float8 select(uint32_t mask, Float8 a, Float8 b) {
+	Float8 r;
+	for (uint32_t i = 0; i < 8; i++) {
+		r.v[i] = (mask >> i & 1) ? a.v[i] : b.v[i];
+	}
+	return r;
+}
+
+inline uint32_t lessThan(Float8 a, Float8 b) { return laneMask(a, b, [](float x, float y) { return x < y; }); }
+inline uint32_t lessEqual(Float8 a, Float8 b) { return laneMask(a, b, [](float x, float y) { return x <= y; }); }
+inline uint32_t greaterThan(Float8 a, Float8 b) { return laneMask(a, b, [](float x, float y) { return x > y; }); }
+inline uint32_t greaterEqual(Float8 a, Float8 b) { return laneMask(a, b, [](float x, float y) { return x >= y; }); }
+inline uint32_t equal(Float8 a, Float8 b) { return laneMask(a, b, [](float x, float y) { return x == y; }); }
+#endif
+
+// Index of the lowest set bit, mask must not be zero
+inline uint32_t firstLane(uint32_t mask) {
+	return static_cast<uint32_t>(std::countr_zero(mask));
+}
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Material.h"
+#include "SIMD.h"
+#include "shader/HostDeviceMaterial.h"
+#include "util/NamespaceDecl.h"
+
+NAMESPACE_BEGIN(cpu)
+
+// Materials and sampling math are the ones compiled into the shaders, see HostDeviceMaterial.h
+using namespace shader;
+
+/**
+* Direction pairs in SoA layout for evaluating one material at one normal many times, as in
+*   numerical integration of the BSDF or its pdf
+*/
+struct BSDFBatch {
+	std::vector<float> woX, woY, woZ;
+	std::vector<float> wiX, wiY, wiZ;
+
+	// Outputs of evalBSDFBatch
+	std::vector<float> bsdfR, bsdfG, bsdfB;
+	std::vector<float> pdf;
+
+	size_t size() const { return woX.size(); }
+	void resize(size_t size);
+	void set(size_t i, const glm::vec3& wo, const glm::vec3& wi);
+};
+
+/**
+* evalBSDF and evalPdf of every pair in the batch, SIMDWidth pairs at a time. The lanes follow
+*   the scalar code operation for operation, so results agree with it up to rounding of sqrt
+*   and division
+*/
+void evalBSDFBatch(const Material& mat, const glm::vec3& albedo, const glm::vec3& n, BSDFBatch& batch);
+
+struct BSDFValidation {
+	// Largest directional albedo of a white base color, the integral of f * cos over the
+	//   hemisphere, above 1 the BSDF creates energy
+	float maxAlbedo = 0.f;
+	// Largest difference between the integral of evalPdf over the hemisphere and the fraction of
+	//   sampleBSDF directions landing there, which are the same if the pdf describes the sampler
+	float maxNormalizationError = 0.f;
+	// Largest total variation distance between histograms of sampled directions and evalPdf
+	//   integrated over the same bins
+	float maxHistogramError = 0.f;
+	// Largest |E[f * cos / pdf] - albedo| in standard deviations of the estimate
+	float maxAlbedoDeviation = 0.f;
+	// Largest relative difference of evalBSDFBatch from evalBSDF and evalPdf
+	float maxBatchError = 0.f;
+	// Expected noise of the sampled quantities for the number of samples taken
+	float noiseTolerance = 0.f;
+
+	double scalarMs = 0.0;
+	double batchMs = 0.0;
+
+	bool passed() const;
+};
+
+/**
+* Checks a non delta material against numerical integration on a fine grid over the hemisphere,
+*   at several outgoing directions with numSamples calls of sampleBSDF each
+*/
+BSDFValidation validateBSDF(const Material& mat, uint32_t numSamples, uint32_t seed = 0);
+
+NAMESPACE_END(cpu)
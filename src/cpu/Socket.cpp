@@ -0,0 +1,252 @@
+#include "Socket.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+#else
+  #include <arpa/inet.h>
+  #include <netdb.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <sys/select.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
+
+NAMESPACE_BEGIN(cpu)
+
+#ifdef _WIN32
+using NativeHandle = SOCKET;
+using SockLen = int;
+#else
+using NativeHandle = int;
+using SockLen = socklen_t;
+#endif
+
+static NativeHandle native(uintptr_t handle) {
+	return static_cast<NativeHandle>(handle);
+}
+
+// Winsock needs starting once per process, it is never cleaned up as sockets live until exit
+static void initSockets() {
+#ifdef _WIN32
+	static std::once_flag flag;
+
+	std::call_once(flag, []() {
+		WSADATA data;
+
+		if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+			throw std::runtime_error("Failed to start Winsock");
+		}
+	});
+#endif
+}
+
+static void closeHandle(uintptr_t handle) {
+#ifdef _WIN32
+	closesocket(native(handle));
+#else
+	::close(native(handle));
+#endif
+}
+
+static bool isValidNative(NativeHandle handle) {
+#ifdef _WIN32
+	return handle != INVALID_SOCKET;
+#else
+	return handle >= 0;
+#endif
+}
+
+// Tiles are small messages answered by large ones, Nagle's algorithm would delay each
+static void disableNagle(NativeHandle handle) {
+	int flag = 1;
+	setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&flag), sizeof(flag));
+}
+
+Socket::~Socket() {
+	close();
+}
+
+Socket::Socket(Socket&& rhs) noexcept : mHandle(rhs.mHandle) {
+	rhs.mHandle = InvalidHandle;
+}
+
+Socket& Socket::operator = (Socket&& rhs) noexcept {
+	if (this != &rhs) {
+		close();
+		mHandle = rhs.mHandle;
+		rhs.mHandle = InvalidHandle;
+	}
+	return *this;
+}
+
+Socket Socket::connect(const std::string& host, uint16_t port) {
+	initSockets();
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addrs = nullptr;
+
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addrs) != 0) {
+		throw std::runtime_error("Failed to resolve " + host);
+	}
+	Socket socket;
+
+	for (addrinfo* addr = addrs; addr != nullptr && !socket.valid(); addr = addr->ai_next) {
+		NativeHandle handle = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+
+		if (!isValidNative(handle)) {
+			continue;
+		}
+		if (::connect(handle, addr->ai_addr, static_cast<SockLen>(addr->ai_addrlen)) != 0) {
+			closeHandle(static_cast<Handle>(handle));
+			continue;
+		}
+		disableNagle(handle);
+		socket = Socket(static_cast<Handle>(handle));
+	}
+	freeaddrinfo(addrs);
+
+	if (!socket.valid()) {
+		throw std::runtime_error("Failed to connect to " + host + ":" + std::to_string(port));
+	}
+	return socket;
+}
+
+Socket Socket::listen(uint16_t port) {
+	initSockets();
+
+	NativeHandle handle = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	if (!isValidNative(handle)) {
+		throw std::runtime_error("Failed to create socket");
+	}
+	Socket socket(static_cast<Handle>(handle));
+
+	int reuse = 1;
+	setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	if (::bind(handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(handle, SOMAXCONN) != 0) {
+		throw std::runtime_error("Failed to listen on port " + std::to_string(port));
+	}
+	return socket;
+}
+
+Socket Socket::accept(uint32_t timeoutMs) {
+	if (!waitReadable(timeoutMs)) {
+		return Socket();
+	}
+	NativeHandle handle = ::accept(native(mHandle), nullptr, nullptr);
+
+	if (!isValidNative(handle)) {
+		return Socket();
+	}
+	disableNagle(handle);
+	return Socket(static_cast<Handle>(handle));
+}
+
+bool Socket::waitReadable(uint32_t timeoutMs) {
+	if (!valid()) {
+		return false;
+	}
+	fd_set readSet;
+	FD_ZERO(&readSet);
+	FD_SET(native(mHandle), &readSet);
+
+	timeval timeout;
+	timeout.tv_sec = static_cast<long>(timeoutMs / 1000);
+	timeout.tv_usec = static_cast<long>(timeoutMs % 1000) * 1000;
+
+	// The first argument is ignored by Winsock
+	return ::select(static_cast<int>(native(mHandle)) + 1, &readSet, nullptr, nullptr, &timeout) > 0;
+}
+
+bool Socket::sendAll(const void* data, size_t size) {
+	const char* ptr = static_cast<const char*>(data);
+
+	while (size > 0) {
+		int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+#ifdef MSG_NOSIGNAL
+		// A worker gone away must not kill the coordinator with SIGPIPE
+		auto sent = ::send(native(mHandle), ptr, chunk, MSG_NOSIGNAL);
+#else
+		auto sent = ::send(native(mHandle), ptr, chunk, 0);
+#endif
+		if (sent <= 0) {
+			return false;
+		}
+		ptr += sent;
+		size -= static_cast<size_t>(sent);
+	}
+	return true;
+}
+
+bool Socket::recvAll(void* data, size_t size) {
+	char* ptr = static_cast<char*>(data);
+
+	while (size > 0) {
+		int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+		auto received = ::recv(native(mHandle), ptr, chunk, 0);
+
+		if (received <= 0) {
+			return false;
+		}
+		ptr += received;
+		size -= static_cast<size_t>(received);
+	}
+	return true;
+}
+
+void Socket::shutdown() {
+	if (valid()) {
+#ifdef _WIN32
+		::shutdown(native(mHandle), SD_BOTH);
+#else
+		::shutdown(native(mHandle), SHUT_RDWR);
+#endif
+	}
+}
+
+void Socket::close() {
+	if (valid()) {
+		closeHandle(mHandle);
+		mHandle = InvalidHandle;
+	}
+}
+
+uint16_t Socket::localPort() const {
+	sockaddr_in addr = {};
+	SockLen size = sizeof(addr);
+
+	if (getsockname(native(mHandle), reinterpret_cast<sockaddr*>(&addr), &size) != 0) {
+		return 0;
+	}
+	return ntohs(addr.sin_port);
+}
+
+std::string Socket::peerName() const {
+	sockaddr_storage addr = {};
+	SockLen size = sizeof(addr);
+	char host[NI_MAXHOST] = {};
+	char port[NI_MAXSERV] = {};
+
+	if (getpeername(native(mHandle), reinterpret_cast<sockaddr*>(&addr), &size) != 0 ||
+		getnameinfo(reinterpret_cast<sockaddr*>(&addr), size, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0
+	) {
+		return "unknown";
+	}
+	return std::string(host) + ":" + port;
+}
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "util/NamespaceDecl.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Blocking TCP socket over Winsock or BSD sockets, only what tile distribution needs. Failures to
+*   set up a connection throw, failed transfers return false so that callers can drop the peer
+*/
+class Socket {
+public:
+	Socket() = default;
+	~Socket();
+
+	Socket(const Socket&) = delete;
+	Socket& operator = (const Socket&) = delete;
+	Socket(Socket&& rhs) noexcept;
+	Socket& operator = (Socket&& rhs) noexcept;
+
+	static Socket connect(const std::string& host, uint16_t port);
+	// Listens on all interfaces, port 0 picks a free one
+	static Socket listen(uint16_t port);
+
+	// Waits up to timeoutMs for a connection, an invalid socket on timeout
+	Socket accept(uint32_t timeoutMs);
+	// Whether data or a closed connection is ready to be read within timeoutMs
+	bool waitReadable(uint32_t timeoutMs);
+
+	bool sendAll(const void* data, size_t size);
+	bool recvAll(void* data, size_t size);
+
+	// Unblocks transfers on other threads, which then fail
+	void shutdown();
+	void close();
+
+	bool valid() const { return mHandle != InvalidHandle; }
+	uint16_t localPort() const;
+	std::string peerName() const;
+
+private:
+	// SOCKET is a pointer sized unsigned integer on Windows, an int elsewhere
+	using Handle = uintptr_t;
+	static constexpr Handle InvalidHandle = ~Handle(0);
+
+	explicit Socket(Handle handle) : mHandle(handle) {}
+
+private:
+	Handle mHandle = InvalidHandle;
+};
+
+NAMESPACE_END(cpu)
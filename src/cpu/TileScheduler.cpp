@@ -0,0 +1,56 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+NAMESPACE_BEGIN(cpu)
+
+TileScheduler::TileScheduler(uint32_t width, uint32_t height, uint32_t tileSize) {
+	tileSize = std::max(tileSize, 1u);
+
+	for (uint32_t y = 0; y < height; y += tileSize) {
+		for (uint32_t x = 0; x < width; x += tileSize) {
+			mTiles.push_back({ x, y, std::min(x + tileSize, width), std::min(y + tileSize, height) });
+		}
+	}
+}
+
+void TileScheduler::distribute(uint32_t numThreads) {
+	mQueues = std::make_unique<WorkerQueue[]>(numThreads);
+
+	for (uint32_t i = 0; i < numThreads; i++) {
+		uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(i) * numTiles() / numThreads);
+		uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(i + 1) * numTiles() / numThreads);
+
+		for (uint32_t j = begin; j < end; j++) {
+			mQueues[i].tiles.push_back(j);
+		}
+	}
+}
+
+std::optional<uint32_t> TileScheduler::next(uint32_t worker, uint32_t numThreads) {
+	{
+		auto& own = mQueues[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+
+		if (!own.tiles.empty()) {
+			uint32_t tileIdx = own.tiles.front();
+			own.tiles.pop_front();
+			return tileIdx;
+		}
+	}
+	// No tiles are added during a run, so one pass over all victims finding nothing means we are done
+	for (uint32_t i = 1; i < numThreads; i++) {
+		auto& victim = mQueues[(worker + i) % numThreads];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+
+		if (!victim.tiles.empty()) {
+			uint32_t tileIdx = victim.tiles.back();
+			victim.tiles.pop_back();
+			mNumSteals++;
+			return tileIdx;
+		}
+	}
+	return std::nullopt;
+}
+
+NAMESPACE_END(cpu)
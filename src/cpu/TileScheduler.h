@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "util/NamespaceDecl.h"
+
+NAMESPACE_BEGIN(cpu)
+
+/**
+* Work stealing scheduler over square image tiles. Each worker starts with a contiguous run of
+*   tiles in scanline order, takes its own tiles from the front and, once out of work, steals
+*   from the back of other workers' queues, so that workers owning cheap regions such as
+*   background pick up tiles of expensive ones without a shared queue on the fast path
+*/
+class TileScheduler {
+public:
+	struct Tile {
+		uint32_t x0, y0;
+		uint32_t x1, y1;
+	};
+
+	TileScheduler(uint32_t width, uint32_t height, uint32_t tileSize);
+
+	uint32_t numTiles() const { return static_cast<uint32_t>(mTiles.size()); }
+	const Tile& tile(uint32_t tileIdx) const { return mTiles[tileIdx]; }
+
+	// Tiles taken from another worker's queue, summed over all run() calls
+	uint64_t numSteals() const { return mNumSteals; }
+
+	// Calls renderTile(tile, tileIdx) once per tile on numThreads workers and returns when all are done
+	template<typename Func>
+	void run(uint32_t numThreads, Func&& renderTile) {
+		numThreads = std::max(std::min(numThreads, numTiles()), 1u);
+		distribute(numThreads);
+
+		auto work = [&](uint32_t worker) {
+			while (auto tileIdx = next(worker, numThreads)) {
+				renderTile(mTiles[*tileIdx], *tileIdx);
+			}
+		};
+		std::vector<std::thread> threads(numThreads);
+
+		for (uint32_t i = 0; i < numThreads; i++) {
+			threads[i] = std::thread(work, i);
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+private:
+	struct alignas(64) WorkerQueue {
+		std::mutex mutex;
+		std::deque<uint32_t> tiles;
+	};
+
+	void distribute(uint32_t numThreads);
+	std::optional<uint32_t> next(uint32_t worker, uint32_t numThreads);
+
+private:
+	std::vector<Tile> mTiles;
+	std::unique_ptr<WorkerQueue[]> mQueues;
+	std::atomic<uint64_t> mNumSteals = 0;
+};
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,205 @@
+#include "TraceBenchmark.h"
+#include "util/Timer.h"
+
+#include <random>
+#include <thread>
+
+#include <glm/gtc/constants.hpp>
+
+NAMESPACE_BEGIN(cpu)
+
+template<typename Func>
+static double parallelTrace(uint32_t numRays, uint32_t numThreads, Func&& traceRange) {
+	Timer timer;
+	std::vector<std::thread> threads(numThreads);
+
+	for (uint32_t i = 0; i < numThreads; i++) {
+		uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(i) * numRays / numThreads);
+		uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(i + 1) * numRays / numThreads);
+		threads[i] = std::thread(traceRange, begin, end);
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	return timer.get();
+}
+
+static RayStream makeStream(const std::vector<Ray>& rays) {
+	RayStream stream;
+	stream.resize(rays.size());
+
+	for (size_t i = 0; i < rays.size(); i++) {
+		stream.set(i, rays[i]);
+	}
+	return stream;
+}
+
+static bool sameHit(bool hit, float t, bool referenceHit, float referenceT) {
+	return hit == referenceHit && (!hit || glm::abs(t - referenceT) <= 1e-5f * referenceT);
+}
+
+static TraceBenchmark::RaySet traceClosest(
+	const AccelerationStructure& accel, const std::string& name, const std::vector<Ray>& rays, uint32_t numThreads,
+	std::vector<Ray>* hitRays = nullptr
+) {
+	uint32_t numRays = static_cast<uint32_t>(rays.size());
+	std::vector<Ray> results(rays);
+	std::vector<Ray> references(rays);
+	std::vector<Intersection> isecs(numRays);
+	std::vector<Intersection> referenceIsecs(numRays);
+
+	TraceBenchmark::RaySet set;
+	set.name = name;
+	set.numRays = numRays;
+
+	set.ms = parallelTrace(numRays, numThreads, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			accel.intersect(results[i], isecs[i]);
+		}
+	});
+	set.referenceMs = parallelTrace(numRays, numThreads, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			accel.intersectReference(references[i], referenceIsecs[i]);
+		}
+	});
+
+	RayStream stream = makeStream(rays);
+	std::vector<Intersection> streamIsecs;
+
+	Timer timer;
+	intersectStream(accel, stream, streamIsecs, numThreads);
+	set.streamMs = timer.get();
+
+	for (uint32_t i = 0; i < numRays; i++) {
+		bool hit = isecs[i].hit();
+		bool referenceHit = referenceIsecs[i].hit();
+		set.numHits += hit;
+		set.numMismatches += !sameHit(hit, results[i].tMax, referenceHit, references[i].tMax);
+		set.numStreamMismatches += !sameHit(streamIsecs[i].hit(), stream.tMax[i], referenceHit, references[i].tMax);
+
+		if (hit && hitRays) {
+			hitRays->push_back(results[i]);
+		}
+	}
+	return set;
+}
+
+static TraceBenchmark::RaySet traceShadow(
+	const AccelerationStructure& accel, const std::string& name, const std::vector<Ray>& rays, uint32_t numThreads
+) {
+	uint32_t numRays = static_cast<uint32_t>(rays.size());
+	std::vector<uint8_t> occluded(numRays);
+	std::vector<uint8_t> referenceOccluded(numRays);
+
+	TraceBenchmark::RaySet set;
+	set.name = name;
+	set.numRays = numRays;
+
+	set.ms = parallelTrace(numRays, numThreads, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			occluded[i] = accel.occluded(rays[i]);
+		}
+	});
+	set.referenceMs = parallelTrace(numRays, numThreads, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			Ray ray = rays[i];
+			Intersection isec;
+			referenceOccluded[i] = accel.intersectReference(ray, isec);
+		}
+	});
+
+	RayStream stream = makeStream(rays);
+	std::vector<uint8_t> streamOccluded;
+
+	Timer timer;
+	occludedStream(accel, stream, streamOccluded, numThreads);
+	set.streamMs = timer.get();
+
+	for (uint32_t i = 0; i < numRays; i++) {
+		set.numHits += occluded[i];
+		set.numMismatches += occluded[i] != referenceOccluded[i];
+		set.numStreamMismatches += streamOccluded[i] != referenceOccluded[i];
+	}
+	return set;
+}
+
+TraceBenchmark benchmarkTracing(
+	const AccelerationStructure& accel, const Scene& scene, uint32_t width, uint32_t height, uint32_t seed
+) {
+	TraceBenchmark result;
+	result.numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	Camera camera = scene.camera;
+	camera.update();
+
+	float aspect = static_cast<float>(width) / height;
+	float tanFOV = glm::tan(glm::radians(camera.FOV() * .5f));
+
+	std::vector<Ray> primaryRays(static_cast<size_t>(width) * height);
+
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			glm::vec2 ndc = glm::vec2((x + .5f) / width, (y + .5f) / height) * 2.f - 1.f;
+			glm::vec3 dir = glm::normalize(glm::vec3(ndc.x * aspect * tanFOV, ndc.y * tanFOV, 1.f));
+
+			Ray& ray = primaryRays[y * width + x];
+			ray.origin = camera.pos();
+			ray.dir = glm::normalize(camera.right() * dir.x + camera.up() * dir.y + camera.front() * dir.z);
+		}
+	}
+	std::vector<Ray> primaryHits;
+	result.sets.push_back(traceClosest(accel, "Primary", primaryRays, result.numThreads, &primaryHits));
+
+	if (primaryHits.empty()) {
+		return result;
+	}
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+	std::vector<Ray> bounceRays(primaryHits.size());
+
+	for (size_t i = 0; i < primaryHits.size(); i++) {
+		float cosTheta = uniform(rng) * 2.f - 1.f;
+		float sinTheta = glm::sqrt(glm::max(1.f - cosTheta * cosTheta, 0.f));
+		float phi = uniform(rng) * glm::two_pi<float>();
+
+		bounceRays[i].origin = primaryHits[i].origin + primaryHits[i].dir * primaryHits[i].tMax;
+		bounceRays[i].dir = glm::vec3(glm::cos(phi) * sinTheta, glm::sin(phi) * sinTheta, cosTheta);
+	}
+	result.sets.push_back(traceClosest(accel, "Bounce (uniform sphere)", bounceRays, result.numThreads));
+
+	const auto& lights = scene.triangleLights;
+
+	if (lights.empty()) {
+		return result;
+	}
+	std::uniform_int_distribution<size_t> lightIndex(0, lights.size() - 1);
+
+	auto makeShadowRays = [&](auto&& pickLight) {
+		std::vector<Ray> shadowRays(primaryHits.size());
+
+		for (size_t i = 0; i < primaryHits.size(); i++) {
+			const auto& light = lights[pickLight()];
+			float r = glm::sqrt(uniform(rng));
+			float s = uniform(rng);
+			glm::vec3 target = light.v0 * (1.f - r) + light.v1 * (r * (1.f - s)) + light.v2 * (r * s);
+
+			glm::vec3 origin = primaryHits[i].origin + primaryHits[i].dir * primaryHits[i].tMax;
+			glm::vec3 toLight = target - origin;
+			float dist = glm::length(toLight);
+
+			shadowRays[i].origin = origin;
+			shadowRays[i].dir = toLight / dist;
+			shadowRays[i].tMax = dist * (1.f - 1e-4f);
+		}
+		return shadowRays;
+	};
+	result.sets.push_back(traceShadow(accel, "Shadow (all lights)", makeShadowRays([&]() { return lightIndex(rng); }), result.numThreads));
+
+	size_t singleLight = lightIndex(rng);
+	result.sets.push_back(traceShadow(accel, "Shadow (one light)", makeShadowRays([&]() { return singleLight; }), result.numThreads));
+
+	return result;
+}
+
+NAMESPACE_END(cpu)
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "AccelerationStructure.h"
+#include "RayStream.h"
+
+NAMESPACE_BEGIN(cpu)
+
+struct TraceBenchmark {
+	struct RaySet {
+		std::string name;
+		uint32_t numRays = 0;
+		uint32_t numHits = 0;
+		double ms = 0.0;
+		double referenceMs = 0.0;
+		double streamMs = 0.0;
+		// Rays where hit or miss disagrees with the binary reference, or hit distances differ relatively by more than 1e-5
+		uint32_t numMismatches = 0;
+		uint32_t numStreamMismatches = 0;
+
+		double raysPerSecond() const { return numRays / (ms * 1e-3); }
+		double referenceRaysPerSecond() const { return numRays / (referenceMs * 1e-3); }
+		double streamRaysPerSecond() const { return numRays / (streamMs * 1e-3); }
+	};
+	uint32_t numThreads = 0;
+	std::vector<RaySet> sets;
+};
+
+/**
+* Traces four ray sets through accel on all hardware threads: coherent primary rays from the
+*   scene camera at width x height (pinhole, as pinholeCameraSampleRay), incoherent rays leaving
+*   primary hits in uniformly sampled directions, and any hit shadow rays from primary hits to
+*   random points on all triangle lights or on a single one. Each set is traced per ray through
+*   the 8-wide BVH, per ray through the scalar binary reference, and as a packet stream
+*/
+TraceBenchmark benchmarkTracing(
+	const AccelerationStructure& accel, const Scene& scene, uint32_t width, uint32_t height, uint32_t seed = 0
+);
+
+NAMESPACE_END(cpu)
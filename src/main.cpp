@@ -1,6 +1,718 @@
 #include "Renderer.h"
+#include "LightExtraction.h"
+#include "VirtualTexture.h"
+#include "cpu/AccelerationStructure.h"
+#include "cpu/DistributedRender.h"
+#include "cpu/EXR.h"
+#include "cpu/PathTracer.h"
+#include "cpu/ReSTIRDI.h"
+#include "cpu/ReSTIRPT.h"
+#include "cpu/ReSTIRValidation.h"
+#include "cpu/ReservoirValidation.h"
+#include "cpu/Shading.h"
+#include "cpu/TraceBenchmark.h"
+#include "util/AliasTable.h"
+#include "util/Timer.h"
 
-int main() {
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <format>
+#include <map>
+#include <random>
+#include <thread>
+
+static void runLightExtractionBenchmark(uint32_t numTriangles) {
+    auto result = benchmarkLightExtraction(numTriangles);
+
+    Log::line<0>("Light Extraction Benchmark");
+    Log::line<1>(std::format("Triangles = {}, SIMD width = {}", result.numTriangles, triangleLightBatchWidth()));
+    Log::line<1>(std::format("Scalar = {:.2f} ms, batched = {:.2f} ms, speedup = {:.2f}x",
+        result.scalarMs, result.batchMs, result.scalarMs / result.batchMs));
+    Log::line<1>(std::format("Mismatched triangles = {}", result.numMismatches));
+}
+
+static void runBSDFValidation(uint32_t numSamples) {
+    struct Case {
+        const char* name;
+        uint32_t type;
+        float roughness;
+        float metallic;
+        float ior;
+    };
+    const Case cases[] = {
+        { "Lambertian", Material::Lambertian, 1.f, 0.f, 1.5f },
+        { "MetalWorkflow, roughness 0.2, metallic 0.5", Material::MetalWorkflow, .2f, .5f, 1.5f },
+        { "MetalWorkflow, roughness 0.5, metallic 0", Material::MetalWorkflow, .5f, 0.f, 1.5f },
+        { "MetalWorkflow, roughness 0.5, metallic 1", Material::MetalWorkflow, .5f, 1.f, 1.5f },
+        { "MetalWorkflow, roughness 1, metallic 0.5", Material::MetalWorkflow, 1.f, .5f, 1.5f },
+        { "Metal, roughness 0.2", Material::Metal, .2f, 0.f, 2.f },
+        { "Metal, roughness 0.5", Material::Metal, .5f, 0.f, 2.f },
+        { "Metal, roughness 1", Material::Metal, 1.f, 0.f, 2.f },
+    };
+    Log::line<0>("BSDF Validation");
+    Log::line<1>(std::format("Samples per direction = {}, SIMD width = {}", numSamples, cpu::SIMDWidth));
+    uint32_t numFailed = 0;
+
+    for (const auto& c : cases) {
+        Material mat;
+        mat.type = c.type;
+        mat.roughness = c.roughness;
+        mat.metallic = c.metallic;
+        mat.ior = c.ior;
+
+        auto result = cpu::validateBSDF(mat, numSamples);
+        numFailed += !result.passed();
+
+        Log::line<1>(std::format("{}: {}", c.name, result.passed() ? "passed" : "FAILED"));
+        Log::line<2>(std::format("Albedo = {:.4f}, PDF normalization error = {:.5f}, histogram error = {:.5f}, noise = {:.5f}",
+            result.maxAlbedo, result.maxNormalizationError, result.maxHistogramError, result.noiseTolerance));
+        Log::line<2>(std::format("Sampled albedo deviation = {:.2f} sigma, batch error = {:.2e}",
+            result.maxAlbedoDeviation, result.maxBatchError));
+        Log::line<2>(std::format("Scalar = {:.2f} ms, batched = {:.2f} ms, speedup = {:.2f}x",
+            result.scalarMs, result.batchMs, result.scalarMs / result.batchMs));
+    }
+    Log::line<1>(std::format("Failed = {} / {}", numFailed, std::size(cases)));
+}
+
+static void runReservoirValidation(uint32_t numStreams) {
+    Log::line<0>("Reservoir Validation");
+    Log::line<1>(std::format("Streams per test = {}", numStreams));
+
+    auto result = cpu::validateReservoirs(numStreams);
+    uint32_t numFailed = 0;
+
+    for (const auto& test : result.tests) {
+        numFailed += !test.passed();
+
+        Log::line<1>(std::format("{}: {}", test.name, test.passed() ? "passed" : "FAILED"));
+        Log::line<2>(std::format("Chi-square = {:.2f}, dof = {}, p = {:.4f}, KS distance = {:.5f}, p = {:.4f}, impossible samples = {}",
+            test.chiSquare, test.dof, test.chiSquarePValue, test.ksDistance, test.ksPValue, test.numImpossible));
+    }
+    Log::line<1>(std::format("Failed = {} / {}, {:.2f} s", numFailed, result.tests.size(), result.ms * 1e-3));
+
+    if (!result.passed()) {
+        throw std::runtime_error("Reservoir validation failed");
+    }
+}
+
+// Exact probability of every item under DiscreteSampler1D::sample, 1 / n of passing through its own entry
+//   plus 1 / n of the rejected part of every entry aliasing to it
+static std::vector<double> aliasTableProbabilities(const DiscreteSampler1D<float>& sampler) {
+    uint32_t n = sampler.size();
+    std::vector<double> probs(n, 0.0);
+
+    for (uint32_t i = 0; i < n; i++) {
+        const auto& distrib = sampler.binomDistribs[i + 1];
+        double pass = std::clamp(static_cast<double>(distrib.prob), 0.0, 1.0);
+        probs[i] += pass / n;
+        probs[distrib.failId - 1] += (1.0 - pass) / n;
+    }
+    return probs;
+}
+
+static std::vector<float> aliasTableTestWeights(const std::string& shape, uint32_t n, std::default_random_engine& rng) {
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+    std::vector<float> weights(n);
+
+    for (uint32_t i = 0; i < n; i++) {
+        float u = uniform(rng);
+        weights[i] =
+            (shape == "constant") ? 1.f :
+            (shape == "uniform") ? u :
+            // Light power spans many orders of magnitude in large scenes
+            (shape == "power law") ? std::pow(u, 8.f) * 1e4f :
+            (shape == "sparse") ? ((u < .1f) ? uniform(rng) : 0.f) :
+            (i == n / 2) ? 1.f : 0.f;
+    }
+    return weights;
+}
+
+static void runAliasTableValidation() {
+    const char* shapes[] = { "constant", "uniform", "power law", "sparse", "single" };
+    const uint32_t sizes[] = { 1, 2, 3, 100, 4097, (1 << 15) + 7, 1 << 20 };
+    const uint32_t threadCounts[] = { 1, 2, 7, 16 };
+
+    // Entries are float, the aliased mass of an item sums the rounding of many residuals
+    const double Tolerance = 1e-5;
+
+    Log::line<0>("Alias Table Validation");
+    std::default_random_engine rng(0);
+    uint32_t numFailed = 0;
+    uint32_t numCases = 0;
+
+    for (auto shape : shapes) {
+        double maxError = 0.0;
+        uint32_t numZeroSampled = 0;
+        uint32_t numShapeFailed = 0;
+
+        for (uint32_t n : sizes) {
+            auto weights = aliasTableTestWeights(shape, n, rng);
+            double sum = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+            for (uint32_t numThreads : threadCounts) {
+                DiscreteSampler1D<float> sampler;
+                sampler.build(weights, numThreads);
+                auto probs = aliasTableProbabilities(sampler);
+
+                double error = 0.0;
+                uint32_t zeroSampled = 0;
+
+                for (uint32_t i = 0; i < n; i++) {
+                    // All zero weights fall back to uniform sampling
+                    double expected = (sum > 0.0) ? weights[i] / sum : 1.0 / n;
+
+                    if (expected == 0.0) {
+                        zeroSampled += (probs[i] != 0.0);
+                    }
+                    else {
+                        // Pass probabilities that are float denormals only keep absolute precision
+                        double scale = std::max(expected, static_cast<double>(std::numeric_limits<float>::min()) / n);
+                        error = std::max(error, std::abs(probs[i] - expected) / scale);
+                    }
+                }
+                bool failed = (sampler.size() != n || error > Tolerance || zeroSampled > 0);
+
+                if (failed) {
+                    Log::line<2>(std::format("{} entries, {} threads: relative error = {:.2e}, zero weight items sampled = {}",
+                        n, numThreads, error, zeroSampled));
+                }
+                maxError = std::max(maxError, error);
+                numZeroSampled += zeroSampled;
+                numShapeFailed += failed;
+                numCases++;
+            }
+        }
+        numFailed += numShapeFailed;
+        Log::line<1>(std::format("{}: {}, max relative error = {:.2e}, zero weight items sampled = {}",
+            shape, numShapeFailed ? "FAILED" : "passed", maxError, numZeroSampled));
+    }
+    Log::line<1>(std::format("Failed = {} / {}", numFailed, numCases));
+
+    if (numFailed > 0) {
+        throw std::runtime_error("Alias table validation failed");
+    }
+}
+
+static void runAliasTableBenchmark(const std::vector<uint32_t>& sizes) {
+    uint32_t numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    Log::line<0>("Alias Table Benchmark");
+    Log::line<1>(std::format("Threads = {}", numThreads));
+    std::default_random_engine rng(0);
+
+    for (uint32_t n : sizes) {
+        auto weights = aliasTableTestWeights("power law", n, rng);
+        DiscreteSampler1D<float> sampler;
+
+        Timer timer;
+        sampler.build(weights, 1);
+        double serialMs = timer.get();
+
+        timer.reset();
+        sampler.build(weights, numThreads);
+        double parallelMs = timer.get();
+
+        Log::line<1>(std::format("{} entries: serial = {:.2f} ms, parallel = {:.2f} ms, speedup = {:.2f}x, {:.1f} Mentries/s",
+            n, serialMs, parallelMs, serialMs / parallelMs, n / parallelMs * 1e-3));
+    }
+}
+
+static void runVirtualTextureValidation(uint32_t numFrames) {
+    Log::line<0>("Virtual Texture Validation");
+
+    auto result = validateVirtualTexture(numFrames);
+
+    Log::line<1>(std::format("Frames = {}, requests = {}, uploads = {}, evictions = {}",
+        result.numFrames, result.numRequests, result.numUploads, result.numEvictions));
+    Log::line<1>(std::format("Page table mismatches = {}, dirty range misses = {}, upload violations = {}, LRU violations = {}",
+        result.numTableMismatches, result.numDirtyMisses, result.numUploadViolations, result.numLRUViolations));
+    Log::line<1>(std::format("Max sRGB mip filtering error = {}", result.maxMipError));
+    Log::line<1>(result.passed() ? "Passed" : "FAILED");
+
+    if (!result.passed()) {
+        throw std::runtime_error("Virtual texture validation failed");
+    }
+}
+
+// Self-tests of the host light structures of a loaded scene, kept out of Scene::load
+static void runLightValidation(const std::string& sceneFile) {
+    Scene scene;
+    scene.keepSourceLights = true;
+    scene.load(sceneFile);
+
+    Log::line<0>("Light Validation");
+    Log::line<1>(std::format("Lights = {}", scene.triangleLights.size()));
+    bool passed = true;
+
+    // Bounds of half edges, octahedral snorm16 normals and the 9 bit RGB9E5 mantissa. Area is derived
+    //   from the decoded edges and loses relative precision on slivers, so it is only reported
+    auto packing = measurePackingError(scene.sourceTriangleLights);
+    bool packingPassed = packing.maxPositionError < 1e-3f && packing.maxNormalError < 1e-3f && packing.maxRadianceError < 4e-3f;
+    passed &= packingPassed;
+
+    Log::line<1>(std::format("Light packing: {}", packingPassed ? "passed" : "FAILED"));
+    Log::line<2>(std::format("Max error: position = {}, normal = {}, radiance = {}, area = {}",
+        packing.maxPositionError, packing.maxNormalError, packing.maxRadianceError, packing.maxAreaError));
+
+    // Every emitter sharing a corner must decode it to one position, else the light BLAS has cracks
+    std::map<std::array<float, 3>, glm::vec3> decodedCorners;
+    uint32_t numSplitCorners = 0;
+    float maxSnapError = 0.f;
+
+    for (size_t i = 0; i < scene.triangleLights.size(); i++) {
+        const auto& source = scene.sourceTriangleLights[i];
+        const auto& decoded = scene.triangleLights[i];
+        glm::vec3 sourceCorners[] = { source.v0, source.v1, source.v2 };
+        glm::vec3 decodedCornersOfLight[] = { decoded.v0, decoded.v1, decoded.v2 };
+        float maxEdge = std::max({
+            glm::length(source.v1 - source.v0), glm::length(source.v2 - source.v0), glm::length(source.v2 - source.v1)
+        });
+
+        for (uint32_t j = 0; j < 3; j++) {
+            const glm::vec3& v = sourceCorners[j];
+            auto [it, inserted] = decodedCorners.try_emplace({ v.x, v.y, v.z }, decodedCornersOfLight[j]);
+            numSplitCorners += (!inserted && it->second != decodedCornersOfLight[j]);
+
+            if (maxEdge > 0.f) {
+                maxSnapError = std::max(maxSnapError, glm::length(decodedCornersOfLight[j] - v) / maxEdge);
+            }
+        }
+    }
+    bool watertightPassed = numSplitCorners == 0;
+    passed &= watertightPassed;
+
+    Log::line<1>(std::format("Light corners: {}", watertightPassed ? "passed" : "FAILED"));
+    Log::line<2>(std::format("Corners = {}, split = {}, max snap error = {}", decodedCorners.size(), numSplitCorners, maxSnapError));
+
+    // PMFs are evaluated in closed form on both sides, differences are float rounding only
+    auto bvh = scene.lightBVH.validate(16, 256);
+    bool bvhPassed = bvh.maxSumError < 1e-3f && bvh.maxPmfError < 1e-3f;
+    passed &= bvhPassed;
+
+    Log::line<1>(std::format("Light BVH: {}", bvhPassed ? "passed" : "FAILED"));
+    Log::line<2>(std::format("Points = {}, samples = {}, PMF sum error = {}, sample / query error = {}",
+        bvh.numPoints, bvh.numSamples, bvh.maxSumError, bvh.maxPmfError));
+
+    if (!scene.triangleLights.empty()) {
+        // Monte Carlo against area sampling, errors of a few percent are expected noise. The sampled
+        //   normalization has a heavier tail from samples at grazing angles to the light
+        auto spherical = validateSphericalTriangleSampling(scene.triangleLights, 16, 1 << 16);
+        bool sphericalPassed = spherical.maxNormalizationError < .1f && spherical.maxSampledNormalizationError < .25f &&
+            spherical.maxIntegralError < .1f;
+        passed &= sphericalPassed;
+
+        Log::line<1>(std::format("Spherical triangle sampling: {}", sphericalPassed ? "passed" : "FAILED"));
+        Log::line<2>(std::format("Checked lights = {}, PDF normalization error = {}, sampled = {}, integral error = {}",
+            spherical.numTriangles, spherical.maxNormalizationError, spherical.maxSampledNormalizationError, spherical.maxIntegralError));
+    }
+
+    if (!scene.triangleLights.empty()) {
+        std::vector<ReGIRLight> regirLights;
+
+        for (const auto& light : scene.triangleLights) {
+            regirLights.push_back({ (light.v0 + light.v1 + light.v2) / 3.f, luminance(light.radiance * light.area) });
+        }
+        // Monte Carlo, relative errors of a few percent are expected noise at this many fills
+        auto regir = scene.regirGrid.validate(regirLights, scene.lightSampleTable, 8, 1 << 18);
+        bool regirPassed = regir.maxCountError < .1f && regir.maxPowerError < .1f;
+        passed &= regirPassed;
+
+        Log::line<1>(std::format("ReGIR: {}", regirPassed ? "passed" : "FAILED"));
+        Log::line<2>(std::format("Cells = {}, fills = {}, relative error of E[W] = {}, E[W * power] = {}",
+            regir.numCells, regir.numFills, regir.maxCountError, regir.maxPowerError));
+    }
+
+    // Last since it changes the lights of the scene
+    auto updates = validateLightUpdates(scene, 32);
+    passed &= updates.passed();
+
+    Log::line<1>(std::format("Light updates: {}", updates.passed() ? "passed" : "FAILED"));
+    Log::line<2>(std::format("Batches = {}, updated lights = {}, table mismatches = {}, dirty range misses = {}, BVH node power error = {}",
+        updates.numBatches, updates.numLights, updates.numTableMismatches, updates.numDirtyMisses, updates.maxNodePowerError));
+
+    if (!passed) {
+        throw std::runtime_error("Light validation failed");
+    }
+}
+
+static void runCPUAccelBuild(const std::string& sceneFile) {
+    Scene scene;
+    scene.load(sceneFile);
+
+    cpu::AccelerationStructure accel;
+    accel.build(scene);
+    accel.logStatistics();
+}
+
+static void runCPUTraceBenchmark(const std::string& sceneFile) {
+    Scene scene;
+    scene.load(sceneFile);
+
+    cpu::AccelerationStructure accel;
+    accel.build(scene);
+    accel.logStatistics();
+
+    glm::uvec2 filmSize = scene.camera.filmSize();
+
+    if (filmSize.x == 0 || filmSize.y == 0) {
+        filmSize = { 1280, 720 };
+    }
+    auto result = cpu::benchmarkTracing(accel, scene, filmSize.x, filmSize.y);
+
+    Log::line<0>("CPU Trace Benchmark");
+    Log::line<1>(std::format("Threads = {}, SIMD width = {}", result.numThreads, cpu::SIMDWidth));
+
+    for (const auto& set : result.sets) {
+        Log::line<1>(std::format("{}: rays = {}, hits = {}", set.name, set.numRays, set.numHits));
+        Log::line<2>(std::format("8-wide = {:.2f} Mrays/s, binary reference = {:.2f} Mrays/s, speedup = {:.2f}x",
+            set.raysPerSecond() * 1e-6, set.referenceRaysPerSecond() * 1e-6, set.referenceMs / set.ms));
+        Log::line<2>(std::format("Packet stream = {:.2f} Mrays/s, speedup over reference = {:.2f}x",
+            set.streamRaysPerSecond() * 1e-6, set.referenceMs / set.streamMs));
+        Log::line<2>(std::format("Mismatched rays: 8-wide = {}, stream = {}", set.numMismatches, set.numStreamMismatches));
+    }
+}
+
+static void runCPURender(const std::string& sceneFile, const std::string& outFile, uint32_t spp, const std::string& mode) {
+    Scene scene;
+    scene.load(sceneFile);
+
+    cpu::AccelerationStructure accel;
+    accel.build(scene);
+    accel.logStatistics();
+
+    cpu::PathTracer::Settings settings;
+    glm::uvec2 filmSize = scene.camera.filmSize();
+
+    if (filmSize.x != 0 && filmSize.y != 0) {
+        settings.width = filmSize.x;
+        settings.height = filmSize.y;
+    }
+    settings.samplesPerPixel = spp;
+    settings.mode = (mode == "direct") ? cpu::PathTracer::Mode::Direct :
+        (mode == "indirect") ? cpu::PathTracer::Mode::Indirect : cpu::PathTracer::Mode::Full;
+
+    cpu::PathTracer tracer(scene, accel, settings);
+    Log::line<0>(std::format("CPU Render {}x{}, {} spp, mode = {}", settings.width, settings.height, spp, mode));
+
+    // The image is rewritten after every pass so that long renders can be inspected while running
+    while (tracer.renderPass()) {
+        const auto& stats = tracer.statistics();
+        Log::line<1>(std::format("{} / {} spp, {:.2f} s, {:.2f} Msamples/s",
+            tracer.sampleCount(), settings.samplesPerPixel, stats.ms * 1e-3, stats.samplesPerSecond() * 1e-6));
+
+        if (!cpu::writeEXR(outFile, settings.width, settings.height, tracer.resolve().data())) {
+            throw std::runtime_error("Failed to write " + outFile);
+        }
+    }
+    const auto& stats = tracer.statistics();
+    Log::line<1>(std::format("Threads = {}, tiles = {}, passes = {}, steals = {}",
+        stats.numThreads, stats.numTiles, stats.numPasses, stats.numSteals));
+    Log::line<1>(std::format("Total = {:.2f} s, {:.2f} Msamples/s, written to {}", stats.ms * 1e-3, stats.samplesPerSecond() * 1e-6, outFile));
+}
+
+// Local workers are separate processes of this executable, more can join from other hosts with
+//   --cpu-render-worker on the printed port
+static void runDistributedRender(
+    const std::string& exePath, const std::string& sceneFile, const std::string& outFile, uint32_t spp, const std::string& mode,
+    uint32_t numLocalWorkers, uint16_t port
+) {
+    // Only the film size is needed here, workers build the acceleration structure themselves
+    Scene scene;
+    scene.load(sceneFile);
+
+    cpu::RenderCoordinator::Settings settings;
+    settings.sceneFile = sceneFile;
+    settings.port = port;
+    glm::uvec2 filmSize = scene.camera.filmSize();
+
+    if (filmSize.x != 0 && filmSize.y != 0) {
+        settings.tracer.width = filmSize.x;
+        settings.tracer.height = filmSize.y;
+    }
+    settings.tracer.samplesPerPixel = spp;
+    settings.tracer.mode = (mode == "direct") ? cpu::PathTracer::Mode::Direct :
+        (mode == "indirect") ? cpu::PathTracer::Mode::Indirect : cpu::PathTracer::Mode::Full;
+
+    cpu::RenderCoordinator coordinator(settings);
+    Log::line<0>(std::format("Distributed CPU Render {}x{}, {} spp, mode = {}, port = {}",
+        settings.tracer.width, settings.tracer.height, spp, mode, coordinator.port()));
+
+    // Hardware threads are split between local workers, each of which also gets its own process
+    uint32_t numThreads = std::max(std::thread::hardware_concurrency() / std::max(numLocalWorkers, 1u), 1u);
+    std::vector<std::thread> localWorkers;
+    std::atomic<uint32_t> numExitedWorkers = 0;
+
+    for (uint32_t i = 0; i < numLocalWorkers; i++) {
+        std::string command = std::format("\"{}\" --cpu-render-worker 127.0.0.1 {} {}", exePath, coordinator.port(), numThreads);
+
+        localWorkers.emplace_back([command, &numExitedWorkers]() {
+            if (std::system(command.c_str()) != 0) {
+                Log::line<1>("Local worker exited with an error");
+            }
+            numExitedWorkers++;
+        });
+    }
+    // Once every local worker has exited, e.g. failing to load the scene, waiting would never end.
+    //   Without local workers, remote ones are expected to connect whenever they come up
+    std::vector<float> rgb;
+    std::exception_ptr error;
+
+    try {
+        rgb = coordinator.run([&]() { return numLocalWorkers > 0 && numExitedWorkers == numLocalWorkers; });
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+    for (auto& worker : localWorkers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (!cpu::writeEXR(outFile, settings.tracer.width, settings.tracer.height, rgb.data())) {
+        throw std::runtime_error("Failed to write " + outFile);
+    }
+    const auto& stats = coordinator.statistics();
+    Log::line<1>(std::format("Workers = {}, tiles = {}, dispatches = {}, re-dispatches = {}, duplicates = {}, lost workers = {}",
+        stats.numWorkers, stats.numTiles, stats.numDispatches, stats.numRedispatches, stats.numDuplicates, stats.numLostWorkers));
+    Log::line<1>(std::format("Total = {:.2f} s, written to {}", stats.ms * 1e-3, outFile));
+}
+
+// Film of the scene's camera scaled down to maxWidth, so that host ReSTIR runs finish in minutes
+static glm::uvec2 hostReSTIRFilmSize(Scene& scene, uint32_t maxWidth) {
+    glm::uvec2 size(1280, 720);
+    glm::uvec2 filmSize = scene.camera.filmSize();
+
+    if (filmSize.x != 0 && filmSize.y != 0) {
+        size = filmSize;
+    }
+    if (size.x > maxWidth) {
+        size.y = std::max(size.y * maxWidth / size.x, 1u);
+        size.x = maxWidth;
+    }
+    return size;
+}
+
+static void logReSTIRValidation(const cpu::ReSTIRValidation& result, uint32_t numFrames, uint32_t numRuns, uint32_t referenceSamples) {
+    Log::line<1>(std::format("Reference: {} spp, mean = {:.5f} +- {:.2f}%, pixels = {}, {:.2f} s",
+        referenceSamples, result.referenceMean, result.referenceRelativeError * 100.0, result.numPixels, result.referenceMs * 1e-3));
+
+    for (const auto& frame : result.frames) {
+        Log::line<2>(std::format("Frame {}: bias = {:+.2f}% +- {:.2f}%, variance = {:.4f}, accumulated RMSE = {:.2f}%",
+            frame.frameCount, frame.relativeBias * 100.0, frame.relativeBiasError * 100.0, frame.relativeVariance,
+            frame.accumulatedRelativeRMSE * 100.0));
+    }
+    Log::line<1>(std::format("ReSTIR = {:.2f} s, {:.2f} ms per frame",
+        result.restirMs * 1e-3, result.restirMs / std::max(numFrames * std::max(numRuns, 2u), 1u)));
+}
+
+static void runReSTIRDIValidation(
+    const std::string& sceneFile, uint32_t numFrames, uint32_t numRuns, const std::string& shift, const std::string& sampleMode, const std::string& reuse
+) {
+    Scene scene;
+    scene.load(sceneFile);
+
+    cpu::AccelerationStructure accel;
+    accel.build(scene);
+
+    // The reuse radius stays 20 pixels
+    glm::uvec2 filmSize = hostReSTIRFilmSize(scene, 320);
+
+    cpu::ReSTIRDI::Settings settings;
+    settings.width = filmSize.x;
+    settings.height = filmSize.y;
+    settings.shiftMode = (shift == "replay") ? cpu::ReSTIRDI::ShiftMode::Replay : cpu::ReSTIRDI::ShiftMode::Reconnection;
+    settings.sampleMode = (sampleMode == "bsdf") ? cpu::ReSTIRDI::SampleMode::BSDF :
+        (sampleMode == "both") ? cpu::ReSTIRDI::SampleMode::Both : cpu::ReSTIRDI::SampleMode::Light;
+    settings.temporalReuse = (reuse == "temporal" || reuse == "both");
+    settings.spatialReuse = (reuse == "spatial" || reuse == "both");
+
+    const uint32_t ReferenceSamples = 256;
+
+    Log::line<0>("CPU ReSTIR DI Validation");
+    Log::line<1>(std::format("{}x{}, {} frames, {} runs, shift = {}, samples = {}, reuse = {}",
+        settings.width, settings.height, numFrames, numRuns, shift, sampleMode, reuse));
+
+    auto result = cpu::validateReSTIR<cpu::ReSTIRDI>(scene, accel, settings, numFrames, numRuns, ReferenceSamples);
+    logReSTIRValidation(result, numFrames, numRuns, ReferenceSamples);
+}
+
+static cpu::ReSTIRPT::ShiftMode toReSTIRPTShiftMode(const std::string& shift) {
+    return (shift == "reconnection") ? cpu::ReSTIRPT::ShiftMode::Reconnection :
+        (shift == "replay") ? cpu::ReSTIRPT::ShiftMode::Replay : cpu::ReSTIRPT::ShiftMode::Hybrid;
+}
+
+static void runReSTIRPTValidation(
+    const std::string& sceneFile, uint32_t numFrames, uint32_t numRuns, const std::string& shift, const std::string& reuse
+) {
+    Scene scene;
+    scene.load(sceneFile);
+
+    cpu::AccelerationStructure accel;
+    accel.build(scene);
+
+    // Paths cost a lot more than DI samples, so the film is smaller than the DI one
+    glm::uvec2 filmSize = hostReSTIRFilmSize(scene, 160);
+
+    cpu::ReSTIRPT::Settings settings;
+    settings.width = filmSize.x;
+    settings.height = filmSize.y;
+    settings.shiftMode = toReSTIRPTShiftMode(shift);
+    settings.temporalReuse = (reuse == "temporal" || reuse == "both");
+    settings.spatialReuse = (reuse == "spatial" || reuse == "both");
+
+    const uint32_t ReferenceSamples = 256;
+
+    Log::line<0>("CPU ReSTIR PT Validation");
+    Log::line<1>(std::format("{}x{}, {} frames, {} runs, shift = {}, reuse = {}",
+        settings.width, settings.height, numFrames, numRuns, shift, reuse));
+
+    auto result = cpu::validateReSTIR<cpu::ReSTIRPT>(scene, accel, settings, numFrames, numRuns, ReferenceSamples);
+    logReSTIRValidation(result, numFrames, numRuns, ReferenceSamples);
+}
+
+static void runReSTIRPTRender(const std::string& sceneFile, const std::string& outFile, uint32_t numFrames, const std::string& shift) {
+    Scene scene;
+    scene.load(sceneFile);
+
+    cpu::AccelerationStructure accel;
+    accel.build(scene);
+
+    glm::uvec2 filmSize = hostReSTIRFilmSize(scene, 640);
+
+    cpu::ReSTIRPT::Settings settings;
+    settings.width = filmSize.x;
+    settings.height = filmSize.y;
+    settings.shiftMode = toReSTIRPTShiftMode(shift);
+    settings.temporalReuse = true;
+    settings.spatialReuse = true;
+
+    cpu::ReSTIRPT restir(scene, accel, settings);
+    Log::line<0>(std::format("CPU ReSTIR PT Render {}x{}, {} frames, shift = {}", settings.width, settings.height, numFrames, shift));
+
+    // Indirect lighting only, as GRISReSTIR outputs it. Frames are averaged, which stays unbiased
+    std::vector<glm::vec3> accumulated(size_t(settings.width) * settings.height, glm::vec3(0.f));
+
+    for (uint32_t frame = 0; frame < numFrames; frame++) {
+        restir.renderFrame();
+
+        for (size_t i = 0; i < accumulated.size(); i++) {
+            accumulated[i] += restir.frame()[i];
+        }
+        Log::line<1>(std::format("{} / {} frames, {:.2f} s", frame + 1, numFrames, restir.ms() * 1e-3));
+    }
+    for (auto& color : accumulated) {
+        color /= static_cast<float>(std::max(numFrames, 1u));
+    }
+    if (!cpu::writeEXR(outFile, settings.width, settings.height, &accumulated[0].x)) {
+        throw std::runtime_error("Failed to write " + outFile);
+    }
+    Log::line<1>(std::format("Written to {}", outFile));
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-light-extraction") {
+        runLightExtractionBenchmark(argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 10'000'000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--validate-bsdf") {
+        runBSDFValidation(argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 1 << 20);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--validate-reservoirs") {
+        runReservoirValidation(argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 1 << 20);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--validate-alias-table") {
+        runAliasTableValidation();
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-alias-table") {
+        if (argc > 2) {
+            runAliasTableBenchmark({ static_cast<uint32_t>(std::stoul(argv[2])) });
+        }
+        else {
+            runAliasTableBenchmark({ 1'000'000, 10'000'000, 50'000'000 });
+        }
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--validate-virtual-texture") {
+        runVirtualTextureValidation(argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 1000);
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--validate-lights") {
+        runLightValidation(argv[2]);
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--cpu-bvh") {
+        runCPUAccelBuild(argv[2]);
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--cpu-trace-bench") {
+        runCPUTraceBenchmark(argv[2]);
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--cpu-render") {
+        runCPURender(
+            argv[2],
+            argc > 3 ? argv[3] : "render.exr",
+            argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 64,
+            argc > 5 ? argv[5] : "full"
+        );
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--cpu-render-distributed") {
+        runDistributedRender(
+            argv[0],
+            argv[2],
+            argc > 3 ? argv[3] : "render.exr",
+            argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 64,
+            argc > 5 ? argv[5] : "full",
+            argc > 6 ? static_cast<uint32_t>(std::stoul(argv[6])) : 4,
+            argc > 7 ? static_cast<uint16_t>(std::stoul(argv[7])) : 0
+        );
+        return 0;
+    }
+    if (argc > 3 && std::string(argv[1]) == "--cpu-render-worker") {
+        cpu::runRenderWorker(
+            argv[2],
+            static_cast<uint16_t>(std::stoul(argv[3])),
+            argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 0,
+            argc > 5 ? static_cast<uint32_t>(std::stoul(argv[5])) : 0
+        );
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--cpu-restir-di") {
+        runReSTIRDIValidation(
+            argv[2],
+            argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : 16,
+            argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 4,
+            argc > 5 ? argv[5] : "reconnection",
+            argc > 6 ? argv[6] : "both",
+            argc > 7 ? argv[7] : "both"
+        );
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--cpu-restir-pt") {
+        runReSTIRPTValidation(
+            argv[2],
+            argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : 8,
+            argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 4,
+            argc > 5 ? argv[5] : "hybrid",
+            argc > 6 ? argv[6] : "both"
+        );
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--cpu-restir-pt-render") {
+        runReSTIRPTRender(
+            argv[2],
+            argc > 3 ? argv[3] : "restir_pt.exr",
+            argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4])) : 16,
+            argc > 5 ? argv[5] : "hybrid"
+        );
+        return 0;
+    }
     std::string scene;
     //scene = "res/box.xml";
     //scene = "res/box2.xml";
@@ -5,6 +5,7 @@
 
 #include "layouts.glsl"
 #include "gbuffer_util.glsl"
+#include "virtual_texture.glsl"
 
 layout(location = 0) out vec4 DepthNormal;
 layout(location = 1) out uvec2 AlbedoMatId;
@@ -27,10 +28,15 @@ void main() {
 	float alpha = 1.0;
 
 	uint texIdx = mat.textureIdx;
+	vec2 duvdx = dFdx(fsIn.uv);
+	vec2 duvdy = dFdy(fsIn.uv);
 
 	if (texIdx == InvalidResourceIdx) {
 		albedo = mat.baseColor;
 	}
+	else if (isVirtualTexture(texIdx)) {
+		albedo = sampleVirtualTexture(texIdx, fsIn.uv, virtualTextureLod(texIdx, duvdx, duvdy)).rgb;
+	}
 	else {
 		vec4 albedoAlpha = texture(uTextures[texIdx], fsIn.uv);
 		albedo = albedoAlpha.rgb;
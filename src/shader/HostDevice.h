@@ -10,6 +10,11 @@
   #define ENUM_END(x) }
   #define SWAPCHAIN_FORMAT vk::Format::eB8G8R8A8Unorm
 
+  // Functions in HostDevice*.h headers are compiled by both glslc and the host compiler
+  #define HOST_DEVICE inline
+  #define OUT_PARAM(x) x&
+  #define INOUT_PARAM(x) x&
+
 const vk::ShaderStageFlags RayPipelineShaderStageFlags =
     vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eAnyHitKHR |
     vk::ShaderStageFlagBits::eMissKHR | vk::ShaderStageFlagBits::eClosestHitKHR;
@@ -22,6 +27,10 @@ const vk::ShaderStageFlags RayQueryShaderStageFlags =
   #define ENUM_END(x) ;
   #define SWAPCHAIN_FORMAT rgba8
 
+  #define HOST_DEVICE
+  #define OUT_PARAM(x) out x
+  #define INOUT_PARAM(x) inout x
+
   #define int32_t int
   #define uint32_t uint
 #endif
@@ -36,6 +45,31 @@ const uint32_t PostProcBlockSizeY = 32;
 const uint32_t RayQueryBlockSizeX = 8;
 const uint32_t RayQueryBlockSizeY = 8;
 
+const uint32_t VirtualTextureTileSize = 128;
+const uint32_t VirtualTextureTileBorder = 1;
+const uint32_t VirtualTexturePaddedTileSize = VirtualTextureTileSize + 2 * VirtualTextureTileBorder;
+const uint32_t VirtualTextureMaxMips = 16;
+const uint32_t VirtualTextureFeedbackSize = 16384;
+const uint32_t VirtualTextureInvalidPage = 0xffffffff;
+
+const uint32_t LightPresampleBlockSize = 256;
+const uint32_t LightPresampleNumTiles = 128;
+const uint32_t LightPresampleTileSize = 1024;
+
+// Lights per block of the two-level light sample table, see BlockDiscreteSampler
+const uint32_t LightTableBlockSize = 1024;
+
+const uint32_t ReGIRBlockSize = 256;
+const uint32_t ReGIRGridDim = 32;
+const uint32_t ReGIRReservoirsPerCell = 16;
+const uint32_t ReGIRCandidatesPerReservoir = 8;
+const uint32_t ReGIRInvalidCell = 0xffffffff;
+
+// Triangle lights subtending solid angles in this range are sampled by solid angle. Smaller ones
+//   are sampled by area, where the spherical construction runs out of float precision
+const float SphericalTriangleMinSolidAngle = 3e-4;
+const float SphericalTriangleMaxSolidAngle = 6.22;
+
 const uint32_t CameraDescSet = 0;
 const uint32_t ResourceDescSet = 1;
 const uint32_t RayImageDescSet = 2;
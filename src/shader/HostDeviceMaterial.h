@@ -0,0 +1,386 @@
+#ifndef HOST_DEVICE_MATERIAL_H
+#define HOST_DEVICE_MATERIAL_H
+
+// BSDFs of the materials, shared by the shaders (through material.glsl) and host code in the
+//   same way as HostDeviceMath.h. GLSL code includes it after the Material struct of layouts.glsl
+
+#include "HostDeviceMath.h"
+
+#ifdef __cplusplus
+  #include "Material.h"
+
+NAMESPACE_BEGIN(shader)
+#endif
+
+const uint Diffuse = 1 << 0;
+const uint Glossy = 1 << 1;
+const uint Specular = 1 << 2;
+const uint Reflection = 1 << 4;
+const uint Transmission = 1 << 5;
+const uint InvalidBSDFSample = 0x80000000;
+
+const uint Principled = 0;
+const uint Lambert = 1;
+const uint MetallicWorkflow = 2;
+const uint Metal = 3;
+const uint Dielectric = 4;
+const uint ThinDielectric = 5;
+const uint Fake = 6;
+const uint Light = 7;
+
+#define MATERIAL_DIELECTRIC_USE_SCHLICK_APPROX true
+
+struct BSDFSample {
+	vec3 wi;
+	float pdf;
+	vec3 bsdf;
+	uint type;
+};
+
+HOST_DEVICE float fresnelSchlick(float cosTheta, float ior) {
+    float f0 = abs(1.0f - ior) / (1.0f + ior);
+    return mix(f0, 1.0f, pow5(1.0f - cosTheta));
+}
+
+HOST_DEVICE vec3 fresnelSchlick(float cosTheta, vec3 f0) {
+    return mix(f0, vec3(1.0f), pow5(1.0f - cosTheta));
+}
+
+HOST_DEVICE float fresnel(float cosIn, float ior) {
+#if MATERIAL_DIELECTRIC_USE_SCHLICK_APPROX
+    return fresnelSchlick(cosIn, ior);
+#else
+    if (cosIn < 0) {
+        ior = 1.0f / ior;
+        cosIn = -cosIn;
+    }
+    float sinIn = sqrt(1.0f - cosIn * cosIn);
+    float sinTr = sinIn / ior;
+    if (sinTr >= 1.0f) {
+        return 1.0f;
+    }
+    float cosTr = sqrt(1.0f - sinTr * sinTr);
+    return (square((cosIn - ior * cosTr) / (cosIn + ior * cosTr)) +
+        square((ior * cosIn - cosTr) / (ior * cosIn + cosTr))) * 0.5f;
+#endif
+}
+
+HOST_DEVICE float schlickG(float cosTheta, float alpha) {
+    float a = alpha * 0.5f;
+    return cosTheta / (cosTheta * (1.0f - a) + a);
+}
+
+HOST_DEVICE float smithG(float cosWo, float cosWi, float alpha) {
+    return schlickG(abs(cosWo), alpha) * schlickG(abs(cosWi), alpha);
+}
+
+HOST_DEVICE float GTR2Distrib(float cosTheta, float alpha) {
+    if (cosTheta < 1e-6f) {
+        return 0.0f;
+    }
+    float aa = alpha * alpha;
+    float nom = aa;
+    float denom = cosTheta * cosTheta * (aa - 1.0f) + 1.0f;
+    denom = denom * denom * Pi;
+    return nom / denom;
+}
+
+// Exact Smith masking of GTR2. GTR2Sample draws visible normals with it, so the pdf has to use it
+//   rather than the Schlick fit of smithG, which is up to ~15% lower at grazing angles
+HOST_DEVICE float GTR2SmithG1(float cosTheta, float alpha) {
+    float aa = alpha * alpha;
+    return 2.0f * cosTheta / (cosTheta + sqrt(aa + (1.0f - aa) * cosTheta * cosTheta));
+}
+
+HOST_DEVICE float GTR2Pdf(vec3 n, vec3 m, vec3 wo, float alpha) {
+    return GTR2Distrib(dot(n, m), alpha) * GTR2SmithG1(dot(n, wo), alpha) *
+        absDot(m, wo) / absDot(n, wo);
+}
+
+HOST_DEVICE vec3 GTR2Sample(vec3 n, vec3 wo, float alpha, vec2 r) {
+    mat3 transMat = matLocalToWorld(n);
+    mat3 transInv = inverse(transMat);
+
+    vec3 vh = normalize((transInv * wo) * vec3(alpha, alpha, 1.0f));
+
+    float lenSq = vh.x * vh.x + vh.y * vh.y;
+    vec3 t = lenSq > 0.0f ? vec3(-vh.y, vh.x, 0.0f) / sqrt(lenSq) : vec3(1.0f, 0.0f, 0.0f);
+    vec3 b = cross(vh, t);
+
+    vec2 p = toConcentricDisk(r);
+    float s = 0.5f * (vh.z + 1.0f);
+    p.y = (1.0f - s) * sqrt(1.0f - p.x * p.x) + s * p.y;
+
+    vec3 wh = t * p.x + b * p.y + vh * sqrt(max(0.0f, 1.0f - dot(p, p)));
+    wh = vec3(wh.x * alpha, wh.y * alpha, max(0.0f, wh.z));
+    return normalize(transMat * wh);
+}
+
+HOST_DEVICE bool isGTR2Connectible(float roughness) {
+    return roughness > 0.05f;
+}
+
+HOST_DEVICE bool isGTR2Delta(float roughness) {
+    return roughness < 0.01f;
+}
+
+HOST_DEVICE bool refract(vec3 n, vec3 wi, float ior, OUT_PARAM(vec3) wt) {
+    float cosIn = dot(n, wi);
+    if (cosIn < 0) {
+        ior = 1.0f / ior;
+    }
+    float sin2In = max(0.0f, 1.0f - cosIn * cosIn);
+    float sin2Tr = sin2In / (ior * ior);
+
+    if (sin2Tr >= 1.0f) {
+        return false;
+    }
+    float cosTr = sqrt(1.0f - sin2Tr);
+    if (cosIn < 0) {
+        cosTr = -cosTr;
+    }
+    wt = normalize(-wi / ior + n * (cosIn / ior - cosTr));
+    return true;
+}
+
+HOST_DEVICE vec3 lambertBSDF(vec3 albedo, vec3 n, vec3 wi) {
+	return albedo * PiInv;
+}
+
+HOST_DEVICE float lambertPdf(vec3 n, vec3 wi) {
+	return absDot(n, wi) * PiInv;
+}
+
+HOST_DEVICE bool lambertSampleBSDF(vec3 albedo, vec3 n, vec2 r, OUT_PARAM(BSDFSample) s) {
+	s.wi = sampleCosineWeightedHemisphere(n, r);
+	s.pdf = absDot(n, s.wi) * PiInv;
+	s.bsdf = albedo * PiInv;
+	s.type = Diffuse | Reflection;
+	return true;
+}
+
+HOST_DEVICE bool dielectricSampleBSDF(Material mat, vec3 albedo, vec3 n, vec3 wo, vec3 r, OUT_PARAM(BSDFSample) s) {
+    float pdfReflect = fresnel(dot(n, wo), mat.ior);
+    s.bsdf = albedo;
+
+    if (r.z < pdfReflect) {
+        s.wi = reflect(-wo, n);
+        s.type = Specular | Reflection;
+        s.pdf = 1.0f;
+    }
+    else {
+        if (!refract(n, wo, mat.ior, s.wi)) {
+            s.type = InvalidBSDFSample;
+            return false;
+        }
+        if (dot(n, wo) < 0) {
+            mat.ior = 1.0f / mat.ior;
+        }
+        s.bsdf /= mat.ior * mat.ior;
+        s.type = Specular | Transmission;
+        s.pdf = 1.0f;
+    }
+    return true;
+}
+
+HOST_DEVICE vec3 metallicWorkflowBSDF(Material mat, vec3 albedo, vec3 n, vec3 wo, vec3 wi) {
+    float alpha = square(mat.roughness);
+    vec3 wh = normalize(wo + wi);
+
+    float cosO = dot(n, wo);
+    float cosI = dot(n, wi);
+
+    if (cosI * cosO < 1e-7f) {
+        return vec3(0.0f);
+    }
+
+    vec3 f = fresnelSchlick(dot(wh, wo), mix(vec3(0.08f), albedo, mat.metallic));
+    float g = smithG(cosO, cosI, alpha);
+    float d = GTR2Distrib(dot(n, wh), alpha);
+
+    return mix(albedo * PiInv * (1.0f - mat.metallic), vec3(g * d / (4.0f * cosI * cosO)), f);
+}
+
+HOST_DEVICE float metallicWorkflowPdf(Material mat, vec3 n, vec3 wo, vec3 wi) {
+    vec3 wh = normalize(wo + wi);
+
+    return mix(
+        satDot(n, wi) * PiInv,
+        GTR2Pdf(n, wh, wo, square(mat.roughness)) / (4.0f * absDot(wh, wo)),
+        1.0f / (2.0f - mat.metallic)
+    );
+}
+
+HOST_DEVICE bool metallicWorkflowSampleBSDF(Material mat, vec3 albedo, vec3 n, vec3 wo, vec3 r, OUT_PARAM(BSDFSample) s) {
+    float alpha = square(mat.roughness);
+    s.type = Reflection;
+
+    if (r.z > (1.0f / (2.0f - mat.metallic))) {
+        s.wi = sampleCosineWeightedHemisphere(n, vec2(r));
+        s.type |= Diffuse;
+    }
+    else {
+        vec3 wh = GTR2Sample(n, wo, alpha, vec2(r));
+        s.wi = -reflect(wo, wh);
+        s.type |= isGTR2Delta(mat.roughness) ? Specular : Glossy;
+    }
+
+    if (dot(n, s.wi) < 0.0f) {
+        s.type = InvalidBSDFSample;
+        return false;
+    }
+    else {
+        s.bsdf = metallicWorkflowBSDF(mat, albedo, n, wo, s.wi);
+        s.pdf = metallicWorkflowPdf(mat, n, wo, s.wi);
+    }
+    return true;
+}
+
+HOST_DEVICE vec3 metalBSDF(Material mat, vec3 albedo, vec3 n, vec3 wo, vec3 wi) {
+    if (isGTR2Delta(mat.roughness)) {
+        return vec3(0.0f);
+    }
+
+    float alpha = square(mat.roughness);
+    vec3 wh = normalize(wo + wi);
+
+    float cosO = dot(n, wo);
+    float cosI = dot(n, wi);
+
+    if (cosI * cosO < 1e-7f) {
+        return vec3(0.0f);
+    }
+
+    float f = fresnelSchlick(absDot(wh, wo), mat.ior);
+    float g = smithG(cosO, cosI, alpha);
+    float d = GTR2Distrib(dot(n, wh), alpha);
+
+    return albedo * f * g * d / (4.0f * cosI * cosO);
+}
+
+HOST_DEVICE float metalPdf(Material mat, vec3 n, vec3 wo, vec3 wi) {
+    if (isGTR2Delta(mat.roughness)) {
+        return 0.0f;
+    }
+    vec3 wh = normalize(wo + wi);
+    return GTR2Pdf(n, wh, wo, square(mat.roughness)) / (4.0f * absDot(wh, wo));
+}
+
+HOST_DEVICE bool metalSampleBSDF(Material mat, vec3 albedo, vec3 n, vec3 wo, vec3 r, OUT_PARAM(BSDFSample) s) {
+    float alpha = square(mat.roughness);
+
+    bool isDelta = isGTR2Delta(mat.roughness);
+
+    if (isDelta) {
+        s.wi = -reflect(wo, n);
+    }
+    else {
+        vec3 wh = GTR2Sample(n, wo, alpha, vec2(r));
+        s.wi = -reflect(wo, wh);
+    }
+
+    if (dot(n, s.wi) < 0.0f) {
+        s.type = InvalidBSDFSample;
+        return false;
+    }
+    else {
+        s.bsdf = isDelta ? fresnelSchlick(absDot(n, wo), mat.ior) * albedo : metalBSDF(mat, albedo, n, wo, s.wi);
+        s.pdf = isDelta ? 1.0f : metalPdf(mat, n, wo, s.wi);
+        s.type = Reflection | (isDelta ? Specular : Glossy);
+    }
+    return true;
+}
+
+HOST_DEVICE bool fakeSampleBSDF(Material mat, vec3 albedo, vec3 wo, OUT_PARAM(BSDFSample) s) {
+    s.wi = -wo;
+    s.bsdf = albedo;
+    s.pdf = 1.0f;
+    s.type = Specular | Transmission;
+    return true;
+}
+
+HOST_DEVICE vec3 evalBSDF(Material mat, vec3 albedo, vec3 n, vec3 wo, vec3 wi) {
+    switch (mat.type) {
+    case Lambert:
+        return lambertBSDF(albedo, n, wi);
+    case MetallicWorkflow:
+        return metallicWorkflowBSDF(mat, albedo, n, wo, wi);
+    case Metal:
+        return metalBSDF(mat, albedo, n, wo, wi);
+    case Dielectric:
+    case Fake:
+        return vec3(0.0f);
+    }
+    return vec3(0.0f);
+}
+
+HOST_DEVICE float evalPdf(Material mat, vec3 n, vec3 wo, vec3 wi) {
+    switch (mat.type) {
+    case Lambert:
+        return lambertPdf(n, wi);
+    case MetallicWorkflow:
+        return metallicWorkflowPdf(mat, n, wo, wi);
+    case Metal:
+        return metalPdf(mat, n, wo, wi);
+    case Dielectric:
+    case Fake:
+        return 0.0f;
+    }
+    return 0.0f;
+}
+
+HOST_DEVICE bool sampleBSDF(Material mat, vec3 albedo, vec3 n, vec3 wo, vec3 r, OUT_PARAM(BSDFSample) s) {
+    switch (mat.type) {
+    case Lambert:
+        return lambertSampleBSDF(albedo, n, vec2(r), s);
+    case MetallicWorkflow:
+        return metallicWorkflowSampleBSDF(mat, albedo, n, wo, r, s);
+    case Metal:
+        return metalSampleBSDF(mat, albedo, n, wo, r, s);
+    case Dielectric:
+        return dielectricSampleBSDF(mat, albedo, n, wo, r, s);
+    case Fake:
+        return fakeSampleBSDF(mat, albedo, wo, s);
+    }
+    return false;
+}
+
+HOST_DEVICE bool isBSDFDelta(Material mat) {
+    switch (mat.type) {
+    case Lambert:
+        return false;
+    case MetallicWorkflow:
+        return (isGTR2Delta(mat.roughness) && mat.metallic > 0.9f);
+    case Metal:
+        return isGTR2Delta(mat.roughness);
+    case Dielectric:
+    case Fake:
+        return true;
+    }
+    return true;
+}
+
+HOST_DEVICE bool isBSDFConnectible(Material mat) {
+    switch (mat.type) {
+    case Lambert:
+        return true;
+    case MetallicWorkflow:
+        return (isGTR2Connectible(mat.roughness) || mat.metallic < 0.9f);
+    case Metal:
+        return isGTR2Connectible(mat.roughness);
+    case Dielectric:
+    case Fake:
+        return false;
+    }
+    return false;
+}
+
+HOST_DEVICE bool isSampleTypeDelta(uint type) {
+    return (type & Specular) == Specular;
+}
+
+#ifdef __cplusplus
+NAMESPACE_END(shader)
+#endif
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef HOST_DEVICE_MATH_H
+#define HOST_DEVICE_MATH_H
+
+// Sampling math shared by the shaders (through math.glsl) and host code. Written in the common
+//   subset of GLSL and C++ with glm: float literals carry the f suffix, swizzles are spelled as
+//   constructors and every random draw is its own statement, since C++ leaves the evaluation
+//   order of arguments unspecified
+
+#include "HostDevice.h"
+
+#ifdef __cplusplus
+  #include <glm/glm.hpp>
+  #include "util/NamespaceDecl.h"
+
+NAMESPACE_BEGIN(shader)
+
+using namespace glm;
+#endif
+
+const float Pi = 3.14159265358979323846f;
+const float PiInv = 1.0f / Pi;
+const vec3 Black = vec3(0.0f);
+
+HOST_DEVICE float sqr(float x) {
+	return x * x;
+}
+
+HOST_DEVICE float powerHeuristic(float pf, int fn, float pg, int gn) {
+	float f = pf * float(fn);
+	float g = pg * float(gn);
+	return f * f / (f * f + g * g);
+}
+
+HOST_DEVICE float powerHeuristic(float f, float g) {
+	return f * f / (f * f + g * g);
+}
+
+HOST_DEVICE vec2 toConcentricDisk(vec2 v) {
+	if (v.x == 0.0f && v.y == 0.0f) {
+		return vec2(0.0f, 0.0f);
+	}
+	v = v * 2.0f - 1.0f;
+	float phi, r;
+
+	if (v.x * v.x > v.y * v.y) {
+		r = v.x;
+		phi = Pi * v.y / v.x * 0.25f;
+	}
+	else {
+		r = v.y;
+		phi = Pi * 0.5f - Pi * v.x / v.y * 0.25f;
+	}
+	return vec2(r * cos(phi), r * sin(phi));
+}
+
+HOST_DEVICE float satDot(vec3 a, vec3 b) {
+	return max(dot(a, b), 0.0f);
+}
+
+HOST_DEVICE float absDot(vec3 a, vec3 b) {
+	return abs(dot(a, b));
+}
+
+HOST_DEVICE float distSqr(vec3 x, vec3 y) {
+	return dot(x - y, x - y);
+}
+
+HOST_DEVICE vec2 sphereToPlane(vec3 uv) {
+	float theta = atan(uv.y, uv.x);
+
+	if (theta < 0.0f) {
+		theta += Pi * 2.0f;
+	}
+	float phi = atan(length(vec2(uv)), uv.z);
+	return vec2(theta * PiInv * 0.5f, phi * PiInv);
+}
+
+HOST_DEVICE vec3 planeToSphere(vec2 uv) {
+	float theta = uv.x * Pi * 2.0f;
+	float phi = uv.y * Pi;
+	return vec3(cos(theta) * sin(phi), sin(theta) * sin(phi), cos(phi));
+}
+
+HOST_DEVICE vec3 getTangent(vec3 n) {
+	return (abs(n.z) > 0.999f) ? vec3(0.0f, 1.0f, 0.0f) : vec3(0.0f, 0.0f, 1.0f);
+}
+
+HOST_DEVICE mat3 matLocalToWorld(vec3 n) {
+	vec3 t = getTangent(n);
+	vec3 b = normalize(cross(n, t));
+	t = cross(b, n);
+	return mat3(t, b, n);
+}
+
+HOST_DEVICE vec3 localToWorld(vec3 n, vec3 v)
+{
+	return normalize(matLocalToWorld(n) * v);
+}
+
+HOST_DEVICE vec3 sampleCosineWeightedHemisphere(vec3 n, vec2 u) {
+	vec2 uv = toConcentricDisk(u);
+	float z = sqrt(1.0f - dot(uv, uv));
+	return localToWorld(n, vec3(uv, z));
+}
+
+HOST_DEVICE bool sameHemisphere(vec3 n, vec3 a, vec3 b) {
+	return dot(n, a) * dot(n, b) > 0;
+}
+
+HOST_DEVICE int maxExtent(vec3 v) {
+	if (v.x > v.y) {
+		return v.x > v.z ? 0 : 2;
+	}
+	else {
+		return v.y > v.z ? 1 : 2;
+	}
+}
+
+HOST_DEVICE float maxComponent(vec3 v) {
+	return max(v.x, max(v.y, v.z));
+}
+
+HOST_DEVICE vec2 uvToBary(vec2 uv) {
+	float r = sqrt(uv.y);
+	return vec2(1.0f - r, uv.x * r);
+}
+
+HOST_DEVICE vec3 sampleTriangleUniform(vec3 va, vec3 vb, vec3 vc, vec2 uv) {
+	float r = sqrt(uv.y);
+	float u = 1.0f - r;
+	float v = uv.x * r;
+	return va * (1.0f - u - v) + vb * u + vc * v;
+}
+
+HOST_DEVICE float triangleArea(vec3 va, vec3 vb, vec3 vc) {
+	return 0.5f * length(cross(vc - va, vb - va));
+}
+
+HOST_DEVICE vec3 rotateZ(vec3 v, float angle) {
+	float cost = cos(angle);
+	float sint = sin(angle);
+	return vec3(vec2(v.x * cost - v.y * sint, v.x * sint + v.y * cost), v.z);
+}
+
+HOST_DEVICE float pow5(float x) {
+	float x2 = x * x;
+	return x2 * x2 * x;
+}
+
+HOST_DEVICE float luminance(vec3 color) {
+	return dot(color, vec3(0.299f, 0.587f, 0.114f));
+}
+
+HOST_DEVICE bool isBlack(vec3 color) {
+	return luminance(color) < 1e-5f;
+}
+
+HOST_DEVICE bool hasNan(vec3 color) {
+	return any(isnan(color));
+}
+
+HOST_DEVICE bool hasInf(vec3 color) {
+	return any(isinf(color));
+}
+
+HOST_DEVICE vec3 clampColor(vec3 color) {
+	if (hasNan(color)) {
+		return vec3(0.0f);
+	}
+	return clamp(color, vec3(0.0f), vec3(1e4f));
+}
+
+HOST_DEVICE uint hash(uint a) {
+	a = (a + 0x7ed55d16u) + (a << 12u);
+	a = (a ^ 0xc761c23cu) ^ (a >> 19u);
+	a = (a + 0x165667b1u) + (a << 5u);
+	a = (a + 0xd3a2646cu) ^ (a << 9u);
+	a = (a + 0xfd7046c5u) + (a << 3u);
+	a = (a ^ 0xb55a4f09u) ^ (a >> 16u);
+	return a;
+}
+
+HOST_DEVICE uint hash2(uint seed) {
+	seed = (seed ^ 61u) ^ (seed >> 16u);
+	seed *= 9u;
+	seed = seed ^ (seed >> 4u);
+	seed *= 0x27d4eb2du;
+	seed = seed ^ (seed >> 15u);
+	return seed;
+}
+
+HOST_DEVICE uint makeSeed(uint seed0, uint seed1, uint index) {
+	return hash2((1u << 31u) | (seed1 << 22u) | seed0) ^ hash2(index);
+}
+
+HOST_DEVICE uint makeSeed(uint rand, uint index) {
+	return hash2(rand) + hash2(index);
+}
+
+HOST_DEVICE uint makeSeed(uint seed, uvec2 index) {
+	return makeSeed((seed + index.x) ^ (index.y - 1u), index.y * (index.x - 2u));
+}
+
+HOST_DEVICE uint urand(INOUT_PARAM(uint) rng) {
+	return rng = hash2(rng);
+}
+
+HOST_DEVICE float sample1f(INOUT_PARAM(uint) rng) {
+	return float(urand(rng)) / 4294967295.0f;
+}
+
+HOST_DEVICE vec2 sample2f(INOUT_PARAM(uint) rng) {
+	float x = sample1f(rng);
+	float y = sample1f(rng);
+	return vec2(x, y);
+}
+
+HOST_DEVICE vec3 sample3f(INOUT_PARAM(uint) rng) {
+	vec2 xy = sample2f(rng);
+	float z = sample1f(rng);
+	return vec3(xy, z);
+}
+
+HOST_DEVICE vec4 sample4f(INOUT_PARAM(uint) rng) {
+	vec2 xy = sample2f(rng);
+	vec2 zw = sample2f(rng);
+	return vec4(xy, zw);
+}
+
+HOST_DEVICE float MISWeight(float f, float g) {
+	return (f * f) / (f * f + g * g);
+}
+
+HOST_DEVICE uint ceilDiv(uint x, uint y) {
+	return (x + y - 1u) / y;
+}
+
+HOST_DEVICE int ceilDiv(int x, int y) {
+	return (x + y - 1) / y;
+}
+
+HOST_DEVICE float square(float x) {
+	return x * x;
+}
+
+HOST_DEVICE float distSquare(vec3 a, vec3 b) {
+	return dot(a - b, a - b);
+}
+
+#ifdef __cplusplus
+NAMESPACE_END(shader)
+#endif
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef HOST_DEVICE_RESERVOIR_H
+#define HOST_DEVICE_RESERVOIR_H
+
+// Reservoir bookkeeping of ReSTIR, shared by the shaders (through di_reservoir.glsl and
+//   gris_reservoir.glsl) and host code in the same way as HostDeviceMath.h. GLSL code includes it
+//   after the reservoir structs of layouts.glsl, host code gets mirrors of them laid out as the
+//   std430 buffers
+
+#include "HostDeviceMath.h"
+
+#ifdef __cplusplus
+  #include "cpu/Ray.h"
+
+NAMESPACE_BEGIN(shader)
+
+using cpu::Intersection;
+using cpu::InvalidHitIndex;
+
+// bool members are 4 bytes in std430
+struct DIPathSample {
+	Intersection isec;
+
+	vec3 Li = vec3(0.0f);
+	float pad0 = 0.0f;
+
+	float jacobian = 0.0f;
+	float samplePdf = 0.0f;
+	uint rng = 0;
+	uint isLightSample = 0;
+};
+
+struct DIReservoir {
+	DIPathSample pathSample;
+
+	uint sampleCount = 0;
+	float resampleWeight = 0.0f;
+	float contribWeight = 0.0f;
+	float weight = 0.0f;
+};
+
+// DIReservoirData in Renderer.cpp
+static_assert(sizeof(DIReservoir) == 64);
+
+struct GRISPathSample {
+	Intersection rcIsec;
+
+	vec3 rcLi = vec3(0.0f);
+	uint rcRng = 0;
+
+	vec3 rcWi = vec3(0.0f);
+	uint flags = 0;
+
+	vec2 pad = vec2(0.0f);
+	float rcPrevSamplePdf = 0.0f;
+	float rcJacobian = 0.0f;
+
+	vec3 F = vec3(0.0f);
+	uint primaryRng = 0;
+};
+
+struct GRISReservoir {
+	GRISPathSample pathSample;
+
+	float sampleCount = 0.0f;
+	float resampleWeight = 0.0f;
+	float contribWeight = 0.0f;
+	float pad0 = 0.0f;
+};
+
+struct GRISReconnectionData {
+	Intersection rcPrevIsec;
+	vec3 rcPrevWo = vec3(0.0f);
+	float pad0 = 0.0f;
+	vec3 rcPrevThroughput = vec3(0.0f);
+	float pad1 = 0.0f;
+};
+
+// GRISReservoirData and GRISReconnectionData in Renderer.cpp
+static_assert(sizeof(GRISReservoir) == 96);
+static_assert(sizeof(GRISReconnectionData) == 48);
+#endif
+
+HOST_DEVICE void DIPathSampleInit(INOUT_PARAM(DIPathSample) pathSample) {
+	pathSample.isec.instanceIdx = InvalidHitIndex;
+}
+
+HOST_DEVICE bool DIPathSampleIsValid(DIPathSample pathSample) {
+	return pathSample.isec.instanceIdx != InvalidHitIndex;
+}
+
+HOST_DEVICE void DIReservoirReset(INOUT_PARAM(DIReservoir) resv) {
+	resv.sampleCount = 0;
+	resv.resampleWeight = 0.0f;
+	resv.contribWeight = 0.0f;
+}
+
+HOST_DEVICE bool DIReservoirIsValid(DIReservoir resv) {
+	return !isnan(resv.resampleWeight);
+}
+
+HOST_DEVICE void DIReservoirResetIfInvalid(INOUT_PARAM(DIReservoir) resv) {
+	if (!DIReservoirIsValid(resv)) {
+		DIReservoirReset(resv);
+	}
+}
+
+HOST_DEVICE void DIReservoirAddSample(INOUT_PARAM(DIReservoir) resv, DIPathSample pathSample, float resampleWeight, float r) {
+	resv.resampleWeight += resampleWeight;
+	resv.sampleCount++;
+
+	if (r * resv.resampleWeight < resampleWeight) {
+		resv.pathSample = pathSample;
+		resv.weight = resampleWeight;
+	}
+}
+
+HOST_DEVICE void DIReservoirMerge(INOUT_PARAM(DIReservoir) resv, DIReservoir rhs, float r) {
+	resv.resampleWeight += rhs.resampleWeight;
+	resv.sampleCount += rhs.sampleCount;
+
+	if (r * resv.resampleWeight < rhs.resampleWeight) {
+		resv.pathSample = rhs.pathSample;
+		resv.weight = rhs.weight;
+	}
+}
+
+HOST_DEVICE void DIReservoirCapSample(INOUT_PARAM(DIReservoir) resv, uint cap) {
+	if (resv.sampleCount > cap) {
+		resv.resampleWeight *= float(cap) / float(resv.sampleCount);
+		resv.sampleCount = cap;
+	}
+}
+
+const uint GRISMaxPathLength = 15;
+const float GRISDistanceThreshold = 0.01f;
+
+const uint RcVertexTypeLightSampled = 0;
+const uint RcVertexTypeLightScattered = 1;
+const uint RcVertexTypeSurface = 2;
+
+// Scatter events around the reconnection vertex that took a delta lobe, which evalBSDF leaves out
+//   so that reconnecting through them loses the path
+const uint GRISDeltaScatterIntoRc = 1;
+const uint GRISDeltaScatterOutOfRc = 2;
+
+HOST_DEVICE float GRISToScalar(vec3 color) {
+	return luminance(color);
+}
+
+HOST_DEVICE uint GRISPathFlagsRcVertexId(uint flags) {
+	return flags & 0xffu;
+}
+
+HOST_DEVICE void GRISPathFlagsSetRcVertexId(INOUT_PARAM(uint) flags, uint id) {
+	flags = (flags & 0xffffff00u) | (id & 0xffu);
+}
+
+HOST_DEVICE uint GRISPathFlagsPathLength(uint flags) {
+	return (flags >> 8u) & 0xffu;
+}
+
+HOST_DEVICE void GRISPathFlagsSetPathLength(INOUT_PARAM(uint) flags, uint id) {
+	flags = (flags & 0xffff00ffu) | ((id & 0xffu) << 8u);
+}
+
+HOST_DEVICE uint GRISPathFlagsRcVertexType(uint flags) {
+	return (flags >> 16u) & 0xffu;
+}
+
+HOST_DEVICE void GRISPathFlagsSetRcVertexType(INOUT_PARAM(uint) flags, uint type) {
+	flags = (flags & 0xff00ffffu) | ((type & 0xffu) << 16u);
+}
+
+HOST_DEVICE uint GRISPathFlagsDeltaScatter(uint flags) {
+	return (flags >> 24u) & 0xffu;
+}
+
+HOST_DEVICE void GRISPathFlagsSetDeltaScatter(INOUT_PARAM(uint) flags, uint mask) {
+	flags = (flags & 0x00ffffffu) | ((mask & 0xffu) << 24u);
+}
+
+HOST_DEVICE void GRISPathSampleReset(INOUT_PARAM(GRISPathSample) pathSample) {
+	pathSample.rcIsec.instanceIdx = InvalidHitIndex;
+	pathSample.rcLi = vec3(0.0f);
+	pathSample.rcWi = vec3(0.0f);
+	pathSample.rcPrevSamplePdf = 0.0f;
+	pathSample.rcJacobian = 0.0f;
+	pathSample.flags = 0;
+	pathSample.F = vec3(0.0f);
+}
+
+HOST_DEVICE bool GRISPathSampleIsValid(GRISPathSample pathSample) {
+	return pathSample.rcIsec.instanceIdx != InvalidHitIndex;
+}
+
+HOST_DEVICE void GRISReservoirReset(INOUT_PARAM(GRISReservoir) resv) {
+	resv.pathSample.rcIsec.instanceIdx = InvalidHitIndex;
+	resv.sampleCount = 0.0f;
+	resv.resampleWeight = 0.0f;
+}
+
+HOST_DEVICE bool isResampleWeightInvalid(float weight) {
+	return isnan(weight) || weight == 0.0f;
+}
+
+HOST_DEVICE bool GRISReconnectionDataIsValid(GRISReconnectionData data) {
+	return data.rcPrevIsec.instanceIdx != InvalidHitIndex;
+}
+
+HOST_DEVICE void GRISReconnectionDataReset(INOUT_PARAM(GRISReconnectionData) data) {
+	data.rcPrevIsec.instanceIdx = InvalidHitIndex;
+}
+
+HOST_DEVICE bool GRISReservoirIsValid(GRISReservoir resv) {
+	return !isnan(resv.resampleWeight) && resv.resampleWeight >= 0.0f;
+}
+
+HOST_DEVICE void GRISReservoirResetIfInvalid(INOUT_PARAM(GRISReservoir) resv) {
+	if (!GRISReservoirIsValid(resv)) {
+		GRISReservoirReset(resv);
+	}
+}
+
+HOST_DEVICE bool GRISReservoirAddSample(INOUT_PARAM(GRISReservoir) resv, GRISPathSample pathSample, float weight, float r) {
+	resv.sampleCount += 1.0f;
+	resv.resampleWeight += weight;
+
+	if (r * resv.resampleWeight < weight) {
+		resv.pathSample = pathSample;
+		return true;
+	}
+	return false;
+}
+
+HOST_DEVICE bool GRISReservoirMerge(INOUT_PARAM(GRISReservoir) resv, GRISReservoir rhs, float r) {
+	resv.sampleCount += rhs.sampleCount;
+	resv.resampleWeight += rhs.resampleWeight;
+
+	if (r * resv.resampleWeight < rhs.resampleWeight) {
+		resv.pathSample = rhs.pathSample;
+		return true;
+	}
+	return false;
+}
+
+HOST_DEVICE void GRISReservoirInitSample(INOUT_PARAM(GRISReservoir) resv, GRISPathSample pathSample, float weight) {
+	resv.sampleCount = 1.0f;
+	resv.resampleWeight = weight;
+	resv.pathSample = pathSample;
+}
+
+HOST_DEVICE void GRISReservoirCapSample(INOUT_PARAM(GRISReservoir) resv, float cap) {
+	if (resv.sampleCount > cap) {
+		resv.resampleWeight *= cap / resv.sampleCount;
+		resv.sampleCount = cap;
+	}
+}
+
+#ifdef __cplusplus
+NAMESPACE_END(shader)
+#endif
+
+#endif
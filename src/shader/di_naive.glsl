@@ -84,12 +84,12 @@ vec3 directIllumination2(uvec2 index, uvec2 frameSize) {
     vec3 albedo;
     int matMeshId;
 
+    Ray ray = pinholeCameraSampleRay(uCamera, vec2(uv.x, 1.0 - uv.y), vec2(0));
+
     if (!unpackGBuffer(texture(uDepthNormal, uv), texelFetch(uAlbedoMatId, ivec2(index), 0), depth, norm, albedo, matMeshId)) {
-        return vec3(0.0);
+        return hasEnvironmentMap() ? clampColor(environmentRadiance(ray.dir)) : vec3(0.0);
     }
     int matId = matMeshId >> 16;
-
-    Ray ray = pinholeCameraSampleRay(uCamera, vec2(uv.x, 1.0 - uv.y), vec2(0));
     uint rng = makeSeed(uCamera.seed, index);
 
     vec3 radiance = vec3(0.0);
@@ -131,7 +131,17 @@ vec3 directIllumination2(uvec2 index, uvec2 frameSize) {
             pos, MinRayDistance, s.wi, MaxRayDistance
         );
 
-        if (intersectionIsValid(isec)) {
+        if (!intersectionIsValid(isec)) {
+            if (hasEnvironmentMap()) {
+                float weight = isSampleTypeDelta(s.type) ? 1.0 : MISWeight(s.pdf, environmentLightPdf(s.wi));
+                float cosTerm = isSampleTypeDelta(s.type) ? 1.0 : satDot(norm, s.wi);
+                vec3 contrib = environmentRadiance(s.wi) * s.bsdf * cosTerm / s.pdf * weight;
+
+                addStream(resv, contrib, 1, sample1f(rng));
+                radiance += contrib;
+            }
+        }
+        else {
             SurfaceInfo surf;
             loadSurfaceInfo(isec, surf);
             float cosTheta = -dot(s.wi, surf.norm);
@@ -142,8 +152,7 @@ vec3 directIllumination2(uvec2 index, uvec2 frameSize) {
 #endif
                 ) {
                 float dist = length(surf.pos - pos);
-                float sumPower = uLightSampleTable[0].prob;
-                float lightPdf = luminance(surf.albedo) / sumPower * dist * dist / abs(cosTheta);
+                float lightPdf = triangleLightPdf(pos, isec.triangleIdx, dist, cosTheta);
                 float weight = isSampleTypeDelta(s.type) ? 1.0 : MISWeight(s.pdf, lightPdf);
                 float cosTerm = isSampleTypeDelta(s.type) ? 1.0 : satDot(norm, s.wi);
 
@@ -8,6 +8,7 @@
 
 vec3 generatePath(uvec2 index, uvec2 frameSize) {
     vec2 uv = (vec2(index) + 0.5) / vec2(frameSize);
+    selectLightTile(index);
 
     float depth;
     vec3 norm;
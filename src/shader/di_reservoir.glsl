@@ -4,6 +4,7 @@
 #include "material.glsl"
 #include "math.glsl"
 #include "ray_layouts.glsl"
+#include "HostDeviceReservoir.h"
 
 const uint SampleModeLight = 0;
 const uint SampleModeBSDF = 1;
@@ -24,57 +25,6 @@ layout(push_constant) uniform _Settings{
 	Settings uSettings;
 };
 
-void DIPathSampleInit(inout DIPathSample pathSample) {
-	pathSample.isec.instanceIdx = InvalidHitIndex;
-}
-
-bool DIPathSampleIsValid(DIPathSample pathSample) {
-	return pathSample.isec.instanceIdx != InvalidHitIndex;
-}
-
-void DIReservoirReset(inout DIReservoir resv) {
-	resv.sampleCount = 0;
-	resv.resampleWeight = 0.0;
-	resv.contribWeight = 0.0;
-}
-
-bool DIReservoirIsValid(DIReservoir resv) {
-	return !isnan(resv.resampleWeight);
-}
-
-void DIReservoirResetIfInvalid(inout DIReservoir resv) {
-	if (!DIReservoirIsValid(resv)) {
-		DIReservoirReset(resv);
-	}
-}
-
-void DIReservoirAddSample(inout DIReservoir resv, DIPathSample pathSample, float resampleWeight, float r) {
-	resv.resampleWeight += resampleWeight;
-	resv.sampleCount++;
-
-	if (r * resv.resampleWeight < resampleWeight) {
-		resv.pathSample = pathSample;
-		resv.weight = resampleWeight;
-	}
-}
-
-void DIReservoirMerge(inout DIReservoir resv, DIReservoir rhs, float r) {
-    resv.resampleWeight += rhs.resampleWeight;
-    resv.sampleCount += rhs.sampleCount;
-
-    if (r * resv.resampleWeight < rhs.resampleWeight) {
-        resv.pathSample = rhs.pathSample;
-        resv.weight = rhs.weight;
-    }
-}
-
-void DIReservoirCapSample(inout DIReservoir resv, uint cap) {
-	if (resv.sampleCount > cap) {
-		resv.resampleWeight *= float(cap) / float(resv.sampleCount);
-		resv.sampleCount = cap;
-	}
-}
-
 vec3 sampleLi(SurfaceInfo surf, Material mat, vec3 wo, uint rng, inout uint resvRng, inout DIReservoir resv) {
     vec3 radiance = vec3(0.0);
     DIPathSample pathSample;
@@ -132,6 +82,10 @@ vec3 sampleLi(SurfaceInfo surf, Material mat, vec3 wo, uint rng, inout uint resv
             surf.pos, MinRayDistance, s.wi, MaxRayDistance
         );
 
+        if (!intersectionIsValid(isec) && hasEnvironmentMap()) {
+            isec = environmentIntersection(s.wi);
+        }
+
         if (intersectionIsValid(isec)) {
             SurfaceInfo hit;
             loadSurfaceInfo(isec, hit);
@@ -143,8 +97,7 @@ vec3 sampleLi(SurfaceInfo surf, Material mat, vec3 wo, uint rng, inout uint resv
 #endif
                 ) {
                 float dist = length(hit.pos - surf.pos);
-                float sumPower = uLightSampleTable[0].prob;
-                float lightPdf = luminance(hit.albedo) / sumPower * dist * dist / abs(cosTheta);
+                float lightPdf = sampledLightPdf(surf.pos, isec.triangleIdx, s.wi, dist, cosTheta);
                 float weight = MISWeight(s.pdf, lightPdf);
 
                 if (uSettings.sampleMode == SampleModeBSDF || isSampleTypeDelta(s.type)) {
@@ -252,8 +205,7 @@ void reconnection(inout DIReservoir dstResv, SurfaceInfo dstSurf, DIReservoir sr
                 }
 
                 if (srcSample.isLightSample) {
-                    float sumPower = uLightSampleTable[0].prob;
-                    dstSamplePdf = luminance(rcSurf.albedo) / sumPower / dstJacobian;
+                    dstSamplePdf = sampledLightPdf(dstSurf.pos, srcSample.isec.triangleIdx, wi, dist, cosTheta);
                 }
                 else {
                     dstSamplePdf = evalPdf(dstMat, dstSurf.norm, wo, wi);
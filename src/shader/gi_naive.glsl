@@ -4,6 +4,7 @@
 #include "camera.glsl"
 #include "ray_gbuffer_util.glsl"
 #include "light_sampling.glsl"
+#include "regir.glsl"
 #include "material.glsl"
 
 struct Resv {
@@ -28,6 +29,7 @@ Resv initResv() {
 vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
     const int MaxTracingDepth = 15;
     vec2 uv = (vec2(index) + 0.5) / vec2(frameSize);
+    selectLightTile(index);
 
     float depth;
     vec3 norm;
@@ -69,6 +71,10 @@ vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
             );
 
             if (!intersectionIsValid(isec)) {
+                if (bounce > 1 && hasEnvironmentMap()) {
+                    float weight = isSampleTypeDelta(s.type) ? 1.0 : MISWeight(s.pdf, environmentLightPdf(ray.dir));
+                    radiance += environmentRadiance(ray.dir) * weight * throughput;
+                }
                 break;
             }
             loadSurfaceInfo(isec, surf);
@@ -87,8 +93,7 @@ vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
 
                 if (!isSampleTypeDelta(s.type)) {
                     float dist = length(surf.pos - lastPos);
-                    float sumPower = uLightSampleTable[0].prob;
-                    float lightPdf = luminance(surf.albedo) / sumPower * dist * dist / abs(cosTheta);
+                    float lightPdf = triangleLightPdf(lastPos, isec.triangleIdx, dist, cosTheta);
                     weight = MISWeight(s.pdf, lightPdf);
                 }
                 vec3 contrib = surf.albedo * weight * throughput;
@@ -102,9 +107,9 @@ vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
             const uint shadowRayFlags = gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT | gl_RayFlagsSkipClosestHitShaderEXT;
 
             vec3 lightRadiance, lightDir;
-            float lightDist, lightPdf;
+            float lightDist, lightPdf, lightMISPdf;
 
-            lightRadiance = sampleLight(surf.pos, lightDir, lightDist, lightPdf, sample4f(rng));
+            lightRadiance = sampleLightReGIR(surf.pos, lightDir, lightDist, lightPdf, lightMISPdf, sample4f(rng));
 
             bool shadowed = traceShadow(
                 uTLAS,
@@ -114,7 +119,7 @@ vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
 
             if (!shadowed && lightPdf > 1e-6) {
                 float bsdfPdf = absDot(surf.norm, lightDir) * PiInv;
-                float weight = MISWeight(lightPdf, bsdfPdf);
+                float weight = MISWeight(lightMISPdf, bsdfPdf);
                 weight = 1.0;
 
                 vec3 contrib = lightRadiance * evalBSDF(mat, surf.albedo, surf.norm, wo, lightDir) * satDot(surf.norm, lightDir) / lightPdf * weight * throughput;
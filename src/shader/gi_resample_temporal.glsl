@@ -4,6 +4,7 @@
 #include "camera.glsl"
 #include "ray_gbuffer_util.glsl"
 #include "light_sampling.glsl"
+#include "regir.glsl"
 #include "gi_reservoir.glsl"
 
 bool findPreviousReservoir(vec2 uv, vec3 pos, float depth, vec3 normal, vec3 albedo, int matMeshId, out GIReservoir resv) {
@@ -34,6 +35,7 @@ bool findPreviousReservoir(vec2 uv, vec3 pos, float depth, vec3 normal, vec3 alb
 vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
     const int MaxTracingDepth = 15;
     vec2 uv = (vec2(index) + 0.5) / vec2(frameSize.xy);
+    selectLightTile(index);
 
     float depth;
     vec3 norm;
@@ -84,6 +86,10 @@ vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
             );
 
             if (!intersectionIsValid(isec)) {
+                if (bounce > 1 && hasEnvironmentMap()) {
+                    float weight = isSampleTypeDelta(s.type) ? 1.0 : MISWeight(s.pdf, environmentLightPdf(ray.dir));
+                    pathSample.rcLo += environmentRadiance(ray.dir) * weight * throughputAfter;
+                }
                 break;
             }
             loadSurfaceInfo(isec, surf);
@@ -106,8 +112,7 @@ vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
 
                 if (bounce > 0 && !isSampleTypeDelta(s.type)) {
                     float dist = length(surf.pos - lastPos);
-                    float sumPower = uLightSampleTable[0].prob;
-                    float lightPdf = luminance(surf.albedo) / sumPower * dist * dist / abs(cosTheta);
+                    float lightPdf = triangleLightPdf(lastPos, isec.triangleIdx, dist, cosTheta);
                     weight = MISWeight(s.pdf, lightPdf);
                 }
                 vec3 weightedLi = surf.albedo * weight;
@@ -121,9 +126,9 @@ vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
             const uint shadowRayFlags = gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT | gl_RayFlagsSkipClosestHitShaderEXT;
 
             vec3 lightRadiance, lightDir;
-            float lightDist, lightPdf;
+            float lightDist, lightPdf, lightMISPdf;
 
-            lightRadiance = sampleLight(surf.pos, lightDir, lightDist, lightPdf, sample4f(rng));
+            lightRadiance = sampleLightReGIR(surf.pos, lightDir, lightDist, lightPdf, lightMISPdf, sample4f(rng));
 
             bool shadowed = traceShadow(
                 uTLAS,
@@ -133,7 +138,7 @@ vec3 indirectIllumination(uvec2 index, uvec2 frameSize) {
 
             if (!shadowed && lightPdf > 1e-6) {
                 float bsdfPdf = absDot(surf.norm, lightDir) * PiInv;
-                float weight = MISWeight(lightPdf, bsdfPdf);
+                float weight = MISWeight(lightMISPdf, bsdfPdf);
                 pathSample.rcLo += lightRadiance * evalBSDF(mat, surf.albedo, surf.norm, wo, lightDir) * satDot(surf.norm, lightDir) / lightPdf * weight * throughputAfter;
             }
         }
@@ -45,6 +45,7 @@ uint nextRcVertexSampleState(uint state, bool connectible) {
 vec3 tracePath(uvec2 index, uvec2 frameSize) {
     const int MaxTracingDepth = 15;
     vec2 uv = (vec2(index) + 0.5) / vec2(frameSize);
+    selectLightTile(index);
 
     float depth;
     vec3 norm;
@@ -97,7 +98,10 @@ vec3 tracePath(uvec2 index, uvec2 frameSize) {
             );
 
             if (!intersectionIsValid(isec)) {
-                break;
+                if (!hasEnvironmentMap()) {
+                    break;
+                }
+                isec = environmentIntersection(ray.dir);
             }
             loadSurfaceInfo(isec, surf);
             mat = uMaterials[surf.matIndex];
@@ -126,8 +130,7 @@ vec3 tracePath(uvec2 index, uvec2 frameSize) {
 #endif
                 ) {
                 float weight = 1.0;
-                float sumPower = uLightSampleTable[0].prob;
-                float lightPdf = luminance(surf.albedo) / sumPower / geometryJacobian;
+                float lightPdf = sampledLightPdf(lastPos, isec.triangleIdx, ray.dir, distToPrev, cosPrevWi);
 
                 if (!isSampleTypeDelta(s.type)) {
                     weight = MISWeight(s.pdf, lightPdf);
@@ -181,6 +184,8 @@ vec3 tracePath(uvec2 index, uvec2 frameSize) {
             float lightDist, lightPdf, lightJacobian;
             uint lightId;
 
+            // Not ReGIR, the pdf of a light sampled reconnection vertex is recomputed with sampledLightPdf
+            //   when shifting, so it has to be the deterministic power sampling pdf
             lightRadiance = sampleLight(surf.pos, lightDir, lightDist, lightPdf, lightJacobian, lightBary, lightId, lightRandSample);
 
             bool shadowed = traceShadow(
@@ -190,7 +195,7 @@ vec3 tracePath(uvec2 index, uvec2 frameSize) {
             );
 
             if (!shadowed && lightPdf > 1e-6) {
-                float bsdfPdf = absDot(surf.norm, lightDir) * PiInv;
+                float bsdfPdf = evalPdf(mat, surf.norm, wo, lightDir);
                 float weight = MISWeight(lightPdf, bsdfPdf);
                 vec3 scatterTerm = evalBSDF(mat, surf.albedo, surf.norm, wo, lightDir) * satDot(surf.norm, lightDir);
                 vec3 weightedLi = lightRadiance / lightPdf * weight;
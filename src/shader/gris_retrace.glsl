@@ -205,8 +205,7 @@ void GRISReservoirReuseAndMerge(inout GRISReservoir dstResv, SurfaceInfo dstPrim
             }
 
             if (rcType == RcVertexTypeLightSampled) {
-                float sumPower = uLightSampleTable[0].prob;
-                dstSamplePdf = luminance(rcSurf.albedo) / sumPower / dstJacobian;
+                dstSamplePdf = sampledLightPdf(rcPrevSurf.pos, srcSample.rcIsec.triangleIdx, wi, dist, -dot(rcSurf.norm, wi));
             }
             else {
                 dstSamplePdf = evalPdf(rcPrevMat, rcPrevSurf.norm, dstRcData.rcPrevWo, wi);
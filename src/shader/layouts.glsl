@@ -82,11 +82,61 @@ struct TriangleLight {
 	float area;
 };
 
+// GPU storage of TriangleLight, decoded by loadTriangleLight in triangle_light.glsl
+struct PackedTriangleLight {
+	vec3 v0;
+	uint normal;
+	uint edges[3];
+	uint radiance;
+};
+
 struct LightSampleTableElement {
 	float prob;
 	uint failId;
 };
 
+struct LightBVHNode {
+	vec3 boundMin;
+	float power;
+	vec3 boundMax;
+	float cosThetaO;
+	vec3 axis;
+	float cosThetaE;
+	uint secondChild;
+	uint lightOffset;
+	uint numLights;
+	uint pad;
+};
+
+// Compact copy of a power sampled TriangleLight, bit 31 of id flags a normal opposite to cross(v1 - v0, v2 - v0)
+struct PresampledLight {
+	vec3 v0;
+	float pmf;
+	vec3 v1;
+	uint id;
+	vec3 v2;
+	uint radiance;
+};
+
+struct ReGIRReservoir {
+	uint lightId;
+	float weight;
+};
+
+struct ReGIRGridHeader {
+	vec3 boundMin;
+	uint enabled;
+	vec3 boundMax;
+	uint pad;
+};
+
+struct VirtualTextureInfo {
+	uint width;
+	uint height;
+	uint numMips;
+	uint pageOffset;
+};
+
 struct Intersection {
 	vec2 bary;
 	uint instanceIdx;
@@ -174,8 +224,19 @@ layout(set = ResourceDescSet, binding = 2) readonly buffer _MaterialIndices { in
 layout(set = ResourceDescSet, binding = 3) readonly buffer _Vertices { MeshVertex uVertices[]; };
 layout(set = ResourceDescSet, binding = 4) readonly buffer _Indices { uint uIndices[]; };
 layout(set = ResourceDescSet, binding = 5) readonly buffer _ObjectInstances { ObjectInstance uObjectInstances[]; };
-layout(set = ResourceDescSet, binding = 6) readonly buffer _TriangleLights { TriangleLight uTriangleLights[]; };
+layout(set = ResourceDescSet, binding = 6) readonly buffer _TriangleLights { PackedTriangleLight uTriangleLights[]; };
 layout(set = ResourceDescSet, binding = 7) readonly buffer _LightSampleTable { LightSampleTableElement uLightSampleTable[]; };
+layout(set = ResourceDescSet, binding = 8) uniform sampler2D uVirtualTextureAtlas;
+layout(set = ResourceDescSet, binding = 9) readonly buffer _VirtualTextureInfos { VirtualTextureInfo uVirtualTextureInfos[]; };
+layout(set = ResourceDescSet, binding = 10) readonly buffer _VirtualPageTable { uint uVirtualPageTable[]; };
+layout(set = ResourceDescSet, binding = 11) buffer _VirtualTextureFeedback { uint uVirtualTextureFeedback[]; };
+layout(set = ResourceDescSet, binding = 12) uniform sampler2D uEnvironmentMap;
+layout(set = ResourceDescSet, binding = 13) readonly buffer _EnvironmentSampleTable { LightSampleTableElement uEnvironmentSampleTable[]; };
+layout(set = ResourceDescSet, binding = 14) readonly buffer _LightBVHNodes { LightBVHNode uLightBVHNodes[]; };
+layout(set = ResourceDescSet, binding = 15) readonly buffer _LightBVHLightIndices { uint uLightBVHLightIndices[]; };
+layout(set = ResourceDescSet, binding = 16) readonly buffer _LightBVHTrails { uint uLightBVHTrails[]; };
+layout(set = ResourceDescSet, binding = 17) buffer _LightTiles { uvec4 uLightTileHeader; PresampledLight uLightTiles[]; };
+layout(set = ResourceDescSet, binding = 18) buffer _ReGIRGrid { ReGIRGridHeader uReGIRHeader; ReGIRReservoir uReGIRReservoirs[]; };
 
 layout(set = RayImageDescSet, binding =  0, rgba16f) uniform image2D uDirectOutput;
 layout(set = RayImageDescSet, binding =  1, rgba16f) uniform image2D uIndirectOutput;
@@ -1,10 +1,33 @@
 #ifndef LIGHT_SAMPLING_GLSL
 #define LIGHT_SAMPLING_GLSL
 
+#include "triangle_light.glsl"
+
 #define SAMPLE_LIGHT_DOUBLE_SIDE 0
+// Use the light BVH instead of the power alias table in sampleLight(ref, wi, dist, pdf, r)
+#define SAMPLE_LIGHT_BVH 1
+
+const float OneMinusEpsilon = 0.99999994;
+
+bool useSphericalTriangleSampling(float solidAngle) {
+    return solidAngle > SphericalTriangleMinSolidAngle && solidAngle < SphericalTriangleMaxSolidAngle;
+}
+
+// Solid angle density of sampleTriangleLight reaching a point at dist and cosTheta on the light
+float triangleLightDirectionPdf(TriangleLight light, vec3 ref, float dist, float cosTheta) {
+    float solidAngle = triangleSolidAngle(light.v0, light.v1, light.v2, ref);
+
+    if (useSphericalTriangleSampling(solidAngle)) {
+        return 1.0 / solidAngle;
+    }
+    return dist * dist / abs(cosTheta) / light.area;
+}
 
 vec3 sampleTriangleLight(TriangleLight light, vec3 ref, out vec3 wi, out float dist, out float pdf, out float jacobian, out vec2 bary, vec2 r) {
-    bary = uvToBary(r);
+    float solidAngle = triangleSolidAngle(light.v0, light.v1, light.v2, ref);
+    bool spherical = useSphericalTriangleSampling(solidAngle);
+
+    bary = spherical ? sampleSphericalTriangle(light.v0, light.v1, light.v2, ref, r) : uvToBary(r);
 
     vec3 pos = light.v0 * (1.0 - bary.x - bary.y) + light.v1 * bary.x + light.v2 * bary.y;
     dist = distance(ref, pos);
@@ -12,7 +35,7 @@ vec3 sampleTriangleLight(TriangleLight light, vec3 ref, out vec3 wi, out float d
     vec3 n = vec3(light.nx, light.ny, light.nz);
     wi = (pos - ref) / dist;
     jacobian = absDot(n, wi) / square(dist);
-    pdf = 1.0 / jacobian / light.area;
+    pdf = spherical ? 1.0 / solidAngle : 1.0 / jacobian / light.area;
 
 #if !SAMPLE_LIGHT_DOUBLE_SIDE
     if (dot(n, wi) > 0) {
@@ -22,14 +45,47 @@ vec3 sampleTriangleLight(TriangleLight light, vec3 ref, out vec3 wi, out float d
     return light.radiance;
 }
 
+/*
+* Two-level light sample table, see BlockDiscreteSampler in AliasTable.h. The leftovers of both
+*   random numbers after picking a block are reused to pick the light inside it
+*/
+const uint LightTableBlockTableOffset = 2;
+
+uint sampleLightTableLevel(uint offset, inout vec2 r) {
+    uint size = max(uLightSampleTable[offset].failId, 1u);
+    float scaled = float(size) * r.x;
+    uint passId = min(uint(scaled), size - 1);
+    LightSampleTableElement distrib = uLightSampleTable[offset + passId + 1];
+
+    r.x = min(scaled - float(passId), OneMinusEpsilon);
+
+    if (r.y < distrib.prob) {
+        r.y /= distrib.prob;
+        return passId;
+    }
+    r.y = min((r.y - distrib.prob) / (1.0 - distrib.prob), OneMinusEpsilon);
+    return distrib.failId - 1;
+}
+
+uint sampleLightTable(vec2 r) {
+    uint numBlocks = uLightSampleTable[1].failId;
+    uint block = sampleLightTableLevel(LightTableBlockTableOffset, r);
+    uint itemTableOffset = LightTableBlockTableOffset + numBlocks + 1 + block * (LightTableBlockSize + 1);
+
+    return block * LightTableBlockSize + sampleLightTableLevel(itemTableOffset, r);
+}
+
 vec3 sampleLightByPower(vec3 ref, out vec3 wi, out float dist, out float pdf, out float jacobian, out vec2 bary, out uint id, vec4 r) {
     float sumPower = uLightSampleTable[0].prob;
-    uint numLights = uLightSampleTable[0].failId;
 
-    id = uint(float(numLights) * r.x);
-    id = (r.y < uLightSampleTable[id + 1].prob) ? id : uLightSampleTable[id + 1].failId - 1;
+    if (sumPower <= 0.0) {
+        id = 0;
+        pdf = 0.0;
+        return vec3(0.0);
+    }
+    id = sampleLightTable(r.xy);
 
-    TriangleLight light = uTriangleLights[id];
+    TriangleLight light = loadTriangleLight(id);
     vec3 radiance = sampleTriangleLight(light, ref, wi, dist, pdf, jacobian, bary, r.zw);
     pdf *= luminance(light.radiance) * light.area / sumPower;
 
@@ -40,22 +96,374 @@ vec3 sampleLightUniform(vec3 ref, out vec3 wi, out float dist, out float pdf, ou
     uint numLights = uLightSampleTable[0].failId;
     id = uint(float(numLights) * r.x);
 
-    TriangleLight light = uTriangleLights[id];
+    TriangleLight light = loadTriangleLight(id);
     vec3 radiance = sampleTriangleLight(light, ref, wi, dist, pdf, jacobian, bary, r.zw);
     pdf *= 1.0 / float(numLights);
 
     return radiance;
 }
 
-vec3 sampleLight(vec3 ref, out vec3 wi, out float dist, out float pdf, out float jacobian, out vec2 bary, out uint id, vec4 r) {
+/*
+* Light presampling tiles, filled each frame by light_presample.comp. Candidates of one
+*   invocation all come from a small tile instead of the whole light list
+*/
+const uint PresampledLightFlipNormal = 0x80000000u;
+
+PresampledLight makePresampledLight(uint id, float pmf) {
+    TriangleLight light = loadTriangleLight(id);
+    PresampledLight presampled;
+
+    presampled.v0 = light.v0;
+    presampled.v1 = light.v1;
+    presampled.v2 = light.v2;
+    presampled.pmf = pmf;
+    presampled.radiance = uTriangleLights[id].radiance;
+
+    vec3 geomNorm = cross(light.v1 - light.v0, light.v2 - light.v0);
+    bool flip = dot(geomNorm, vec3(light.nx, light.ny, light.nz)) < 0.0;
+    presampled.id = id | (flip ? PresampledLightFlipNormal : 0u);
+
+    return presampled;
+}
+
+bool lightTilesEnabled() {
+    return uLightTileHeader.x != 0;
+}
+
+// Tile sampleLight draws from, shared by all pixels of a RayQueryBlockSizeX x RayQueryBlockSizeY
+//   block so that a workgroup reads one tile. Set by the pass before sampling lights
+uint gLightTile = 0;
+
+void selectLightTile(uvec2 index) {
+    uvec2 block = index / uvec2(RayQueryBlockSizeX, RayQueryBlockSizeY);
+    gLightTile = makeSeed(uCamera.seed, block) % LightPresampleNumTiles;
+}
+
+// Each tile is an i.i.d. power sampled set, so a fixed tile still selects lights by power in expectation
+vec3 sampleLightPresampled(uint tile, vec3 ref, out vec3 wi, out float dist, out float pdf, out float jacobian, out vec2 bary, out uint id, vec4 r) {
+    uint entry = min(uint(r.y * float(LightPresampleTileSize)), LightPresampleTileSize - 1);
+    PresampledLight presampled = uLightTiles[tile * LightPresampleTileSize + entry];
+
+    vec3 geomNorm = cross(presampled.v1 - presampled.v0, presampled.v2 - presampled.v0);
+    float len = length(geomNorm);
+    bool flip = (presampled.id & PresampledLightFlipNormal) != 0;
+
+    TriangleLight light;
+    light.v0 = presampled.v0;
+    light.v1 = presampled.v1;
+    light.v2 = presampled.v2;
+    vec3 n = geomNorm / len * (flip ? -1.0 : 1.0);
+    light.nx = n.x;
+    light.ny = n.y;
+    light.nz = n.z;
+    light.radiance = unpackRGB9E5(presampled.radiance);
+    light.area = 0.5 * len;
+
+    id = presampled.id & ~PresampledLightFlipNormal;
+    vec3 radiance = sampleTriangleLight(light, ref, wi, dist, pdf, jacobian, bary, r.zw);
+    pdf *= presampled.pmf;
+
+    return radiance;
+}
+
+// Triangle lights only, by power from presampled tiles or the light sample table
+vec3 sampleTriangleLightByPower(vec3 ref, out vec3 wi, out float dist, out float pdf, out float jacobian, out vec2 bary, out uint id, vec4 r) {
+    if (lightTilesEnabled()) {
+        return sampleLightPresampled(gLightTile, ref, wi, dist, pdf, jacobian, bary, id, r);
+    }
     return sampleLightByPower(ref, wi, dist, pdf, jacobian, bary, id, r);
     //return sampleLightUniform(ref, wi, dist, pdf, jacobian, bary, id, r);
 }
 
+/*
+* Light BVH, see LightBVH.cpp for the CPU reference of the functions below
+*/
+
+float triangleLightPower(uint id) {
+    TriangleLight light = loadTriangleLight(id);
+    return luminance(light.radiance) * light.area;
+}
+
+float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    return (cosA > cosB) ? 1.0 : cosA * cosB + sinA * sinB;
+}
+
+float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    return (cosA > cosB) ? 0.0 : sinA * cosB - cosA * sinB;
+}
+
+float lightBVHImportance(uint nodeIdx, vec3 pos, vec3 norm) {
+    LightBVHNode node = uLightBVHNodes[nodeIdx];
+
+    vec3 center = (node.boundMin + node.boundMax) * 0.5;
+    vec3 diag = node.boundMax - node.boundMin;
+    vec3 toPos = pos - center;
+
+    float dist2 = dot(toPos, toPos);
+    float clampedDist2 = max(dist2, length(diag) * 0.5);
+    float dist = sqrt(dist2);
+    vec3 wi = (dist > 0.0) ? toPos / dist : node.axis;
+
+    float cosThetaW = dot(node.axis, wi);
+    float sinThetaW = sqrt(max(1.0 - cosThetaW * cosThetaW, 0.0));
+
+    float radius2 = dot(diag, diag) * 0.25;
+    float cosThetaB = (dist2 < radius2) ? -1.0 : sqrt(max(1.0 - radius2 / dist2, 0.0));
+    float sinThetaB = sqrt(max(1.0 - cosThetaB * cosThetaB, 0.0));
+
+    float sinThetaO = sqrt(max(1.0 - node.cosThetaO * node.cosThetaO, 0.0));
+
+    float cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, node.cosThetaO);
+    float cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+
+    if (cosThetaP <= node.cosThetaE) {
+        return 0.0;
+    }
+    float importance = node.power * cosThetaP / clampedDist2;
+
+    if (norm != vec3(0.0)) {
+        float cosThetaI = absDot(wi, norm);
+        float sinThetaI = sqrt(max(1.0 - cosThetaI * cosThetaI, 0.0));
+        importance *= cosSubClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+    }
+    return max(importance, 0.0);
+}
+
+bool sampleLightBVH(vec3 pos, vec3 norm, float r, out uint id, out float pmf) {
+    uint nodeIdx = 0;
+    pmf = 1.0;
+
+    while (true) {
+        LightBVHNode node = uLightBVHNodes[nodeIdx];
+
+        if (node.numLights == 1) {
+            id = uLightBVHLightIndices[node.lightOffset];
+            return true;
+        }
+        else if (node.numLights > 1) {
+            if (node.power <= 0.0) {
+                return false;
+            }
+            float target = r * node.power;
+
+            for (uint i = 0; i < node.numLights; i++) {
+                id = uLightBVHLightIndices[node.lightOffset + i];
+                float power = triangleLightPower(id);
+
+                if (target < power || i == node.numLights - 1) {
+                    pmf *= power / node.power;
+                    return true;
+                }
+                target -= power;
+            }
+        }
+        float importance0 = lightBVHImportance(nodeIdx + 1, pos, norm);
+        float importance1 = lightBVHImportance(node.secondChild, pos, norm);
+
+        if (importance0 == 0.0 && importance1 == 0.0) {
+            return false;
+        }
+        float prob0 = importance0 / (importance0 + importance1);
+
+        if (r < prob0) {
+            nodeIdx = nodeIdx + 1;
+            r = min(r / prob0, OneMinusEpsilon);
+            pmf *= prob0;
+        }
+        else {
+            nodeIdx = node.secondChild;
+            r = min((r - prob0) / (1.0 - prob0), OneMinusEpsilon);
+            pmf *= 1.0 - prob0;
+        }
+    }
+    return false;
+}
+
+float lightBVHPmf(vec3 pos, vec3 norm, uint id) {
+    uint bitTrail = uLightBVHTrails[id];
+    uint nodeIdx = 0;
+    float pmf = 1.0;
+
+    while (true) {
+        LightBVHNode node = uLightBVHNodes[nodeIdx];
+
+        if (node.numLights == 1) {
+            return pmf;
+        }
+        else if (node.numLights > 1) {
+            return (node.power > 0.0) ? pmf * triangleLightPower(id) / node.power : 0.0;
+        }
+        float importance0 = lightBVHImportance(nodeIdx + 1, pos, norm);
+        float importance1 = lightBVHImportance(node.secondChild, pos, norm);
+
+        if (importance0 == 0.0 && importance1 == 0.0) {
+            return 0.0;
+        }
+        float prob0 = importance0 / (importance0 + importance1);
+
+        if ((bitTrail & 1) != 0) {
+            nodeIdx = node.secondChild;
+            pmf *= 1.0 - prob0;
+        }
+        else {
+            nodeIdx = nodeIdx + 1;
+            pmf *= prob0;
+        }
+        bitTrail >>= 1;
+    }
+    return 0.0;
+}
+
+vec3 sampleLightByBVH(vec3 ref, out vec3 wi, out float dist, out float pdf, vec4 r) {
+    uint id;
+    float pmf;
+
+    if (!sampleLightBVH(ref, vec3(0.0), r.x, id, pmf)) {
+        pdf = 0.0;
+        return vec3(0.0);
+    }
+    vec3 dummy;
+    vec3 radiance = sampleTriangleLight(loadTriangleLight(id), ref, wi, dist, pdf, dummy.x, dummy.yz, r.zw);
+    pdf *= pmf;
+    return radiance;
+}
+
+/*
+* Environment map, see DiscreteSampler2D for the layout of uEnvironmentSampleTable.
+*   Texels are importance sampled by luminance * sin(theta) of the equirectangular map
+*/
+const uint EnvironmentRowTableOffset = 2;
+
+bool hasEnvironmentMap() {
+    return uEnvironmentSampleTable[0].prob > 0.0;
+}
+
+bool hasTriangleLights() {
+    return uLightSampleTable[0].prob > 0.0;
+}
+
+// Probability of picking the environment map over triangle lights in sampleLight
+float environmentSelectProb() {
+    if (!hasEnvironmentMap()) {
+        return 0.0;
+    }
+    return hasTriangleLights() ? 0.5 : 1.0;
+}
+
+vec3 environmentRadiance(vec3 dir) {
+    return textureLod(uEnvironmentMap, sphereToPlane(dir), 0.0).rgb;
+}
+
+float environmentMapPdf(vec3 dir) {
+    uvec2 size = uvec2(uEnvironmentSampleTable[0].failId, uEnvironmentSampleTable[1].failId);
+    vec2 uv = sphereToPlane(dir);
+    uvec2 texel = min(uvec2(uv * vec2(size)), size - 1);
+
+    float sinTheta = sin(Pi * (float(texel.y) + 0.5) / float(size.y));
+    float texelPdf = luminance(texelFetch(uEnvironmentMap, ivec2(texel), 0).rgb) * sinTheta / uEnvironmentSampleTable[0].prob;
+    float sinDir = sqrt(max(1.0 - dir.z * dir.z, 1e-8));
+
+    return texelPdf * float(size.x * size.y) / (2.0 * Pi * Pi * sinDir);
+}
+
+uint sampleEnvironmentTable(uint offset, uint size, float r1, float r2) {
+    uint passId = min(uint(float(size) * r1), size - 1);
+    LightSampleTableElement distrib = uEnvironmentSampleTable[offset + passId + 1];
+    return (r2 < distrib.prob) ? passId : distrib.failId - 1;
+}
+
+vec3 sampleEnvironmentMap(out vec3 wi, out float pdf, vec4 r) {
+    uvec2 size = uvec2(uEnvironmentSampleTable[0].failId, uEnvironmentSampleTable[1].failId);
+
+    uint row = sampleEnvironmentTable(EnvironmentRowTableOffset, size.y, r.x, r.y);
+    uint column = sampleEnvironmentTable(EnvironmentRowTableOffset + size.y + 1 + row * (size.x + 1), size.x, r.z, r.w);
+
+    // The column and row picks only use the integer part of N * r, the rest jitters within the texel
+    vec2 jitter = fract(vec2(r.z * float(size.x), r.x * float(size.y)));
+    vec2 uv = (vec2(column, row) + jitter) / vec2(size);
+
+    wi = planeToSphere(uv);
+    pdf = environmentMapPdf(wi);
+    return environmentRadiance(wi);
+}
+
+// Solid angle pdf of the power proportional pick, alias table or presampled tiles, reaching light id from
+//   ref, with the share sampleLight(ref, wi, dist, pdf, jacobian, bary, id, r) leaves to triangle lights
+float triangleLightPowerPdf(vec3 ref, uint id, float dist, float cosTheta) {
+    TriangleLight light = loadTriangleLight(id);
+    float pmf = luminance(light.radiance) * light.area / uLightSampleTable[0].prob;
+    return pmf * triangleLightDirectionPdf(light, ref, dist, cosTheta) * (1.0 - environmentSelectProb());
+}
+
+// Solid angle pdf of sampleLight reaching emissive triangle id from ref
+float triangleLightPdf(vec3 ref, uint id, float dist, float cosTheta) {
+#if SAMPLE_LIGHT_BVH
+    float pmf = lightBVHPmf(ref, vec3(0.0), id);
+#else
+    float pmf = triangleLightPower(id) / uLightSampleTable[0].prob;
+#endif
+    return pmf * triangleLightDirectionPdf(loadTriangleLight(id), ref, dist, cosTheta) * (1.0 - environmentSelectProb());
+}
+
+// Solid angle pdf of sampleLight producing a direction that escapes the scene
+float environmentLightPdf(vec3 dir) {
+    return environmentMapPdf(dir) * environmentSelectProb();
+}
+
 vec3 sampleLight(vec3 ref, out vec3 wi, out float dist, out float pdf, vec4 r) {
+    float envProb = environmentSelectProb();
+
+    if (r.x < envProb) {
+        r.x /= envProb;
+        dist = MaxRayDistance;
+        vec3 radiance = sampleEnvironmentMap(wi, pdf, r);
+        pdf *= envProb;
+        return radiance;
+    }
+    r.x = (r.x - envProb) / (1.0 - envProb);
+
+#if SAMPLE_LIGHT_BVH
+    vec3 radiance = sampleLightByBVH(ref, wi, dist, pdf, r);
+#else
     vec3 dummy;
     uint id;
-    return sampleLightByPower(ref, wi, dist, pdf, dummy.x, dummy.yz, id, r);
+    vec3 radiance = sampleLightByPower(ref, wi, dist, pdf, dummy.x, dummy.yz, id, r);
+#endif
+    pdf *= 1.0 - envProb;
+    return radiance;
+}
+
+/*
+* Light sampling of the ReSTIR passes, which keep the light id. Environment samples get
+*   EnvironmentLightId and sphereToPlane(wi) as bary, the jacobian of a light at MaxRayDistance
+*/
+vec3 sampleLight(vec3 ref, out vec3 wi, out float dist, out float pdf, out float jacobian, out vec2 bary, out uint id, vec4 r) {
+    float envProb = environmentSelectProb();
+
+    if (r.x < envProb) {
+        r.x /= envProb;
+        vec3 radiance = sampleEnvironmentMap(wi, pdf, r);
+        dist = MaxRayDistance;
+        jacobian = 1.0 / square(MaxRayDistance);
+        bary = sphereToPlane(wi);
+        id = EnvironmentLightId;
+        pdf *= envProb;
+        return radiance;
+    }
+    r.x = (r.x - envProb) / (1.0 - envProb);
+
+    vec3 radiance = sampleTriangleLightByPower(ref, wi, dist, pdf, jacobian, bary, id, r);
+    pdf *= 1.0 - envProb;
+    return radiance;
+}
+
+// Solid angle pdf of sampleLight(ref, wi, dist, pdf, jacobian, bary, id, r) reaching light id along wi
+float sampledLightPdf(vec3 ref, uint id, vec3 wi, float dist, float cosTheta) {
+    if (id == EnvironmentLightId) {
+        return environmentLightPdf(wi);
+    }
+    return triangleLightPowerPdf(ref, id, dist, cosTheta);
 }
 
 vec3 sampleLightThreaded(vec3 ref, float blockRand, out vec3 wi, out float dist, out float pdf, inout uint rng) {
@@ -70,7 +478,7 @@ vec3 sampleLightThreaded(vec3 ref, float blockRand, out vec3 wi, out float dist,
     uint idx = blockSize * blockIdx + uint(sample1f(rng) * realSize);
     vec3 dummy;
 
-    TriangleLight light = uTriangleLights[idx];
+    TriangleLight light = loadTriangleLight(idx);
     vec3 radiance = sampleTriangleLight(light, ref, wi, dist, pdf, dummy.x, dummy.yz, sample2f(rng));
     pdf *= 1.0 / float(numLights);
 
@@ -1,109 +1,12 @@
 #ifndef MATH_GLSL
 #define MATH_GLSL
 
-const float Pi = 3.14159265358979323846;
-const float PiInv = 1.0 / Pi;
-const float Inf = 1.0 / 0.0;
-const vec3 Black = vec3(0.0);
-
-float sqr(float x) {
-	return x * x;
-}
-
-float powerHeuristic(float pf, int fn, float pg, int gn) {
-	float f = pf * float(fn);
-	float g = pg * float(gn);
-	return f * f / (f * f + g * g);
-}
-
-float powerHeuristic(float f, float g) {
-	return f * f / (f * f + g * g);
-}
-
-vec2 toConcentricDisk(vec2 v) {
-	if (v.x == 0.0 && v.y == 0.0) {
-		return vec2(0.0, 0.0);
-	}
-	v = v * 2.0 - 1.0;
-	float phi, r;
+#include "HostDeviceMath.h"
 
-	if (v.x * v.x > v.y * v.y) {
-		r = v.x;
-		phi = Pi * v.y / v.x * 0.25;
-	}
-	else {
-		r = v.y;
-		phi = Pi * 0.5 - Pi * v.x / v.y * 0.25;
-	}
-	return vec2(r * cos(phi), r * sin(phi));
-}
-
-float satDot(vec3 a, vec3 b) {
-	return max(dot(a, b), 0.0);
-}
-
-float absDot(vec3 a, vec3 b) {
-	return abs(dot(a, b));
-}
-
-float distSqr(vec3 x, vec3 y) {
-	return dot(x - y, x - y);
-}
-
-vec2 sphereToPlane(vec3 uv) {
-	float theta = atan(uv.y, uv.x);
-
-	if (theta < 0.0) {
-		theta += Pi * 2.0;
-	}
-	float phi = atan(length(uv.xy), uv.z);
-	return vec2(theta * PiInv * 0.5, phi * PiInv);
-}
+// Shader only helpers. The spherical triangle routines have their host version in
+//   SphericalTriangle.cpp
 
-vec3 planeToSphere(vec2 uv) {
-	float theta = uv.x * Pi * 2.0;
-	float phi = uv.y * Pi;
-	return vec3(cos(theta) * sin(phi), sin(theta) * sin(phi), cos(phi));
-}
-
-vec3 getTangent(vec3 n) {
-	return (abs(n.z) > 0.999) ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
-}
-
-mat3 matLocalToWorld(vec3 n) {
-	vec3 t = getTangent(n);
-	vec3 b = normalize(cross(n, t));
-	t = cross(b, n);
-	return mat3(t, b, n);
-}
-
-vec3 localToWorld(vec3 n, vec3 v)
-{
-	return normalize(matLocalToWorld(n) * v);
-}
-
-vec3 sampleCosineWeightedHemisphere(vec3 n, vec2 u) {
-	vec2 uv = toConcentricDisk(u);
-	float z = sqrt(1.0 - dot(uv, uv));
-	return localToWorld(n, vec3(uv, z));
-}
-
-bool sameHemisphere(vec3 n, vec3 a, vec3 b) {
-	return dot(n, a) * dot(n, b) > 0;
-}
-
-int maxExtent(vec3 v) {
-	if (v.x > v.y) {
-		return v.x > v.z ? 0 : 2;
-	}
-	else {
-		return v.y > v.z ? 1 : 2;
-	}
-}
-
-float maxComponent(vec3 v) {
-	return max(v.x, max(v.y, v.z));
-}
+const float Inf = 1.0 / 0.0;
 
 float angleBetween(vec3 x, vec3 y) {
 	if (dot(x, y) < 0.0) {
@@ -114,22 +17,6 @@ float angleBetween(vec3 x, vec3 y) {
 	}
 }
 
-vec2 uvToBary(vec2 uv) {
-	float r = sqrt(uv.y);
-	return vec2(1.0 - r, uv.x * r);
-}
-
-vec3 sampleTriangleUniform(vec3 va, vec3 vb, vec3 vc, vec2 uv) {
-	float r = sqrt(uv.y);
-	float u = 1.0 - r;
-	float v = uv.x * r;
-	return va * (1.0 - u - v) + vb * u + vc * v;
-}
-
-float triangleArea(vec3 va, vec3 vb, vec3 vc) {
-	return 0.5f * length(cross(vc - va, vb - va));
-}
-
 float triangleSphericalArea(vec3 a, vec3 b, vec3 c) {
 	vec3 ab = cross(a, b);
 	vec3 bc = cross(b, c);
@@ -157,38 +44,63 @@ float triangleSolidAngle(vec3 va, vec3 vb, vec3 vc, vec3 p) {
 	return triangleSolidAngle(normalize(va - p), normalize(vb - p), normalize(vc - p));
 }
 
-vec3 rotateZ(vec3 v, float angle) {
-	float cost = cos(angle);
-	float sint = sin(angle);
-	return vec3(vec2(v.x * cost - v.y * sint, v.x * sint + v.y * cost), v.z);
-}
-
-float pow5(float x) {
-	float x2 = x * x;
-	return x2 * x2 * x;
-}
+// Arvo 1995 in the formulation of pbrt-v4, uniformly samples the solid angle the triangle subtends
+//   at p and returns barycentrics of vb and vc for the point hit on the triangle.
+//   SphericalTriangle.cpp has the CPU version
+vec2 sampleSphericalTriangle(vec3 va, vec3 vb, vec3 vc, vec3 p, vec2 u) {
+	vec3 a = normalize(va - p);
+	vec3 b = normalize(vb - p);
+	vec3 c = normalize(vc - p);
 
-float luminance(vec3 color) {
-	return dot(color, vec3(0.299, 0.587, 0.114));
-}
-
-bool isBlack(vec3 color) {
-	return luminance(color) < 1e-5f;
-}
-
-bool hasNan(vec3 color) {
-	return isnan(color.x) || isnan(color.y) || isnan(color.z);
-}
+	vec3 nab = cross(a, b);
+	vec3 nbc = cross(b, c);
+	vec3 nca = cross(c, a);
 
-bool hasInf(vec3 color) {
-	return isinf(color.x) || isinf(color.y) || isinf(color.z);
-}
+	if (dot(nab, nab) == 0.0 || dot(nbc, nbc) == 0.0 || dot(nca, nca) == 0.0) {
+		return vec2(1.0 / 3.0);
+	}
+	nab = normalize(nab);
+	nbc = normalize(nbc);
+	nca = normalize(nca);
+
+	float alpha = angleBetween(nab, -nca);
+	float beta = angleBetween(nbc, -nab);
+	float gamma = angleBetween(nca, -nbc);
+
+	// Pick the sub-triangle area, then the point of c' on arc ac that produces it
+	float areaPi = mix(Pi, alpha + beta + gamma, u.x);
+	float cosAlpha = cos(alpha);
+	float sinAlpha = sin(alpha);
+	float sinPhi = sin(areaPi) * cosAlpha - cos(areaPi) * sinAlpha;
+	float cosPhi = cos(areaPi) * cosAlpha + sin(areaPi) * sinAlpha;
+	float k1 = cosPhi + cosAlpha;
+	float k2 = sinPhi - sinAlpha * dot(a, b);
+
+	float cosBp = clamp((k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) / ((k2 * sinPhi + k1 * cosPhi) * sinAlpha), -1.0, 1.0);
+	float sinBp = sqrt(max(1.0 - cosBp * cosBp, 0.0));
+	vec3 cp = cosBp * a + sinBp * normalize(c - dot(c, a) * a);
+
+	// Then the direction along arc bc'
+	float cosTheta = 1.0 - u.y * (1.0 - dot(cp, b));
+	float sinTheta = sqrt(max(1.0 - cosTheta * cosTheta, 0.0));
+	vec3 perp = cp - dot(cp, b) * b;
+	vec3 w = (dot(perp, perp) > 0.0) ? cosTheta * b + sinTheta * normalize(perp) : b;
+
+	vec3 e1 = vb - va;
+	vec3 e2 = vc - va;
+	vec3 s1 = cross(w, e2);
+	float divisor = dot(s1, e1);
+
+	if (divisor == 0.0) {
+		return vec2(1.0 / 3.0);
+	}
+	vec3 s = p - va;
+	vec2 bary = clamp(vec2(dot(s, s1), dot(w, cross(s, e1))) / divisor, 0.0, 1.0);
 
-vec3 clampColor(vec3 color) {
-	if (hasNan(color)) {
-		return vec3(0.0);
+	if (bary.x + bary.y > 1.0) {
+		bary /= bary.x + bary.y;
 	}
-	return clamp(color, vec3(0.0), vec3(1e4));
+	return bary;
 }
 
 vec3 colorWheel(float x) {
@@ -214,75 +126,4 @@ vec3 assert(bool assertion) {
 	return colorWheel(1.0 - float(assertion) * 0.5);
 }
 
-uint hash(uint a) {
-	a = (a + 0x7ed55d16u) + (a << 12u);
-	a = (a ^ 0xc761c23cu) ^ (a >> 19u);
-	a = (a + 0x165667b1u) + (a << 5u);
-	a = (a + 0xd3a2646cu) ^ (a << 9u);
-	a = (a + 0xfd7046c5u) + (a << 3u);
-	a = (a ^ 0xb55a4f09u) ^ (a >> 16u);
-	return a;
-}
-
-uint hash2(uint seed) {
-	seed = (seed ^ 61u) ^ (seed >> 16u);
-	seed *= 9u;
-	seed = seed ^ (seed >> 4u);
-	seed *= 0x27d4eb2du;
-	seed = seed ^ (seed >> 15u);
-	return seed;
-}
-
-uint makeSeed(uint seed0, uint seed1, uint index) {
-	return hash2((1u << 31u) | (seed1 << 22) | seed0) ^ hash2(index);
-}
-
-uint makeSeed(uint rand, uint index) {
-	return hash2(rand) + hash2(index);
-}
-
-uint makeSeed(uint seed, uvec2 index) {
-	return makeSeed((seed + index.x) ^ (index.y - 1), index.y * (index.x - 2));
-}
-
-uint urand(inout uint rng) {
-	return rng = hash2(rng);
-}
-
-float sample1f(inout uint rng) {
-	return float(urand(rng)) / 4294967295.0;
-}
-
-vec2 sample2f(inout uint rng) {
-	return vec2(sample1f(rng), sample1f(rng));
-}
-
-vec3 sample3f(inout uint rng) {
-	return vec3(sample2f(rng), sample1f(rng));
-}
-
-vec4 sample4f(inout uint rng) {
-	return vec4(sample2f(rng), sample2f(rng));
-}
-
-float MISWeight(float f, float g) {
-	return (f * f) / (f * f + g * g);
-}
-
-uint ceilDiv(uint x, uint y) {
-	return (x + y - 1) / y;
-}
-
-int ceilDiv(int x, int y) {
-	return (x + y - 1) / y;
-}
-
-float square(float x) {
-	return x * x;
-}
-
-float distSquare(vec3 a, vec3 b) {
-	return dot(a - b, a - b);
-}
-
 #endif
\ No newline at end of file
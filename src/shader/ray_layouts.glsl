@@ -2,6 +2,8 @@
 #define RAYTRACING_LAYOUTS_GLSL
 
 #include "layouts.glsl"
+#include "virtual_texture.glsl"
+#include "triangle_light.glsl"
 
 const int ClosestHitPayloadLocation = 0;
 const int ShadowPayloadLocation = 1;
@@ -11,6 +13,8 @@ const float MaxRayDistance = 1e7;
 
 const uint InvalidHitIndex = 0xffffffff;
 const uint SpecialHitIndex = 0xfffffffe;
+// Light id of the environment map in light sampled ReSTIR vertices, see environmentIntersection
+const uint EnvironmentLightId = 0xffffffff;
 
 struct Ray {
     vec3 ori;
@@ -47,8 +51,25 @@ void intersectionSetInvalid(inout Intersection isec) {
     isec.instanceIdx = InvalidHitIndex;
 }
 
+/*
+* Escaped directions as hits on the light instance, with sphereToPlane(dir) in place of the
+*   barycentrics. They load as a light at MaxRayDistance facing back along dir, so that ReSTIR
+*   shifts treat the environment map like a distant emitter
+*/
+Intersection environmentIntersection(vec3 dir) {
+    return Intersection(sphereToPlane(dir), 0, EnvironmentLightId);
+}
+
+void loadEnvironmentSurfaceInfo(vec2 uv, out SurfaceInfo info) {
+    vec3 dir = planeToSphere(uv);
+
+    info.pos = dir * MaxRayDistance;
+    info.norm = -dir;
+    info.albedo = textureLod(uEnvironmentMap, uv, 0.0).rgb;
+}
+
 void loadLightSurfaceInfo(uint triangleIdx, vec3 bary, out SurfaceInfo info) {
-    TriangleLight light = uTriangleLights[triangleIdx];
+    TriangleLight light = loadTriangleLight(triangleIdx);
 
     info.pos = light.v0 * bary.x + light.v1 * bary.y + light.v2 * bary.z;
     info.norm = vec3(light.nx, light.ny, light.nz);
@@ -81,6 +102,9 @@ void loadObjectSurfaceInfo(uint instanceIdx, uint triangleIdx, vec3 bary, out Su
     if (texIdx == InvalidResourceIdx) {
         info.albedo = uMaterials[info.matIndex].baseColor;
     }
+    else if (isVirtualTexture(texIdx)) {
+        info.albedo = sampleVirtualTexture(texIdx, vec2(uvx, uvy), VirtualTextureRayLod).rgb;
+    }
     else {
         info.albedo = texture(uTextures[nonuniformEXT(texIdx)], vec2(uvx, uvy)).rgb;
     }
@@ -89,7 +113,11 @@ void loadObjectSurfaceInfo(uint instanceIdx, uint triangleIdx, vec3 bary, out Su
 void loadSurfaceInfo(uint instanceIdx, uint triangleIdx, vec2 bary, out SurfaceInfo info) {
     vec3 barycentrics = vec3(1.0 - bary.x - bary.y, bary.x, bary.y);
 
-    if (instanceIdx == 0) {
+    if (instanceIdx == 0 && triangleIdx == EnvironmentLightId) {
+        loadEnvironmentSurfaceInfo(bary, info);
+        info.isLight = true;
+    }
+    else if (instanceIdx == 0) {
         loadLightSurfaceInfo(triangleIdx, barycentrics, info);
         info.isLight = true;
     }
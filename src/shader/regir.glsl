@@ -0,0 +1,128 @@
+#ifndef REGIR_GLSL
+#define REGIR_GLSL
+
+#include "light_sampling.glsl"
+
+/*
+* World-space grid of light reservoirs (ReGIR), see ReGIR.cpp for the CPU reference of the
+*   cell layout and reservoir filling. Every cell keeps ReGIRReservoirsPerCell reservoirs, each
+*   resampled from power sampled candidates with a target that is bounded by the cell size
+*/
+bool ReGIREnabled() {
+    return uReGIRHeader.enabled != 0;
+}
+
+vec3 ReGIRCellSize(ReGIRGridHeader header) {
+    return (header.boundMax - header.boundMin) / float(ReGIRGridDim);
+}
+
+uint ReGIRCellIndex(ReGIRGridHeader header, vec3 pos) {
+    if (any(lessThan(pos, header.boundMin)) || any(greaterThanEqual(pos, header.boundMax))) {
+        return ReGIRInvalidCell;
+    }
+    uvec3 cell = min(uvec3((pos - header.boundMin) / ReGIRCellSize(header)), uvec3(ReGIRGridDim - 1));
+    return cell.x + ReGIRGridDim * (cell.y + ReGIRGridDim * cell.z);
+}
+
+vec3 ReGIRCellCenter(ReGIRGridHeader header, uint cellIdx) {
+    uvec3 cell = uvec3(cellIdx % ReGIRGridDim, (cellIdx / ReGIRGridDim) % ReGIRGridDim, cellIdx / (ReGIRGridDim * ReGIRGridDim));
+    return header.boundMin + (vec3(cell) + 0.5) * ReGIRCellSize(header);
+}
+
+float ReGIRTarget(TriangleLight light, vec3 center, float radius) {
+    vec3 centroid = (light.v0 + light.v1 + light.v2) / 3.0;
+    vec3 d = centroid - center;
+    return luminance(light.radiance) * light.area / max(dot(d, d), square(radius));
+}
+
+ReGIRReservoir ReGIRFillReservoir(uint cellIdx, ReGIRGridHeader header, inout uint rng) {
+    float sumPower = uLightSampleTable[0].prob;
+
+    ReGIRReservoir resv;
+    resv.lightId = 0;
+    resv.weight = 0.0;
+
+    if (sumPower <= 0.0) {
+        return resv;
+    }
+    vec3 center = ReGIRCellCenter(header, cellIdx);
+    float radius = length(ReGIRCellSize(header)) * 0.5;
+
+    float weightSum = 0.0;
+    float selectedTarget = 0.0;
+
+    for (uint i = 0; i < ReGIRCandidatesPerReservoir; i++) {
+        vec2 r = sample2f(rng);
+        float resampleRand = sample1f(rng);
+
+        uint id = sampleLightTable(r);
+
+        TriangleLight light = loadTriangleLight(id);
+        float sourcePdf = luminance(light.radiance) * light.area / sumPower;
+        float target = ReGIRTarget(light, center, radius);
+
+        if (sourcePdf <= 0.0) {
+            continue;
+        }
+        float weight = target / sourcePdf;
+        weightSum += weight;
+
+        if (resampleRand * weightSum < weight) {
+            resv.lightId = id;
+            selectedTarget = target;
+        }
+    }
+    resv.weight = (selectedTarget > 0.0) ? weightSum / (float(ReGIRCandidatesPerReservoir) * selectedTarget) : 0.0;
+    return resv;
+}
+
+/*
+* The reservoir weight W is an unbiased estimate of the inverse selection probability, so it
+*   is used in place of the light pmf. MIS needs a pdf that can be evaluated for BSDF sampled
+*   hits too, misPdf returns the one of the fallback sampler
+*/
+vec3 sampleLightReGIR(vec3 ref, out vec3 wi, out float dist, out float pdf, out float misPdf, out float jacobian, out vec2 bary, out uint id, vec4 r) {
+    uint cellIdx = ReGIREnabled() ? ReGIRCellIndex(uReGIRHeader, ref) : ReGIRInvalidCell;
+
+    if (cellIdx == ReGIRInvalidCell) {
+        vec3 radiance = sampleTriangleLightByPower(ref, wi, dist, pdf, jacobian, bary, id, r);
+        misPdf = pdf;
+        return radiance;
+    }
+    uint resvIdx = cellIdx * ReGIRReservoirsPerCell + min(uint(r.x * float(ReGIRReservoirsPerCell)), ReGIRReservoirsPerCell - 1);
+    ReGIRReservoir resv = uReGIRReservoirs[resvIdx];
+
+    id = resv.lightId;
+    TriangleLight light = loadTriangleLight(id);
+    vec3 radiance = sampleTriangleLight(light, ref, wi, dist, pdf, jacobian, bary, r.zw);
+
+    misPdf = pdf * luminance(light.radiance) * light.area / uLightSampleTable[0].prob;
+    pdf = (resv.weight > 0.0) ? pdf / resv.weight : 0.0;
+
+    return radiance;
+}
+
+vec3 sampleLightReGIR(vec3 ref, out vec3 wi, out float dist, out float pdf, out float misPdf, vec4 r) {
+    uint cellIdx = ReGIREnabled() ? ReGIRCellIndex(uReGIRHeader, ref) : ReGIRInvalidCell;
+    float envProb = environmentSelectProb();
+
+    if (cellIdx == ReGIRInvalidCell || r.x < envProb) {
+        vec3 radiance = sampleLight(ref, wi, dist, pdf, r);
+        misPdf = pdf;
+        return radiance;
+    }
+    r.x = (r.x - envProb) / (1.0 - envProb);
+
+    float jacobian;
+    vec2 bary;
+    uint id;
+    vec3 radiance = sampleLightReGIR(ref, wi, dist, pdf, misPdf, jacobian, bary, id, r);
+
+    TriangleLight light = loadTriangleLight(id);
+    misPdf = triangleLightPdf(ref, id, dist, absDot(vec3(light.nx, light.ny, light.nz), wi));
+    pdf *= 1.0 - envProb;
+
+    return radiance;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TRIANGLE_LIGHT_GLSL
+#define TRIANGLE_LIGHT_GLSL
+
+#include "layouts.glsl"
+
+/*
+* Decoding of PackedTriangleLight, the CPU encoder is in TriangleLight.cpp / util/Packing.h
+*/
+vec3 decodeOctahedral(uint packed) {
+    vec2 p = unpackSnorm2x16(packed);
+    vec3 dir = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+
+    if (dir.z < 0.0) {
+        dir.xy = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(dir);
+}
+
+vec3 unpackRGB9E5(uint packed) {
+    uvec3 rgb = uvec3(packed, packed >> 9, packed >> 18) & 0x1ffu;
+    return vec3(rgb) * exp2(float(int(packed >> 27) - 24));
+}
+
+TriangleLight loadTriangleLight(uint id) {
+    PackedTriangleLight packed = uTriangleLights[id];
+
+    vec2 e0 = unpackHalf2x16(packed.edges[0]);
+    vec2 e1 = unpackHalf2x16(packed.edges[1]);
+    vec2 e2 = unpackHalf2x16(packed.edges[2]);
+    vec3 edge1 = vec3(e0, e1.x);
+    vec3 edge2 = vec3(e1.y, e2);
+    vec3 norm = decodeOctahedral(packed.normal);
+
+    TriangleLight light;
+    light.v0 = packed.v0;
+    light.v1 = packed.v0 + edge1;
+    light.v2 = packed.v0 + edge2;
+    light.nx = norm.x;
+    light.ny = norm.y;
+    light.nz = norm.z;
+    light.radiance = unpackRGB9E5(packed.radiance);
+    light.area = 0.5 * length(cross(edge1, edge2));
+
+    return light;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef VIRTUAL_TEXTURE_GLSL
+#define VIRTUAL_TEXTURE_GLSL
+
+#include "layouts.glsl"
+
+// Ray traced lookups have no screen-space derivatives, so they request a coarser mip
+const float VirtualTextureRayLod = 2.0;
+
+uint packVirtualTextureTile(uint texIdx, uint mip, uvec2 tile) {
+    return (texIdx << 20) | (mip << 16) | (tile.y << 8) | tile.x;
+}
+
+bool isVirtualTexture(uint texIdx) {
+    return uVirtualTextureInfos[texIdx].numMips > 0;
+}
+
+uvec2 virtualTextureMipSize(VirtualTextureInfo info, uint mip) {
+    return max(uvec2(info.width, info.height) >> mip, uvec2(1));
+}
+
+uvec2 virtualTextureTiles(VirtualTextureInfo info, uint mip) {
+    return (virtualTextureMipSize(info, mip) + VirtualTextureTileSize - 1) / VirtualTextureTileSize;
+}
+
+uint virtualTexturePageIndex(VirtualTextureInfo info, uint mip, uvec2 tile) {
+    uint offset = info.pageOffset;
+
+    for (uint i = 0; i < mip; i++) {
+        uvec2 tiles = virtualTextureTiles(info, i);
+        offset += tiles.x * tiles.y;
+    }
+    return offset + tile.y * virtualTextureTiles(info, mip).x + tile.x;
+}
+
+void virtualTextureRequest(uint key) {
+    // Identical requests always land in the same slot, and the per-frame seed reshuffles
+    //   which of two colliding requests survives
+    uint slot = ((key * 0x9e3779b1u) ^ uCamera.seed) % VirtualTextureFeedbackSize;
+    uVirtualTextureFeedback[slot] = key;
+}
+
+float virtualTextureLod(uint texIdx, vec2 duvdx, vec2 duvdy) {
+    VirtualTextureInfo info = uVirtualTextureInfos[texIdx];
+    vec2 size = vec2(info.width, info.height);
+    return log2(max(length(duvdx * size), length(duvdy * size)));
+}
+
+vec4 sampleVirtualTexture(uint texIdx, vec2 uv, float lod) {
+    VirtualTextureInfo info = uVirtualTextureInfos[texIdx];
+    uv = fract(uv);
+
+    uint mip = uint(clamp(lod, 0.0, float(info.numMips - 1)));
+    uvec2 tile = min(uvec2(uv * vec2(virtualTextureMipSize(info, mip))) / VirtualTextureTileSize, virtualTextureTiles(info, mip) - 1);
+    virtualTextureRequest(packVirtualTextureTile(texIdx, mip, tile));
+
+    uint slot = VirtualTextureInvalidPage;
+
+    // Fall back to coarser mips until a resident tile is found, the coarsest is always pinned
+    for (; mip < info.numMips; mip++) {
+        tile = min(uvec2(uv * vec2(virtualTextureMipSize(info, mip))) / VirtualTextureTileSize, virtualTextureTiles(info, mip) - 1);
+        slot = uVirtualPageTable[virtualTexturePageIndex(info, mip, tile)];
+
+        if (slot != VirtualTextureInvalidPage) {
+            break;
+        }
+    }
+
+    if (slot == VirtualTextureInvalidPage) {
+        return vec4(1.0, 0.0, 1.0, 1.0);
+    }
+    uint atlasTiles = uint(textureSize(uVirtualTextureAtlas, 0).x) / VirtualTexturePaddedTileSize;
+    vec2 local = uv * vec2(virtualTextureMipSize(info, mip)) - vec2(tile * VirtualTextureTileSize);
+    vec2 atlasCoord = vec2(uvec2(slot % atlasTiles, slot / atlasTiles) * VirtualTexturePaddedTileSize + VirtualTextureTileBorder) + local;
+
+    return textureLod(uVirtualTextureAtlas, atlasCoord / vec2(textureSize(uVirtualTextureAtlas, 0)), 0.0);
+}
+
+#endif
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
+#include <numeric>
+#include <thread>
 #include <vector>
 
 template<typename T>
@@ -17,116 +20,480 @@ template<typename T>
 struct DiscreteSampler1D {
 	using DistribT = BinomialDistrib<T>;
 
+	// Below this many items per thread the cost of spawning threads dominates
+	static constexpr uint32_t MinItemsPerThread = 1 << 15;
+
 	DiscreteSampler1D() = default;
 
-	DiscreteSampler1D(std::vector<T> distribution) {
+	DiscreteSampler1D(const std::vector<T>& distribution) {
 		build(distribution);
 	}
 
-	void build(std::vector<T> distribution) {
-		binomDistribs.resize(distribution.size() + 1);
-		T sumAll = static_cast<T>(0);
+	void build(const std::vector<T>& distribution) {
+		build(distribution, std::thread::hardware_concurrency());
+	}
+
+	/**
+	* Parallel sweeping construction (Hübschle-Schneider & Sanders, "Parallel Weighted Random Sampling").
+	*   Items are split into light (weight <= mean) and heavy ones, and the sequential sweep that pairs
+	*   them is cut at points found by binary searching prefix sums, so every thread can fill its
+	*   share of the table independently. All sums are accumulated in double
+	*/
+	void build(const std::vector<T>& distribution, uint32_t numThreads) {
+		const uint32_t n = static_cast<uint32_t>(distribution.size());
+		binomDistribs.resize(n + 1);
 
-		for (const auto& val : distribution) {
-			sumAll += val;
+		if (n == 0) {
+			binomDistribs[0] = { static_cast<T>(0), 0 };
+			return;
 		}
-		T sumInv = static_cast<T>(distribution.size()) / sumAll;
+		numThreads = std::clamp(numThreads, 1u, (n + MinItemsPerThread - 1) / MinItemsPerThread);
 
-		for (auto& val : distribution) {
-			val *= sumInv;
-		}
+		std::vector<double> partialSums(numThreads);
 
-		std::vector<DistribT> stackGtOne(distribution.size() * 2);
-		std::vector<DistribT> stackLsOne(distribution.size() * 2);
-		int topGtOne = 0;
-		int topLsOne = 0;
+		parallelFor(n, numThreads, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+			double sum = 0.0;
+			for (uint32_t i = begin; i < end; i++) {
+				sum += static_cast<double>(distribution[i]);
+			}
+			partialSums[thread] = sum;
+		});
+		double sumAll = std::accumulate(partialSums.begin(), partialSums.end(), 0.0);
 
-		for (uint32_t i = 0; i < distribution.size(); i++) {
-			auto& val = distribution[i];
-			(val > static_cast<T>(1) ? stackGtOne[topGtOne++] : stackLsOne[topLsOne++]) = DistribT{ val, i + 1 };
+		if (sumAll <= 0.0) {
+			// Nothing to importance sample, fall back to a uniform table that never aliases
+			for (uint32_t i = 0; i < n; i++) {
+				binomDistribs[i + 1] = DistribT{ static_cast<T>(1), i + 1 };
+			}
+			binomDistribs[0] = { static_cast<T>(0), n };
+			return;
 		}
+		double scale = static_cast<double>(n) / sumAll;
 
-		while (topGtOne && topLsOne) {
-			DistribT gt = stackGtOne[--topGtOne];
-			DistribT ls = stackLsOne[--topLsOne];
+		auto weight = [&](uint32_t idx) {
+			return static_cast<double>(distribution[idx]) * scale;
+		};
 
-			binomDistribs[ls.failId] = DistribT{ ls.prob, gt.failId };
-			// Place ls in the table, and "fill" the rest of probability with gt.prob
-			gt.prob -= (static_cast<T>(1) - ls.prob);
-			// See if gt.prob is still greater than 1 that it needs more iterations to
-			//   be splitted to different binomial distributions
-			(gt.prob > static_cast<T>(1) ? stackGtOne[topGtOne++] : stackLsOne[topLsOne++]) = gt;
-		}
+		// Stable partition into light and heavy items
+		std::vector<uint32_t> numLightInChunk(numThreads + 1, 0);
+		std::vector<uint32_t> numHeavyInChunk(numThreads + 1, 0);
 
-		for (int i = topGtOne - 1; i >= 0; i--) {
-			DistribT gt = stackGtOne[i];
-			binomDistribs[gt.failId] = gt;
-		}
+		parallelFor(n, numThreads, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+			for (uint32_t i = begin; i < end; i++) {
+				(weight(i) > 1.0 ? numHeavyInChunk : numLightInChunk)[thread + 1]++;
+			}
+		});
+		std::partial_sum(numLightInChunk.begin(), numLightInChunk.end(), numLightInChunk.begin());
+		std::partial_sum(numHeavyInChunk.begin(), numHeavyInChunk.end(), numHeavyInChunk.begin());
+
+		const uint32_t numLight = numLightInChunk[numThreads];
+		const uint32_t numHeavy = numHeavyInChunk[numThreads];
+		std::vector<uint32_t> light(numLight);
+		std::vector<uint32_t> heavy(numHeavy);
+
+		parallelFor(n, numThreads, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+			uint32_t lightTop = numLightInChunk[thread];
+			uint32_t heavyTop = numHeavyInChunk[thread];
+
+			for (uint32_t i = begin; i < end; i++) {
+				if (weight(i) > 1.0) {
+					heavy[heavyTop++] = i;
+				}
+				else {
+					light[lightTop++] = i;
+				}
+			}
+		});
+
+		std::vector<double> lightPrefix = prefixSum(light, weight, numThreads);
+		std::vector<double> heavyPrefix = prefixSum(heavy, weight, numThreads);
+
+		// Mass that the first i + j table entries took beyond what the first i light and the first j
+		//   heavy items own, i.e. how much of heavy item j has been handed out
+		auto spill = [&](uint32_t i, uint32_t j) {
+			return static_cast<double>(i) + static_cast<double>(j) - lightPrefix[i] - heavyPrefix[j];
+		};
 
-		for (int i = topLsOne - 1; i >= 0; i--) {
-			DistribT ls = stackLsOne[i];
-			binomDistribs[ls.failId] = ls;
+		// Sweep state after the first `cells` table entries have been completed
+		auto findSplit = [&](uint64_t cells) -> std::pair<uint32_t, uint32_t> {
+			uint32_t lo = static_cast<uint32_t>(cells > numHeavy ? cells - numHeavy : 0);
+			uint32_t hi = static_cast<uint32_t>(std::min<uint64_t>(cells, numLight));
+
+			while (lo < hi) {
+				uint32_t mid = lo + (hi - lo) / 2;
+				(spill(mid, static_cast<uint32_t>(cells - mid)) >= 0.0) ? hi = mid : lo = mid + 1;
+			}
+			return { lo, static_cast<uint32_t>(cells - lo) };
+		};
+
+		std::vector<std::pair<uint32_t, uint32_t>> splits(numThreads + 1);
+
+		for (uint32_t t = 0; t < numThreads; t++) {
+			splits[t] = findSplit(static_cast<uint64_t>(n) * t / numThreads);
 		}
-		binomDistribs[0] = { sumAll, static_cast<uint32_t>(distribution.size()) };
+		splits[numThreads] = { numLight, numHeavy };
+
+		parallelFor(numThreads, numThreads, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+			auto [i, j] = splits[thread];
+			auto [iEnd, jEnd] = splits[thread + 1];
+
+			while (i < iEnd || j < jEnd) {
+				// Near ties the rounded spill can disagree with the split search, the split points win
+				bool finishHeavy = (i == iEnd) ? true : (j == jEnd) ? false : spill(i, j + 1) >= 0.0;
+
+				if (finishHeavy) {
+					// The heavy item has dropped to at most 1 and borrows the rest from the next heavy one
+					bool isLast = (j + 1 == numHeavy);
+					double residual = 1.0 - spill(i, j + 1);
+					binomDistribs[heavy[j] + 1] = DistribT{
+						isLast ? static_cast<T>(1) : static_cast<T>(std::clamp(residual, 0.0, 1.0)),
+						(isLast ? heavy[j] : heavy[j + 1]) + 1
+					};
+					j++;
+				}
+				else {
+					bool hasHeavy = (j < numHeavy);
+					binomDistribs[light[i] + 1] = DistribT{
+						hasHeavy ? static_cast<T>(weight(light[i])) : static_cast<T>(1),
+						(hasHeavy ? heavy[j] : light[i]) + 1
+					};
+					i++;
+				}
+			}
+		});
+		binomDistribs[0] = { static_cast<T>(sumAll), n };
 	}
 
 	void clear() {
 		binomDistribs.clear();
 	}
 
-	uint32_t sample(float r1, float r2) {
-		uint32_t passId = uint32_t(float(binomDistribs.size()) * r1);
-		DistribT distrib = binomDistribs[passId];
-		return (r2 < distrib.prob) ? passId : distrib.failId;
+	uint32_t size() const {
+		return binomDistribs.empty() ? 0 : binomDistribs[0].failId;
+	}
+
+	uint32_t sample(float r1, float r2) const {
+		uint32_t passId = std::min(static_cast<uint32_t>(static_cast<float>(size()) * r1), size() - 1);
+		DistribT distrib = binomDistribs[passId + 1];
+		return (r2 < distrib.prob) ? passId : distrib.failId - 1;
 	}
 
 	std::vector<DistribT> binomDistribs;
+
+private:
+	template<typename Func>
+	static void parallelFor(uint32_t count, uint32_t numThreads, Func&& func) {
+		if (numThreads <= 1) {
+			func(0, count, 0);
+			return;
+		}
+		std::vector<std::thread> threads(numThreads);
+
+		for (uint32_t i = 0; i < numThreads; i++) {
+			uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * i / numThreads);
+			uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (i + 1) / numThreads);
+			threads[i] = std::thread(func, begin, end, i);
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+	template<typename WeightFunc>
+	static std::vector<double> prefixSum(const std::vector<uint32_t>& items, WeightFunc weight, uint32_t numThreads) {
+		const uint32_t count = static_cast<uint32_t>(items.size());
+		std::vector<double> prefix(count + 1);
+		std::vector<double> chunkOffsets(numThreads + 1, 0.0);
+
+		parallelFor(count, numThreads, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+			double sum = 0.0;
+			for (uint32_t i = begin; i < end; i++) {
+				sum += weight(items[i]);
+			}
+			chunkOffsets[thread + 1] = sum;
+		});
+		std::partial_sum(chunkOffsets.begin(), chunkOffsets.end(), chunkOffsets.begin());
+
+		parallelFor(count, numThreads, [&](uint32_t begin, uint32_t end, uint32_t thread) {
+			double sum = chunkOffsets[thread];
+			for (uint32_t i = begin; i < end; i++) {
+				prefix[i] = sum;
+				sum += weight(items[i]);
+			}
+		});
+		prefix[count] = chunkOffsets[numThreads];
+		return prefix;
+	}
 };
 
+/**
+* Row-then-column sampler of a 2D distribution. Every alias table is stored in one flat array so
+*   that the whole sampler can be uploaded as a single buffer:
+*   [0]                                   { sumAll, width }
+*   [1]                                   { 0, height }
+*   [RowTableOffset, + height + 1)        row table, header included
+*   [columnTableOffset(row), + width + 1) column table of that row, header included
+*/
 template<typename T>
 struct DiscreteSampler2D {
 	using DistribT = BinomialDistrib<T>;
 
+	static constexpr uint32_t RowTableOffset = 2;
+
 	DiscreteSampler2D() = default;
 
-	DiscreteSampler2D(const T* data, int width, int height) {
-		columnSamplers.resize(height);
-		std::vector<T> sumRows(height);
-		std::vector<T> rowData(width);
+	DiscreteSampler2D(const T* data, uint32_t width, uint32_t height) {
+		build(data, width, height);
+	}
 
-		for (int i = 0; i < height; i++) {
-			for (int j = 0; j < width; j++) {
-				sumRows[i] += data[i * width + j];
-			}
-			float sumRowInv = static_cast<T>(1) / sumRows[i];
+	void build(const T* data, uint32_t width, uint32_t height) {
+		build(data, width, height, std::thread::hardware_concurrency());
+	}
+
+	void build(const T* data, uint32_t width, uint32_t height, uint32_t numThreads) {
+		this->width = width;
+		this->height = height;
+		table.resize(columnTableOffset(height));
 
-			for (int j = 0; j < width; j++) {
-				rowData[j] = data[i * width + j] * sumRowInv;
+		numThreads = std::clamp(numThreads, 1u, height);
+		std::vector<double> sumRows(height);
+		std::vector<std::thread> threads(numThreads);
+
+		// Rows are small enough to be built serially, the parallelism comes from building many at once
+		auto buildRows = [&](uint32_t begin, uint32_t end) {
+			DiscreteSampler1D<T> rowSampler;
+			std::vector<T> rowData(width);
+
+			for (uint32_t i = begin; i < end; i++) {
+				rowData.assign(data + size_t(i) * width, data + size_t(i + 1) * width);
+				rowSampler.build(rowData, 1);
+				sumRows[i] = static_cast<double>(rowSampler.binomDistribs[0].prob);
+				std::copy(rowSampler.binomDistribs.begin(), rowSampler.binomDistribs.end(), table.begin() + columnTableOffset(i));
 			}
-			columnSamplers[i] = DiscreteSampler1D<T>(rowData);
-			sumAll += sumRows[i];
+		};
+
+		for (uint32_t i = 0; i < numThreads; i++) {
+			uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(height) * i / numThreads);
+			uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(height) * (i + 1) / numThreads);
+			threads[i] = std::thread(buildRows, begin, end);
+		}
+		for (auto& thread : threads) {
+			thread.join();
 		}
 
-		T sumAllInv = static_cast<T>(1) / sumAll;
-		for (int i = 0; i < height; i++) {
-			sumRows[i] *= sumAllInv;
+		DiscreteSampler1D<double> rowSampler;
+		rowSampler.build(sumRows, numThreads);
+
+		for (uint32_t i = 0; i <= height; i++) {
+			const auto& distrib = rowSampler.binomDistribs[i];
+			table[RowTableOffset + i] = DistribT{ static_cast<T>(distrib.prob), distrib.failId };
 		}
-		rowSampler = DiscreteSampler1D<T>(sumRows);
+		sumAll = static_cast<T>(rowSampler.binomDistribs[0].prob);
+
+		table[0] = { sumAll, width };
+		table[1] = { static_cast<T>(0), height };
 	}
 
 	void clear() {
-		columnSamplers.clear();
-		rowSampler.clear();
+		table.clear();
 		sumAll = static_cast<T>(0);
 	}
 
-	std::pair<uint32_t, uint32_t> sample(float r1, float r2, float r3, float r4) {
-		uint32_t row = rowSampler.sample(r1, r2);
-		uint32_t column = columnSamplers[row].sample(r3, r4);
+	uint32_t columnTableOffset(uint32_t row) const {
+		return RowTableOffset + (height + 1) + row * (width + 1);
+	}
+
+	std::pair<uint32_t, uint32_t> sample(float r1, float r2, float r3, float r4) const {
+		uint32_t row = sampleTable(RowTableOffset, height, r1, r2);
+		uint32_t column = sampleTable(columnTableOffset(row), width, r3, r4);
 		return { row, column };
 	}
 
-	std::vector<DiscreteSampler1D<T>> columnSamplers;
-	DiscreteSampler1D<T> rowSampler;
+	std::vector<DistribT> table;
+	uint32_t width = 0;
+	uint32_t height = 0;
 	T sumAll = static_cast<T>(0);
-};
\ No newline at end of file
+
+private:
+	uint32_t sampleTable(uint32_t offset, uint32_t size, float r1, float r2) const {
+		uint32_t passId = std::min(static_cast<uint32_t>(static_cast<float>(size) * r1), size - 1);
+		DistribT distrib = table[offset + passId + 1];
+		return (r2 < distrib.prob) ? passId : distrib.failId - 1;
+	}
+};
+
+/**
+* Two-level alias table for distributions whose weights change at runtime. Items are grouped into
+*   blocks of BlockSize, each with its own alias table, and a block table picks blocks by their sums.
+*   Changing weights only rebuilds the affected blocks and the block table. Flat layout:
+*   [0]                                        { sumAll, numItems }
+*   [1]                                        { 0, numBlocks }
+*   [BlockTableOffset, + numBlocks + 1)        block table, header included
+*   [itemTableOffset(block), + BlockSize + 1)  item table of that block, header included, local failIds
+*/
+template<typename T, uint32_t BlockSize>
+struct BlockDiscreteSampler {
+	using DistribT = BinomialDistrib<T>;
+
+	static constexpr uint32_t BlockTableOffset = 2;
+
+	// Ranges of table entries, [begin, end)
+	using Range = std::pair<uint32_t, uint32_t>;
+
+	BlockDiscreteSampler() = default;
+
+	BlockDiscreteSampler(const std::vector<T>& distribution) {
+		build(distribution);
+	}
+
+	void build(const std::vector<T>& distribution) {
+		weights = distribution;
+		numItems = static_cast<uint32_t>(distribution.size());
+		numBlocks = std::max((numItems + BlockSize - 1) / BlockSize, 1u);
+		table.assign(itemTableOffset(numBlocks), DistribT{ static_cast<T>(0), 0 });
+		blockSums.assign(numBlocks, 0.0);
+		mDirtyBlocks.assign(numBlocks, false);
+		mDirtyList.clear();
+
+		uint32_t numThreads = std::clamp(std::thread::hardware_concurrency(), 1u, numBlocks);
+		std::vector<std::thread> threads(numThreads);
+
+		auto buildBlocks = [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				buildBlock(i);
+			}
+		};
+
+		for (uint32_t i = 0; i < numThreads; i++) {
+			uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(numBlocks) * i / numThreads);
+			uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(numBlocks) * (i + 1) / numThreads);
+			threads[i] = std::thread(buildBlocks, begin, end);
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		buildBlockTable();
+	}
+
+	// Changes are batched until commit()
+	void update(uint32_t idx, T weight) {
+		weights[idx] = weight;
+		uint32_t block = idx / BlockSize;
+
+		if (!mDirtyBlocks[block]) {
+			mDirtyBlocks[block] = true;
+			mDirtyList.push_back(block);
+		}
+	}
+
+	/**
+	* Rebuilds dirty blocks and the block table. Cost is O(BlockSize) per dirty block plus
+	*   O(numItems / BlockSize) for the block table. Returns the table ranges that changed, merged
+	*/
+	std::vector<Range> commit() {
+		std::vector<Range> ranges;
+
+		if (mDirtyList.empty()) {
+			return ranges;
+		}
+		std::sort(mDirtyList.begin(), mDirtyList.end());
+
+		for (uint32_t block : mDirtyList) {
+			buildBlock(block);
+			mDirtyBlocks[block] = false;
+		}
+		buildBlockTable();
+		ranges.push_back({ 0, itemTableOffset(0) });
+
+		for (uint32_t block : mDirtyList) {
+			Range range = { itemTableOffset(block), itemTableOffset(block + 1) };
+
+			if (ranges.back().second == range.first) {
+				ranges.back().second = range.second;
+			}
+			else {
+				ranges.push_back(range);
+			}
+		}
+		mDirtyList.clear();
+		return ranges;
+	}
+
+	void clear() {
+		table.clear();
+		weights.clear();
+		blockSums.clear();
+		mDirtyBlocks.clear();
+		mDirtyList.clear();
+		numItems = 0;
+		numBlocks = 0;
+	}
+
+	uint32_t size() const {
+		return numItems;
+	}
+
+	T sum() const {
+		return table.empty() ? static_cast<T>(0) : table[0].prob;
+	}
+
+	uint32_t itemTableOffset(uint32_t block) const {
+		return BlockTableOffset + (numBlocks + 1) + block * (BlockSize + 1);
+	}
+
+	// Must match sampleLightTable in light_sampling.glsl. The leftovers of both random numbers after
+	//   picking the block are reused to pick the item inside it
+	uint32_t sample(float r1, float r2) const {
+		uint32_t block = sampleTable(BlockTableOffset, r1, r2);
+		return block * BlockSize + sampleTable(itemTableOffset(block), r1, r2);
+	}
+
+	std::vector<DistribT> table;
+	std::vector<T> weights;
+	std::vector<double> blockSums;
+	uint32_t numItems = 0;
+	uint32_t numBlocks = 0;
+
+private:
+	void buildBlock(uint32_t block) {
+		uint32_t begin = block * BlockSize;
+		uint32_t end = std::min(begin + BlockSize, numItems);
+
+		DiscreteSampler1D<T> sampler;
+		sampler.build(std::vector<T>(weights.begin() + begin, weights.begin() + std::max(begin, end)), 1);
+
+		std::copy(sampler.binomDistribs.begin(), sampler.binomDistribs.end(), table.begin() + itemTableOffset(block));
+		blockSums[block] = static_cast<double>(sampler.binomDistribs[0].prob);
+	}
+
+	void buildBlockTable() {
+		DiscreteSampler1D<double> sampler;
+		sampler.build(blockSums, 1);
+
+		for (uint32_t i = 0; i <= numBlocks; i++) {
+			const auto& distrib = sampler.binomDistribs[i];
+			table[BlockTableOffset + i] = DistribT{ static_cast<T>(distrib.prob), distrib.failId };
+		}
+		table[0] = { static_cast<T>(sampler.binomDistribs[0].prob), numItems };
+		table[1] = { static_cast<T>(0), numBlocks };
+	}
+
+	uint32_t sampleTable(uint32_t offset, float& r1, float& r2) const {
+		uint32_t size = std::max(table[offset].failId, 1u);
+		float scaled = static_cast<float>(size) * r1;
+		uint32_t passId = std::min(static_cast<uint32_t>(scaled), size - 1);
+		DistribT distrib = table[offset + passId + 1];
+
+		r1 = std::min(scaled - static_cast<float>(passId), 0x1.fffffep-1f);
+
+		if (r2 < distrib.prob) {
+			r2 = r2 / distrib.prob;
+			return passId;
+		}
+		r2 = std::min((r2 - distrib.prob) / (1.f - distrib.prob), 0x1.fffffep-1f);
+		return distrib.failId - 1;
+	}
+
+	std::vector<bool> mDirtyBlocks;
+	std::vector<uint32_t> mDirtyList;
+};
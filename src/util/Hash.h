@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "NamespaceDecl.h"
+
+NAMESPACE_BEGIN(util)
+
+constexpr uint64_t FNV1aBasis = 0xcbf29ce484222325ull;
+
+// 64-bit FNV-1a, chained through seed. For cache keys and corruption checks, not security
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t seed = FNV1aBasis) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+inline uint64_t fnv1a(std::string_view str, uint64_t seed = FNV1aBasis) {
+	return fnv1a(str.data(), str.size(), seed);
+}
+
+NAMESPACE_END(util)
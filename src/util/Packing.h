@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "NamespaceDecl.h"
+
+/**
+* Host counterparts of the GLSL packing functions used by compressed GPU data. Decoders must
+*   give the same results as the GLSL builtins (unpackHalf2x16, unpackSnorm2x16)
+*/
+
+NAMESPACE_BEGIN(util)
+
+// IEEE 754 binary16 with round to nearest even
+inline uint16_t floatToHalf(float value) {
+	uint32_t bits = std::bit_cast<uint32_t>(value);
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t absBits = bits & 0x7fffffff;
+
+	if (absBits >= 0x7f800000) {
+		return static_cast<uint16_t>(sign | 0x7c00 | ((absBits > 0x7f800000) ? 0x200 : 0));
+	}
+	if (absBits >= 0x47800000) {
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+	if (absBits < 0x38800000) {
+		if (absBits < 0x33000000) {
+			return static_cast<uint16_t>(sign);
+		}
+		uint32_t mantissa = (absBits & 0x7fffff) | 0x800000;
+		uint32_t shift = 126 - (absBits >> 23);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+
+		if (rest > halfway || (rest == halfway && (half & 1))) {
+			half++;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+	uint32_t half = (absBits - 0x38000000) >> 13;
+	uint32_t rest = absBits & 0x1fff;
+
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+		half++;
+	}
+	return static_cast<uint16_t>(sign | half);
+}
+
+inline float halfToFloat(uint16_t half) {
+	uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+
+	if (exponent == 0) {
+		float value = std::ldexp(static_cast<float>(mantissa), -24);
+		return sign ? -value : value;
+	}
+	if (exponent == 31) {
+		return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+	}
+	return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+inline uint32_t packHalf2x16(float x, float y) {
+	return static_cast<uint32_t>(floatToHalf(x)) | (static_cast<uint32_t>(floatToHalf(y)) << 16);
+}
+
+inline float unpackHalfLow(uint32_t packed) {
+	return halfToFloat(static_cast<uint16_t>(packed & 0xffff));
+}
+
+inline float unpackHalfHigh(uint32_t packed) {
+	return halfToFloat(static_cast<uint16_t>(packed >> 16));
+}
+
+inline uint32_t packSnorm2x16(float x, float y) {
+	auto pack = [](float v) {
+		return static_cast<uint32_t>(static_cast<int16_t>(std::round(std::clamp(v, -1.f, 1.f) * 32767.f))) & 0xffff;
+	};
+	return pack(x) | (pack(y) << 16);
+}
+
+inline float unpackSnormLow(uint32_t packed) {
+	return std::clamp(static_cast<float>(static_cast<int16_t>(packed & 0xffff)) / 32767.f, -1.f, 1.f);
+}
+
+inline float unpackSnormHigh(uint32_t packed) {
+	return std::clamp(static_cast<float>(static_cast<int16_t>(packed >> 16)) / 32767.f, -1.f, 1.f);
+}
+
+// Octahedral unit vector (Cigolle et al. 2014) in two snorm16, must match decodeOctahedral in triangle_light.glsl
+inline uint32_t encodeOctahedral(const glm::vec3& dir) {
+	float sum = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+
+	if (!(sum > 0.f)) {
+		return packSnorm2x16(0.f, 0.f);
+	}
+	float u = dir.x / sum;
+	float v = dir.y / sum;
+
+	if (dir.z < 0.f) {
+		float foldedU = (1.f - std::abs(v)) * (u >= 0.f ? 1.f : -1.f);
+		float foldedV = (1.f - std::abs(u)) * (v >= 0.f ? 1.f : -1.f);
+		u = foldedU;
+		v = foldedV;
+	}
+	return packSnorm2x16(u, v);
+}
+
+inline glm::vec3 decodeOctahedral(uint32_t packed) {
+	float u = unpackSnormLow(packed);
+	float v = unpackSnormHigh(packed);
+	glm::vec3 dir(u, v, 1.f - std::abs(u) - std::abs(v));
+
+	if (dir.z < 0.f) {
+		dir.x = (1.f - std::abs(v)) * (u >= 0.f ? 1.f : -1.f);
+		dir.y = (1.f - std::abs(u)) * (v >= 0.f ? 1.f : -1.f);
+	}
+	return glm::normalize(dir);
+}
+
+// Shared exponent RGB with 9 bit mantissas and a 5 bit exponent, as in GL_EXT_texture_shared_exponent
+inline uint32_t packRGB9E5(const glm::vec3& color) {
+	constexpr float MaxValue = 511.f / 512.f * 65536.f;
+
+	float r = std::clamp(color.x, 0.f, MaxValue);
+	float g = std::clamp(color.y, 0.f, MaxValue);
+	float b = std::clamp(color.z, 0.f, MaxValue);
+	float maxChannel = std::max({ r, g, b });
+
+	int exponent;
+	std::frexp(std::max(maxChannel, 1.f / 65536.f), &exponent);
+	exponent += 15;
+	float denom = std::ldexp(1.f, exponent - 24);
+
+	if (std::floor(maxChannel / denom + .5f) >= 512.f) {
+		exponent++;
+		denom *= 2.f;
+	}
+	auto mantissa = [&](float v) { return static_cast<uint32_t>(std::floor(v / denom + .5f)); };
+	return mantissa(r) | (mantissa(g) << 9) | (mantissa(b) << 18) | (static_cast<uint32_t>(exponent) << 27);
+}
+
+inline glm::vec3 unpackRGB9E5(uint32_t packed) {
+	float scale = std::ldexp(1.f, static_cast<int>(packed >> 27) - 24);
+	return glm::vec3(
+		static_cast<float>(packed & 0x1ff),
+		static_cast<float>((packed >> 9) & 0x1ff),
+		static_cast<float>((packed >> 18) & 0x1ff)
+	) * scale;
+}
+
+NAMESPACE_END(util)
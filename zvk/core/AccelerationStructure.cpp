@@ -12,33 +12,7 @@ AccelerationStructure::AccelerationStructure(
 {
     std::vector<vk::AccelerationStructureGeometryKHR> geometries;
     std::vector<vk::AccelerationStructureBuildRangeInfoKHR> buildRangeInfos;
-
-    for (const auto& mesh : triangleMeshes) {
-        auto triangleData = vk::AccelerationStructureGeometryTrianglesDataKHR()
-            .setVertexData(mesh.vertexAddress)
-            .setVertexFormat(mesh.vertexFormat)
-            .setVertexStride(mesh.vertexStride)
-            .setMaxVertex(mesh.maxVertex)
-            .setIndexData(mesh.indexAddress)
-            .setIndexType(mesh.indexType);
-
-        auto geometryData = vk::AccelerationStructureGeometryDataKHR()
-            .setTriangles(triangleData);
-
-        auto geometry = vk::AccelerationStructureGeometryKHR()
-            .setGeometry(geometryData)
-            .setGeometryType(vk::GeometryTypeKHR::eTriangles)
-            .setFlags(vk::GeometryFlagBitsKHR::eNoDuplicateAnyHitInvocation);
-
-        auto buildRange = vk::AccelerationStructureBuildRangeInfoKHR()
-            .setPrimitiveCount(mesh.numIndices / 3)
-            .setPrimitiveOffset(0)
-            .setFirstVertex(0)
-            .setTransformOffset(0);
-
-        geometries.push_back(geometry);
-        buildRangeInfos.push_back(buildRange);
-    }
+    triangleGeometries(triangleMeshes, geometries, buildRangeInfos);
 
     buildAccelerationStructure(queueIdx, geometries, buildRangeInfos, flags);
 }
@@ -76,6 +50,39 @@ AccelerationStructure::AccelerationStructure(
     buildAccelerationStructure(queueIdx, geometry, buildRangeInfo, flags);
 }
 
+void AccelerationStructure::triangleGeometries(
+    const vk::ArrayProxy<const AccelerationStructureTriangleMesh>& triangleMeshes,
+    std::vector<vk::AccelerationStructureGeometryKHR>& geometries,
+    std::vector<vk::AccelerationStructureBuildRangeInfoKHR>& buildRangeInfos
+) {
+    for (const auto& mesh : triangleMeshes) {
+        auto triangleData = vk::AccelerationStructureGeometryTrianglesDataKHR()
+            .setVertexData(mesh.vertexAddress)
+            .setVertexFormat(mesh.vertexFormat)
+            .setVertexStride(mesh.vertexStride)
+            .setMaxVertex(mesh.maxVertex)
+            .setIndexData(mesh.indexAddress)
+            .setIndexType(mesh.indexType);
+
+        auto geometryData = vk::AccelerationStructureGeometryDataKHR()
+            .setTriangles(triangleData);
+
+        auto geometry = vk::AccelerationStructureGeometryKHR()
+            .setGeometry(geometryData)
+            .setGeometryType(vk::GeometryTypeKHR::eTriangles)
+            .setFlags(vk::GeometryFlagBitsKHR::eNoDuplicateAnyHitInvocation);
+
+        auto buildRange = vk::AccelerationStructureBuildRangeInfoKHR()
+            .setPrimitiveCount(mesh.numIndices / 3)
+            .setPrimitiveOffset(0)
+            .setFirstVertex(0)
+            .setTransformOffset(0);
+
+        geometries.push_back(geometry);
+        buildRangeInfos.push_back(buildRange);
+    }
+}
+
 void AccelerationStructure::destroy() {
     zvk::ExtFunctions::destroyAccelerationStructureKHR(mCtx->device, structure);
     mBuffer.reset();
@@ -102,15 +109,77 @@ void AccelerationStructure::buildAccelerationStructure(
         mCtx->device, vk::AccelerationStructureBuildTypeKHR::eDevice, buildGeometryInfo, maxPrimitiveCounts
     );
 
-    mBuffer = Memory::createBuffer(
-        mCtx, buildSizeInfo.accelerationStructureSize,
+    createStructure(buildSizeInfo.accelerationStructureSize);
+    uncompactedSize = size;
+
+    auto scratchBuffer = Memory::createBuffer(
+        mCtx, buildSizeInfo.buildScratchSize,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryAllocateFlagBits::eDeviceAddress
+    );
+
+    buildGeometryInfo
+        .setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
+        .setDstAccelerationStructure(structure)
+        .setScratchData(scratchBuffer->address());
+
+    bool allowCompaction = static_cast<bool>(flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction);
+    vk::QueryPool queryPool;
+
+    auto cmd = Command::createOneTimeSubmit(mCtx, queueIdx);
+
+    if (allowCompaction) {
+        queryPool = mCtx->device.createQueryPool(
+            vk::QueryPoolCreateInfo()
+                .setQueryType(vk::QueryType::eAccelerationStructureCompactedSizeKHR)
+                .setQueryCount(1)
+        );
+        cmd->cmd.resetQueryPool(queryPool, 0, 1);
+    }
+    zvk::ExtFunctions::cmdBuildAccelerationStructuresKHR(cmd->cmd, buildGeometryInfo, buildRangeInfos.data());
+
+    if (allowCompaction) {
+        auto barrier = vk::MemoryBarrier(
+            vk::AccessFlagBits::eAccelerationStructureWriteKHR, vk::AccessFlagBits::eAccelerationStructureReadKHR
+        );
+        cmd->cmd.pipelineBarrier(
+            vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+            vk::DependencyFlags{ 0 }, barrier, {}, {}
+        );
+        zvk::ExtFunctions::cmdWriteAccelerationStructuresPropertiesKHR(
+            cmd->cmd, structure, vk::QueryType::eAccelerationStructureCompactedSizeKHR, queryPool, 0
+        );
+    }
+    cmd->submitAndWait();
+
+    if (allowCompaction) {
+        auto compactedSize = mCtx->device.getQueryPoolResult<vk::DeviceSize>(
+            queryPool, 0, 1, sizeof(vk::DeviceSize), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+        ).value;
+        mCtx->device.destroyQueryPool(queryPool);
+
+        if (compactedSize > 0 && compactedSize < size) {
+            compact(queueIdx, compactedSize);
+        }
+    }
+}
+
+void AccelerationStructure::createStructure(vk::DeviceSize structureSize) {
+    auto buffer = Memory::createBuffer(
+        mCtx, structureSize,
         vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
         vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryAllocateFlagBits::eDeviceAddress
     );
+    createStructure(std::move(buffer), 0, structureSize);
+}
+
+void AccelerationStructure::createStructure(std::shared_ptr<Buffer> buffer, vk::DeviceSize offset, vk::DeviceSize structureSize) {
+    mBuffer = std::move(buffer);
 
     auto createInfo = vk::AccelerationStructureCreateInfoKHR()
         .setBuffer(mBuffer->buffer)
-        .setSize(buildSizeInfo.accelerationStructureSize)
+        .setOffset(offset)
+        .setSize(structureSize)
         .setType(type);
 
     structure = zvk::ExtFunctions::createAccelerationStructureKHR(mCtx->device, createInfo);
@@ -119,21 +188,25 @@ void AccelerationStructure::buildAccelerationStructure(
         .setAccelerationStructure(structure);
 
     address = zvk::ExtFunctions::getAccelerationStructureDeviceAddressKHR(mCtx->device, addressInfo);
+    size = structureSize;
+}
 
-    auto scratchBuffer = Memory::createBuffer(
-        mCtx, buildSizeInfo.buildScratchSize,
-        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
-        vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryAllocateFlagBits::eDeviceAddress
-    );
+void AccelerationStructure::compact(QueueIdx queueIdx, vk::DeviceSize compactedSize) {
+    auto source = structure;
+    auto sourceBuffer = std::move(mBuffer);
 
-    buildGeometryInfo
-        .setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
-        .setDstAccelerationStructure(structure)
-        .setScratchData(scratchBuffer->address());
+    createStructure(compactedSize);
+
+    auto copyInfo = vk::CopyAccelerationStructureInfoKHR()
+        .setSrc(source)
+        .setDst(structure)
+        .setMode(vk::CopyAccelerationStructureModeKHR::eCompact);
 
     auto cmd = Command::createOneTimeSubmit(mCtx, queueIdx);
-    zvk::ExtFunctions::cmdBuildAccelerationStructuresKHR(cmd->cmd, buildGeometryInfo, buildRangeInfos.data());
+    zvk::ExtFunctions::cmdCopyAccelerationStructureKHR(cmd->cmd, copyInfo);
     cmd->submitAndWait();
+
+    zvk::ExtFunctions::destroyAccelerationStructureKHR(mCtx->device, source);
 }
 
 NAMESPACE_END(zvk)
@@ -10,6 +10,7 @@
 
 NAMESPACE_BEGIN(zvk)
 
+// With indexType eNoneKHR vertices are read sequentially and numIndices is the number of vertices
 struct AccelerationStructureTriangleMesh {
     vk::DeviceAddress vertexAddress;
     vk::DeviceAddress indexAddress;
@@ -38,19 +39,41 @@ public:
     void destroy();
 
 private:
+    friend class AccelerationStructureBuilder;
+
+    // Left unbuilt, for AccelerationStructureBuilder
+    AccelerationStructure(const Context* ctx, vk::AccelerationStructureTypeKHR type) :
+        BaseVkObject(ctx), type(type) {}
+
+    static void triangleGeometries(
+        const vk::ArrayProxy<const AccelerationStructureTriangleMesh>& triangleMeshes,
+        std::vector<vk::AccelerationStructureGeometryKHR>& geometries,
+        std::vector<vk::AccelerationStructureBuildRangeInfoKHR>& buildRangeInfos);
+
+    void createStructure(vk::DeviceSize structureSize);
+
+    // Placed at offset in a buffer possibly shared with other structures
+    void createStructure(std::shared_ptr<Buffer> buffer, vk::DeviceSize offset, vk::DeviceSize structureSize);
+
     void buildAccelerationStructure(
         QueueIdx queueIdx,
         const vk::ArrayProxy<const vk::AccelerationStructureGeometryKHR>& geometries,
         const vk::ArrayProxy<const vk::AccelerationStructureBuildRangeInfoKHR>& buildRangeInfos,
         vk::BuildAccelerationStructureFlagsKHR flags);
 
+    // Copies into a structure of the queried compacted size and releases the original
+    void compact(QueueIdx queueIdx, vk::DeviceSize compactedSize);
+
 public:
     vk::AccelerationStructureKHR structure;
     vk::AccelerationStructureTypeKHR type;
     vk::DeviceAddress address;
+    vk::DeviceSize size = 0;
+    // Equal to size unless built with eAllowCompaction
+    vk::DeviceSize uncompactedSize = 0;
 
 private:
-    std::unique_ptr<Buffer> mBuffer;
+    std::shared_ptr<Buffer> mBuffer;
 };
 
 NAMESPACE_END(zvk)
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "AccelerationStructureBuilder.h"
+
+#include <algorithm>
+
+#include "Command.h"
+#include "core/ExtFunctions.h"
+#include "util/Timer.h"
+
+NAMESPACE_BEGIN(zvk)
+
+// Required alignment of vk::AccelerationStructureCreateInfoKHR::offset
+constexpr vk::DeviceSize StructureOffsetAlignment = 256;
+
+static vk::DeviceSize alignUp(vk::DeviceSize size, vk::DeviceSize alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+static bool allowsCompaction(vk::BuildAccelerationStructureFlagsKHR flags) {
+    return static_cast<bool>(flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction);
+}
+
+static std::shared_ptr<Buffer> createStorageBuffer(const Context* ctx, vk::DeviceSize size) {
+    return Memory::createBuffer(
+        ctx, size,
+        vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryAllocateFlagBits::eDeviceAddress
+    );
+}
+
+static void buildBarrier(vk::CommandBuffer cmd) {
+    auto barrier = vk::MemoryBarrier(
+        vk::AccessFlagBits::eAccelerationStructureWriteKHR,
+        vk::AccessFlagBits::eAccelerationStructureReadKHR | vk::AccessFlagBits::eAccelerationStructureWriteKHR
+    );
+    cmd.pipelineBarrier(
+        vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+        vk::DependencyFlags{ 0 }, barrier, {}, {}
+    );
+}
+
+uint32_t AccelerationStructureBuilder::add(
+    const vk::ArrayProxy<const AccelerationStructureTriangleMesh>& triangleMeshes,
+    vk::BuildAccelerationStructureFlagsKHR flags
+) {
+    BuildInput input;
+    AccelerationStructure::triangleGeometries(triangleMeshes, input.geometries, input.buildRangeInfos);
+    input.flags = flags;
+
+    mInputs.push_back(std::move(input));
+    return static_cast<uint32_t>(mInputs.size() - 1);
+}
+
+std::vector<std::unique_ptr<AccelerationStructure>> AccelerationStructureBuilder::build(QueueIdx queueIdx) {
+    Timer timer;
+    mStatistics = Statistics();
+    mStatistics.numStructures = static_cast<uint32_t>(mInputs.size());
+
+    std::vector<std::unique_ptr<AccelerationStructure>> structures;
+
+    if (mInputs.empty()) {
+        return structures;
+    }
+    uint32_t numInputs = static_cast<uint32_t>(mInputs.size());
+
+    std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildInfos(numInputs);
+    std::vector<vk::AccelerationStructureBuildSizesInfoKHR> buildSizes(numInputs);
+    std::vector<vk::DeviceSize> storageOffsets(numInputs);
+
+    // Compactable structures go to their own buffer, released once they are copied out of it
+    vk::DeviceSize storageSizes[2] = { 0, 0 };
+
+    for (uint32_t i = 0; i < numInputs; i++) {
+        const auto& input = mInputs[i];
+
+        buildInfos[i] = vk::AccelerationStructureBuildGeometryInfoKHR()
+            .setType(vk::AccelerationStructureTypeKHR::eBottomLevel)
+            .setFlags(input.flags)
+            .setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
+            .setGeometries(input.geometries);
+
+        std::vector<uint32_t> maxPrimitiveCounts;
+
+        for (const auto& buildRange : input.buildRangeInfos) {
+            maxPrimitiveCounts.push_back(buildRange.primitiveCount);
+        }
+        buildSizes[i] = zvk::ExtFunctions::getAccelerationStructureBuildSizesKHR(
+            mCtx->device, vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfos[i], maxPrimitiveCounts
+        );
+        auto& storageSize = storageSizes[allowsCompaction(input.flags)];
+        storageOffsets[i] = storageSize;
+        storageSize += alignUp(buildSizes[i].accelerationStructureSize, StructureOffsetAlignment);
+    }
+    std::shared_ptr<Buffer> storage[2];
+
+    for (int i = 0; i < 2; i++) {
+        if (storageSizes[i] > 0) {
+            storage[i] = createStorageBuffer(mCtx, storageSizes[i]);
+        }
+    }
+    std::vector<AccelerationStructure*> compactable;
+
+    for (uint32_t i = 0; i < numInputs; i++) {
+        bool compaction = allowsCompaction(mInputs[i].flags);
+
+        // Not through std::make_unique, the constructor is only accessible to this class
+        structures.emplace_back(new AccelerationStructure(mCtx, vk::AccelerationStructureTypeKHR::eBottomLevel));
+        auto structure = structures.back().get();
+
+        structure->createStructure(storage[compaction], storageOffsets[i], buildSizes[i].accelerationStructureSize);
+        structure->uncompactedSize = structure->size;
+        buildInfos[i].setDstAccelerationStructure(structure->structure);
+
+        if (compaction) {
+            compactable.push_back(structure);
+        }
+    }
+
+    // Greedy in order of add(), a build larger than the budget gets a batch of its own
+    vk::DeviceSize scratchAlignment = std::max<vk::DeviceSize>(
+        mCtx->instance()->accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment, 1
+    );
+    std::vector<std::pair<uint32_t, uint32_t>> batches;
+    std::vector<vk::DeviceSize> scratchOffsets(numInputs);
+    vk::DeviceSize batchScratch = 0;
+    vk::DeviceSize scratchSize = 0;
+    uint32_t batchBegin = 0;
+
+    for (uint32_t i = 0; i < numInputs; i++) {
+        vk::DeviceSize size = alignUp(buildSizes[i].buildScratchSize, scratchAlignment);
+
+        if (i > batchBegin && batchScratch + size > mScratchBudget) {
+            batches.push_back({ batchBegin, i });
+            batchBegin = i;
+            batchScratch = 0;
+        }
+        scratchOffsets[i] = batchScratch;
+        batchScratch += size;
+        scratchSize = std::max(scratchSize, batchScratch);
+    }
+    batches.push_back({ batchBegin, numInputs });
+
+    // Padded so that the start can be aligned, buffer addresses are not guaranteed to be
+    auto scratchBuffer = Memory::createBuffer(
+        mCtx, scratchSize + scratchAlignment,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+        vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryAllocateFlagBits::eDeviceAddress
+    );
+    vk::DeviceAddress scratchAddress = alignUp(scratchBuffer->address(), scratchAlignment);
+
+    auto cmd = Command::createOneTimeSubmit(mCtx, queueIdx);
+    vk::QueryPool queryPool;
+
+    if (!compactable.empty()) {
+        queryPool = mCtx->device.createQueryPool(
+            vk::QueryPoolCreateInfo()
+                .setQueryType(vk::QueryType::eAccelerationStructureCompactedSizeKHR)
+                .setQueryCount(static_cast<uint32_t>(compactable.size()))
+        );
+        cmd->cmd.resetQueryPool(queryPool, 0, static_cast<uint32_t>(compactable.size()));
+    }
+
+    for (size_t batch = 0; batch < batches.size(); batch++) {
+        auto [begin, end] = batches[batch];
+
+        // Builds of the previous batch used the same scratch memory
+        if (batch > 0) {
+            buildBarrier(cmd->cmd);
+        }
+        std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> buildRangeInfos;
+
+        for (uint32_t i = begin; i < end; i++) {
+            buildInfos[i].setScratchData(scratchAddress + scratchOffsets[i]);
+            buildRangeInfos.push_back(mInputs[i].buildRangeInfos.data());
+        }
+        zvk::ExtFunctions::cmdBuildAccelerationStructuresKHR(
+            cmd->cmd,
+            vk::ArrayProxy<const vk::AccelerationStructureBuildGeometryInfoKHR>(end - begin, buildInfos.data() + begin),
+            buildRangeInfos
+        );
+    }
+
+    if (!compactable.empty()) {
+        std::vector<vk::AccelerationStructureKHR> handles;
+
+        for (auto structure : compactable) {
+            handles.push_back(structure->structure);
+        }
+        buildBarrier(cmd->cmd);
+        zvk::ExtFunctions::cmdWriteAccelerationStructuresPropertiesKHR(
+            cmd->cmd, handles, vk::QueryType::eAccelerationStructureCompactedSizeKHR, queryPool, 0
+        );
+    }
+    cmd->submitAndWait();
+    scratchBuffer.reset();
+
+    mStatistics.numBatches = static_cast<uint32_t>(batches.size());
+    mStatistics.scratchSize = scratchSize;
+    mStatistics.uncompactedSize = storageSizes[0] + storageSizes[1];
+    mStatistics.storageSize = mStatistics.uncompactedSize;
+
+    if (!compactable.empty()) {
+        auto compactedSizes = mCtx->device.getQueryPoolResults<vk::DeviceSize>(
+            queryPool, 0, static_cast<uint32_t>(compactable.size()),
+            compactable.size() * sizeof(vk::DeviceSize), sizeof(vk::DeviceSize),
+            vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+        ).value;
+        mCtx->device.destroyQueryPool(queryPool);
+
+        storage[1].reset();
+        compact(queueIdx, compactable, compactedSizes);
+    }
+    mInputs.clear();
+    mStatistics.buildTimeMs = timer.get();
+    return structures;
+}
+
+void AccelerationStructureBuilder::compact(
+    QueueIdx queueIdx,
+    const std::vector<AccelerationStructure*>& structures, const std::vector<vk::DeviceSize>& compactedSizes
+) {
+    auto sourceStorage = structures.front()->mBuffer;
+
+    std::vector<vk::DeviceSize> offsets(structures.size());
+    vk::DeviceSize compactedStorageSize = 0;
+
+    for (size_t i = 0; i < structures.size(); i++) {
+        if (compactedSizes[i] > 0 && compactedSizes[i] < structures[i]->size) {
+            offsets[i] = compactedStorageSize;
+            compactedStorageSize += alignUp(compactedSizes[i], StructureOffsetAlignment);
+        }
+    }
+    if (compactedStorageSize == 0) {
+        return;
+    }
+    auto compactedStorage = createStorageBuffer(mCtx, compactedStorageSize);
+    std::vector<vk::AccelerationStructureKHR> sources;
+
+    auto cmd = Command::createOneTimeSubmit(mCtx, queueIdx);
+
+    for (size_t i = 0; i < structures.size(); i++) {
+        if (compactedSizes[i] == 0 || compactedSizes[i] >= structures[i]->size) {
+            continue;
+        }
+        auto source = structures[i]->structure;
+        structures[i]->createStructure(compactedStorage, offsets[i], compactedSizes[i]);
+
+        auto copyInfo = vk::CopyAccelerationStructureInfoKHR()
+            .setSrc(source)
+            .setDst(structures[i]->structure)
+            .setMode(vk::CopyAccelerationStructureModeKHR::eCompact);
+
+        zvk::ExtFunctions::cmdCopyAccelerationStructureKHR(cmd->cmd, copyInfo);
+        sources.push_back(source);
+    }
+    cmd->submitAndWait();
+
+    for (auto source : sources) {
+        zvk::ExtFunctions::destroyAccelerationStructureKHR(mCtx->device, source);
+    }
+    mStatistics.numCompacted = static_cast<uint32_t>(sources.size());
+    mStatistics.storageSize += compactedStorageSize;
+
+    // Released unless some structure could not be compacted and still lives in it
+    if (sourceStorage.use_count() == 1) {
+        mStatistics.storageSize -= sourceStorage->size;
+    }
+}
+
+NAMESPACE_END(zvk)
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <memory>
+#include <vector>
+
+#include "AccelerationStructure.h"
+
+NAMESPACE_BEGIN(zvk)
+
+/**
+* Builds many BLASes at once. Their storage is sub-allocated from one buffer, builds are packed
+*   into batches whose scratch fits in the budget and recorded into a single submission, with a
+*   barrier between batches only since they share the scratch buffer. Structures allowing
+*   compaction are compacted together afterwards into another shared buffer
+*/
+class AccelerationStructureBuilder : public BaseVkObject {
+public:
+    struct Statistics {
+        uint32_t numStructures = 0;
+        uint32_t numBatches = 0;
+        uint32_t numCompacted = 0;
+        // Storage the structures occupy after compaction, and before it
+        vk::DeviceSize storageSize = 0;
+        vk::DeviceSize uncompactedSize = 0;
+        vk::DeviceSize scratchSize = 0;
+        double buildTimeMs = 0;
+    };
+
+    static constexpr vk::DeviceSize DefaultScratchBudget = 64 * 1024 * 1024;
+
+    AccelerationStructureBuilder(const Context* ctx, vk::DeviceSize scratchBudget = DefaultScratchBudget) :
+        BaseVkObject(ctx), mScratchBudget(scratchBudget) {}
+
+    // Returns the index of the structure in what build() returns
+    uint32_t add(
+        const vk::ArrayProxy<const AccelerationStructureTriangleMesh>& triangleMeshes,
+        vk::BuildAccelerationStructureFlagsKHR flags);
+
+    // Builds everything added so far, in order of add()
+    std::vector<std::unique_ptr<AccelerationStructure>> build(QueueIdx queueIdx);
+
+    const Statistics& statistics() const { return mStatistics; }
+
+private:
+    struct BuildInput {
+        std::vector<vk::AccelerationStructureGeometryKHR> geometries;
+        std::vector<vk::AccelerationStructureBuildRangeInfoKHR> buildRangeInfos;
+        vk::BuildAccelerationStructureFlagsKHR flags;
+    };
+
+    // Compacted copies of the structures allowing it, replacing the originals
+    void compact(
+        QueueIdx queueIdx,
+        const std::vector<AccelerationStructure*>& structures, const std::vector<vk::DeviceSize>& compactedSizes);
+
+private:
+    vk::DeviceSize mScratchBudget;
+    std::vector<BuildInput> mInputs;
+    Statistics mStatistics;
+};
+
+NAMESPACE_END(zvk)
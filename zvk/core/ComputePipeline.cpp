@@ -29,6 +29,9 @@ void ComputePipeline::createPipeline(
 	const std::vector<vk::DescriptorSetLayout>& descLayouts,
 	uint32_t pushConstantSize
 ) {
+	// Also called to rebuild the pipeline after its shader is reloaded
+	destroy();
+
 	auto stageInfo = zvk::ShaderManager::shaderStageCreateInfo(
 		shaderManager->createShaderModule(shaderPath),
 		vk::ShaderStageFlagBits::eCompute
@@ -53,7 +56,7 @@ void ComputePipeline::createPipeline(
 		.setLayout(mPipelineLayout)
 		.setStage(stageInfo);
 
-	auto result = mCtx->device.createComputePipeline({}, pipelineCreateInfo);
+	auto result = mCtx->device.createComputePipeline(mCtx->pipelineCache->cache, pipelineCreateInfo);
 
 	if (result.result != vk::Result::eSuccess) {
 		throw std::runtime_error("Failed to create {compute pipeline} with shader: " + shaderPath.generic_string());
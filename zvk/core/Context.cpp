@@ -7,7 +7,10 @@
 
 NAMESPACE_BEGIN(zvk)
 
-Context::Context(const Instance* instance, const std::vector<const char*>& extensions, void* featureChain) :
+Context::Context(
+	const Instance* instance, const std::vector<const char*>& extensions, void* featureChain,
+	const File::path& pipelineCacheDir
+) :
 	mInstance(instance)
 {
 	Log::line<0>("Requested device extensions");
@@ -82,9 +85,15 @@ Context::Context(const Instance* instance, const std::vector<const char*>& exten
 	queues[QueueIdx::AsyncTransfer] = Queue(device, transferFamily, transferIdx);
 
 	createCmdPools();
+
+	pipelineCache = std::make_unique<PipelineCache>(instance, device, pipelineCacheDir);
 }
 
 void Context::destroy() {
+	if (pipelineCache) {
+		pipelineCache->save();
+		pipelineCache.reset();
+	}
 	std::set<vk::CommandPool> pools(cmdPools.array().begin(), cmdPools.array().end());
 	for (auto& pool : pools) {
 		device.destroyCommandPool(pool);
@@ -5,8 +5,10 @@
 #include <optional>
 #include <vector>
 #include <array>
+#include <memory>
 
 #include "Instance.h"
+#include "PipelineCache.h"
 
 NAMESPACE_BEGIN(zvk)
 
@@ -65,7 +67,10 @@ using CommandPoolSet = ObjectSet<vk::CommandPool, 4, QueueIdx>;
 class Context {
 public:
     Context() : mInstance(nullptr) {}
-    Context(const Instance* instance, const std::vector<const char*>& extensions, void* featureChain = nullptr);
+    // The pipeline cache is loaded from and saved to pipelineCacheDir
+    Context(
+        const Instance* instance, const std::vector<const char*>& extensions, void* featureChain = nullptr,
+        const File::path& pipelineCacheDir = "cache");
     ~Context() { destroy(); }
     void destroy();
 
@@ -80,6 +85,9 @@ public:
     QueueSet queues;
     CommandPoolSet cmdPools;
 
+    // Passed to every pipeline creation, saved on destroy()
+    std::unique_ptr<PipelineCache> pipelineCache;
+
 private:
     const Instance* mInstance;
 };
@@ -10,6 +10,8 @@ static PFN_vkCreateAccelerationStructureKHR fpCreateAccelerationStructureKHR = n
 static PFN_vkDestroyAccelerationStructureKHR fpDestroyAccelerationStructureKHR = nullptr;
 static PFN_vkGetAccelerationStructureDeviceAddressKHR fpGetAccelerationStructureDeviceAddressKHR = nullptr;
 static PFN_vkCmdBuildAccelerationStructuresKHR fpCmdBuildAccelerationStructuresKHR = nullptr;
+static PFN_vkCmdWriteAccelerationStructuresPropertiesKHR fpCmdWriteAccelerationStructuresPropertiesKHR = nullptr;
+static PFN_vkCmdCopyAccelerationStructureKHR fpCmdCopyAccelerationStructureKHR = nullptr;
 static PFN_vkGetRayTracingShaderGroupHandlesKHR fpGetRayTracingShaderGroupHandlesKHR = nullptr;
 static PFN_vkCreateRayTracingPipelinesKHR fpCreateRayTracingPipelinesKHR = nullptr;
 static PFN_vkCmdTraceRaysKHR fpCmdTraceRaysKHR = nullptr;
@@ -40,6 +42,8 @@ void load(vk::Instance instance) {
 	loadFunction(instance, "vkGetAccelerationStructureDeviceAddressKHR", fpGetAccelerationStructureDeviceAddressKHR);
 	loadFunction(instance, "vkCmdBuildAccelerationStructuresKHR", fpCmdBuildAccelerationStructuresKHR);
 	loadFunction(instance, "vkDestroyAccelerationStructureKHR", fpDestroyAccelerationStructureKHR);
+	loadFunction(instance, "vkCmdWriteAccelerationStructuresPropertiesKHR", fpCmdWriteAccelerationStructuresPropertiesKHR);
+	loadFunction(instance, "vkCmdCopyAccelerationStructureKHR", fpCmdCopyAccelerationStructureKHR);
 	loadFunction(instance, "vkGetRayTracingShaderGroupHandlesKHR", fpGetRayTracingShaderGroupHandlesKHR);
 	loadFunction(instance, "vkCreateRayTracingPipelinesKHR", fpCreateRayTracingPipelinesKHR);
 	loadFunction(instance, "vkCmdTraceRaysKHR", fpCmdTraceRaysKHR);
@@ -116,6 +120,33 @@ void cmdBuildAccelerationStructuresKHR(
 	);
 }
 
+void cmdWriteAccelerationStructuresPropertiesKHR(
+	vk::CommandBuffer commandBuffer,
+	vk::ArrayProxy<const vk::AccelerationStructureKHR> const& accelerationStructures,
+	vk::QueryType queryType,
+	vk::QueryPool queryPool,
+	uint32_t firstQuery
+) {
+	fpCmdWriteAccelerationStructuresPropertiesKHR(
+		commandBuffer,
+		accelerationStructures.size(),
+		reinterpret_cast<const VkAccelerationStructureKHR*>(accelerationStructures.data()),
+		static_cast<VkQueryType>(queryType),
+		queryPool,
+		firstQuery
+	);
+}
+
+void cmdCopyAccelerationStructureKHR(
+	vk::CommandBuffer commandBuffer,
+	const vk::CopyAccelerationStructureInfoKHR& copyInfo
+) {
+	fpCmdCopyAccelerationStructureKHR(
+		commandBuffer,
+		reinterpret_cast<const VkCopyAccelerationStructureInfoKHR*>(&copyInfo)
+	);
+}
+
 std::vector<uint8_t> getRayTracingShaderGroupHandlesKHR(
 	vk::Device device,
 	vk::Pipeline pipeline,
@@ -30,6 +30,17 @@ void cmdBuildAccelerationStructuresKHR(
 	vk::ArrayProxy<const vk::AccelerationStructureBuildGeometryInfoKHR> const& infos,
 	vk::ArrayProxy<const vk::AccelerationStructureBuildRangeInfoKHR* const> const& pBuildRangeInfos);
 
+void cmdWriteAccelerationStructuresPropertiesKHR(
+	vk::CommandBuffer commandBuffer,
+	vk::ArrayProxy<const vk::AccelerationStructureKHR> const& accelerationStructures,
+	vk::QueryType queryType,
+	vk::QueryPool queryPool,
+	uint32_t firstQuery);
+
+void cmdCopyAccelerationStructureKHR(
+	vk::CommandBuffer commandBuffer,
+	const vk::CopyAccelerationStructureInfoKHR& copyInfo);
+
 std::vector<uint8_t> getRayTracingShaderGroupHandlesKHR(
 	vk::Device device,
 	vk::Pipeline pipeline,
@@ -221,6 +221,7 @@ void Instance::queryPhysicalDeviceProperties() {
 	vk::PhysicalDeviceProperties2 props2;
 	props2.pNext = &rayTracingPipelineProperties;
 	rayTracingPipelineProperties.pNext = &accelerationStructureProperties;
+	accelerationStructureProperties.pNext = &idProperties;
 
 	mPhysicalDevice.getProperties2(&props2);
 	deviceProperties = props2.properties;
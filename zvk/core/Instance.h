@@ -52,6 +52,7 @@ public:
 	vk::PhysicalDeviceMemoryProperties memProperties;
 	vk::PhysicalDeviceRayTracingPipelinePropertiesKHR rayTracingPipelineProperties;
 	vk::PhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties;
+	vk::PhysicalDeviceIDProperties idProperties;
 
 private:
 	vk::Instance mInstance;
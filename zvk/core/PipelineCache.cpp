@@ -0,0 +1,167 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <format>
+#include <fstream>
+
+#include "util/Error.h"
+#include "util/Hash.h"
+
+NAMESPACE_BEGIN(zvk)
+
+constexpr uint32_t CacheFileMagic = 0x4350565a;
+constexpr uint32_t CacheFileVersion = 1;
+
+struct CacheFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint32_t reserved;
+	uint8_t deviceUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+// Fields of VkPipelineCacheHeaderVersionOne the driver's blob starts with
+constexpr size_t DriverHeaderSize = 16 + VK_UUID_SIZE;
+
+static CacheFileHeader deviceHeader(const Instance* instance) {
+	const auto& props = instance->deviceProperties;
+
+	CacheFileHeader header = {};
+	header.magic = CacheFileMagic;
+	header.version = CacheFileVersion;
+	header.vendorID = props.vendorID;
+	header.deviceID = props.deviceID;
+	header.driverVersion = props.driverVersion;
+	std::memcpy(header.deviceUUID, instance->idProperties.deviceUUID.data(), VK_UUID_SIZE);
+	return header;
+}
+
+static std::string uuidString(const uint8_t* uuid) {
+	std::string str;
+
+	for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+		str += std::format("{:02x}", uuid[i]);
+	}
+	return str;
+}
+
+PipelineCache::PipelineCache(const Instance* instance, vk::Device device, const File::path& directory) :
+	mInstance(instance), mDevice(device)
+{
+	mPath = directory / ("pipeline_" + uuidString(instance->idProperties.deviceUUID.data()) + ".bin");
+
+	auto data = load();
+
+	auto createInfo = vk::PipelineCacheCreateInfo()
+		.setInitialDataSize(data.size())
+		.setPInitialData(data.empty() ? nullptr : data.data());
+
+	cache = mDevice.createPipelineCache(createInfo);
+	mLoadedSize = data.size();
+	mSavedHash = data.empty() ? 0 : util::fnv1a(data.data(), data.size());
+}
+
+void PipelineCache::destroy() {
+	if (cache) {
+		mDevice.destroyPipelineCache(cache);
+		cache = nullptr;
+	}
+}
+
+std::vector<uint8_t> PipelineCache::load() {
+	std::ifstream file(mPath, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		Log::line<0>("Pipeline cache: " + mPath.generic_string() + " not found, starting cold");
+		return {};
+	}
+	size_t fileSize = file.tellg();
+	file.seekg(0);
+
+	auto reject = [&](const std::string& reason) {
+		Log::line<0>("Pipeline cache: " + mPath.generic_string() + " " + reason + ", starting cold");
+		return std::vector<uint8_t>();
+	};
+
+	CacheFileHeader header;
+	CacheFileHeader expected = deviceHeader(mInstance);
+
+	if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+		return reject("truncated");
+	}
+	if (header.magic != expected.magic || header.version != expected.version) {
+		return reject("has a bad header");
+	}
+	if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID ||
+		std::memcmp(header.deviceUUID, expected.deviceUUID, VK_UUID_SIZE) != 0
+	) {
+		return reject("is for another device");
+	}
+	if (header.driverVersion != expected.driverVersion) {
+		return reject(std::format("is from driver {}, running {}", header.driverVersion, expected.driverVersion));
+	}
+	if (header.dataSize != fileSize - sizeof(header) || header.dataSize < DriverHeaderSize) {
+		return reject("has a bad size");
+	}
+	std::vector<uint8_t> data(header.dataSize);
+
+	if (!file.read(reinterpret_cast<char*>(data.data()), data.size()) || util::fnv1a(data.data(), data.size()) != header.dataHash) {
+		return reject("is corrupted");
+	}
+
+	// Drivers validate their own header too, but not all of them handle garbage past it gracefully
+	uint32_t driverHeader[4];
+	std::memcpy(driverHeader, data.data(), sizeof(driverHeader));
+
+	if (driverHeader[0] < DriverHeaderSize || driverHeader[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		driverHeader[2] != expected.vendorID || driverHeader[3] != expected.deviceID ||
+		std::memcmp(data.data() + 16, mInstance->deviceProperties.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0
+	) {
+		return reject("doesn't match the driver's cache format");
+	}
+	Log::line<0>(std::format("Pipeline cache: loaded {} KB from {}", data.size() / 1024, mPath.generic_string()));
+	return data;
+}
+
+void PipelineCache::save() {
+	auto data = mDevice.getPipelineCacheData(cache);
+	uint64_t hash = util::fnv1a(data.data(), data.size());
+
+	if (data.empty() || hash == mSavedHash) {
+		return;
+	}
+	CacheFileHeader header = deviceHeader(mInstance);
+	header.dataSize = data.size();
+	header.dataHash = hash;
+
+	// Written aside and renamed over the old file, so that a crash never leaves a half written cache
+	File::path tempPath = mPath;
+	tempPath += ".tmp";
+
+	std::error_code error;
+	File::create_directories(mPath.parent_path(), error);
+
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+	if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+		!file.write(reinterpret_cast<const char*>(data.data()), data.size())
+	) {
+		Log::line<0>("Pipeline cache: failed to write " + tempPath.generic_string());
+		return;
+	}
+	file.close();
+	File::rename(tempPath, mPath, error);
+
+	if (error) {
+		Log::line<0>("Pipeline cache: failed to replace " + mPath.generic_string() + ", " + error.message());
+		return;
+	}
+	mSavedHash = hash;
+	Log::line<0>(std::format("Pipeline cache: saved {} KB to {}", data.size() / 1024, mPath.generic_string()));
+}
+
+NAMESPACE_END(zvk)
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include "Instance.h"
+#include "util/File.h"
+
+NAMESPACE_BEGIN(zvk)
+
+/**
+* vk::PipelineCache persisted across runs, one file per device named after its UUID. The file
+*   carries our own header with the driver version, size and hash of the data in front of the
+*   driver's blob, anything that doesn't match the running device and driver or fails the hash is
+*   dropped and the cache starts cold
+*/
+class PipelineCache {
+public:
+	PipelineCache(const Instance* instance, vk::Device device, const File::path& directory);
+	~PipelineCache() { destroy(); }
+	void destroy();
+
+	// Writes the data gathered so far, skipped if nothing changed since the last load or save
+	void save();
+
+	// Whether valid data was loaded, so pipelines compiled before are created from the cache
+	bool warm() const { return mLoadedSize > 0; }
+	size_t loadedSize() const { return mLoadedSize; }
+	const File::path& path() const { return mPath; }
+
+private:
+	std::vector<uint8_t> load();
+
+public:
+	vk::PipelineCache cache;
+
+private:
+	const Instance* mInstance;
+	vk::Device mDevice;
+	File::path mPath;
+	size_t mLoadedSize = 0;
+	uint64_t mSavedHash = 0;
+};
+
+NAMESPACE_END(zvk)
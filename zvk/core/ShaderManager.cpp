@@ -1,9 +1,170 @@
 #include "ShaderManager.h"
 
+#include <algorithm>
+#include <format>
+#include <set>
+#include <sstream>
+
+#ifdef ZVK_HAS_SHADERC
+  #include <shaderc/shaderc.hpp>
+#endif
+
 #include "util/Error.h"
+#include "util/Hash.h"
+#include "util/Timer.h"
 
 NAMESPACE_BEGIN(zvk)
 
+// Mirrors the glslc command line in src/CMakeLists.txt, hashed into cache keys so that changing it
+//   invalidates cached SPIR-V
+constexpr const char* CompileOptionsKey = "--target-env=vulkan1.2 -O";
+
+static std::string readFile(const File::path& path) {
+	std::ifstream file(path, std::ios::binary);
+	std::stringstream ss;
+	ss << file.rdbuf();
+	return ss.str();
+}
+
+constexpr uint32_t SPIRVMagic = 0x07230203;
+
+// Empty if the file is missing, truncated or not SPIR-V, so that a damaged cache entry is a miss
+static std::vector<uint32_t> readSPIRV(const File::path& path) {
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		return {};
+	}
+	size_t size = file.tellg();
+
+	if (size == 0 || size % sizeof(uint32_t) != 0) {
+		return {};
+	}
+	std::vector<uint32_t> code(size / sizeof(uint32_t));
+	file.seekg(0);
+
+	if (!file.read(reinterpret_cast<char*>(code.data()), size) || code[0] != SPIRVMagic) {
+		return {};
+	}
+	return code;
+}
+
+static bool isShaderSource(const File::path& path) {
+	static const std::set<std::string> extensions = {
+		".vert", ".frag", ".geom", ".tesc", ".tese", ".comp", ".rgen", ".rmiss", ".rchit", ".rahit", ".rint", ".rcall"
+	};
+	return extensions.find(path.extension().string()) != extensions.end();
+}
+
+// Names in #include "..." and #include <...> directives
+static std::vector<std::string> parseIncludes(const std::string& source) {
+	std::vector<std::string> includes;
+	std::istringstream stream(source);
+	std::string line;
+
+	while (std::getline(stream, line)) {
+		size_t pos = line.find_first_not_of(" \t");
+
+		if (pos == std::string::npos || line[pos] != '#') {
+			continue;
+		}
+		pos = line.find_first_not_of(" \t", pos + 1);
+
+		if (pos == std::string::npos || line.compare(pos, 7, "include") != 0) {
+			continue;
+		}
+		size_t begin = line.find_first_of("\"<", pos + 7);
+
+		if (begin == std::string::npos) {
+			continue;
+		}
+		size_t end = line.find(line[begin] == '"' ? '"' : '>', begin + 1);
+
+		if (end != std::string::npos) {
+			includes.push_back(line.substr(begin + 1, end - begin - 1));
+		}
+	}
+	return includes;
+}
+
+// Relative to the including file first, then to the source directory, as glslc with -I
+static std::optional<File::path> resolveInclude(const File::path& includer, const std::string& name, const File::path& sourceDir) {
+	for (const auto& dir : { includer.parent_path(), sourceDir }) {
+		File::path path = (dir / name).lexically_normal();
+
+		if (File::exists(path)) {
+			return path;
+		}
+	}
+	return std::nullopt;
+}
+
+#ifdef ZVK_HAS_SHADERC
+static shaderc_shader_kind shaderKind(const File::path& source) {
+	static const std::map<std::string, shaderc_shader_kind> kinds = {
+		{ ".vert", shaderc_vertex_shader },
+		{ ".frag", shaderc_fragment_shader },
+		{ ".geom", shaderc_geometry_shader },
+		{ ".tesc", shaderc_tess_control_shader },
+		{ ".tese", shaderc_tess_evaluation_shader },
+		{ ".comp", shaderc_compute_shader },
+		{ ".rgen", shaderc_raygen_shader },
+		{ ".rmiss", shaderc_miss_shader },
+		{ ".rchit", shaderc_closesthit_shader },
+		{ ".rahit", shaderc_anyhit_shader },
+		{ ".rint", shaderc_intersection_shader },
+		{ ".rcall", shaderc_callable_shader },
+	};
+	return kinds.at(source.extension().string());
+}
+
+// Serves includes from the files already read for the cache key, so that what is compiled is
+//   exactly what was hashed even if files change in between
+class ClosureIncluder : public shaderc::CompileOptions::IncluderInterface {
+public:
+	ClosureIncluder(const File::path& sourceDir, const std::vector<std::pair<File::path, std::string>>& files) :
+		mSourceDir(sourceDir)
+	{
+		for (const auto& [path, content] : files) {
+			mFiles[path.generic_string()] = &content;
+		}
+	}
+
+	shaderc_include_result* GetInclude(
+		const char* requestedSource, shaderc_include_type type, const char* requestingSource, size_t includeDepth
+	) override {
+		auto include = new Include();
+		auto path = resolveInclude(requestingSource, requestedSource, mSourceDir);
+		auto file = path ? mFiles.find(path->generic_string()) : mFiles.end();
+
+		if (file != mFiles.end()) {
+			include->name = file->first;
+			include->content = *file->second;
+		}
+		else {
+			// An empty name tells shaderc the include failed, the content is the error
+			include->content = std::string("Cannot find ") + requestedSource;
+		}
+		include->result = { include->name.data(), include->name.size(), include->content.data(), include->content.size(), include };
+		return &include->result;
+	}
+
+	void ReleaseInclude(shaderc_include_result* data) override {
+		delete static_cast<Include*>(data->user_data);
+	}
+
+private:
+	struct Include {
+		shaderc_include_result result;
+		std::string name;
+		std::string content;
+	};
+
+	File::path mSourceDir;
+	std::map<std::string, const std::string*> mFiles;
+};
+#endif
+
 void ShaderManager::destroyShaderModules() {
 	for (auto& pair : mLoadedShaders) {
 		mDevice.destroyShaderModule(pair.second);
@@ -12,33 +173,228 @@ void ShaderManager::destroyShaderModules() {
 }
 
 vk::ShaderModule ShaderManager::createShaderModule(const File::path& path, ShaderLoadOp operation) {
+	if (mRecordedShaders) {
+		mRecordedShaders->insert(path);
+	}
 	if (mLoadedShaders.find(path) != mLoadedShaders.end()) {
 		return mLoadedShaders[path];
 	}
+	auto createInfo = vk::ShaderModuleCreateInfo()
+		.setCode(loadCode(path, operation == ShaderLoadOp::Normal));
 
-	Log::line<0>("Loading shader: " + File::absolute(path).generic_string());
-
-	std::ifstream file(File::absolute(path), std::ios::ate | std::ios::binary);
+	auto shaderModule = mDevice.createShaderModule(createInfo);
 
-	if (!file.is_open()) {
-		Log::exit("not found");
+	if (operation == ShaderLoadOp::Normal) {
+		mLoadedShaders[path] = shaderModule;
 	}
-	size_t size = file.tellg();
+	return shaderModule;
+}
 
-	std::vector<char> buffer(size);
-	file.seekg(0);
-	file.read(buffer.data(), size);
+void ShaderManager::reloadShaderModule(const File::path& path) {
+	auto loaded = mLoadedShaders.find(path);
 
+	if (loaded == mLoadedShaders.end()) {
+		return;
+	}
 	auto createInfo = vk::ShaderModuleCreateInfo()
-		.setPCode(reinterpret_cast<uint32_t*>(buffer.data()))
-		.setCodeSize(buffer.size());
+		.setCode(loadCode(path, true));
 
+	// Pipelines keep working after their modules are destroyed
 	auto shaderModule = mDevice.createShaderModule(createInfo);
+	mDevice.destroyShaderModule(loaded->second);
+	loaded->second = shaderModule;
+}
 
-	if (operation == ShaderLoadOp::Normal) {
-		mLoadedShaders[path] = shaderModule;
+std::vector<File::path> ShaderManager::changedShaders() {
+	std::set<File::path> changedFiles;
+
+	for (auto& [file, time] : mSourceTimes) {
+		std::error_code error;
+		auto newTime = File::last_write_time(file, error);
+
+		// Editors saving through a temporary file may have it missing for a moment, caught next time
+		if (!error && newTime != time) {
+			changedFiles.insert(file);
+			time = newTime;
+		}
 	}
-	return shaderModule;
+	std::vector<File::path> changed;
+
+	if (changedFiles.empty()) {
+		return changed;
+	}
+	for (const auto& [path, sources] : mShaderSources) {
+		if (std::any_of(sources.begin(), sources.end(), [&](const File::path& file) { return changedFiles.contains(file); })) {
+			changed.push_back(path);
+		}
+	}
+	return changed;
+}
+
+void ShaderManager::beginRecording() {
+	mRecording.clear();
+	mRecordedShaders = &mRecording;
+}
+
+std::set<File::path> ShaderManager::endRecording() {
+	mRecordedShaders = nullptr;
+	return std::move(mRecording);
+}
+
+std::vector<uint32_t> ShaderManager::loadCode(const File::path& path, bool watch) {
+	std::vector<uint32_t> code;
+
+	if (auto source = sourcePath(path)) {
+		auto closure = loadSourceClosure(*source);
+		code = compileOrLoadCached(*source, closure);
+
+		// Watched from when the files were read, so edits made while compiling aren't missed
+		if (!code.empty() && watch) {
+			auto& sources = mShaderSources[path];
+			sources.clear();
+
+			for (size_t i = 0; i < closure.files.size(); i++) {
+				sources.push_back(closure.files[i].first);
+				mSourceTimes[closure.files[i].first] = closure.times[i];
+			}
+		}
+	}
+	if (code.empty()) {
+		Log::line<0>("Loading shader: " + File::absolute(path).generic_string());
+		code = readSPIRV(File::absolute(path));
+	}
+	if (code.empty()) {
+		Log::exit("not found");
+	}
+	return code;
+}
+
+void ShaderManager::setDefine(const std::string& name, const std::string& value) {
+	mDefines[name] = value;
+}
+
+std::optional<File::path> ShaderManager::sourcePath(const File::path& path) const {
+	if (mSourceDir.empty()) {
+		return std::nullopt;
+	}
+	// shaders/di_naive.comp.spv is compiled from <source dir>/di_naive.comp
+	File::path source = mSourceDir / ((path.extension() == ".spv") ? path.stem() : path.filename());
+
+	if (!isShaderSource(source) || !File::exists(source)) {
+		return std::nullopt;
+	}
+	return source.lexically_normal();
+}
+
+ShaderManager::SourceClosure ShaderManager::loadSourceClosure(const File::path& source) const {
+	SourceClosure closure;
+	std::set<File::path> visited;
+
+	auto visit = [&](auto&& self, const File::path& path) -> void {
+		if (!visited.insert(path).second) {
+			return;
+		}
+		std::error_code error;
+		closure.times.push_back(File::last_write_time(path, error));
+		closure.files.push_back({ path, readFile(path) });
+		auto includes = parseIncludes(closure.files.back().second);
+
+		for (const auto& name : includes) {
+			// Missing includes are left to the compiler to report
+			if (auto include = resolveInclude(path, name, mSourceDir)) {
+				self(self, *include);
+			}
+		}
+	};
+	visit(visit, source);
+
+	// Paths relative to the source directory so that cache entries survive moving the checkout
+	closure.hash = util::fnv1a(CompileOptionsKey);
+
+	for (const auto& [path, content] : closure.files) {
+		closure.hash = util::fnv1a(path.lexically_relative(mSourceDir).generic_string(), closure.hash);
+		closure.hash = util::fnv1a(content, closure.hash);
+	}
+	for (const auto& [name, value] : mDefines) {
+		closure.hash = util::fnv1a(name + "=" + value + ";", closure.hash);
+	}
+	return closure;
+}
+
+std::vector<uint32_t> ShaderManager::compileOrLoadCached(const File::path& source, const SourceClosure& closure) {
+	std::string name = source.filename().string();
+	File::path cachePath = mCacheDir / std::format("{}.{:016x}.spv", name, closure.hash);
+
+	if (!mCacheDir.empty()) {
+		if (auto code = readSPIRV(cachePath); !code.empty()) {
+			Log::line<0>("Loading cached shader: " + name);
+			return code;
+		}
+	}
+#ifdef ZVK_HAS_SHADERC
+	Timer timer;
+	auto code = compile(source, closure);
+	Log::line<0>(std::format("Compiled shader: {}, {} files, {:.2f} ms", name, closure.files.size(), timer.get()));
+
+	if (!mCacheDir.empty()) {
+		std::error_code error;
+		File::create_directories(mCacheDir, error);
+
+		// Entries of older versions of this shader are never hit again
+		for (const auto& entry : File::directory_iterator(mCacheDir, error)) {
+			std::string entryName = entry.path().filename().string();
+
+			if (entryName.starts_with(name + ".") && entryName.ends_with(".spv") &&
+				entryName.size() == name.size() + 21 && entry.path() != cachePath
+			) {
+				File::remove(entry.path(), error);
+			}
+		}
+		// Written aside and renamed, so that a crash or another instance never reads a half written entry
+		File::path tempPath = cachePath;
+		tempPath += ".tmp";
+
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+		if (!file.write(reinterpret_cast<const char*>(code.data()), code.size() * sizeof(uint32_t))) {
+			Log::line<0>("Shader cache: failed to write " + tempPath.generic_string());
+			return code;
+		}
+		file.close();
+		File::rename(tempPath, cachePath, error);
+
+		if (error) {
+			Log::line<0>("Shader cache: failed to replace " + cachePath.generic_string() + ", " + error.message());
+		}
+	}
+	return code;
+#else
+	return {};
+#endif
+}
+
+std::vector<uint32_t> ShaderManager::compile(const File::path& source, const SourceClosure& closure) const {
+#ifdef ZVK_HAS_SHADERC
+	shaderc::Compiler compiler;
+	shaderc::CompileOptions options;
+
+	options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+	options.SetOptimizationLevel(shaderc_optimization_level_performance);
+	options.SetIncluder(std::make_unique<ClosureIncluder>(mSourceDir, closure.files));
+
+	for (const auto& [name, value] : mDefines) {
+		options.AddMacroDefinition(name, value);
+	}
+	const auto& [path, content] = closure.files.front();
+	auto result = compiler.CompileGlslToSpv(content, shaderKind(source), path.generic_string().c_str(), options);
+
+	if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+		throw std::runtime_error("Failed to compile shader " + source.filename().string() + ":\n" + result.GetErrorMessage());
+	}
+	return std::vector<uint32_t>(result.cbegin(), result.cend());
+#else
+	return {};
+#endif
 }
 
 vk::PipelineShaderStageCreateInfo ShaderManager::shaderStageCreateInfo(
@@ -52,4 +408,4 @@ vk::PipelineShaderStageCreateInfo ShaderManager::shaderStageCreateInfo(
 		.setPName(entrance);
 }
 
-NAMESPACE_END(zvk)
\ No newline at end of file
+NAMESPACE_END(zvk)
@@ -5,6 +5,8 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <optional>
+#include <set>
 
 #include "util/File.h"
 #include "util/NamespaceDecl.h"
@@ -15,25 +17,74 @@ enum class ShaderLoadOp {
 	Normal, NoRecord, InstantDestroy
 };
 
+/**
+* Creates shader modules from paths of compiled shaders, "shaders/<name>.spv". With a source
+*   directory holding <name>, the GLSL source is compiled at runtime instead (when built with
+*   shaderc) and the SPIR-V cached in the cache directory under a hash of the source, everything
+*   it includes and the defines, so that unchanged shaders load from the cache and editing a
+*   header recompiles only the stages including it. Without a source the prebuilt file is read
+*/
 class ShaderManager {
 public:
-	ShaderManager(vk::Device device) : mDevice(device) {}
+	ShaderManager(vk::Device device, const File::path& sourceDir = {}, const File::path& cacheDir = {}) :
+		mDevice(device), mSourceDir(sourceDir), mCacheDir(cacheDir) {}
+
 	~ShaderManager() { destroyShaderModules(); }
 
 	void destroyShaderModules();
 
+	// Throws if a source fails to compile
 	vk::ShaderModule createShaderModule(
 		const File::path& path,
 		ShaderLoadOp operation = ShaderLoadOp::Normal);
 
+	// Recompiles a loaded shader and replaces its module. Throws if it fails, leaving the old module
+	void reloadShaderModule(const File::path& path);
+
+	// Loaded shaders with a source file changed on disk since they were loaded or last returned here
+	std::vector<File::path> changedShaders();
+
+	// Collects the shaders requested in between, to tell which pipelines a shader change affects
+	void beginRecording();
+	std::set<File::path> endRecording();
+
+	// Macro defined for all shaders compiled afterwards, part of the cache key
+	void setDefine(const std::string& name, const std::string& value = "");
+
 	static vk::PipelineShaderStageCreateInfo shaderStageCreateInfo(
 		vk::ShaderModule module,
 		vk::ShaderStageFlagBits stage,
 		const char* entrance = "main");
 
+private:
+	// A source file and everything it includes, in the order first reached
+	struct SourceClosure {
+		std::vector<std::pair<File::path, std::string>> files;
+		std::vector<File::file_time_type> times;
+		uint64_t hash;
+	};
+
+	std::optional<File::path> sourcePath(const File::path& path) const;
+	SourceClosure loadSourceClosure(const File::path& source) const;
+	// SPIR-V of a shader, watching its sources if asked. Exits if there is neither source nor SPIR-V
+	std::vector<uint32_t> loadCode(const File::path& path, bool watch);
+	std::vector<uint32_t> compileOrLoadCached(const File::path& source, const SourceClosure& closure);
+	std::vector<uint32_t> compile(const File::path& source, const SourceClosure& closure) const;
+
 private:
 	vk::Device mDevice;
 	std::map<File::path, vk::ShaderModule> mLoadedShaders;
+
+	File::path mSourceDir;
+	File::path mCacheDir;
+	std::map<std::string, std::string> mDefines;
+
+	// Source files of each loaded shader, and when each file was last seen modified
+	std::map<File::path, std::vector<File::path>> mShaderSources;
+	std::map<File::path, File::file_time_type> mSourceTimes;
+
+	std::set<File::path> mRecording;
+	std::set<File::path>* mRecordedShaders = nullptr;
 };
 
-NAMESPACE_END(zvk)
\ No newline at end of file
+NAMESPACE_END(zvk)
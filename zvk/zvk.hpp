@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/AccelerationStructure.h"
+#include "core/AccelerationStructureBuilder.h"
 #include "core/Alignment.h"
 #include "core/Command.h"
 #include "core/Context.h"
@@ -11,6 +12,7 @@
 #include "core/HostImage.h"
 #include "core/Instance.h"
 #include "core/Memory.h"
+#include "core/PipelineCache.h"
 #include "core/ShaderBindingTable.h"
 #include "core/ShaderManager.h"
 #include "core/Swapchain.h"